@@ -0,0 +1,221 @@
+// binlog.c
+#include "binlog.h"
+#include <stdio.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "BINLOG";
+
+#define BINLOG_RING_MASK (BINLOG_RING_SIZE - 1)
+#define BINLOG_LINE_MAX 160
+#define BINLOG_UART_DRAIN_PERIOD_MS 200
+
+_Static_assert((BINLOG_RING_SIZE & BINLOG_RING_MASK) == 0, "BINLOG_RING_SIZE must be a power of two");
+
+// Mỗi slot có số thứ tự riêng: BINLOG_SEQ(idx) = đã ghi xong bản ghi thứ idx, cộng 1 (số lẻ) = một
+// producer đang ghi bản ghi đó. Slot chỉ có một producer tại một thời điểm: producer nhận chỉ số
+// của vòng sau trong lúc slot còn đang được ghi (producer trước bị chiếm CPU trọn một vòng ring)
+// thì bỏ bản ghi của mình, không ghi chồng
+#define BINLOG_SEQ(idx)     (((uint32_t)(idx) + 1u) << 1)
+#define BINLOG_SEQ_BUSY     1u
+
+typedef struct {
+    atomic_uint seq;
+    binlog_record_t rec;
+} binlog_slot_t;
+
+static binlog_slot_t s_ring[BINLOG_RING_SIZE];
+static atomic_uint s_head = 0;     // Chỉ số ghi tiếp theo (nhiều producer)
+static uint32_t s_tail = 0;        // Chỉ số đọc tiếp theo (một consumer, bảo vệ bởi s_drain_mutex)
+static atomic_uint s_lost = 0;
+static SemaphoreHandle_t s_drain_mutex = NULL;
+
+/* ---------- Producer: không khóa, không định dạng ---------- */
+void binlog_write(char level, const char *tag, const char *fmt, int nargs,
+                  binlog_arg_t a0, binlog_arg_t a1, binlog_arg_t a2,
+                  binlog_arg_t a3, binlog_arg_t a4, binlog_arg_t a5)
+{
+    const uint32_t idx = atomic_fetch_add_explicit(&s_head, 1, memory_order_relaxed);
+    binlog_slot_t *slot = &s_ring[idx & BINLOG_RING_MASK];
+
+    // Nhận slot: chỉ khi không ai đang ghi và chưa có bản ghi mới hơn
+    uint32_t cur = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    do {
+        if ((cur & BINLOG_SEQ_BUSY) || (int32_t)(cur - BINLOG_SEQ(idx)) >= 0) {
+            return;     // Consumer tính vào s_lost khi đi qua chỉ số này
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&slot->seq, &cur, BINLOG_SEQ(idx) | BINLOG_SEQ_BUSY,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    atomic_thread_fence(memory_order_release);
+
+    slot->rec.tag = tag;
+    slot->rec.fmt = fmt;
+    slot->rec.ts_us = esp_timer_get_time();
+    slot->rec.level = level;
+    slot->rec.nargs = (uint8_t)nargs;
+    slot->rec.args[0] = a0;
+    slot->rec.args[1] = a1;
+    slot->rec.args[2] = a2;
+    slot->rec.args[3] = a3;
+    slot->rec.args[4] = a4;
+    slot->rec.args[5] = a5;
+
+    atomic_store_explicit(&slot->seq, BINLOG_SEQ(idx), memory_order_release);
+}
+
+/* ---------- Định dạng một bản ghi (chỉ chạy phía consumer) ---------- */
+static int binlog_format(const binlog_record_t *rec, char *out, size_t out_size)
+{
+    int pos = snprintf(out, out_size, "%c (%lu) %s: ", rec->level,
+                       (unsigned long)(rec->ts_us / 1000), rec->tag ? rec->tag : "?");
+    const char *p = rec->fmt;
+    int arg = 0;
+
+    while (*p && pos < (int)out_size - 1) {
+        if (*p != '%') {
+            out[pos++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[pos++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Tách đặc tả "%[flags][width][.precision][length]conv", bỏ length modifier
+        char spec[16];
+        int n = 0;
+        spec[n++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && n < (int)sizeof(spec) - 2) spec[n++] = *p++;
+        while (*p && strchr("hlLqjzt", *p)) p++;
+        char conv = *p ? *p++ : '\0';
+        if (conv == '\0') break;
+        spec[n++] = conv;
+        spec[n] = '\0';
+
+        binlog_arg_t v = (arg < rec->nargs) ? rec->args[arg] : 0;
+        arg++;
+
+        int w;
+        switch (conv) {
+            case 'd': case 'i':
+                w = snprintf(out + pos, out_size - pos, spec, (int)(int32_t)v);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                const uint32_t bits = (uint32_t)v;
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                w = snprintf(out + pos, out_size - pos, spec, (double)f);
+                break;
+            }
+            case 's':
+                w = snprintf(out + pos, out_size - pos, spec, v ? (const char *)v : "(null)");
+                break;
+            case 'p':
+                w = snprintf(out + pos, out_size - pos, spec, (void *)v);
+                break;
+            default: // u, o, x, X, c
+                w = snprintf(out + pos, out_size - pos, spec, (unsigned int)v);
+                break;
+        }
+        if (w < 0) break;
+        pos += w;
+    }
+
+    if (pos >= (int)out_size) pos = out_size - 1;
+    out[pos] = '\0';
+    return pos;
+}
+
+/* ---------- Consumer ---------- */
+size_t binlog_drain(binlog_sink_t sink, void *ctx, size_t max_records)
+{
+    if (sink == NULL || s_drain_mutex == NULL) return 0;
+    if (xSemaphoreTake(s_drain_mutex, portMAX_DELAY) != pdTRUE) return 0;
+
+    char line[BINLOG_LINE_MAX];
+    size_t drained = 0;
+
+    while (drained < max_records) {
+        const uint32_t head = atomic_load_explicit(&s_head, memory_order_acquire);
+        if (head == s_tail) break;
+
+        // Producer đã vượt quá một vòng ring: bỏ qua phần bị ghi đè
+        if (head - s_tail > BINLOG_RING_SIZE) {
+            atomic_fetch_add_explicit(&s_lost, head - s_tail - BINLOG_RING_SIZE, memory_order_relaxed);
+            s_tail = head - BINLOG_RING_SIZE;
+        }
+
+        binlog_slot_t *slot = &s_ring[s_tail & BINLOG_RING_MASK];
+        const uint32_t seq1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq1 != BINLOG_SEQ(s_tail)) {
+            if ((int32_t)((seq1 & ~BINLOG_SEQ_BUSY) - BINLOG_SEQ(s_tail)) > 0) {
+                // Slot đã bị ghi đè bởi vòng sau
+                atomic_fetch_add_explicit(&s_lost, 1, memory_order_relaxed);
+                s_tail++;
+                continue;
+            }
+            // Producer chưa ghi xong, lần drain sau sẽ đọc. Nếu producer đó đã bỏ bản ghi (slot bận)
+            // thì slot giữ số cũ tới khi vòng sau ghi vào, lúc đó nhánh trên tính là mất
+            break;
+        }
+
+        binlog_record_t rec = slot->rec;
+        atomic_thread_fence(memory_order_acquire);
+        const uint32_t seq2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+        s_tail++;
+        if (seq2 != seq1) {
+            atomic_fetch_add_explicit(&s_lost, 1, memory_order_relaxed);
+            continue;
+        }
+
+        int len = binlog_format(&rec, line, sizeof(line));
+        sink(line, (size_t)len, ctx);
+        drained++;
+    }
+
+    xSemaphoreGive(s_drain_mutex);
+    return drained;
+}
+
+uint32_t binlog_lost_count(void)
+{
+    return atomic_load_explicit(&s_lost, memory_order_relaxed);
+}
+
+static void binlog_uart_sink(const char *line, size_t len, void *ctx)
+{
+    (void)len;
+    (void)ctx;
+    printf("%s\n", line);
+}
+
+static void binlog_uart_task(void *arg)
+{
+    while (1) {
+        binlog_drain(binlog_uart_sink, NULL, BINLOG_RING_SIZE);
+        vTaskDelay(pdMS_TO_TICKS(BINLOG_UART_DRAIN_PERIOD_MS));
+    }
+}
+
+esp_err_t binlog_init(bool start_uart_task)
+{
+    if (s_drain_mutex != NULL) return ESP_OK;
+
+    s_drain_mutex = xSemaphoreCreateMutex();
+    if (s_drain_mutex == NULL) return ESP_ERR_NO_MEM;
+
+    if (start_uart_task) {
+        // Ưu tiên thấp nhất: việc in log không bao giờ chiếm CPU của task cảm biến
+        if (xTaskCreate(binlog_uart_task, "binlog_uart", 3072, NULL, 1, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create UART drain task");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ESP_LOGI(TAG, "Binary logger ready (%d records, %u bytes)", BINLOG_RING_SIZE, (unsigned)sizeof(s_ring));
+    return ESP_OK;
+}
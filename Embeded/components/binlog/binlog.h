@@ -0,0 +1,116 @@
+// binlog.h
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*
+ * Logger nhị phân trì hoãn (deferred binary logger).
+ *
+ * Trên đường nóng (hot path) chỉ ghi một bản ghi kích thước cố định gồm
+ * con trỏ chuỗi định dạng (format ID), timestamp và tối đa BINLOG_MAX_ARGS
+ * tham số 32-bit vào ring buffer trong RAM, không khóa, không printf.
+ * Việc định dạng chuỗi chỉ xảy ra khi drain (UART hoặc qua MQTT).
+ *
+ * Lưu ý:
+ *  - fmt và tag phải là chuỗi hằng (string literal) vì chỉ lưu con trỏ.
+ *  - Tham số "%s" cũng phải trỏ tới vùng nhớ tĩnh, KHÔNG dùng buffer trên stack.
+ *  - Mỗi tham số được lưu một word: float/double lưu dạng float, số nguyên 64-bit bị cắt.
+ *  - Nhiều producer (task, ISR) ghi đồng thời được; ring đầy thì bản ghi cũ bị ghi đè. Một bản ghi
+ *    đang ghi dở không bao giờ bị ghi chồng: producer vòng sau gặp slot đó thì bỏ bản ghi của mình.
+ */
+
+#ifndef BINLOG_RING_SIZE
+#define BINLOG_RING_SIZE 128 // Phải là lũy thừa của 2
+#endif
+
+#define BINLOG_MAX_ARGS 6
+
+// Mỗi tham số chiếm một word (32-bit trên ESP32), đủ chứa con trỏ chuỗi tĩnh
+typedef uintptr_t binlog_arg_t;
+
+typedef struct {
+    const char *tag;
+    const char *fmt;       // "Format ID": con trỏ tới chuỗi định dạng nằm trong flash
+    int64_t ts_us;         // esp_timer_get_time() tại thời điểm ghi
+    char level;            // 'E', 'W', 'I', 'D'
+    uint8_t nargs;
+    binlog_arg_t args[BINLOG_MAX_ARGS];
+} binlog_record_t;
+
+/**
+ * @brief Hàm nhận từng dòng log đã được định dạng khi drain.
+ * @param line Chuỗi đã định dạng (không có ký tự xuống dòng).
+ * @param len Độ dài chuỗi.
+ * @param ctx Con trỏ ngữ cảnh truyền vào binlog_drain().
+ */
+typedef void (*binlog_sink_t)(const char *line, size_t len, void *ctx);
+
+/**
+ * @brief Khởi tạo phía đọc (consumer) của logger.
+ * Có thể gọi BLOGx() trước khi init, bản ghi vẫn được giữ trong ring.
+ * @param start_uart_task true: tạo task ưu tiên thấp tự drain ra UART (stdout).
+ */
+esp_err_t binlog_init(bool start_uart_task);
+
+/**
+ * @brief Định dạng và đẩy tối đa max_records bản ghi ra sink.
+ * @return Số bản ghi đã drain.
+ */
+size_t binlog_drain(binlog_sink_t sink, void *ctx, size_t max_records);
+
+/**
+ * @brief Số bản ghi bị ghi đè trước khi kịp drain (ring đầy).
+ */
+uint32_t binlog_lost_count(void);
+
+/* Ghi một bản ghi; thường không gọi trực tiếp mà dùng macro BLOGx(). */
+void binlog_write(char level, const char *tag, const char *fmt, int nargs,
+                  binlog_arg_t a0, binlog_arg_t a1, binlog_arg_t a2,
+                  binlog_arg_t a3, binlog_arg_t a4, binlog_arg_t a5);
+
+/* --- Chuyển tham số về 32-bit theo kiểu (chọn lúc biên dịch bằng _Generic) --- */
+static inline binlog_arg_t binlog_arg_i(int32_t v) { return (binlog_arg_t)(uint32_t)v; }
+static inline binlog_arg_t binlog_arg_u(uint32_t v) { return v; }
+static inline binlog_arg_t binlog_arg_s(const char *v) { return (binlog_arg_t)v; }
+static inline binlog_arg_t binlog_arg_f(float v) { uint32_t u; memcpy(&u, &v, sizeof(u)); return u; }
+static inline binlog_arg_t binlog_arg_d(double v) { return binlog_arg_f((float)v); }
+
+#define BINLOG_ARG(x) _Generic((x),            \
+        float: binlog_arg_f,                   \
+        double: binlog_arg_d,                  \
+        char *: binlog_arg_s,                  \
+        const char *: binlog_arg_s,            \
+        unsigned int: binlog_arg_u,            \
+        unsigned long: binlog_arg_u,           \
+        default: binlog_arg_i)(x)
+
+#define BINLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define BINLOG_NARGS(...) BINLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define BINLOG_CAT_(a, b) a##b
+#define BINLOG_CAT(a, b) BINLOG_CAT_(a, b)
+
+#define BINLOG_W0(l, t, f) binlog_write(l, t, f, 0, 0, 0, 0, 0, 0, 0)
+#define BINLOG_W1(l, t, f, a) binlog_write(l, t, f, 1, BINLOG_ARG(a), 0, 0, 0, 0, 0)
+#define BINLOG_W2(l, t, f, a, b) binlog_write(l, t, f, 2, BINLOG_ARG(a), BINLOG_ARG(b), 0, 0, 0, 0)
+#define BINLOG_W3(l, t, f, a, b, c) binlog_write(l, t, f, 3, BINLOG_ARG(a), BINLOG_ARG(b), BINLOG_ARG(c), 0, 0, 0)
+#define BINLOG_W4(l, t, f, a, b, c, d) \
+        binlog_write(l, t, f, 4, BINLOG_ARG(a), BINLOG_ARG(b), BINLOG_ARG(c), BINLOG_ARG(d), 0, 0)
+#define BINLOG_W5(l, t, f, a, b, c, d, e) \
+        binlog_write(l, t, f, 5, BINLOG_ARG(a), BINLOG_ARG(b), BINLOG_ARG(c), BINLOG_ARG(d), BINLOG_ARG(e), 0)
+#define BINLOG_W6(l, t, f, a, b, c, d, e, g) \
+        binlog_write(l, t, f, 6, BINLOG_ARG(a), BINLOG_ARG(b), BINLOG_ARG(c), BINLOG_ARG(d), BINLOG_ARG(e), BINLOG_ARG(g))
+
+#define BINLOG(level, tag, fmt, ...) \
+        BINLOG_CAT(BINLOG_W, BINLOG_NARGS(__VA_ARGS__))(level, tag, fmt, ##__VA_ARGS__)
+
+#define BLOGE(tag, fmt, ...) BINLOG('E', tag, fmt, ##__VA_ARGS__)
+#define BLOGW(tag, fmt, ...) BINLOG('W', tag, fmt, ##__VA_ARGS__)
+#define BLOGI(tag, fmt, ...) BINLOG('I', tag, fmt, ##__VA_ARGS__)
+#define BLOGD(tag, fmt, ...) BINLOG('D', tag, fmt, ##__VA_ARGS__)
+
+#endif // BINLOG_H
@@ -4,6 +4,7 @@
 #include "driver/gpio.h"
 #include "ds18b20.h"
 #include "esp_mac.h"
+#include "binlog.h"
 
 static const char *TAG = "DS18B20_SENSOR";
 
@@ -43,6 +44,6 @@ static const char *TAG = "DS18B20_SENSOR";
     uint8_t data[9];
     for (int i=0;i<9;i++) data[i] = ow_read_byte();
     int16_t raw = (data[1]<<8) | data[0];
-    ESP_LOGI(TAG, "Temp=%d", raw/16.0);
+    BLOGI(TAG, "Temp=%.2f", raw / 16.0f);
     return raw / 16.0f;
 }
\ No newline at end of file
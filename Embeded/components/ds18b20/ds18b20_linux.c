@@ -0,0 +1,28 @@
+// ds18b20_linux.c - backend cho target linux: nhiệt độ lấy từ kịch bản mô phỏng
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "ds18b20.h"
+#include "binlog.h"
+#include "sim.h"
+
+static const char *TAG = "DS18B20_SENSOR";
+
+// Không có bus 1-Wire thật: các hàm mức thấp giữ nguyên API nhưng không làm gì
+ void ow_output_low(void) { }
+ void ow_input(void)      { }
+ int  ow_read(void)       { return 1; }
+ int ow_reset(void)       { return 0; }
+ void ow_write_bit(int bit) { (void)bit; }
+ int ow_read_bit(void)    { return 1; }
+ void ow_write_byte(uint8_t b) { (void)b; }
+ uint8_t ow_read_byte(void) { return 0xFF; }
+
+ float ds18b20_read_temp(void) {
+    vTaskDelay(pdMS_TO_TICKS(750)); // Giữ thời gian chuyển đổi giống cảm biến thật
+    // Lượng tử hóa 1/16 °C như thanh ghi của DS18B20
+    int16_t raw = (int16_t)(sim_temp_c() * 16.0f);
+    BLOGI(TAG, "Temp=%.2f", raw / 16.0f);
+    return raw / 16.0f;
+}
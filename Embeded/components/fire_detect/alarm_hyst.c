@@ -0,0 +1,60 @@
+// alarm_hyst.c
+#include "alarm_hyst.h"
+#include <stddef.h>
+
+void alarm_hyst_init(alarm_hyst_t *h, const alarm_hyst_config_t *cfg)
+{
+    *h = (alarm_hyst_t){ 0 };
+    h->cfg = *cfg;
+    if (h->cfg.clear_threshold > h->cfg.set_threshold) {
+        h->cfg.clear_threshold = h->cfg.set_threshold;
+    }
+}
+
+bool alarm_hyst_update(alarm_hyst_t *h, int32_t value, uint32_t now_ms)
+{
+    const bool naive = (value >= h->cfg.set_threshold);
+    if (naive != h->naive_state) {
+        h->naive_state = naive;
+        h->naive_flips++;
+    }
+
+    bool desired = h->state;
+    if (!h->state && value >= h->cfg.set_threshold) {
+        desired = true;
+    } else if (h->state && value <= h->cfg.clear_threshold) {
+        desired = false;
+    }
+
+    if (desired == h->state) {
+        h->pending = false;
+        return h->state;
+    }
+
+    if (!h->pending) {
+        h->pending = true;
+        h->pending_since_ms = now_ms;
+    }
+
+    const uint32_t dwell = desired ? h->cfg.min_on_ms : h->cfg.min_off_ms;
+    if (now_ms - h->pending_since_ms >= dwell) {
+        h->state = desired;
+        h->pending = false;
+        h->transitions++;
+    }
+    return h->state;
+}
+
+// Bộ so sánh đơn thuần cũng bị ép tắt: lần tắt ép buộc tính vào cả hai bộ đếm, không làm lệch số bị chặn
+void alarm_hyst_reset(alarm_hyst_t *h)
+{
+    if (h->state) {
+        h->transitions++;
+    }
+    if (h->naive_state) {
+        h->naive_flips++;
+    }
+    h->state = false;
+    h->naive_state = false;
+    h->pending = false;
+}
@@ -0,0 +1,57 @@
+// alarm_hyst.h
+#ifndef ALARM_HYST_H
+#define ALARM_HYST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Trễ (hysteresis) + thời gian dừng tối thiểu (dwell) cho một nguồn báo cháy.
+ *
+ * - Bật khi giá trị >= set_threshold, chỉ tắt khi giá trị <= clear_threshold.
+ * - Một chuyển trạng thái chỉ được chấp nhận khi điều kiện giữ liên tục
+ *   ít nhất min_on_ms (bật) / min_off_ms (tắt).
+ * - Đếm số lần chuyển trạng thái mà bộ so sánh ngưỡng đơn thuần sẽ phát ra
+ *   nhưng đã bị chặn (suppressed), để đưa vào diagnostics.
+ */
+
+typedef struct {
+    int32_t set_threshold;
+    int32_t clear_threshold;    // Phải <= set_threshold
+    uint32_t min_on_ms;
+    uint32_t min_off_ms;
+} alarm_hyst_config_t;
+
+typedef struct {
+    alarm_hyst_config_t cfg;
+    bool state;
+    bool pending;               // Đang chờ đủ dwell để chuyển trạng thái
+    uint32_t pending_since_ms;
+    bool naive_state;           // Trạng thái của bộ so sánh "value >= set_threshold"
+    uint32_t naive_flips;
+    uint32_t transitions;
+} alarm_hyst_t;
+
+void alarm_hyst_init(alarm_hyst_t *h, const alarm_hyst_config_t *cfg);
+
+/**
+ * @brief Cập nhật với giá trị mới.
+ * @return Trạng thái đã qua trễ/dwell.
+ */
+bool alarm_hyst_update(alarm_hyst_t *h, int32_t value, uint32_t now_ms);
+
+/**
+ * @brief Ép về trạng thái tắt (ví dụ khi reset bằng tay), cả trạng thái đã lọc lẫn bộ so sánh đơn thuần;
+ * bộ đếm không bị xóa.
+ */
+void alarm_hyst_reset(alarm_hyst_t *h);
+
+/**
+ * @brief Số lần chuyển trạng thái đã bị chặn so với bộ so sánh ngưỡng đơn thuần.
+ */
+static inline uint32_t alarm_hyst_suppressed(const alarm_hyst_t *h)
+{
+    return h->naive_flips > h->transitions ? h->naive_flips - h->transitions : 0;
+}
+
+#endif // ALARM_HYST_H
@@ -0,0 +1,91 @@
+// fire_score.c
+#include "fire_score.h"
+#include <stddef.h>
+
+// Nội suy tuyến tính có bão hòa: 0 khi x <= x0, weight khi x >= x1
+static int32_t ramp(int32_t x, int32_t x0, int32_t x1, int32_t weight)
+{
+    if (x <= x0) return 0;
+    if (x >= x1 || x1 <= x0) return weight;
+    return (int32_t)(((int64_t)(x - x0) * weight) / (x1 - x0));
+}
+
+// Slope theo phút từ chênh lệch EWMA (Q4) trong dt_ms
+static int32_t per_minute(int32_t delta_q4, uint32_t dt_ms)
+{
+    if (dt_ms == 0) return 0;
+    return (int32_t)(((int64_t)delta_q4 * 60000) / ((int64_t)dt_ms << 4));
+}
+
+void fire_score_init(fire_score_t *fs, const fire_score_config_t *cfg)
+{
+    static const fire_score_config_t defaults = FIRE_SCORE_CONFIG_DEFAULT();
+    *fs = (fire_score_t){ 0 };
+    fs->cfg = cfg ? *cfg : defaults;
+    fs->level = FIRE_LEVEL_NORMAL;
+}
+
+fire_level_t fire_score_update(fire_score_t *fs, int32_t temp_cdeg, int32_t gas, int flame_count, uint32_t now_ms)
+{
+    const fire_score_config_t *c = &fs->cfg;
+    const int32_t temp_q4 = temp_cdeg << 4;
+    const int32_t gas_q4 = gas << 4;
+
+    if (!fs->primed) {
+        fs->temp_ewma_q4 = temp_q4;
+        fs->gas_ewma_q4 = gas_q4;
+        fs->temp_slope = 0;
+        fs->gas_slope = 0;
+        fs->primed = true;
+    } else {
+        const uint32_t dt_ms = now_ms - fs->last_ms;
+        const int32_t prev_temp = fs->temp_ewma_q4;
+        const int32_t prev_gas = fs->gas_ewma_q4;
+
+        fs->temp_ewma_q4 += (temp_q4 - fs->temp_ewma_q4) >> c->ewma_shift;
+        fs->gas_ewma_q4 += (gas_q4 - fs->gas_ewma_q4) >> c->ewma_shift;
+
+        const int32_t temp_slope_now = per_minute(fs->temp_ewma_q4 - prev_temp, dt_ms);
+        const int32_t gas_slope_now = per_minute(fs->gas_ewma_q4 - prev_gas, dt_ms);
+        fs->temp_slope += (temp_slope_now - fs->temp_slope) >> c->ewma_shift;
+        fs->gas_slope += (gas_slope_now - fs->gas_slope) >> c->ewma_shift;
+    }
+    fs->last_ms = now_ms;
+
+    // Thời gian lửa liên tục (ít nhất một cảm biến)
+    if (flame_count > 0 && fs->flame_count == 0) {
+        fs->flame_since_ms = now_ms;
+    }
+    fs->flame_count = flame_count;
+
+    int32_t score = 0;
+    score += ramp(fs->temp_ewma_q4 >> 4, c->temp_pre_cdeg, c->temp_alarm_cdeg, FIRE_SCORE_MAX);
+    score += ramp(fs->temp_slope, c->temp_slope_min, c->temp_slope_full, c->temp_slope_weight);
+    score += ramp(fs->gas_ewma_q4 >> 4, c->gas_light, c->gas_strong, FIRE_SCORE_MAX);
+    score += ramp(fs->gas_slope, 0, c->gas_slope_full, c->gas_slope_weight);
+    if (flame_count > 0) {
+        score += flame_count * c->flame_weight_per_sensor;
+        score += ramp((int32_t)(now_ms - fs->flame_since_ms), 0, (int32_t)c->flame_duration_full_ms,
+                      c->flame_duration_weight);
+    }
+    if (score > FIRE_SCORE_MAX) score = FIRE_SCORE_MAX;
+    fs->score = (int16_t)score;
+
+    if (score >= c->alarm_level) {
+        fs->level = FIRE_LEVEL_ALARM;
+    } else if (score >= c->pre_alarm_level) {
+        fs->level = FIRE_LEVEL_PRE_ALARM;
+    } else {
+        fs->level = FIRE_LEVEL_NORMAL;
+    }
+    return fs->level;
+}
+
+const char *fire_level_to_str(fire_level_t level)
+{
+    switch (level) {
+        case FIRE_LEVEL_PRE_ALARM: return "PRE_ALARM";
+        case FIRE_LEVEL_ALARM:     return "ALARM";
+        default:                   return "NORMAL";
+    }
+}
@@ -0,0 +1,106 @@
+// fire_score.h
+#ifndef FIRE_SCORE_H
+#define FIRE_SCORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Bộ hợp nhất nhiều tín hiệu (nhiệt độ, khí gas, cảm biến lửa) thành một
+ * điểm rủi ro cháy dạng số nguyên cố định 0..FIRE_SCORE_MAX.
+ *
+ * Mỗi lần cập nhật chỉ tốn O(1): EWMA và độ dốc (slope) được tính tăng dần,
+ * không lưu lịch sử mẫu, không dùng số thực. Đủ rẻ để chạy ở mọi mẫu.
+ */
+
+#define FIRE_SCORE_MAX 1000
+
+typedef enum {
+    FIRE_LEVEL_NORMAL = 0,
+    FIRE_LEVEL_PRE_ALARM,
+    FIRE_LEVEL_ALARM,
+} fire_level_t;
+
+typedef struct {
+    uint8_t ewma_shift;             // alpha = 1 / 2^ewma_shift
+
+    // Nhiệt độ (đơn vị 0.01 °C)
+    int32_t temp_pre_cdeg;          // Bắt đầu cộng điểm từ mức này
+    int32_t temp_alarm_cdeg;        // Đạt mức này -> đủ điểm báo cháy
+    int32_t temp_slope_min;         // 0.01 °C/phút, bắt đầu cộng điểm
+    int32_t temp_slope_full;        // 0.01 °C/phút, đạt điểm tối đa của slope
+    int16_t temp_slope_weight;
+
+    // Khí gas (cùng đơn vị với giá trị truyền vào fire_score_update)
+    int32_t gas_light;
+    int32_t gas_strong;
+    int32_t gas_slope_full;         // đơn vị gas/phút
+    int16_t gas_slope_weight;
+
+    // Cảm biến lửa
+    int16_t flame_weight_per_sensor;
+    uint32_t flame_duration_full_ms;
+    int16_t flame_duration_weight;
+
+    // Ngưỡng mức
+    int16_t pre_alarm_level;
+    int16_t alarm_level;
+} fire_score_config_t;
+
+#define FIRE_SCORE_CONFIG_DEFAULT() {           \
+    .ewma_shift = 1,                            \
+    .temp_pre_cdeg = 3500,                      \
+    .temp_alarm_cdeg = 4500,                    \
+    .temp_slope_min = 200,                      \
+    .temp_slope_full = 1500,                    \
+    .temp_slope_weight = 900,                   \
+    .gas_light = 0,                             \
+    .gas_strong = 80,                           \
+    .gas_slope_full = 160,                      \
+    .gas_slope_weight = 300,                    \
+    .flame_weight_per_sensor = 150,             \
+    .flame_duration_full_ms = 10000,            \
+    .flame_duration_weight = 300,               \
+    .pre_alarm_level = 400,                     \
+    .alarm_level = FIRE_SCORE_MAX,              \
+}
+
+typedef struct {
+    fire_score_config_t cfg;
+    bool primed;                    // Đã có ít nhất một mẫu
+
+    uint32_t last_ms;
+    int32_t temp_ewma_q4;           // 0.01 °C, Q4
+    int32_t temp_slope;             // 0.01 °C/phút (đã làm mượt)
+    int32_t gas_ewma_q4;            // Q4
+    int32_t gas_slope;              // gas/phút (đã làm mượt)
+
+    int flame_count;
+    uint32_t flame_since_ms;        // Thời điểm bắt đầu có >= 1 cảm biến lửa
+
+    int16_t score;
+    fire_level_t level;
+} fire_score_t;
+
+/**
+ * @brief Khởi tạo bộ tính điểm với cấu hình cho trước (NULL = mặc định).
+ */
+void fire_score_init(fire_score_t *fs, const fire_score_config_t *cfg);
+
+/**
+ * @brief Cập nhật đặc trưng và tính lại điểm rủi ro, O(1).
+ *
+ * @param temp_cdeg Nhiệt độ hiện tại (0.01 °C).
+ * @param gas Giá trị khí gas hiện tại.
+ * @param flame_count Số cảm biến lửa đang phát hiện lửa.
+ * @param now_ms Thời điểm lấy mẫu (ms, đơn điệu tăng).
+ * @return Mức rủi ro mới.
+ */
+fire_level_t fire_score_update(fire_score_t *fs, int32_t temp_cdeg, int32_t gas, int flame_count, uint32_t now_ms);
+
+static inline int32_t fire_score_temp_ewma_cdeg(const fire_score_t *fs) { return fs->temp_ewma_q4 >> 4; }
+static inline int32_t fire_score_gas_ewma(const fire_score_t *fs) { return fs->gas_ewma_q4 >> 4; }
+
+const char *fire_level_to_str(fire_level_t level);
+
+#endif // FIRE_SCORE_H
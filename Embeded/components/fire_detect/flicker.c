@@ -0,0 +1,135 @@
+// flicker.c
+#include "flicker.h"
+#include <stddef.h>
+
+// 2cos(2*pi*k/128) dạng Q14 cho k = 0..32; phần tư còn lại suy ra theo đối xứng
+static const int32_t s_cos2_q14[FLICKER_WINDOW / 4 + 1] = {
+    32768, 32729, 32610, 32413, 32138, 31786, 31357, 30853,
+    30274, 29622, 28899, 28106, 27246, 26320, 25330, 24279,
+    23170, 22006, 20788, 19520, 18205, 16846, 15447, 14010,
+    12540, 11039, 9512, 7962, 6393, 4808, 3212, 1608,
+    0,
+};
+
+static int32_t goertzel_coeff(int k)
+{
+    const int quarter = FLICKER_WINDOW / 4;
+    return (k <= quarter) ? s_cos2_q14[k] : -s_cos2_q14[2 * quarter - k];
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit != 0) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+// Nội suy tuyến tính value trong [lo, hi] -> 0..100
+static int32_t ramp_pct(int32_t value, int32_t lo, int32_t hi)
+{
+    if (value <= lo) return 0;
+    if (value >= hi || hi <= lo) return 100;
+    return (value - lo) * 100 / (hi - lo);
+}
+
+void flicker_init(flicker_detector_t *fd, const flicker_config_t *cfg)
+{
+    *fd = (flicker_detector_t){ 0 };
+    if (cfg != NULL) {
+        fd->cfg = *cfg;
+    } else {
+        fd->cfg = (flicker_config_t)FLICKER_CONFIG_DEFAULT();
+    }
+    // Bin hợp lệ: 1..N/2-1 (bỏ DC và Nyquist)
+    if (fd->cfg.bin_first < 1) fd->cfg.bin_first = 1;
+    if (fd->cfg.bin_last > FLICKER_WINDOW / 2 - 1) fd->cfg.bin_last = FLICKER_WINDOW / 2 - 1;
+    if (fd->cfg.bin_last - fd->cfg.bin_first + 1 > FLICKER_MAX_BINS) {
+        fd->cfg.bin_last = fd->cfg.bin_first + FLICKER_MAX_BINS - 1;
+    }
+    for (int k = fd->cfg.bin_first; k <= fd->cfg.bin_last; k++) {
+        fd->coeff_q14[fd->nbins++] = goertzel_coeff(k);
+    }
+}
+
+void flicker_goertzel_bank(const int32_t *restrict coeff_q14, int nbins,
+                           const int16_t *restrict x, int n, int64_t *restrict power)
+{
+    // |s| <= n * max|x| / sin(w): với n = 128, 12 bit và bin >= 1 vẫn dưới 2^31
+    int32_t s1[FLICKER_MAX_BINS] = { 0 };
+    int32_t s2[FLICKER_MAX_BINS] = { 0 };
+
+    for (int i = 0; i < n; i++) {
+        const int32_t xi = x[i];
+        for (int b = 0; b < nbins; b++) {
+            const int32_t s0 = xi + (int32_t)(((int64_t)coeff_q14[b] * s1[b]) >> FLICKER_Q) - s2[b];
+            s2[b] = s1[b];
+            s1[b] = s0;
+        }
+    }
+    for (int b = 0; b < nbins; b++) {
+        const int64_t a = s1[b], c = s2[b];
+        power[b] = a * a + c * c - ((coeff_q14[b] * a) >> FLICKER_Q) * c;
+    }
+}
+
+static void flicker_analyze(flicker_detector_t *fd, flicker_result_t *out)
+{
+    int16_t block[FLICKER_WINDOW];
+    int64_t power[FLICKER_MAX_BINS];
+
+    // Ring -> khối tuyến tính theo thứ tự thời gian, trừ DC
+    uint32_t sum = 0;
+    for (int i = 0; i < FLICKER_WINDOW; i++) sum += fd->ring[i];
+    const int32_t mean = (int32_t)(sum / FLICKER_WINDOW);
+    uint64_t ac_energy = 0;
+    for (int i = 0; i < FLICKER_WINDOW; i++) {
+        const int32_t v = (int32_t)fd->ring[(fd->head + i) % FLICKER_WINDOW] - mean;
+        block[i] = (int16_t)v;
+        ac_energy += (uint64_t)((int64_t)v * v);
+    }
+
+    flicker_goertzel_bank(fd->coeff_q14, fd->nbins, block, FLICKER_WINDOW, power);
+
+    // Parseval: một bin một phía đóng góp 2|X_k|^2 / N^2 vào phương sai
+    uint64_t band_energy = 0;      // Tổng bình phương (miền thời gian) của phần trong dải
+    for (int b = 0; b < fd->nbins; b++) {
+        if (power[b] > 0) band_energy += (uint64_t)power[b];
+    }
+    band_energy = band_energy * 2 / FLICKER_WINDOW;
+
+    out->mean = (uint16_t)mean;
+    out->ac_rms = (uint16_t)isqrt64(ac_energy / FLICKER_WINDOW);
+    out->band_rms = (uint16_t)isqrt64(band_energy / FLICKER_WINDOW);
+    uint32_t pct = ac_energy ? (uint32_t)(band_energy * 100 / ac_energy) : 0;
+    out->band_pct = (uint8_t)(pct > 100 ? 100 : pct);
+
+    // Cần cả biên độ nhấp nháy đủ lớn lẫn phổ tập trung trong dải (nhiễu trắng / trôi chậm thì không)
+    const int32_t amp = ramp_pct(out->band_rms, fd->cfg.band_rms_min, fd->cfg.band_rms_full);
+    const int32_t shape = ramp_pct(out->band_pct, fd->cfg.band_pct_min, fd->cfg.band_pct_full);
+    out->confidence = (uint8_t)(amp * shape / 100);
+}
+
+bool flicker_push(flicker_detector_t *fd, uint16_t sample, flicker_result_t *out)
+{
+    fd->ring[fd->head] = sample;
+    fd->head = (uint8_t)((fd->head + 1) % FLICKER_WINDOW);
+    if (fd->count < FLICKER_WINDOW) fd->count++;
+    fd->since_result++;
+
+    if (fd->count < FLICKER_WINDOW || fd->since_result < FLICKER_HOP) {
+        return false;
+    }
+    fd->since_result = 0;
+    flicker_analyze(fd, out);
+    return true;
+}
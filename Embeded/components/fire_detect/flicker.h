@@ -0,0 +1,84 @@
+// flicker.h
+#ifndef FLICKER_H
+#define FLICKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Phân tích nhấp nháy (flicker) trên ngõ analog của cảm biến lửa.
+ *
+ * Ngọn lửa thật dao động cường độ hồng ngoại ở khoảng 1..20 Hz; nắng hay đèn
+ * sợi đốt gần như không đổi (đèn lưới điện nhấp nháy 100/120 Hz, nằm ngoài dải).
+ * Mỗi kênh lấy mẫu FLICKER_SAMPLE_HZ, cửa sổ trượt FLICKER_WINDOW mẫu (bước
+ * FLICKER_HOP). Năng lượng trong dải được đo bằng một dãy bộ lọc Goertzel
+ * số nguyên (mỗi bin một bộ cộng hưởng, hệ số Q14) chạy chung trên một khối mẫu.
+ *
+ * Ở 100 Hz, đèn 120 Hz bị gập (alias) về 20 Hz nên dải mặc định dừng ở bin 18
+ * (14 Hz); bộ trung bình 10 ms trước khi hạ tốc độ mẫu đã triệt 100 Hz.
+ */
+
+#define FLICKER_SAMPLE_HZ   100
+#define FLICKER_WINDOW      128     // Mẫu mỗi cửa sổ (1.28 s), độ phân giải bin 0.78 Hz
+#define FLICKER_HOP         64      // Có kết quả mới mỗi 0.64 s
+#define FLICKER_MAX_BINS    32
+#define FLICKER_Q           14      // Hệ số 2cos(w) dạng Q14
+
+typedef struct {
+    uint8_t bin_first;              // Bin k -> tần số k * FLICKER_SAMPLE_HZ / FLICKER_WINDOW
+    uint8_t bin_last;
+    uint16_t band_rms_min;          // RMS trong dải (đơn vị ADC) bắt đầu cộng độ tin cậy
+    uint16_t band_rms_full;         // RMS trong dải đạt độ tin cậy tối đa
+    uint8_t band_pct_min;           // % năng lượng AC nằm trong dải, bắt đầu cộng
+    uint8_t band_pct_full;          // % đạt tối đa
+} flicker_config_t;
+
+#define FLICKER_CONFIG_DEFAULT() {      \
+    .bin_first = 2,                     \
+    .bin_last = 18,                     \
+    .band_rms_min = 6,                  \
+    .band_rms_full = 60,                \
+    .band_pct_min = 30,                 \
+    .band_pct_full = 70,                \
+}
+
+typedef struct {
+    uint16_t mean;                  // Mức DC trung bình của cửa sổ (đơn vị ADC)
+    uint16_t ac_rms;                // RMS toàn bộ thành phần AC
+    uint16_t band_rms;              // RMS trong dải nhấp nháy
+    uint8_t band_pct;               // % năng lượng AC nằm trong dải
+    uint8_t confidence;             // 0..100: khả năng đây là ngọn lửa
+} flicker_result_t;
+
+typedef struct {
+    flicker_config_t cfg;
+    uint8_t nbins;
+    int32_t coeff_q14[FLICKER_MAX_BINS];
+    uint16_t ring[FLICKER_WINDOW];
+    uint8_t head;                   // Vị trí ghi tiếp theo
+    uint16_t count;                 // Số mẫu hợp lệ (tối đa FLICKER_WINDOW)
+    uint16_t since_result;          // Số mẫu từ lần phân tích trước
+} flicker_detector_t;
+
+/**
+ * @brief Khởi tạo bộ phân tích một kênh (cfg = NULL dùng mặc định).
+ */
+void flicker_init(flicker_detector_t *fd, const flicker_config_t *cfg);
+
+/**
+ * @brief Thêm một mẫu (đã hạ về FLICKER_SAMPLE_HZ).
+ * @return true khi đủ cửa sổ và tới bước phân tích; kết quả ghi vào @p out.
+ */
+bool flicker_push(flicker_detector_t *fd, uint16_t sample, flicker_result_t *out);
+
+/**
+ * @brief Kernel Goertzel nhiều bin trên một khối mẫu đã trừ DC.
+ *
+ * Trạng thái các bin nằm trong mảng liền nhau và vòng trong chạy theo bin, nên
+ * trên bản build host (target linux, replay) trình biên dịch vector hóa được.
+ * @param power Ghi |X_k|^2 của từng bin.
+ */
+void flicker_goertzel_bank(const int32_t *coeff_q14, int nbins,
+                           const int16_t *x, int n, int64_t *power);
+
+#endif // FLICKER_H
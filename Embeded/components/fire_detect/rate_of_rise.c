@@ -0,0 +1,72 @@
+// rate_of_rise.c
+#include "rate_of_rise.h"
+#include <stddef.h>
+
+void ror_init(ror_detector_t *ror, const ror_config_t *cfg)
+{
+    static const ror_config_t defaults = ROR_CONFIG_DEFAULT();
+    *ror = (ror_detector_t){ 0 };
+    ror->cfg = cfg ? *cfg : defaults;
+    if (ror->cfg.window < 3) ror->cfg.window = 3;
+    if (ror->cfg.window > ROR_MAX_WINDOW) ror->cfg.window = ROR_MAX_WINDOW;
+}
+
+// Dời gốc trục x thêm d ms, giữ nguyên các tổng ở dạng đóng (O(1))
+static void ror_rebase(ror_detector_t *ror, int64_t d)
+{
+    const int64_t n = ror->count;
+    ror->sxx += -2 * d * ror->sx + n * d * d;
+    ror->sxy -= d * ror->sy;
+    ror->sx -= n * d;
+    ror->t_ref += (uint32_t)d;
+}
+
+bool ror_update(ror_detector_t *ror, int32_t temp_cdeg, uint32_t now_ms)
+{
+    if (ror->count == 0) {
+        ror->t_ref = now_ms;
+    }
+
+    // Bớt mẫu cũ nhất khi cửa sổ đầy
+    if (ror->count == ror->cfg.window) {
+        const int64_t x0 = (int32_t)(ror->t_ms[ror->head] - ror->t_ref);
+        const int64_t y0 = ror->y[ror->head];
+        ror->sx -= x0;
+        ror->sy -= y0;
+        ror->sxx -= x0 * x0;
+        ror->sxy -= x0 * y0;
+        ror->head = (ror->head + 1) % ror->cfg.window;
+        ror->count--;
+    }
+
+    // Thêm mẫu mới
+    const uint8_t tail = (ror->head + ror->count) % ror->cfg.window;
+    ror->t_ms[tail] = now_ms;
+    ror->y[tail] = temp_cdeg;
+    ror->count++;
+
+    const int64_t x = (int32_t)(now_ms - ror->t_ref);
+    ror->sx += x;
+    ror->sy += temp_cdeg;
+    ror->sxx += x * x;
+    ror->sxy += x * temp_cdeg;
+
+    // Giữ x nhỏ: gốc trục luôn là mẫu cũ nhất
+    const int64_t d = (int32_t)(ror->t_ms[ror->head] - ror->t_ref);
+    if (d != 0) ror_rebase(ror, d);
+
+    const int64_t n = ror->count;
+    const int64_t den = n * ror->sxx - ror->sx * ror->sx;
+    const uint32_t span_ms = now_ms - ror->t_ms[ror->head];
+
+    ror->valid = (n >= 3) && (den > 0) && (span_ms >= ror->cfg.min_span_ms);
+    if (!ror->valid) {
+        ror->slope = 0;
+        return false;
+    }
+
+    // slope (0.01 °C/ms) * 60000 -> 0.01 °C/phút
+    const int64_t num = n * ror->sxy - ror->sx * ror->sy;
+    ror->slope = (int32_t)((num * 60000) / den);
+    return ror->slope >= ror->cfg.rate_cdeg_per_min;
+}
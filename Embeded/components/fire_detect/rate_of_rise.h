@@ -0,0 +1,58 @@
+// rate_of_rise.h
+#ifndef RATE_OF_RISE_H
+#define RATE_OF_RISE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Phát hiện cháy theo tốc độ tăng nhiệt (rate-of-rise).
+ *
+ * Độ dốc được ước lượng bằng hồi quy bình phương tối thiểu trên cửa sổ trượt
+ * kích thước cố định. Các tổng Sx, Sy, Sxx, Sxy được cập nhật tăng dần
+ * (thêm mẫu mới, bớt mẫu cũ) nên mỗi lần cập nhật là O(1), không cộng lại
+ * toàn bộ cửa sổ. Mẫu mang timestamp thật nên chu kỳ lấy mẫu có thể thay đổi.
+ */
+
+#define ROR_MAX_WINDOW 32
+
+typedef struct {
+    int32_t rate_cdeg_per_min;  // Ngưỡng báo cháy (0.01 °C/phút)
+    uint8_t window;             // Số mẫu trong cửa sổ (3..ROR_MAX_WINDOW)
+    uint32_t min_span_ms;       // Cửa sổ phải trải dài ít nhất chừng này mới đánh giá
+} ror_config_t;
+
+#define ROR_CONFIG_DEFAULT() {          \
+    .rate_cdeg_per_min = 830,           \
+    .window = 16,                       \
+    .min_span_ms = 20000,               \
+}
+
+typedef struct {
+    ror_config_t cfg;
+    uint32_t t_ms[ROR_MAX_WINDOW];
+    int32_t y[ROR_MAX_WINDOW];
+    uint8_t head;               // Vị trí mẫu cũ nhất
+    uint8_t count;
+
+    uint32_t t_ref;             // Gốc trục x (ms); x = t - t_ref
+    int64_t sx, sy, sxx, sxy;
+
+    int32_t slope;              // 0.01 °C/phút, chỉ có nghĩa khi valid = true
+    bool valid;
+} ror_detector_t;
+
+/**
+ * @brief Khởi tạo bộ phát hiện (cfg = NULL dùng mặc định).
+ */
+void ror_init(ror_detector_t *ror, const ror_config_t *cfg);
+
+/**
+ * @brief Thêm một mẫu nhiệt độ và cập nhật độ dốc, O(1).
+ * @param temp_cdeg Nhiệt độ (0.01 °C).
+ * @param now_ms Thời điểm lấy mẫu (ms, đơn điệu tăng).
+ * @return true nếu tốc độ tăng nhiệt vượt ngưỡng.
+ */
+bool ror_update(ror_detector_t *ror, int32_t temp_cdeg, uint32_t now_ms);
+
+#endif // RATE_OF_RISE_H
@@ -0,0 +1,52 @@
+// sample_sched.c
+#include "sample_sched.h"
+#include <stddef.h>
+
+void sample_sched_init(sample_sched_t *sched, const sample_sched_config_t *cfg)
+{
+    static const sample_sched_config_t defaults = SAMPLE_SCHED_CONFIG_DEFAULT();
+    *sched = (sample_sched_t){ 0 };
+    sched->cfg = cfg ? *cfg : defaults;
+    sched->mode = SAMPLE_MODE_NORMAL;
+}
+
+static sample_mode_t target_mode(const sample_sched_config_t *c, int16_t score, int32_t rise, bool alarm)
+{
+    if (alarm || score >= c->score_critical || rise >= c->rise_critical) return SAMPLE_MODE_CRITICAL;
+    if (score >= c->score_elevated || rise >= c->rise_elevated) return SAMPLE_MODE_ELEVATED;
+    if (score >= c->score_normal || rise >= c->rise_normal) return SAMPLE_MODE_NORMAL;
+    return SAMPLE_MODE_QUIET;
+}
+
+sample_mode_t sample_sched_update(sample_sched_t *sched, int16_t risk_score, int32_t temp_rise, bool alarm_active)
+{
+    const sample_mode_t target = target_mode(&sched->cfg, risk_score, temp_rise, alarm_active);
+
+    if (target > sched->mode) {
+        // Gần ngưỡng: tăng tốc ngay
+        sched->mode = target;
+        sched->calm_count = 0;
+        sched->mode_changes++;
+    } else if (target < sched->mode) {
+        // Yên tĩnh: chỉ giảm một bậc sau calm_samples mẫu liên tiếp
+        if (++sched->calm_count >= sched->cfg.calm_samples) {
+            sched->mode--;
+            sched->calm_count = 0;
+            sched->mode_changes++;
+        }
+    } else {
+        sched->calm_count = 0;
+    }
+    return sched->mode;
+}
+
+const char *sample_mode_to_str(sample_mode_t mode)
+{
+    switch (mode) {
+        case SAMPLE_MODE_QUIET:    return "QUIET";
+        case SAMPLE_MODE_NORMAL:   return "NORMAL";
+        case SAMPLE_MODE_ELEVATED: return "ELEVATED";
+        case SAMPLE_MODE_CRITICAL: return "CRITICAL";
+        default:                   return "?";
+    }
+}
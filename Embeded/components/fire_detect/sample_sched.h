@@ -0,0 +1,69 @@
+// sample_sched.h
+#ifndef SAMPLE_SCHED_H
+#define SAMPLE_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Lập lịch lấy mẫu thích nghi: rút ngắn chu kỳ khi điểm rủi ro hoặc tốc độ
+ * tăng nhiệt tiến gần ngưỡng báo cháy, kéo dài khi mọi thứ yên tĩnh.
+ * Tăng tốc ngay lập tức, giảm tốc từng bậc sau một số mẫu yên tĩnh liên tiếp.
+ */
+
+typedef enum {
+    SAMPLE_MODE_QUIET = 0,
+    SAMPLE_MODE_NORMAL,
+    SAMPLE_MODE_ELEVATED,
+    SAMPLE_MODE_CRITICAL,
+    SAMPLE_MODE_COUNT,
+} sample_mode_t;
+
+typedef struct {
+    uint32_t period_ms[SAMPLE_MODE_COUNT];  // Chu kỳ lấy mẫu tổng cho từng mode
+    int16_t score_normal;                   // Điểm rủi ro tối thiểu cho từng mode
+    int16_t score_elevated;
+    int16_t score_critical;
+    int32_t rise_normal;                    // Tốc độ tăng nhiệt (0.01 °C/phút) cho từng mode
+    int32_t rise_elevated;
+    int32_t rise_critical;
+    uint8_t calm_samples;                   // Số mẫu yên tĩnh liên tiếp trước khi giảm một bậc
+} sample_sched_config_t;
+
+#define SAMPLE_SCHED_CONFIG_DEFAULT() {                 \
+    .period_ms = { 5000, 2000, 1000, 0 },               \
+    .score_normal = 50,                                 \
+    .score_elevated = 300,                              \
+    .score_critical = 700,                              \
+    .rise_normal = 100,                                 \
+    .rise_elevated = 350,                               \
+    .rise_critical = 600,                               \
+    .calm_samples = 5,                                  \
+}
+
+typedef struct {
+    sample_sched_config_t cfg;
+    sample_mode_t mode;
+    uint8_t calm_count;
+    uint32_t mode_changes;
+} sample_sched_t;
+
+void sample_sched_init(sample_sched_t *sched, const sample_sched_config_t *cfg);
+
+/**
+ * @brief Cập nhật mode theo mẫu vừa đọc.
+ * @param risk_score Điểm rủi ro hiện tại (fire_score).
+ * @param temp_rise Tốc độ tăng nhiệt hiện tại (0.01 °C/phút).
+ * @param alarm_active Đang báo cháy -> luôn ở mode CRITICAL.
+ * @return Mode mới.
+ */
+sample_mode_t sample_sched_update(sample_sched_t *sched, int16_t risk_score, int32_t temp_rise, bool alarm_active);
+
+static inline uint32_t sample_sched_period_ms(const sample_sched_t *sched)
+{
+    return sched->cfg.period_ms[sched->mode];
+}
+
+const char *sample_mode_to_str(sample_mode_t mode);
+
+#endif // SAMPLE_SCHED_H
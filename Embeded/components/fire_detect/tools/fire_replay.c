@@ -0,0 +1,274 @@
+// fire_replay.c - chạy lại kịch bản mô phỏng trên máy host, so sánh luật cũ với fire_score
+//
+// Build và chạy (từ thư mục components/fire_detect/tools):
+//     gcc -O2 -I.. -I../../mq2 fire_replay.c ../fire_score.c ../../mq2/mq2_ppm.c -o fire_replay
+//     ./fire_replay [-p chu_kỳ_ms] ../../sim/scenarios/*.txt
+//
+// Đọc cùng cú pháp kịch bản với components/sim (temp, gas, ramp, gpio, wait, exit; rf/ao bị bỏ qua),
+// lấy mẫu theo thời gian ảo nên một kịch bản vài phút chạy trong vài ms. Khoảng cháy thật được đánh
+// dấu trong chú thích của kịch bản (sim bỏ qua):
+//     #! fire      cháy thật bắt đầu từ thời điểm này
+//     #! clear     hết cháy
+// Kịch bản không có dấu nào là kịch bản không cháy: mọi lần báo đều là báo nhầm.
+//
+// Hai luật được so sánh trên nguồn nhiệt/gas (đồng thuận cảm biến lửa là nguồn riêng, không tính):
+//     old    temp > 45 °C || gas > 0 (độ lệch ADC so với baseline), luật trước fire_score
+//     score  fire_score đạt FIRE_LEVEL_ALARM với đúng cấu hình của firmware
+// Báo cháy trong khoảng cháy: trễ phát hiện tính từ "#! fire". Báo ngoài khoảng cháy: báo nhầm.
+// peak: điểm cao nhất của fire_score trong kịch bản không cháy, cho biết còn cách ngưỡng báo cháy bao xa.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "fire_score.h"
+#include "mq2_ppm.h"
+
+// Giống main/ds18b20_read.c và backend mq2 của sim
+#define FIRE_THRESHOLD_C        45.0f
+#define FIRE_PRE_ALARM_C        32.0f
+#define GAS_THRESHOLD_LIGHT     200
+#define GAS_THRESHOLD_STRONG    2000
+#define GAS_SLOPE_FULL_PPM_MIN  1000
+#define SENSOR_POLL_INTERVAL_MS 2000
+#define MQ2_SIM_BASELINE_RAW    400
+#define MQ2_WARMUP_MS           30000   // Trước khi hiệu chỉnh xong firmware không đọc gas
+
+#define MAX_FIRE_SPANS          8
+#define LINE_MAX_LEN            256
+
+static const int FLAME_PINS[] = { 13, 12, 14, 27, 26 };
+#define NUM_FLAME_PINS (int)(sizeof(FLAME_PINS) / sizeof(FLAME_PINS[0]))
+
+typedef struct {
+    float from;
+    float to;
+    int64_t start_ms;
+    int64_t dur_ms;
+} value_t;
+
+typedef struct {
+    int64_t start_ms;
+    int64_t end_ms;             // -1: tới hết kịch bản
+} span_t;
+
+typedef enum { RULE_OLD = 0, RULE_SCORE, RULE_COUNT } rule_t;
+
+static const char *const RULE_NAMES[RULE_COUNT] = { "old", "score" };
+
+typedef struct {
+    bool on;
+    int alarms;                 // Số lần bật trong khoảng cháy
+    int false_alarms;           // Số lần bật ngoài khoảng cháy
+    int64_t false_on_ms;        // Tổng thời gian đang báo ngoài khoảng cháy
+    int64_t latency_ms[MAX_FIRE_SPANS];     // -1: bỏ lỡ
+} rule_stats_t;
+
+typedef struct {
+    int64_t now_ms;
+    int64_t next_sample_ms;
+    int period_ms;
+    value_t temp;
+    value_t gas;
+    bool flame[NUM_FLAME_PINS];
+    span_t spans[MAX_FIRE_SPANS];
+    int n_spans;
+    fire_score_t score;
+    int32_t calib_cdeg;
+    int peak_score;             // Điểm cao nhất, chỉ tính cho kịch bản không cháy
+    rule_stats_t rule[RULE_COUNT];
+} replay_t;
+
+static float value_at(const value_t *v, int64_t t_ms)
+{
+    if (v->dur_ms <= 0 || t_ms >= v->start_ms + v->dur_ms) return v->to;
+    if (t_ms <= v->start_ms) return v->from;
+    return v->from + (v->to - v->from) * (float)(t_ms - v->start_ms) / (float)v->dur_ms;
+}
+
+static int span_at(const replay_t *r, int64_t t_ms)
+{
+    for (int i = 0; i < r->n_spans; i++) {
+        if (t_ms >= r->spans[i].start_ms && (r->spans[i].end_ms < 0 || t_ms < r->spans[i].end_ms)) return i;
+    }
+    return -1;
+}
+
+static void rule_sample(replay_t *r, rule_stats_t *s, bool alarm, int64_t t_ms)
+{
+    const int span = span_at(r, t_ms);
+    if (alarm && !s->on) {
+        if (span < 0) {
+            s->false_alarms++;
+        } else {
+            s->alarms++;
+        }
+    }
+    if (alarm && span >= 0 && s->latency_ms[span] < 0) {
+        s->latency_ms[span] = t_ms - r->spans[span].start_ms;
+    }
+    if (alarm && span < 0) s->false_on_ms += r->period_ms;
+    s->on = alarm;
+}
+
+// Một mẫu của temp_gas_sensor_task: cùng đầu vào cho cả hai luật
+static void sample(replay_t *r, int64_t t_ms)
+{
+    const float temp = value_at(&r->temp, t_ms);
+    const bool gas_ready = t_ms >= MQ2_WARMUP_MS;
+    const float g = value_at(&r->gas, t_ms);
+    const int gas_delta = (gas_ready && g > 0) ? (int)(g + 0.5f) : 0;
+    const int32_t temp_cdeg = (int32_t)(temp * 100);
+
+    int ppm = 0;
+    if (gas_ready) {
+        const uint32_t ratio = mq2_temp_compensate(mq2_ratio_q16(MQ2_SIM_BASELINE_RAW + gas_delta,
+                                                                 MQ2_SIM_BASELINE_RAW),
+                                                   temp_cdeg, r->calib_cdeg);
+        ppm = mq2_ppm_from_ratio(MQ2_GAS_SMOKE, ratio);
+    } else {
+        r->calib_cdeg = temp_cdeg;      // Hiệu chỉnh xong ở nhiệt độ lúc hết làm nóng
+    }
+    int flame_count = 0;
+    for (int i = 0; i < NUM_FLAME_PINS; i++) flame_count += r->flame[i];
+
+    rule_sample(r, &r->rule[RULE_OLD], temp > FIRE_THRESHOLD_C || gas_delta > 0, t_ms);
+    const fire_level_t level = fire_score_update(&r->score, temp_cdeg, ppm, flame_count, (uint32_t)t_ms);
+    rule_sample(r, &r->rule[RULE_SCORE], level == FIRE_LEVEL_ALARM, t_ms);
+    if (r->n_spans == 0 && r->score.score > r->peak_score) r->peak_score = r->score.score;
+}
+
+static void advance(replay_t *r, int64_t ms)
+{
+    const int64_t end_ms = r->now_ms + ms;
+    while (r->next_sample_ms <= end_ms) {
+        sample(r, r->next_sample_ms);
+        r->next_sample_ms += r->period_ms;
+    }
+    r->now_ms = end_ms;
+}
+
+static void mark_span(replay_t *r, const char *what, const char *path, int lineno)
+{
+    if (strncmp(what, "fire", 4) == 0) {
+        if (r->n_spans == MAX_FIRE_SPANS) {
+            fprintf(stderr, "%s:%d: too many fire spans\n", path, lineno);
+            return;
+        }
+        r->spans[r->n_spans++] = (span_t){ .start_ms = r->now_ms, .end_ms = -1 };
+    } else if (strncmp(what, "clear", 5) == 0 && r->n_spans > 0 && r->spans[r->n_spans - 1].end_ms < 0) {
+        r->spans[r->n_spans - 1].end_ms = r->now_ms;
+    }
+}
+
+// Các dấu "#!" phải có trước khi tính trễ: quét một lượt lấy khoảng cháy, lượt sau mới lấy mẫu
+static bool run_script(replay_t *r, const char *path, bool spans_only)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    char line[LINE_MAX_LEN];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        char what[16];
+        float a, b;
+        long ms;
+        int pin, level;
+        if (sscanf(line, " #! %15s", what) == 1) {
+            if (spans_only) mark_span(r, what, path, lineno);
+            continue;
+        }
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        if (sscanf(line, " wait %ld", &ms) == 1) {
+            if (spans_only) {
+                r->now_ms += ms;
+            } else {
+                advance(r, ms);
+            }
+        } else if (spans_only) {
+            continue;
+        } else if (sscanf(line, " temp %f", &a) == 1) {
+            r->temp = (value_t){ a, a, r->now_ms, 0 };
+        } else if (sscanf(line, " gas %f", &a) == 1) {
+            r->gas = (value_t){ a, a, r->now_ms, 0 };
+        } else if (sscanf(line, " ramp %15s %f %f %ld", what, &a, &b, &ms) == 4) {
+            value_t *v = strcmp(what, "temp") == 0 ? &r->temp : strcmp(what, "gas") == 0 ? &r->gas : NULL;
+            if (v) *v = (value_t){ a, b, r->now_ms, ms };
+        } else if (sscanf(line, " gpio %d %d", &pin, &level) == 2) {
+            for (int i = 0; i < NUM_FLAME_PINS; i++) {
+                if (FLAME_PINS[i] == pin) r->flame[i] = (level == 0);      // Active-low
+            }
+        } else if (strncmp(line + strspn(line, " \t"), "exit", 4) == 0) {
+            break;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static void replay_file(const char *path, int period_ms)
+{
+    static const fire_score_config_t defaults = FIRE_SCORE_CONFIG_DEFAULT();
+    replay_t r = {
+        .period_ms = period_ms,
+        .temp = { 25.0f, 25.0f, 0, 0 },
+    };
+    fire_score_config_t cfg = defaults;
+    cfg.temp_pre_cdeg = (int32_t)(FIRE_PRE_ALARM_C * 100);
+    cfg.temp_alarm_cdeg = (int32_t)(FIRE_THRESHOLD_C * 100);
+    cfg.gas_light = GAS_THRESHOLD_LIGHT;
+    cfg.gas_strong = GAS_THRESHOLD_STRONG;
+    cfg.gas_slope_full = GAS_SLOPE_FULL_PPM_MIN;
+    fire_score_init(&r.score, &cfg);
+    for (int k = 0; k < RULE_COUNT; k++) {
+        for (int i = 0; i < MAX_FIRE_SPANS; i++) r.rule[k].latency_ms[i] = -1;
+    }
+
+    if (!run_script(&r, path, true)) return;
+    r.now_ms = 0;
+    run_script(&r, path, false);
+
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    for (int k = 0; k < RULE_COUNT; k++) {
+        const rule_stats_t *s = &r.rule[k];
+        printf("%-28s %-6s %5d %6d %10.1f ", name, RULE_NAMES[k], r.n_spans, s->false_alarms,
+               s->false_on_ms / 1000.0);
+        if (k == RULE_SCORE && r.n_spans == 0) {
+            printf("%5d ", r.peak_score);
+        } else {
+            printf("%5s ", "-");
+        }
+        for (int i = 0; i < r.n_spans; i++) {
+            if (s->latency_ms[i] < 0) {
+                printf("%s%s", i ? "," : "", "missed");
+            } else {
+                printf("%s%.1f", i ? "," : "", s->latency_ms[i] / 1000.0);
+            }
+        }
+        printf("%s\n", r.n_spans ? "" : "-");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int period_ms = SENSOR_POLL_INTERVAL_MS;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-p") == 0) {
+        period_ms = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || period_ms <= 0) {
+        fprintf(stderr, "usage: %s [-p period_ms] scenario.txt...\n", argv[0]);
+        return 2;
+    }
+    printf("# sample period %d ms\n", period_ms);
+    printf("%-28s %-6s %5s %6s %10s %5s %s\n", "trace", "rule", "fires", "false", "false_on_s", "peak",
+           "latency_s");
+    for (int i = first; i < argc; i++) {
+        replay_file(argv[i], period_ms);
+    }
+    return 0;
+}
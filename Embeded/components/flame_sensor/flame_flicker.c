@@ -0,0 +1,72 @@
+// flame_flicker.c - phần chung: cửa sổ trượt + Goertzel cho từng kênh, gọi callback
+#include "flame_flicker.h"
+#include "flame_flicker_backend.h"
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "binlog.h"
+
+static const char *TAG = "FLAME_FLICKER";
+
+static flame_flicker_channel_t s_channels[FLAME_FLICKER_MAX_CHANNELS];
+static flicker_detector_t s_detectors[FLAME_FLICKER_MAX_CHANNELS];
+static int s_num_channels = 0;
+static flame_flicker_cb_t s_callback = NULL;
+static atomic_int s_aux_raw = -1;
+static bool s_started = false;
+
+void flame_flicker_feed(int slot, uint16_t sample)
+{
+    if (slot < 0 || slot >= s_num_channels) return;
+
+    flicker_result_t result;
+    if (!flicker_push(&s_detectors[slot], sample, &result)) return;
+
+    BLOGD(TAG, "Sensor %d: mean=%u ac=%u band=%u (%u%%) conf=%u",
+          s_channels[slot].sensor_index, result.mean, result.ac_rms,
+          result.band_rms, result.band_pct, result.confidence);
+    if (s_callback != NULL) {
+        s_callback(s_channels[slot].sensor_index, &result);
+    }
+}
+
+void flame_flicker_set_aux(uint16_t sample)
+{
+    atomic_store_explicit(&s_aux_raw, sample, memory_order_relaxed);
+}
+
+int flame_flicker_read_aux(void)
+{
+    return atomic_load_explicit(&s_aux_raw, memory_order_relaxed);
+}
+
+esp_err_t flame_flicker_start(const flame_flicker_config_t *cfg)
+{
+    if (cfg == NULL || cfg->channels == NULL || cfg->callback == NULL ||
+        cfg->num_channels <= 0 ||
+        cfg->num_channels + (cfg->aux_adc_channel >= 0 ? 1 : 0) > FLAME_FLICKER_MAX_CHANNELS) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_started) {
+        ESP_LOGE(TAG, "Already started.");
+        return ESP_FAIL;
+    }
+
+    s_num_channels = cfg->num_channels;
+    s_callback = cfg->callback;
+    for (int i = 0; i < s_num_channels; i++) {
+        s_channels[i] = cfg->channels[i];
+        flicker_init(&s_detectors[i], &cfg->flicker);
+    }
+
+    esp_err_t err = flame_flicker_backend_start(cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sample source failed to start: %d", err);
+        return err;
+    }
+    s_started = true;
+    ESP_LOGI(TAG, "Flicker analysis on %d channels (%d Hz, window %d, bins %u..%u)",
+             s_num_channels, FLICKER_SAMPLE_HZ, FLICKER_WINDOW,
+             cfg->flicker.bin_first, cfg->flicker.bin_last);
+    return ESP_OK;
+}
@@ -0,0 +1,55 @@
+// flame_flicker.h
+#ifndef FLAME_FLICKER_H
+#define FLAME_FLICKER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "flicker.h"
+
+/*
+ * Chế độ analog (tùy chọn) cho mảng cảm biến lửa: lấy mẫu ngõ AO của module
+ * bằng ADC continuous (DMA), hạ về FLICKER_SAMPLE_HZ bằng trung bình khối rồi
+ * đo năng lượng nhấp nháy từng kênh (flicker.h). Ngõ DO vẫn do flame_sensor xử lý;
+ * kết quả ở đây chỉ là độ tin cậy bổ sung cho phần đồng thuận.
+ *
+ * Ràng buộc phần cứng ESP32:
+ *   - Chỉ ADC1 (GPIO32..39) dùng được ở chế độ continuous và khi bật Wi-Fi.
+ *   - Khi continuous đang chạy, adc_oneshot trên ADC1 bị từ chối: kênh ADC1 khác
+ *     cần đọc (vd. MQ2) phải được đưa vào cùng pattern qua aux_adc_channel.
+ */
+
+#define FLAME_FLICKER_MAX_CHANNELS 7
+
+typedef struct {
+    int sensor_index;       // Chỉ số cảm biến trong mảng truyền cho flame_sensor_init
+    int adc_channel;        // Kênh ADC1 (ADC_CHANNEL_x) nối với ngõ AO
+} flame_flicker_channel_t;
+
+/**
+ * @brief Callback sau mỗi lần phân tích một kênh (mỗi FLICKER_HOP mẫu).
+ * Chạy trong task lấy mẫu: phải ngắn, không chặn.
+ */
+typedef void (*flame_flicker_cb_t)(int sensor_index, const flicker_result_t *result);
+
+typedef struct {
+    const flame_flicker_channel_t *channels;
+    int num_channels;
+    int aux_adc_channel;            // -1: không dùng
+    flicker_config_t flicker;
+    flame_flicker_cb_t callback;
+} flame_flicker_config_t;
+
+/**
+ * @brief Khởi động lấy mẫu và phân tích nhấp nháy.
+ * @return ESP_ERR_INVALID_ARG nếu cấu hình sai, lỗi của driver ADC nếu không khởi tạo được.
+ */
+esp_err_t flame_flicker_start(const flame_flicker_config_t *cfg);
+
+/**
+ * @brief Giá trị thô (trung bình 1/FLICKER_SAMPLE_HZ gần nhất) của kênh aux.
+ * Dùng làm nguồn đọc cho mq2 khi ADC1 đang ở chế độ continuous.
+ * @return -1 nếu chưa có mẫu hoặc không cấu hình aux.
+ */
+int flame_flicker_read_aux(void);
+
+#endif // FLAME_FLICKER_H
@@ -0,0 +1,164 @@
+// flame_flicker_adc.c - nguồn mẫu ESP32: ADC1 continuous (DMA), trung bình khối về FLICKER_SAMPLE_HZ
+#include "flame_flicker_backend.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_adc/adc_continuous.h"
+
+static const char *TAG = "FLAME_FLICKER";
+
+// Tốc độ tổng thấp nhất driver continuous của ESP32 chấp nhận (SOC_ADC_SAMPLE_FREQ_THRES_LOW)
+#define FLICKER_ADC_MIN_TOTAL_HZ    20000
+#define FLICKER_ADC_FRAME_BYTES     256     // Một lần DMA báo xong: 128 kết quả 2 byte
+#define FLICKER_ADC_POOL_BYTES      1024
+#define FLICKER_ADC_TASK_PRIO       9       // Dưới flame_sensor_task (10), trên cảm biến chậm
+#define FLICKER_SLOT_NONE           0xFF
+#define FLICKER_SLOT_AUX            0xFE
+
+typedef struct {
+    uint32_t sum;
+    uint16_t count;
+} flicker_acc_t;
+
+static adc_continuous_handle_t s_adc = NULL;
+static TaskHandle_t s_task = NULL;
+static uint8_t s_slot_of_channel[SOC_ADC_CHANNEL_NUM(ADC_UNIT_1)];
+static flicker_acc_t s_acc[FLAME_FLICKER_MAX_CHANNELS + 1];    // +1: aux
+static uint16_t s_decim = 1;
+static uint32_t s_pool_overflows = 0;
+
+static bool IRAM_ATTR flicker_conv_done_cb(adc_continuous_handle_t handle,
+                                           const adc_continuous_evt_data_t *edata, void *user_data)
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_task, &woken);
+    return woken == pdTRUE;
+}
+
+static bool IRAM_ATTR flicker_pool_ovf_cb(adc_continuous_handle_t handle,
+                                          const adc_continuous_evt_data_t *edata, void *user_data)
+{
+    s_pool_overflows++;
+    return false;
+}
+
+// Cộng dồn từng kết quả vào kênh của nó; đủ s_decim mẫu thì ra một mẫu 100 Hz
+static void flicker_consume(const uint8_t *buf, uint32_t len)
+{
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&buf[i];
+        const uint32_t ch = p->type1.channel;
+        if (ch >= SOC_ADC_CHANNEL_NUM(ADC_UNIT_1)) continue;
+        const uint8_t slot = s_slot_of_channel[ch];
+        if (slot == FLICKER_SLOT_NONE) continue;
+
+        flicker_acc_t *acc = &s_acc[slot == FLICKER_SLOT_AUX ? FLAME_FLICKER_MAX_CHANNELS : slot];
+        acc->sum += p->type1.data;
+        if (++acc->count < s_decim) continue;
+
+        const uint16_t sample = (uint16_t)(acc->sum / acc->count);
+        acc->sum = 0;
+        acc->count = 0;
+        if (slot == FLICKER_SLOT_AUX) {
+            flame_flicker_set_aux(sample);
+        } else {
+            flame_flicker_feed(slot, sample);
+        }
+    }
+}
+
+static void flicker_adc_task(void *arg)
+{
+    uint8_t buf[FLICKER_ADC_FRAME_BYTES];
+    uint32_t last_ovf = 0;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t len = 0;
+        while (adc_continuous_read(s_adc, buf, sizeof(buf), &len, 0) == ESP_OK) {
+            flicker_consume(buf, len);
+        }
+        if (s_pool_overflows != last_ovf) {
+            last_ovf = s_pool_overflows;
+            ESP_LOGW(TAG, "ADC pool overflow (%lu), samples dropped", (unsigned long)last_ovf);
+        }
+    }
+}
+
+static esp_err_t flicker_adc_configure(adc_digi_pattern_config_t *pattern, int n, uint32_t total_hz)
+{
+    adc_continuous_config_t dig_cfg = {
+        .pattern_num = n,
+        .adc_pattern = pattern,
+        .sample_freq_hz = total_hz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    esp_err_t err = adc_continuous_config(s_adc, &dig_cfg);
+    if (err != ESP_OK) return err;
+
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = flicker_conv_done_cb,
+        .on_pool_ovf = flicker_pool_ovf_cb,
+    };
+    err = adc_continuous_register_event_callbacks(s_adc, &cbs, NULL);
+    if (err != ESP_OK) return err;
+
+    if (xTaskCreate(flicker_adc_task, "flicker_adc", 3072, NULL, FLICKER_ADC_TASK_PRIO, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = adc_continuous_start(s_adc);
+    if (err != ESP_OK) {
+        vTaskDelete(s_task);
+        s_task = NULL;
+    }
+    return err;
+}
+
+esp_err_t flame_flicker_backend_start(const flame_flicker_config_t *cfg)
+{
+    memset(s_slot_of_channel, FLICKER_SLOT_NONE, sizeof(s_slot_of_channel));
+
+    adc_digi_pattern_config_t pattern[FLAME_FLICKER_MAX_CHANNELS];
+    int n = 0;
+    for (int i = 0; i <= cfg->num_channels; i++) {
+        const bool aux = (i == cfg->num_channels);
+        const int ch = aux ? cfg->aux_adc_channel : cfg->channels[i].adc_channel;
+        if (aux && ch < 0) break;
+        if (ch < 0 || ch >= SOC_ADC_CHANNEL_NUM(ADC_UNIT_1) || s_slot_of_channel[ch] != FLICKER_SLOT_NONE) {
+            ESP_LOGE(TAG, "ADC1 channel %d invalid or used twice", ch);
+            return ESP_ERR_INVALID_ARG;
+        }
+        s_slot_of_channel[ch] = aux ? FLICKER_SLOT_AUX : (uint8_t)i;
+        pattern[n++] = (adc_digi_pattern_config_t){
+            .atten = ADC_ATTEN_DB_12,           // AO của module 0..3.3 V
+            .channel = (uint8_t)ch,
+            .unit = ADC_UNIT_1,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+        };
+    }
+
+    // Mỗi kênh được lấy s_decim mẫu cho một mẫu 100 Hz; trung bình khối 10 ms cũng
+    // triệt nhấp nháy 100 Hz của đèn và làm bộ lọc chống alias
+    const uint32_t per_sample = (uint32_t)n * FLICKER_SAMPLE_HZ;
+    s_decim = (uint16_t)((FLICKER_ADC_MIN_TOTAL_HZ + per_sample - 1) / per_sample);
+    const uint32_t total_hz = s_decim * per_sample;
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = FLICKER_ADC_POOL_BYTES,
+        .conv_frame_size = FLICKER_ADC_FRAME_BYTES,
+    };
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &s_adc);
+    if (err != ESP_OK) return err;
+
+    err = flicker_adc_configure(pattern, n, total_hz);
+    if (err != ESP_OK) {
+        adc_continuous_deinit(s_adc);
+        s_adc = NULL;
+        return err;
+    }
+    ESP_LOGI(TAG, "ADC1 continuous: %d channels, %lu Hz total, decimate %u",
+             n, (unsigned long)total_hz, s_decim);
+    return ESP_OK;
+}
@@ -0,0 +1,17 @@
+// flame_flicker_backend.h - giao tiếp nội bộ giữa phần phân tích chung và nguồn mẫu (ADC / sim)
+#ifndef FLAME_FLICKER_BACKEND_H
+#define FLAME_FLICKER_BACKEND_H
+
+#include <stdint.h>
+#include "flame_flicker.h"
+
+/**
+ * @brief Khởi động nguồn mẫu. Mỗi mẫu đã hạ tốc độ của kênh @p slot (chỉ số trong
+ * cfg->channels) được đưa vào flame_flicker_feed(); kênh aux ghi qua flame_flicker_set_aux().
+ */
+esp_err_t flame_flicker_backend_start(const flame_flicker_config_t *cfg);
+
+void flame_flicker_feed(int slot, uint16_t sample);
+void flame_flicker_set_aux(uint16_t sample);
+
+#endif // FLAME_FLICKER_BACKEND_H
@@ -0,0 +1,41 @@
+// flame_flicker_linux.c - nguồn mẫu target linux: ngõ AO lấy từ kịch bản mô phỏng (lệnh ao / ao_replay)
+#include "flame_flicker_backend.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sim.h"
+
+static const char *TAG = "FLAME_FLICKER";
+
+static flame_flicker_channel_t s_sim_channels[FLAME_FLICKER_MAX_CHANNELS];
+static int s_sim_num_channels = 0;
+
+// Mỗi tick 10 ms một mẫu cho mỗi kênh; kênh chưa có lệnh ao trong kịch bản thì không có mẫu,
+// nên cảm biến đó hành xử như chỉ có ngõ digital
+static void flicker_sim_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    const TickType_t period = pdMS_TO_TICKS(1000 / FLICKER_SAMPLE_HZ) ? pdMS_TO_TICKS(1000 / FLICKER_SAMPLE_HZ) : 1;
+    while (1) {
+        vTaskDelayUntil(&last_wake, period);
+        for (int i = 0; i < s_sim_num_channels; i++) {
+            const int raw = sim_flame_ao(s_sim_channels[i].sensor_index);
+            if (raw >= 0) {
+                flame_flicker_feed(i, (uint16_t)raw);
+            }
+        }
+    }
+}
+
+esp_err_t flame_flicker_backend_start(const flame_flicker_config_t *cfg)
+{
+    s_sim_num_channels = cfg->num_channels;
+    for (int i = 0; i < cfg->num_channels; i++) {
+        s_sim_channels[i] = cfg->channels[i];
+    }
+    if (xTaskCreate(flicker_sim_task, "flicker_sim", 4096, NULL, 9, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Simulated AO source (%d channels, scenario 'ao' commands)", cfg->num_channels);
+    return ESP_OK;
+}
@@ -5,8 +5,11 @@
 #include "freertos/queue.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
+#include "gpio_hub.h"
+#include "binlog.h"
 #include <stdlib.h> // For malloc, free
 #include <string.h> // For memcpy
+#include <stdio.h>
 
 static const char *TAG = "FLAME_SENSOR_LIB";
 
@@ -27,11 +30,11 @@ static flame_sensor_event_cb_t user_callback = NULL;
 static QueueHandle_t sensor_evt_queue = NULL;
 static TaskHandle_t sensor_task_handle = NULL;
 
-/* ---------- ISR: chỉ đẩy INDEX của cảm biến vào queue ---------- */
-// Rất nhanh và hiệu quả, không tìm kiếm gì trong task nữa
-static void IRAM_ATTR flame_isr_handler(void *arg) {
-    int sensor_index = (int)arg;
-    xQueueSendFromISR(sensor_evt_queue, &sensor_index, NULL);
+/* ---------- Consumer của GPIO hub: chỉ đẩy INDEX của cảm biến vào queue ---------- */
+// Chạy trong task dispatch của hub nên không được chặn: queue đầy thì bỏ (cạnh sau sẽ đọc lại mức chân)
+static void flame_edge_cb(gpio_num_t pin, const gpio_hub_edge_t *edge, void *ctx) {
+    int sensor_index = (int)(intptr_t)ctx;
+    xQueueSend(sensor_evt_queue, &sensor_index, 0);
 }
 
 /* ---------- Task xử lý sự kiện: debounce không chặn và gọi callback ---------- */
@@ -53,7 +56,7 @@ static void flame_sensor_task(void *arg) {
             // Nếu trạng thái thay đổi so với trạng thái đã lưu, cập nhật và gọi callback
             if (is_flame_detected != sensors_info[sensor_index].current_state) {
                 sensors_info[sensor_index].current_state = is_flame_detected;
-                ESP_LOGI(TAG, "Sensor index %d (GPIO %d) state changed: %s",
+                BLOGI(TAG, "Sensor index %d (GPIO %d) state changed: %s",
                          sensor_index, sensors_info[sensor_index].pin,
                          is_flame_detected ? "FLAME DETECTED" : "NO FLAME");
 
@@ -88,29 +91,32 @@ esp_err_t flame_sensor_init(const gpio_num_t* pins, int count, flame_sensor_even
         return ESP_ERR_NO_MEM;
     }
 
-    // Tạo queue và cài đặt ISR service
+    // Tạo queue; ngắt do GPIO hub quản lý (một ISR chung cho mọi input)
     sensor_evt_queue = xQueueCreate(10, sizeof(int)); // Queue chứa index (int)
-    gpio_install_isr_service(0);
 
     // Cấu hình từng pin
     for (int i = 0; i < num_sensors; i++) {
         sensors_info[i].pin = pins[i];
         sensors_info[i].last_intr_time = 0;
 
-        gpio_config_t io_conf = {
-            .pin_bit_mask = (1ULL << pins[i]),
-            .mode = GPIO_MODE_INPUT,
-            .pull_up_en = GPIO_PULLUP_ENABLE,
-            .pull_down_en = GPIO_PULLDOWN_DISABLE,
-            .intr_type = GPIO_INTR_ANYEDGE // Ngắt cả 2 cạnh
+        char name[12];
+        snprintf(name, sizeof(name), "flame%d", i);
+        gpio_hub_source_config_t src_cfg = {
+            .pin = pins[i],
+            .name = name,
+            .intr_type = GPIO_INTR_ANYEDGE, // Ngắt cả 2 cạnh
+            .pull_up = true,
+            .cb = flame_edge_cb,
+            .ctx = (void*)(intptr_t)i,      // Truyền INDEX thay vì PIN
         };
-        gpio_config(&io_conf);
-        
+        esp_err_t err = gpio_hub_register(&src_cfg);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register GPIO %d with hub: %d", pins[i], err);
+            return err;
+        }
+
         // Đọc và lưu trạng thái ban đầu
         sensors_info[i].current_state = (gpio_get_level(pins[i]) == 0);
-
-        // **[Cải tiến] Thêm ISR handler, truyền vào INDEX thay vì PIN**
-        gpio_isr_handler_add(pins[i], flame_isr_handler, (void*)i);
     }
 
     // Tạo task xử lý nền
@@ -0,0 +1,247 @@
+// flood.c - cache chống trùng, trạng thái từng nút gốc và hàng chờ phát lại có jitter
+#include "flood.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+// seq lùi trong khoảng này so với khung mới nhất của origin: khung cũ đi đường vòng tới muộn.
+// Lùi xa hơn: origin khởi động lại với seq ngẫu nhiên mới
+#define FLOOD_STALE_WINDOW      64
+
+typedef struct {
+    uint8_t origin[FLOOD_ORIGIN_LEN];
+    uint16_t seq;
+    uint8_t heard;              // Số lần đã nghe (lần đầu + các bản phát lại)
+} flood_seen_t;
+
+typedef struct {
+    bool used;
+    uint8_t origin[FLOOD_ORIGIN_LEN];
+    uint16_t seq;
+    uint8_t cmd;
+    int64_t last_rx_us;
+} flood_origin_t;
+
+typedef struct {
+    bool used;
+    flood_frame_t frame;
+    int64_t rx_us;
+    int64_t due_us;
+} flood_pending_t;
+
+static uint8_t s_self[FLOOD_ORIGIN_LEN];
+static uint16_t s_seq;
+static uint32_t s_rng = 1;
+static uint32_t s_hop_air_us;
+static flood_seen_t s_seen[FLOOD_DUP_CACHE];
+static int s_seen_next = 0;
+static flood_origin_t s_origins[FLOOD_MAX_ORIGINS];
+static flood_pending_t s_pending[FLOOD_PENDING];
+static flood_stats_t s_stats;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;   // Originate có thể chạy ở task cảm biến/nút
+
+// xorshift32: chỉ cần các nút nhận cùng một khung chọn jitter khác nhau
+static uint32_t flood_rand(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+void flood_init(const uint8_t self[FLOOD_ORIGIN_LEN], uint32_t seed, uint32_t hop_air_us)
+{
+    portENTER_CRITICAL(&s_mux);
+    memcpy(s_self, self, FLOOD_ORIGIN_LEN);
+    s_hop_air_us = hop_air_us;
+    s_rng = seed ^ ((uint32_t)self[2] << 24 | (uint32_t)self[3] << 16 | (uint32_t)self[4] << 8 | self[5]);
+    if (s_rng == 0) s_rng = 1;
+    s_seq = (uint16_t)flood_rand();
+    portEXIT_CRITICAL(&s_mux);
+}
+
+// Gọi khi giữ s_mux
+static flood_seen_t *flood_seen_find(const uint8_t origin[FLOOD_ORIGIN_LEN], uint16_t seq)
+{
+    for (int i = 0; i < FLOOD_DUP_CACHE; i++) {
+        if (s_seen[i].heard && s_seen[i].seq == seq && memcmp(s_seen[i].origin, origin, FLOOD_ORIGIN_LEN) == 0) {
+            return &s_seen[i];
+        }
+    }
+    return NULL;
+}
+
+// Ghi đè vòng tròn: cặp cũ nhất bị quên trước (gọi khi giữ s_mux)
+static void flood_seen_add(const uint8_t origin[FLOOD_ORIGIN_LEN], uint16_t seq)
+{
+    flood_seen_t *e = &s_seen[s_seen_next];
+    s_seen_next = (s_seen_next + 1) % FLOOD_DUP_CACHE;
+    memcpy(e->origin, origin, FLOOD_ORIGIN_LEN);
+    e->seq = seq;
+    e->heard = 1;
+}
+
+/**
+ * Slot của origin, hoặc slot trống / origin không cháy im lâu nhất cho origin mới (gọi khi giữ s_mux).
+ * Origin đang báo cháy không bao giờ bị đẩy ra: quên nó thì flood_remote_active tắt còi sai.
+ * NULL khi mọi slot đều đang cháy.
+ */
+static flood_origin_t *flood_origin_slot(const uint8_t origin[FLOOD_ORIGIN_LEN])
+{
+    for (int i = 0; i < FLOOD_MAX_ORIGINS; i++) {
+        if (s_origins[i].used && memcmp(s_origins[i].origin, origin, FLOOD_ORIGIN_LEN) == 0) return &s_origins[i];
+    }
+    flood_origin_t *victim = NULL;
+    for (int i = 0; i < FLOOD_MAX_ORIGINS; i++) {
+        flood_origin_t *o = &s_origins[i];
+        if (!o->used) {
+            victim = o;
+            break;
+        }
+        if (o->cmd != 1 && (victim == NULL || o->last_rx_us < victim->last_rx_us)) victim = o;
+    }
+    if (victim != NULL) memset(victim, 0, sizeof(*victim));
+    return victim;
+}
+
+void flood_originate(flood_frame_t *out, uint8_t cmd, uint8_t ttl)
+{
+    portENTER_CRITICAL(&s_mux);
+    memset(out, 0, sizeof(*out));
+    out->type = FLOOD_FRAME_ALARM;
+    out->cmd = cmd;
+    out->ttl = ttl > FLOOD_MAX_HOPS ? FLOOD_MAX_HOPS : ttl;
+    memcpy(out->origin, s_self, FLOOD_ORIGIN_LEN);
+    out->seq = ++s_seq;
+    flood_seen_add(out->origin, out->seq);
+    s_stats.originated++;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+// Mọi phần đều là hiệu của cùng một đồng hồ đơn điệu trên cùng một nút (gọi khi giữ s_mux).
+// Chưa tính hàng đợi/CSMA trước khi origin phát: origin gửi ngay, không có jitter
+static void flood_record_latency(const flood_frame_t *frame, int64_t rx_us, int64_t now_us)
+{
+    if (frame->hops >= FLOOD_MAX_HOPS) return;
+    flood_hop_stats_t *h = &s_stats.hop[frame->hops];
+    const int64_t queued_us = now_us > rx_us ? now_us - rx_us : 0;
+    h->last_us = frame->hold_us + (uint32_t)queued_us + (uint32_t)(frame->hops + 1) * s_hop_air_us;
+    if (h->last_us > h->max_us) h->max_us = h->last_us;
+    h->hold_us = frame->hold_us;
+    h->n++;
+}
+
+// Gọi khi giữ s_mux
+static void flood_schedule_relay(const flood_frame_t *frame, int64_t now_us)
+{
+    for (int i = 0; i < FLOOD_PENDING; i++) {
+        flood_pending_t *p = &s_pending[i];
+        if (p->used) continue;
+        p->used = true;
+        p->frame = *frame;
+        p->frame.ttl--;
+        p->frame.hops++;
+        p->rx_us = now_us;
+        const uint32_t span_ms = FLOOD_JITTER_MAX_MS - FLOOD_JITTER_MIN_MS + 1;
+        p->due_us = now_us + (int64_t)(FLOOD_JITTER_MIN_MS + flood_rand() % span_ms) * 1000;
+        return;
+    }
+    s_stats.pending_full++;
+}
+
+flood_rx_t flood_rx(const flood_frame_t *frame, int64_t rx_us, int64_t now_us)
+{
+    if (frame->type != FLOOD_FRAME_ALARM || frame->ttl == 0 || frame->ttl > FLOOD_MAX_HOPS ||
+        frame->hops >= FLOOD_MAX_HOPS) {
+        return FLOOD_RX_INVALID;
+    }
+    flood_rx_t ret = FLOOD_RX_NEW;
+    portENTER_CRITICAL(&s_mux);
+    flood_seen_t *seen = flood_seen_find(frame->origin, frame->seq);
+    if (memcmp(frame->origin, s_self, FLOOD_ORIGIN_LEN) == 0) {
+        if (seen != NULL && seen->heard < UINT8_MAX) seen->heard++;
+        ret = FLOOD_RX_OWN;
+    } else if (seen != NULL) {
+        if (seen->heard < UINT8_MAX) seen->heard++;
+        s_stats.rx_dup++;
+        ret = FLOOD_RX_DUP;
+    } else {
+        flood_seen_add(frame->origin, frame->seq);
+        flood_origin_t *o = flood_origin_slot(frame->origin);
+        const int16_t diff = o != NULL ? (int16_t)(frame->seq - o->seq) : 0;
+        if (o != NULL && o->used && diff <= 0 && diff > -FLOOD_STALE_WINDOW) {
+            s_stats.rx_stale++;
+            ret = FLOOD_RX_STALE;
+        } else {
+            // Hết slot: vẫn phát lại cho nút sau; còi vẫn bật vì mọi origin đang nhớ đều cháy
+            if (o != NULL) {
+                o->used = true;
+                memcpy(o->origin, frame->origin, FLOOD_ORIGIN_LEN);
+                o->seq = frame->seq;
+                o->cmd = frame->cmd;
+                o->last_rx_us = rx_us;
+            } else {
+                s_stats.origins_full++;
+            }
+            s_stats.rx_new++;
+            flood_record_latency(frame, rx_us, now_us);
+            if (frame->ttl > 1) flood_schedule_relay(frame, rx_us);
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return ret;
+}
+
+int flood_relay_due(flood_frame_t *out, int max, int64_t now_us, int64_t *next_due_us)
+{
+    int n = 0;
+    int64_t next = 0;
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < FLOOD_PENDING; i++) {
+        flood_pending_t *p = &s_pending[i];
+        if (!p->used) continue;
+        if (p->due_us > now_us || n >= max) {
+            if (next == 0 || p->due_us < next) next = p->due_us;
+            continue;
+        }
+        p->used = false;
+        const flood_seen_t *seen = flood_seen_find(p->frame.origin, p->frame.seq);
+        if (seen != NULL && seen->heard > FLOOD_SUPPRESS_COUNT) {
+            s_stats.suppressed++;
+            continue;
+        }
+        out[n] = p->frame;
+        out[n].hold_us += (uint32_t)(now_us - p->rx_us);
+        n++;
+        s_stats.relayed++;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    *next_due_us = next;
+    return n;
+}
+
+bool flood_remote_active(void)
+{
+    bool active = false;
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < FLOOD_MAX_ORIGINS && !active; i++) {
+        active = s_origins[i].used && s_origins[i].cmd == 1;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return active;
+}
+
+void flood_clear_remote(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < FLOOD_MAX_ORIGINS; i++) {
+        s_origins[i].cmd = 0;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void flood_get_stats(flood_stats_t *out)
+{
+    portENTER_CRITICAL(&s_mux);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_mux);
+}
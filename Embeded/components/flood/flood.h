@@ -0,0 +1,117 @@
+// flood.h
+#ifndef FLOOD_H
+#define FLOOD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Lan truyền cảnh báo cháy nhiều bước qua ESP-NOW (controlled flooding), không cần Wi-Fi:
+ * - Nút phát hiện cháy (origin) broadcast khung kèm MAC gốc, số thứ tự và TTL.
+ * - Nút nhận lần đầu một cặp (origin, seq) thì áp trạng thái rồi phát lại sau một khoảng
+ *   jitter ngẫu nhiên với TTL - 1; cặp đã thấy bị bỏ (cache chống trùng).
+ * - Trong lúc chờ jitter mà đã nghe đủ FLOOD_SUPPRESS_COUNT nút khác phát lại cùng khung
+ *   thì hủy lượt phát của mình: vùng dày đặc không nhân số khung lên theo số nút.
+ *
+ * Trễ tối đa tới nút cách origin h bước: h * (FLOOD_JITTER_MAX_MS + thời gian hàng đợi và
+ * phát sóng của một khung). Component không gửi/nhận gì; radio và timer nằm ở main.
+ *
+ * Trễ được đo bằng đồng hồ đơn điệu của từng nút, không cần SNTP (lưới không Wi-Fi không có giờ):
+ * mỗi relay cộng thời gian mình giữ khung vào hold_us, nút nhận cộng thêm thời gian khung nằm
+ * trong hàng đợi của mình và airtime ước lượng của từng bước.
+ */
+
+#define FLOOD_FRAME_ALARM       0xA4    // Byte đầu khung; cạnh các khung hub 0xA1..0xA3, 0xA5
+#define FLOOD_ORIGIN_LEN        6       // MAC station của nút gốc
+
+#ifndef FLOOD_MAX_HOPS
+#define FLOOD_MAX_HOPS          8       // TTL lớn nhất chấp nhận, cũng là số ô thống kê trễ
+#endif
+#ifndef FLOOD_DUP_CACHE
+#define FLOOD_DUP_CACHE         32      // Cặp (origin, seq) gần nhất; > số khung lan trong một jitter
+#endif
+#ifndef FLOOD_MAX_ORIGINS
+#define FLOOD_MAX_ORIGINS       16      // Số nút gốc được nhớ trạng thái
+#endif
+#ifndef FLOOD_PENDING
+#define FLOOD_PENDING           8       // Khung đang chờ phát lại
+#endif
+#ifndef FLOOD_JITTER_MIN_MS
+#define FLOOD_JITTER_MIN_MS     2
+#endif
+#ifndef FLOOD_JITTER_MAX_MS
+#define FLOOD_JITTER_MAX_MS     20      // ~20 khung 20 byte ở 1 Mbps: đủ rộng để các nút lệch nhau
+#endif
+#ifndef FLOOD_SUPPRESS_COUNT
+#define FLOOD_SUPPRESS_COUNT    2       // Số bản phát lại nghe được thì tự hủy lượt của mình
+#endif
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;               // FLOOD_FRAME_ALARM
+    uint8_t cmd;                // 0 = an toàn, 1 = cháy (như espnow_payload_t.cmd)
+    uint8_t ttl;                // Số bước còn được phát lại
+    uint8_t hops;               // Số lần đã được phát lại; nút nhận cách origin hops + 1 bước
+    uint8_t origin[FLOOD_ORIGIN_LEN];
+    uint16_t seq;               // Tăng mỗi khung của origin; bắt đầu ngẫu nhiên sau khởi động
+    uint32_t hold_us;           // Tổng thời gian các relay giữ khung (jitter + hàng đợi), đo tại từng relay
+} flood_frame_t;
+
+typedef enum {
+    FLOOD_RX_NEW = 0,           // Lần đầu thấy: áp trạng thái, có thể đã xếp lịch phát lại
+    FLOOD_RX_DUP,               // Đã thấy (origin, seq)
+    FLOOD_RX_STALE,             // Cũ hơn trạng thái đã biết của origin (đến qua đường dài hơn)
+    FLOOD_RX_OWN,               // Khung của chính mình vọng lại
+    FLOOD_RX_INVALID,
+} flood_rx_t;
+
+typedef struct {
+    uint32_t n;
+    uint32_t last_us;           // hold_us + hàng đợi ở nút nhận + (hops + 1) * airtime một bước
+    uint32_t max_us;
+    uint32_t hold_us;           // Phần của last_us nằm ở các relay (jitter + hàng đợi)
+} flood_hop_stats_t;
+
+typedef struct {
+    uint32_t originated;
+    uint32_t rx_new;
+    uint32_t rx_dup;
+    uint32_t rx_stale;
+    uint32_t relayed;
+    uint32_t suppressed;        // Lượt phát lại bị hủy vì đã nghe đủ bản phát lại khác
+    uint32_t pending_full;
+    uint32_t origins_full;      // Khung từ origin mới không được nhớ vì mọi slot đều đang cháy
+    flood_hop_stats_t hop[FLOOD_MAX_HOPS];  // hop[i]: khung đến sau i + 1 bước
+} flood_stats_t;
+
+/**
+ * @brief Gọi một lần khi đã biết MAC; @p seed làm lệch jitter và seq đầu giữa các nút/lần khởi động.
+ * @param hop_air_us Airtime ước lượng của một khung trên một bước, cộng vào trễ đo được.
+ */
+void flood_init(const uint8_t self[FLOOD_ORIGIN_LEN], uint32_t seed, uint32_t hop_air_us);
+
+/** @brief Tạo khung gốc cho trạng thái @p cmd và ghi nó vào cache (tiếng vọng bị bỏ). */
+void flood_originate(flood_frame_t *out, uint8_t cmd, uint8_t ttl);
+
+/**
+ * @brief Xử lý một khung nhận được (gọi từ một task duy nhất).
+ * Khung mới có TTL > 1 được xếp lịch phát lại, thời gian giữ tính từ @p rx_us (esp_timer lúc radio
+ * nhận); @p now_us là lúc xử lý, phần chênh là thời gian nằm trong hàng đợi của nút này.
+ */
+flood_rx_t flood_rx(const flood_frame_t *frame, int64_t rx_us, int64_t now_us);
+
+/**
+ * @brief Lấy các khung đã tới hạn phát lại (đã giảm TTL, cộng thời gian giữ).
+ * @param next_due_us Thời điểm (esp_timer) của khung chờ kế tiếp, 0 nếu không còn.
+ * @return Số khung chép vào @p out.
+ */
+int flood_relay_due(flood_frame_t *out, int max, int64_t now_us, int64_t *next_due_us);
+
+/** @brief Có nút gốc nào (khác chính mình) đang báo cháy. */
+bool flood_remote_active(void);
+
+/** @brief Quên trạng thái cháy của các nút gốc (nút reset); origin còn cháy sẽ báo lại ở lượt làm mới. */
+void flood_clear_remote(void);
+
+void flood_get_stats(flood_stats_t *out);
+
+#endif // FLOOD_H
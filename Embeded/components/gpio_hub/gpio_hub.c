@@ -0,0 +1,321 @@
+// gpio_hub.c
+#include "gpio_hub.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#include "esp_intr_alloc.h"
+#include "hal/gpio_ll.h"
+#endif
+
+static const char *TAG = "GPIO_HUB";
+
+#define GPIO_HUB_RATE_WINDOW_US 1000000
+
+#if CONFIG_IDF_TARGET_LINUX
+#define GPIO_HUB_INTR_FLAGS     0
+#define hub_read_level(pin)     gpio_get_level(pin)
+#define hub_ring_calloc(n, sz)  calloc((n), (sz))
+#else
+#define GPIO_HUB_INTR_FLAGS     (GPIO_HUB_ISR_IRAM ? ESP_INTR_FLAG_IRAM : 0)
+// gpio_get_level() nằm trong flash (trừ khi bật CONFIG_GPIO_CTRL_FUNC_IN_IRAM), đọc thẳng thanh ghi
+#define hub_read_level(pin)     gpio_ll_get_level(&GPIO, (pin))
+// Ring được ISR ghi khi cache tắt: bắt buộc ở RAM nội
+#define hub_ring_calloc(n, sz)  heap_caps_calloc((n), (sz), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#endif
+
+typedef struct {
+    gpio_num_t pin;
+    bool active;
+    bool bulk;                  // Drain bởi task bulk thay vì task dispatch
+    char name[12];
+    gpio_hub_cb_t cb;
+    void *ctx;
+
+    // Ring SPSC: ISR chỉ ghi head, task dispatch chỉ ghi tail
+    gpio_hub_edge_t *ring;
+    uint32_t mask;
+    uint16_t capacity;          // Dung lượng đã cấp phát (giữ lại để đăng ký lại)
+    atomic_uint head;
+    atomic_uint tail;
+
+    atomic_uint edges;
+    atomic_uint overflows;
+    uint32_t window_edges;
+    uint32_t rate_hz;
+    uint16_t max_depth;
+} gpio_hub_source_t;
+
+static DRAM_ATTR gpio_hub_source_t s_sources[GPIO_HUB_MAX_SOURCES];
+static DRAM_ATTR TaskHandle_t s_dispatch_task = NULL;
+static DRAM_ATTR TaskHandle_t s_bulk_task = NULL;
+static portMUX_TYPE s_hub_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* ---------- ISR chung: timestamp + mức chân vào ring của nguồn ---------- */
+static void IRAM_ATTR gpio_hub_isr(void *arg)
+{
+    gpio_hub_source_t *src = (gpio_hub_source_t *)arg;
+    const uint32_t ts = (uint32_t)esp_timer_get_time();
+    const uint8_t level = (uint8_t)hub_read_level(src->pin);
+
+    atomic_fetch_add_explicit(&src->edges, 1, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&src->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&src->tail, memory_order_acquire);
+    bool wake = !src->bulk;
+    if (head - tail > src->mask) {
+        atomic_fetch_add_explicit(&src->overflows, 1, memory_order_relaxed);
+        wake = true;
+    } else {
+        src->ring[head & src->mask] = (gpio_hub_edge_t){ .ts_us = ts, .level = level };
+        atomic_store_explicit(&src->head, head + 1, memory_order_release);
+        // Nguồn bulk chỉ đánh thức task khi ring vừa đầy một nửa, còn lại chờ chu kỳ lô
+        if (head + 1 - tail == (src->mask + 1) / 2) wake = true;
+    }
+    if (!wake) return;
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(src->bulk ? s_bulk_task : s_dispatch_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/* ---------- Drain: trộn ring các nguồn cùng nhóm theo timestamp, gọi consumer ---------- */
+static void gpio_hub_drain(bool bulk)
+{
+    gpio_hub_source_t *srcs[GPIO_HUB_MAX_SOURCES];
+    gpio_hub_cb_t cbs[GPIO_HUB_MAX_SOURCES];
+    void *ctxs[GPIO_HUB_MAX_SOURCES];
+    uint32_t heads[GPIO_HUB_MAX_SOURCES];
+    int n = 0;
+
+    // Chụp head của mọi nguồn trước: cạnh đến sau lượt drain này để lượt sau
+    for (int i = 0; i < GPIO_HUB_MAX_SOURCES; i++) {
+        gpio_hub_source_t *src = &s_sources[i];
+        gpio_hub_cb_t cb;
+        void *ctx;
+        portENTER_CRITICAL(&s_hub_mux);
+        cb = (src->active && src->bulk == bulk) ? src->cb : NULL;
+        ctx = src->ctx;
+        portEXIT_CRITICAL(&s_hub_mux);
+        if (cb == NULL) continue;
+
+        const uint32_t tail = atomic_load_explicit(&src->tail, memory_order_relaxed);
+        const uint32_t head = atomic_load_explicit(&src->head, memory_order_acquire);
+        if (head == tail) continue;
+        if (head - tail > src->max_depth) {
+            src->max_depth = (uint16_t)(head - tail);
+        }
+        srcs[n] = src;
+        cbs[n] = cb;
+        ctxs[n] = ctx;
+        heads[n] = head;
+        n++;
+    }
+
+    while (n > 0) {
+        // Nguồn có cạnh đầu ring cũ nhất (hiệu số để đúng cả khi ts_us tràn)
+        int best = 0;
+        for (int k = 1; k < n; k++) {
+            const gpio_hub_source_t *a = srcs[k];
+            const gpio_hub_source_t *b = srcs[best];
+            const uint32_t ta = a->ring[atomic_load_explicit(&a->tail, memory_order_relaxed) & a->mask].ts_us;
+            const uint32_t tb = b->ring[atomic_load_explicit(&b->tail, memory_order_relaxed) & b->mask].ts_us;
+            if ((int32_t)(ta - tb) < 0) best = k;
+        }
+        gpio_hub_source_t *src = srcs[best];
+        uint32_t tail = atomic_load_explicit(&src->tail, memory_order_relaxed);
+        const gpio_hub_edge_t edge = src->ring[tail & src->mask];
+        atomic_store_explicit(&src->tail, ++tail, memory_order_release);
+        cbs[best](src->pin, &edge, ctxs[best]);
+
+        if (tail == heads[best]) {
+            n--;
+            srcs[best] = srcs[n];
+            cbs[best] = cbs[n];
+            ctxs[best] = ctxs[n];
+            heads[best] = heads[n];
+        }
+    }
+}
+
+/* ---------- Task dispatch: nguồn thường, đánh thức mỗi cạnh ---------- */
+static void gpio_hub_dispatch_task(void *arg)
+{
+    int64_t window_start = esp_timer_get_time();
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GPIO_HUB_RATE_WINDOW_US / 1000));
+        gpio_hub_drain(false);
+
+        const int64_t now = esp_timer_get_time();
+        if (now - window_start >= GPIO_HUB_RATE_WINDOW_US) {
+            const int64_t elapsed = now - window_start;
+            for (int i = 0; i < GPIO_HUB_MAX_SOURCES; i++) {
+                gpio_hub_source_t *src = &s_sources[i];
+                if (!src->active) continue;     // gpio_hub_register xóa bộ đếm khi slot còn inactive
+                const uint32_t edges = atomic_load_explicit(&src->edges, memory_order_relaxed);
+                src->rate_hz = (uint32_t)((int64_t)(edges - src->window_edges) * 1000000 / elapsed);
+                src->window_edges = edges;
+            }
+            window_start = now;
+        }
+    }
+}
+
+/* ---------- Task bulk: nguồn nhiều cạnh (RF), drain theo lô ở ưu tiên thấp ---------- */
+static void gpio_hub_bulk_task(void *arg)
+{
+    const TickType_t period = pdMS_TO_TICKS(GPIO_HUB_BULK_PERIOD_MS) ? pdMS_TO_TICKS(GPIO_HUB_BULK_PERIOD_MS) : 1;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, period);
+        gpio_hub_drain(true);
+    }
+}
+
+esp_err_t gpio_hub_init(void)
+{
+    if (s_dispatch_task != NULL) return ESP_OK;
+
+    esp_err_t err = gpio_install_isr_service(GPIO_HUB_INTR_FLAGS);
+    if (err == ESP_ERR_INVALID_STATE) {
+        // Service đã được cài ở nơi khác với cờ của nơi đó: ISR có thể không IRAM-safe
+        if (GPIO_HUB_INTR_FLAGS) ESP_LOGW(TAG, "GPIO ISR service installed elsewhere, IRAM flag not applied");
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "gpio_install_isr_service failed: %d", err);
+        return err;
+    }
+    if (xTaskCreate(gpio_hub_bulk_task, "gpio_hub_bulk", 3072, NULL,
+                    GPIO_HUB_BULK_TASK_PRIO, &s_bulk_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(gpio_hub_dispatch_task, "gpio_hub_task", 3072, NULL,
+                    GPIO_HUB_TASK_PRIO, &s_dispatch_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "GPIO hub ready (%d sources max, IRAM ISR %s)", GPIO_HUB_MAX_SOURCES,
+             GPIO_HUB_INTR_FLAGS ? "on" : "off");
+    return ESP_OK;
+}
+
+static gpio_hub_source_t *find_source(gpio_num_t pin)
+{
+    for (int i = 0; i < GPIO_HUB_MAX_SOURCES; i++) {
+        if (s_sources[i].active && s_sources[i].pin == pin) return &s_sources[i];
+    }
+    return NULL;
+}
+
+static uint16_t round_up_pow2(uint16_t n)
+{
+    uint16_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+esp_err_t gpio_hub_register(const gpio_hub_source_config_t *cfg)
+{
+    if (cfg == NULL || cfg->cb == NULL || cfg->pin < 0 || cfg->pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = gpio_hub_init();
+    if (err != ESP_OK) return err;
+    if (find_source(cfg->pin) != NULL) {
+        ESP_LOGE(TAG, "GPIO %d already registered", cfg->pin);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Chọn slot: ưu tiên slot cũ của chính chân này để tái dùng ring
+    gpio_hub_source_t *src = NULL;
+    for (int i = 0; i < GPIO_HUB_MAX_SOURCES && src == NULL; i++) {
+        if (!s_sources[i].active && s_sources[i].ring != NULL && s_sources[i].pin == cfg->pin) src = &s_sources[i];
+    }
+    for (int i = 0; i < GPIO_HUB_MAX_SOURCES && src == NULL; i++) {
+        if (!s_sources[i].active && s_sources[i].ring == NULL) src = &s_sources[i];
+    }
+    if (src == NULL) return ESP_ERR_NO_MEM;
+
+    const uint16_t size = round_up_pow2(cfg->ring_size ? cfg->ring_size : GPIO_HUB_DEFAULT_RING_SIZE);
+    if (src->capacity < size) {
+        // Ring cũ (nếu có) không còn được ISR/dispatch dùng vì slot đang inactive
+        free(src->ring);
+        src->ring = hub_ring_calloc(size, sizeof(gpio_hub_edge_t));
+        src->capacity = src->ring ? size : 0;
+        if (src->ring == NULL) return ESP_ERR_NO_MEM;
+    }
+
+    src->pin = cfg->pin;
+    snprintf(src->name, sizeof(src->name), "%s", cfg->name ? cfg->name : "gpio");
+    src->mask = size - 1;
+    atomic_store(&src->head, 0);
+    atomic_store(&src->tail, 0);
+    // Thống kê thuộc về lần đăng ký này: xóa cùng lúc, không trộn với lần đăng ký trước
+    atomic_store(&src->edges, 0);
+    atomic_store(&src->overflows, 0);
+    src->window_edges = 0;
+    src->rate_hz = 0;
+    src->max_depth = 0;
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = (1ULL << cfg->pin),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = cfg->pull_up ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = cfg->intr_type,
+    };
+    err = gpio_config(&io_conf);
+    if (err != ESP_OK) return err;
+
+    portENTER_CRITICAL(&s_hub_mux);
+    src->cb = cfg->cb;
+    src->ctx = cfg->ctx;
+    src->bulk = cfg->bulk;
+    src->active = true;
+    portEXIT_CRITICAL(&s_hub_mux);
+
+    err = gpio_isr_handler_add(cfg->pin, gpio_hub_isr, src);
+    if (err != ESP_OK) {
+        portENTER_CRITICAL(&s_hub_mux);
+        src->active = false;
+        portEXIT_CRITICAL(&s_hub_mux);
+        return err;
+    }
+    ESP_LOGI(TAG, "Registered '%s' on GPIO %d (ring %u%s)", src->name, cfg->pin, size, src->bulk ? ", bulk" : "");
+    return ESP_OK;
+}
+
+esp_err_t gpio_hub_unregister(gpio_num_t pin)
+{
+    gpio_hub_source_t *src = find_source(pin);
+    if (src == NULL) return ESP_ERR_NOT_FOUND;
+
+    gpio_isr_handler_remove(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+    portENTER_CRITICAL(&s_hub_mux);
+    src->active = false;
+    src->cb = NULL;
+    src->ctx = NULL;
+    portEXIT_CRITICAL(&s_hub_mux);
+    return ESP_OK;
+}
+
+int gpio_hub_get_stats(gpio_hub_stats_t *out, int max)
+{
+    int n = 0;
+    for (int i = 0; i < GPIO_HUB_MAX_SOURCES && n < max; i++) {
+        const gpio_hub_source_t *src = &s_sources[i];
+        if (!src->active) continue;
+        out[n].pin = src->pin;
+        memcpy(out[n].name, src->name, sizeof(out[n].name));
+        out[n].edges = atomic_load_explicit(&src->edges, memory_order_relaxed);
+        out[n].overflows = atomic_load_explicit(&src->overflows, memory_order_relaxed);
+        out[n].rate_hz = src->rate_hz;
+        out[n].ring_size = (uint16_t)(src->mask + 1);
+        out[n].max_depth = src->max_depth;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,116 @@
+// gpio_hub.h
+#ifndef GPIO_HUB_H
+#define GPIO_HUB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+/*
+ * Hub sự kiện GPIO dùng chung cho mọi input (cảm biến lửa, RF 433MHz, nút nhấn).
+ *
+ * Một ISR duy nhất được gắn cho mọi chân: chỉ lấy timestamp + mức chân, đẩy vào
+ * ring lock-free riêng của nguồn đó (SPSC: ISR ghi, task đọc). Chi phí ngắt là
+ * hằng số cho mỗi cạnh, không phụ thuộc số consumer.
+ *
+ * Hai task drain các ring:
+ *  - task dispatch ưu tiên cao (GPIO_HUB_TASK_PRIO), được đánh thức ở mỗi cạnh,
+ *    cho các nguồn thưa cần phản ứng ngay (cảm biến lửa, nút nhấn);
+ *  - task bulk ưu tiên thấp (GPIO_HUB_BULK_TASK_PRIO) cho nguồn có cờ bulk (RF 433MHz):
+ *    không bị đánh thức theo từng cạnh nhiễu mà drain theo lô mỗi GPIO_HUB_BULK_PERIOD_MS
+ *    hoặc khi ring đầy một nửa.
+ *
+ * Thứ tự giao cạnh: trong một nguồn luôn đúng thứ tự ISR. Giữa các nguồn cùng một
+ * task, mỗi lần drain trộn các ring theo ts_us nên cạnh được giao theo thứ tự
+ * thời gian (trong phạm vi các cạnh đã có trong ring lúc drain). Giữa nguồn thường
+ * và nguồn bulk không có thứ tự chung: consumer cần so sánh thì dùng ts_us.
+ *
+ * Callback chạy trong task drain: phải ngắn và không chặn (đẩy vào queue
+ * của consumer nếu cần xử lý lâu), nếu không ring của nguồn khác sẽ bị tràn.
+ */
+
+#ifndef GPIO_HUB_MAX_SOURCES
+#define GPIO_HUB_MAX_SOURCES 16
+#endif
+
+#ifndef GPIO_HUB_DEFAULT_RING_SIZE
+#define GPIO_HUB_DEFAULT_RING_SIZE 32   // Phải là lũy thừa của 2
+#endif
+
+#ifndef GPIO_HUB_TASK_PRIO
+#define GPIO_HUB_TASK_PRIO 12
+#endif
+
+#ifndef GPIO_HUB_BULK_TASK_PRIO
+#define GPIO_HUB_BULK_TASK_PRIO 4       // Dưới rf_control_task (6): giải mã RF không chen task điều khiển
+#endif
+
+#ifndef GPIO_HUB_BULK_PERIOD_MS
+#define GPIO_HUB_BULK_PERIOD_MS 10      // Trễ giao tối đa của nguồn bulk khi ring chưa đầy một nửa
+#endif
+
+// 1: cài ISR service với ESP_INTR_FLAG_IRAM - ISR vẫn chạy và ghi cạnh vào ring khi
+// cache flash bị tắt (NVS commit, OTA). ISR, ring và bảng nguồn đều nằm trong IRAM/DRAM;
+// task dispatch tạm dừng trong lúc ghi flash rồi xử lý bù các cạnh đã đệm.
+#ifndef GPIO_HUB_ISR_IRAM
+#define GPIO_HUB_ISR_IRAM 1
+#endif
+
+typedef struct {
+    uint32_t ts_us;     // esp_timer_get_time() tại ISR (tràn sau ~71 phút, dùng hiệu số)
+    uint8_t level;      // Mức chân đọc ngay trong ISR
+} gpio_hub_edge_t;
+
+/**
+ * @brief Callback nhận từng cạnh của một nguồn (chạy trong task dispatch hoặc task bulk).
+ */
+typedef void (*gpio_hub_cb_t)(gpio_num_t pin, const gpio_hub_edge_t *edge, void *ctx);
+
+typedef struct {
+    gpio_num_t pin;
+    const char *name;           // Tên ngắn cho diagnostics (được sao chép)
+    gpio_int_type_t intr_type;
+    bool pull_up;
+    uint16_t ring_size;         // 0: GPIO_HUB_DEFAULT_RING_SIZE; làm tròn lên lũy thừa của 2
+    bool bulk;                  // Nguồn nhiều cạnh: drain theo lô trong task ưu tiên thấp
+    gpio_hub_cb_t cb;
+    void *ctx;
+} gpio_hub_source_config_t;
+
+// Mọi bộ đếm tính từ lần gpio_hub_register gần nhất của chân
+typedef struct {
+    gpio_num_t pin;
+    char name[12];
+    uint32_t edges;         // Tổng số cạnh ISR nhận được
+    uint32_t overflows;     // Số cạnh bị bỏ do ring đầy
+    uint32_t rate_hz;       // Số cạnh/giây trong cửa sổ 1 s gần nhất
+    uint16_t ring_size;
+    uint16_t max_depth;     // Độ sâu ring lớn nhất từng thấy khi dispatch
+} gpio_hub_stats_t;
+
+/**
+ * @brief Cài ISR service và tạo task dispatch + task bulk. Gọi nhiều lần vẫn an toàn.
+ * Nếu ISR service đã được cài trước đó (không có cờ IRAM) thì chỉ cảnh báo.
+ */
+esp_err_t gpio_hub_init(void);
+
+/**
+ * @brief Cấu hình chân và đăng ký một nguồn. Mỗi chân chỉ thuộc một nguồn.
+ * Tự gọi gpio_hub_init() nếu chưa khởi tạo.
+ * @return ESP_ERR_INVALID_STATE nếu chân đã được đăng ký, ESP_ERR_NO_MEM nếu hết slot/bộ nhớ.
+ */
+esp_err_t gpio_hub_register(const gpio_hub_source_config_t *cfg);
+
+/**
+ * @brief Gỡ nguồn của chân: tắt ngắt, bỏ các cạnh chưa dispatch.
+ */
+esp_err_t gpio_hub_unregister(gpio_num_t pin);
+
+/**
+ * @brief Lấy thống kê của các nguồn đang đăng ký.
+ * @return Số phần tử đã ghi vào out (tối đa max).
+ */
+int gpio_hub_get_stats(gpio_hub_stats_t *out, int max);
+
+#endif // GPIO_HUB_H
@@ -0,0 +1,145 @@
+// hub.c - bảng leaf của hub: cập nhật từ net_dispatch_task, chụp lại khi publish message gộp
+#include "hub.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+// 802.11 ở 1 Mbps: PLCP preamble + header dài 192 us; khung action vendor của ESP-NOW thêm
+// 24 byte MAC header, 15 byte category/OUI/element header và 4 byte FCS quanh payload
+#define HUB_PLCP_US             192
+#define HUB_ESPNOW_OVERHEAD     43
+
+typedef struct {
+    bool used;
+    hub_leaf_t leaf;
+} hub_slot_t;
+
+static hub_slot_t s_slots[HUB_MAX_LEAVES];
+static hub_stats_t s_stats;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;  // Bản ghi ngắn, task publish chụp cả bảng
+
+void hub_id_set(char dst[HUB_ID_LEN], const char *src)
+{
+    size_t n = strlen(src);
+    if (n > HUB_ID_LEN) n = HUB_ID_LEN;
+    memset(dst, 0, HUB_ID_LEN);
+    memcpy(dst, src, n);
+}
+
+bool hub_id_equals(const char src[HUB_ID_LEN], const char *id)
+{
+    const size_t n = strlen(id);
+    if (n > HUB_ID_LEN || memcmp(src, id, n) != 0) return false;
+    return n == HUB_ID_LEN || src[n] == '\0';
+}
+
+void hub_id_get(const char src[HUB_ID_LEN], char *out)
+{
+    size_t n = 0;
+    while (n < HUB_ID_LEN && src[n] != '\0') n++;
+    memcpy(out, src, n);
+    out[n] = '\0';
+}
+
+uint32_t hub_espnow_airtime_us(int payload_len)
+{
+    return HUB_PLCP_US + (uint32_t)(HUB_ESPNOW_OVERHEAD + payload_len) * 8;
+}
+
+void hub_note_rx(int frame_len)
+{
+    portENTER_CRITICAL(&s_mux);
+    s_stats.bytes += (uint32_t)frame_len;
+    s_stats.airtime_us += hub_espnow_airtime_us(frame_len);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+// Gọi khi giữ s_mux
+static hub_slot_t *hub_slot_find(const char id[HUB_ID_LEN])
+{
+    for (int i = 0; i < HUB_MAX_LEAVES; i++) {
+        if (s_slots[i].used && memcmp(s_slots[i].leaf.state.id, id, HUB_ID_LEN) == 0) return &s_slots[i];
+    }
+    return NULL;
+}
+
+// Slot trống, hoặc leaf offline lâu nhất; NULL nếu mọi leaf còn online (gọi khi giữ s_mux)
+static hub_slot_t *hub_slot_alloc(int64_t now_us)
+{
+    hub_slot_t *oldest = NULL;
+    for (int i = 0; i < HUB_MAX_LEAVES; i++) {
+        if (!s_slots[i].used) return &s_slots[i];
+        if (oldest == NULL || s_slots[i].leaf.last_rx_us < oldest->leaf.last_rx_us) oldest = &s_slots[i];
+    }
+    if (now_us - oldest->leaf.last_rx_us < (int64_t)HUB_LEAF_TIMEOUT_MS * 1000) return NULL;
+    return oldest;
+}
+
+bool hub_leaf_update(const hub_state_frame_t *frame, int8_t rssi, int64_t now_us)
+{
+    bool ok = true;
+    portENTER_CRITICAL(&s_mux);
+    hub_slot_t *slot = hub_slot_find(frame->id);
+    if (slot == NULL) {
+        slot = hub_slot_alloc(now_us);
+        if (slot != NULL) {
+            if (!slot->used) s_stats.leaves++;
+            memset(slot, 0, sizeof(*slot));
+            slot->used = true;
+        }
+    } else {
+        const uint8_t gap = (uint8_t)(frame->seq - slot->leaf.state.seq - 1);
+        if (gap < 128) {    // Khoảng lớn hơn: leaf khởi động lại, seq về 0
+            slot->leaf.lost += gap;
+            s_stats.lost += gap;
+        }
+    }
+    if (slot != NULL) {
+        slot->leaf.state = *frame;
+        slot->leaf.rssi = rssi;
+        slot->leaf.last_rx_us = now_us;
+        slot->leaf.frames++;
+        s_stats.frames++;
+    } else {
+        s_stats.table_full++;
+        ok = false;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return ok;
+}
+
+bool hub_leaf_known(const char *id)
+{
+    char key[HUB_ID_LEN];
+    hub_id_set(key, id);
+    portENTER_CRITICAL(&s_mux);
+    const bool found = hub_slot_find(key) != NULL;
+    portEXIT_CRITICAL(&s_mux);
+    return found;
+}
+
+int hub_leaf_snapshot(hub_leaf_t *out, int max, int64_t now_us)
+{
+    int n = 0;
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < HUB_MAX_LEAVES && n < max; i++) {
+        if (s_slots[i].used) out[n++] = s_slots[i].leaf;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    for (int i = 0; i < n; i++) {
+        out[i].online = now_us - out[i].last_rx_us < (int64_t)HUB_LEAF_TIMEOUT_MS * 1000;
+    }
+    return n;
+}
+
+void hub_get_stats(hub_stats_t *out, int64_t now_us)
+{
+    portENTER_CRITICAL(&s_mux);
+    *out = s_stats;
+    out->online = 0;
+    for (int i = 0; i < HUB_MAX_LEAVES; i++) {
+        if (s_slots[i].used && now_us - s_slots[i].leaf.last_rx_us < (int64_t)HUB_LEAF_TIMEOUT_MS * 1000) {
+            out->online++;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
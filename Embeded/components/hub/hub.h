@@ -0,0 +1,121 @@
+// hub.h
+#ifndef HUB_H
+#define HUB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Chế độ hub: tủ "leaf" không kết nối Wi-Fi/MQTT, chỉ gửi khung trạng thái gọn qua ESP-NOW;
+ * một tủ "hub" giữ bảng các leaf và đưa lên broker một message gộp mỗi chu kỳ, lệnh từ
+ * dashboard được hub phát lại xuống leaf. Component này chỉ định nghĩa khung và giữ bảng
+ * leaf; gửi/nhận ESP-NOW và MQTT nằm ở main.
+ *
+ * Hub -> leaf dùng broadcast kèm id đích: không tốn slot peer của ESP-NOW (tối đa 20) và
+ * không phải biết MAC của leaf. Broadcast không có ACK tầng MAC; lệnh đã có ACK/gửi lại ở
+ * tầng ứng dụng, còn khung trạng thái được gửi lại mỗi giây.
+ */
+
+#define HUB_ID_LEN              16      // id_thiet_bi trong khung; đủ 16 ký tự thì không có NUL
+
+#ifndef HUB_MAX_LEAVES
+#define HUB_MAX_LEAVES          24
+#endif
+#ifndef HUB_LEAF_TIMEOUT_MS
+#define HUB_LEAF_TIMEOUT_MS     5000    // Không nhận khung trạng thái trong khoảng này: leaf offline
+#endif
+
+// Byte đầu của khung ESP-NOW; 0/1 vẫn là khung cảnh báo giữa hai tủ (espnow_payload_t)
+#define HUB_FRAME_STATE_V1      0xA1    // Khung trạng thái cũ (risk_score 8 bit bị cắt): không còn dùng, hub bỏ qua
+#define HUB_FRAME_STATE         0xA5    // leaf -> hub, mỗi giây; đổi mã khi đổi bố cục hub_state_frame_t
+#define HUB_FRAME_UPLINK        0xA2    // leaf -> hub: cảnh báo/ACK hub publish thay leaf
+#define HUB_FRAME_DOWNLINK      0xA3    // hub -> leaf: lệnh từ sensor/<id>/command
+
+#define HUB_FLAG_ALARM          0x01
+#define HUB_FLAG_WEB            0x02    // Báo động do web bật (led_status)
+#define HUB_FLAG_GAS_HIGH       0x04
+#define HUB_FLAG_SYNCED         0x08    // ts_ms là UTC; không có thì là ms từ lúc leaf khởi động
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;               // HUB_FRAME_STATE
+    uint8_t seq;                // Tăng mỗi khung: hub đếm khung mất
+    char id[HUB_ID_LEN];
+    uint8_t flags;
+    uint8_t flame_mask;
+    uint16_t risk_score;        // 0..FIRE_SCORE_MAX (1000), không vừa 8 bit
+    uint8_t risk_level;         // fire_level_t
+    int16_t temp_cdeg;
+    int16_t temp_rise_cdeg_min;
+    uint16_t gas_ppm[3];        // lpg, khói, co
+    int64_t ts_ms;              // Thời điểm mẫu mới nhất
+} hub_state_frame_t;
+
+typedef enum {
+    HUB_UPLINK_ALERT = 0,       // -> sensor/<id>/alert
+    HUB_UPLINK_ACK,             // -> sensor/<id>/ack
+    HUB_UPLINK_COUNT
+} hub_uplink_kind_t;
+
+// Khung mang một message JSON nguyên văn (uplink hoặc downlink)
+typedef struct __attribute__((packed)) {
+    uint8_t type;               // HUB_FRAME_UPLINK / HUB_FRAME_DOWNLINK
+    uint8_t kind;               // hub_uplink_kind_t; 0 với downlink
+    char id[HUB_ID_LEN];        // Leaf gửi (uplink) hoặc leaf đích (downlink)
+    char payload[];             // Không kết thúc NUL, dài = độ dài khung - HUB_MSG_HDR_LEN
+} hub_msg_frame_t;
+
+#define HUB_MSG_HDR_LEN         (2 + HUB_ID_LEN)
+
+typedef struct {
+    hub_state_frame_t state;    // Khung trạng thái gần nhất
+    int64_t last_rx_us;
+    uint32_t frames;
+    uint32_t lost;              // Khung mất, suy ra từ khoảng trống seq
+    int8_t rssi;
+    bool online;                // Tính lúc chụp: nhận khung trong HUB_LEAF_TIMEOUT_MS
+} hub_leaf_t;
+
+typedef struct {
+    uint32_t frames;            // Khung trạng thái nhận được
+    uint32_t bytes;             // Byte ESP-NOW nhận (mọi khung hub)
+    uint32_t airtime_us;        // Ước lượng thời gian chiếm kênh của các khung đó
+    uint32_t lost;
+    uint32_t table_full;        // Khung của leaf mới bị bỏ vì bảng đầy
+    uint32_t leaves;            // Số slot đang dùng
+    uint32_t online;            // Leaf có khung trong HUB_LEAF_TIMEOUT_MS gần nhất
+} hub_stats_t;
+
+/** @brief Chép @p src vào trường id của khung (cắt ở HUB_ID_LEN, phần thừa điền 0). */
+void hub_id_set(char dst[HUB_ID_LEN], const char *src);
+
+/** @brief So trường id của khung với chuỗi @p id. */
+bool hub_id_equals(const char src[HUB_ID_LEN], const char *id);
+
+/** @brief Chép id của khung ra chuỗi kết thúc NUL (@p out ít nhất HUB_ID_LEN + 1). */
+void hub_id_get(const char src[HUB_ID_LEN], char *out);
+
+/**
+ * @brief Ghi nhận khung trạng thái của một leaf (gọi từ một task duy nhất).
+ * @return false nếu leaf mới mà bảng đã đầy và không có leaf offline để thay.
+ */
+bool hub_leaf_update(const hub_state_frame_t *frame, int8_t rssi, int64_t now_us);
+
+/** @brief Cộng một khung hub nhận được vào thống kê byte/airtime. */
+void hub_note_rx(int frame_len);
+
+/** @brief Leaf @p id đã từng gửi khung trạng thái. */
+bool hub_leaf_known(const char *id);
+
+/** @brief Chụp bảng leaf vào @p out (tối đa @p max phần tử), trả về số leaf. */
+int hub_leaf_snapshot(hub_leaf_t *out, int max, int64_t now_us);
+
+/** @brief Chụp thống kê; @p now_us dùng để đếm leaf online. */
+void hub_get_stats(hub_stats_t *out, int64_t now_us);
+
+/**
+ * @brief Ước lượng airtime (us) của một khung ESP-NOW @p payload_len byte ở 1 Mbps
+ * (tốc độ mặc định của ESP-NOW): preamble dài + header 802.11/vendor action + FCS.
+ */
+uint32_t hub_espnow_airtime_us(int payload_len);
+
+#endif // HUB_H
@@ -0,0 +1,413 @@
+// journal.c
+#include "journal.h"
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "JOURNAL";
+
+#define JOURNAL_SEG_SIZE        4096                                // Một sector xóa của flash
+#define JOURNAL_SLOT_SIZE       32
+#define JOURNAL_SLOTS_PER_SEG   (JOURNAL_SEG_SIZE / JOURNAL_SLOT_SIZE)  // Ô 0 là header
+#define JOURNAL_SEG_MAGIC       0x4A524E4Cu                         // "JRNL"
+#define JOURNAL_READ_CHUNK      8                                   // Số ô đọc mỗi lần (256 byte)
+#define JOURNAL_UNIX_VALID_S    1600000000LL                        // Trước mốc này coi như chưa có giờ
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seg_seq;       // Tăng mỗi lần mở segment mới: segment mới nhất có seg_seq lớn nhất
+    uint32_t first_seq;     // seq của bản ghi đầu tiên ghi vào segment
+    uint8_t reserved[16];
+    uint32_t crc;
+} journal_seg_hdr_t;
+
+_Static_assert(sizeof(journal_record_t) == JOURNAL_SLOT_SIZE, "journal record must fill one slot");
+_Static_assert(sizeof(journal_seg_hdr_t) == JOURNAL_SLOT_SIZE, "segment header must fill one slot");
+
+static const esp_partition_t *s_part = NULL;
+static QueueHandle_t s_queue = NULL;
+static SemaphoreHandle_t s_flash_mutex = NULL;     // Task ghi và journal_read dùng chung flash
+
+// Vị trí ghi (chỉ đổi khi giữ s_flash_mutex)
+static uint16_t s_num_segs = 0;
+static uint16_t s_cur_seg = 0;
+static uint16_t s_cur_slot = 0;
+static uint16_t s_oldest_seg = 0;
+static uint32_t s_cur_seg_seq = 0;
+static uint32_t s_next_seq = 1;
+static uint16_t s_boot = 0;
+
+static uint32_t s_written = 0;               // Chỉ đổi khi giữ s_flash_mutex
+static uint32_t s_erases = 0;
+// journal_log chạy ở nhiều task và không được chờ mutex; journal_read đếm CRC ngoài mutex
+static atomic_uint s_dropped;
+static atomic_uint s_crc_errors;
+
+/* ---------- CRC32 (IEEE, bảng 16 phần tử theo nibble) ---------- */
+
+static uint32_t journal_crc32(const void *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ p[i]) & 0x0F];
+        crc = (crc >> 4) ^ table[(crc ^ (p[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+static bool slot_is_erased(const void *slot)
+{
+    const uint32_t *w = slot;
+    for (size_t i = 0; i < JOURNAL_SLOT_SIZE / sizeof(uint32_t); i++) {
+        if (w[i] != 0xFFFFFFFFu) return false;
+    }
+    return true;
+}
+
+static bool record_valid(const journal_record_t *rec)
+{
+    return rec->crc == journal_crc32(rec, offsetof(journal_record_t, crc));
+}
+
+static size_t seg_offset(uint16_t seg, uint16_t slot)
+{
+    return (size_t)seg * JOURNAL_SEG_SIZE + (size_t)slot * JOURNAL_SLOT_SIZE;
+}
+
+static bool read_header(uint16_t seg, journal_seg_hdr_t *hdr)
+{
+    if (esp_partition_read(s_part, seg_offset(seg, 0), hdr, sizeof(*hdr)) != ESP_OK) return false;
+    return hdr->magic == JOURNAL_SEG_MAGIC && hdr->crc == journal_crc32(hdr, offsetof(journal_seg_hdr_t, crc));
+}
+
+/* ---------- Ghi ---------- */
+
+// Xóa segment @p seg và ghi header mới; segment cũ nhất bị ghi đè thì dời mốc cũ nhất
+static esp_err_t open_segment(uint16_t seg)
+{
+    esp_err_t err = esp_partition_erase_range(s_part, seg_offset(seg, 0), JOURNAL_SEG_SIZE);
+    if (err != ESP_OK) return err;
+    s_erases++;
+    if (seg == s_oldest_seg && s_cur_slot != 0) {
+        s_oldest_seg = (seg + 1) % s_num_segs;
+    }
+
+    journal_seg_hdr_t hdr = {
+        .magic = JOURNAL_SEG_MAGIC,
+        .seg_seq = s_cur_seg_seq + 1,
+        .first_seq = s_next_seq,
+    };
+    memset(hdr.reserved, 0xFF, sizeof(hdr.reserved));
+    hdr.crc = journal_crc32(&hdr, offsetof(journal_seg_hdr_t, crc));
+    err = esp_partition_write(s_part, seg_offset(seg, 0), &hdr, sizeof(hdr));
+    if (err != ESP_OK) return err;
+
+    s_cur_seg = seg;
+    s_cur_seg_seq = hdr.seg_seq;
+    s_cur_slot = 1;
+    return ESP_OK;
+}
+
+static bool append_record(journal_record_t *rec)
+{
+    if (s_cur_slot >= JOURNAL_SLOTS_PER_SEG &&
+        open_segment((s_cur_seg + 1) % s_num_segs) != ESP_OK) {
+        return false;
+    }
+    rec->seq = s_next_seq;
+    rec->boot = s_boot;
+    rec->crc = journal_crc32(rec, offsetof(journal_record_t, crc));
+    const esp_err_t err = esp_partition_write(s_part, seg_offset(s_cur_seg, s_cur_slot), rec, sizeof(*rec));
+    s_cur_slot++;   // Kể cả khi lỗi: ô có thể đã bị ghi dở, không ghi lại lên đó
+    if (err != ESP_OK) return false;
+    s_next_seq++;
+    s_written++;
+    return true;
+}
+
+static void journal_task(void *arg)
+{
+    journal_record_t rec;
+    while (1) {
+        if (xQueueReceive(s_queue, &rec, portMAX_DELAY) != pdTRUE) continue;
+        xSemaphoreTake(s_flash_mutex, portMAX_DELAY);
+        const bool ok = append_record(&rec);
+        xSemaphoreGive(s_flash_mutex);
+        if (!ok) {
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+            ESP_LOGW(TAG, "Flash write failed, record dropped");
+        }
+    }
+}
+
+bool journal_log(journal_event_t event, uint8_t source, journal_actor_t actor, int32_t value)
+{
+    if (s_queue == NULL) return false;
+
+    journal_record_t rec = {
+        .uptime_ms = (uint32_t)(esp_timer_get_time() / 1000),
+        .value = value,
+        .event = (uint8_t)event,
+        .source = source,
+        .actor = (uint8_t)actor,
+    };
+    struct timeval tv;
+    if (gettimeofday(&tv, NULL) == 0 && tv.tv_sec >= JOURNAL_UNIX_VALID_S) {
+        rec.unix_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+    if (xQueueSend(s_queue, &rec, 0) != pdTRUE) {
+        atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+/* ---------- Khôi phục khi khởi động ---------- */
+
+// Quét một segment: trả về ô trống đầu tiên, cập nhật bản ghi hợp lệ cuối cùng (nếu có)
+static uint16_t scan_segment(uint16_t seg, journal_record_t *last, bool *found)
+{
+    journal_record_t chunk[JOURNAL_READ_CHUNK];
+    for (uint16_t slot = 1; slot < JOURNAL_SLOTS_PER_SEG; slot += JOURNAL_READ_CHUNK) {
+        const uint16_t n = (JOURNAL_SLOTS_PER_SEG - slot) < JOURNAL_READ_CHUNK ? (JOURNAL_SLOTS_PER_SEG - slot) : JOURNAL_READ_CHUNK;
+        if (esp_partition_read(s_part, seg_offset(seg, slot), chunk, n * sizeof(chunk[0])) != ESP_OK) {
+            return JOURNAL_SLOTS_PER_SEG;
+        }
+        for (uint16_t i = 0; i < n; i++) {
+            if (slot_is_erased(&chunk[i])) return slot + i;
+            if (record_valid(&chunk[i])) {
+                *last = chunk[i];
+                *found = true;
+            } else {
+                atomic_fetch_add_explicit(&s_crc_errors, 1, memory_order_relaxed);
+            }
+        }
+    }
+    return JOURNAL_SLOTS_PER_SEG;
+}
+
+static esp_err_t journal_recover(void)
+{
+    bool any = false;
+    uint32_t oldest_seq = UINT32_MAX;
+    for (uint16_t seg = 0; seg < s_num_segs; seg++) {
+        journal_seg_hdr_t hdr;
+        if (!read_header(seg, &hdr)) continue;
+        if (!any || hdr.seg_seq > s_cur_seg_seq) {
+            s_cur_seg = seg;
+            s_cur_seg_seq = hdr.seg_seq;
+            s_next_seq = hdr.first_seq;
+        }
+        if (hdr.seg_seq < oldest_seq) {
+            oldest_seq = hdr.seg_seq;
+            s_oldest_seg = seg;
+        }
+        any = true;
+    }
+    if (!any) {
+        ESP_LOGW(TAG, "No valid segment, formatting journal");
+        s_cur_seg_seq = 0;
+        s_next_seq = 1;
+        s_oldest_seg = 0;
+        s_cur_slot = 0;
+        return open_segment(0);
+    }
+
+    journal_record_t last;
+    bool found = false;
+    s_cur_slot = scan_segment(s_cur_seg, &last, &found);
+    if (!found && s_cur_seg != s_oldest_seg) {
+        // Mất điện ngay sau khi mở segment mới: số lần boot nằm ở segment trước
+        const uint16_t prev = (s_cur_seg + s_num_segs - 1) % s_num_segs;
+        (void)scan_segment(prev, &last, &found);
+    }
+    if (found) {
+        s_next_seq = last.seq + 1;
+        s_boot = last.boot;
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_init(void)
+{
+    if (s_queue != NULL) return ESP_OK;
+
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+    if (s_part == NULL) {
+        ESP_LOGE(TAG, "Partition '%s' not found", JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_num_segs = (uint16_t)(s_part->size / JOURNAL_SEG_SIZE);
+    if (s_num_segs < 2) {
+        ESP_LOGE(TAG, "Partition too small (%lu bytes)", (unsigned long)s_part->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    s_flash_mutex = xSemaphoreCreateMutex();
+    QueueHandle_t queue = xQueueCreate(JOURNAL_QUEUE_LEN, sizeof(journal_record_t));
+    if (s_flash_mutex == NULL || queue == NULL) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = journal_recover();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Recovery failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    s_boot++;
+
+    if (xTaskCreate(journal_task, "journal_task", 3072, NULL, JOURNAL_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_queue = queue;
+    ESP_LOGI(TAG, "Journal: %u segments, next seq %lu, boot %u, write slot %u/%u",
+             s_num_segs, (unsigned long)s_next_seq, s_boot, s_cur_slot, JOURNAL_SLOTS_PER_SEG);
+    journal_log(JOURNAL_EV_BOOT, 0, JOURNAL_ACTOR_SYSTEM, 0);
+    return ESP_OK;
+}
+
+/* ---------- Đọc ---------- */
+
+// Segment sống thứ k tính từ segment cũ nhất
+static uint16_t live_segment(uint16_t k)
+{
+    return (s_oldest_seg + k) % s_num_segs;
+}
+
+// Tìm nhị phân trên header: segment sống cuối cùng có first_seq <= seq (gọi khi giữ mutex)
+static uint16_t find_segment(uint32_t seq, journal_seg_hdr_t *hdr_out)
+{
+    const uint16_t live = (uint16_t)((s_cur_seg + s_num_segs - s_oldest_seg) % s_num_segs + 1);
+    uint16_t lo = 0, hi = live - 1;
+    while (lo < hi) {
+        const uint16_t mid = (uint16_t)((lo + hi + 1) / 2);
+        journal_seg_hdr_t hdr;
+        if (read_header(live_segment(mid), &hdr) && hdr.first_seq <= seq) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    const uint16_t seg = live_segment(lo);
+    if (!read_header(seg, hdr_out)) memset(hdr_out, 0, sizeof(*hdr_out));
+    return seg;
+}
+
+size_t journal_read(uint32_t from_seq, size_t max, journal_visit_cb_t cb, void *ctx)
+{
+    if (s_queue == NULL || cb == NULL) return 0;
+
+    journal_record_t chunk[JOURNAL_READ_CHUNK];
+    uint32_t want = from_seq;
+    size_t delivered = 0;
+    bool located = false;
+    uint16_t seg = 0, slot = 1;
+    uint32_t seg_seq = 0;
+
+    while (delivered < max) {
+        xSemaphoreTake(s_flash_mutex, portMAX_DELAY);
+        journal_seg_hdr_t hdr;
+        if (located && (!read_header(seg, &hdr) || hdr.seg_seq != seg_seq)) {
+            located = false;    // Segment vừa bị xóa để ghi đè: tìm lại theo seq
+        }
+        if (!located) {
+            seg = find_segment(want, &hdr);
+            seg_seq = hdr.seg_seq;
+            slot = 1;
+            located = true;
+        }
+        const bool is_current = (seg == s_cur_seg);
+        const uint16_t end = is_current ? s_cur_slot : JOURNAL_SLOTS_PER_SEG;
+        uint16_t n = (end > slot) ? (uint16_t)(end - slot) : 0;
+        if (n > JOURNAL_READ_CHUNK) n = JOURNAL_READ_CHUNK;
+        if (n > 0 && esp_partition_read(s_part, seg_offset(seg, slot), chunk, n * sizeof(chunk[0])) != ESP_OK) {
+            n = 0;
+        }
+        xSemaphoreGive(s_flash_mutex);
+
+        if (n == 0) {
+            if (is_current || slot < end) break;    // Hết dữ liệu hoặc lỗi đọc
+            // Hết segment: sang segment kế tiếp nếu nó tiếp nối đúng thứ tự
+            const uint16_t next = (seg + 1) % s_num_segs;
+            xSemaphoreTake(s_flash_mutex, portMAX_DELAY);
+            const bool ok = read_header(next, &hdr) && hdr.seg_seq == seg_seq + 1;
+            xSemaphoreGive(s_flash_mutex);
+            if (!ok) break;
+            seg = next;
+            seg_seq = hdr.seg_seq;
+            slot = 1;
+            continue;
+        }
+
+        for (uint16_t i = 0; i < n && delivered < max; i++) {
+            if (slot_is_erased(&chunk[i])) continue;
+            if (!record_valid(&chunk[i])) {
+                atomic_fetch_add_explicit(&s_crc_errors, 1, memory_order_relaxed);
+                continue;
+            }
+            if (chunk[i].seq < want) continue;
+            delivered++;
+            want = chunk[i].seq + 1;
+            if (!cb(&chunk[i], ctx)) return delivered;
+        }
+        slot += n;
+    }
+    return delivered;
+}
+
+void journal_get_stats(journal_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (s_flash_mutex == NULL) return;
+    xSemaphoreTake(s_flash_mutex, portMAX_DELAY);
+    journal_seg_hdr_t hdr;
+    out->first_seq = (s_part != NULL && read_header(s_oldest_seg, &hdr)) ? hdr.first_seq : s_next_seq;
+    out->next_seq = s_next_seq;
+    out->boot = s_boot;
+    out->segments = s_num_segs;
+    out->written = s_written;
+    out->dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+    out->erases = s_erases;
+    out->crc_errors = atomic_load_explicit(&s_crc_errors, memory_order_relaxed);
+    xSemaphoreGive(s_flash_mutex);
+}
+
+const char *journal_event_to_str(uint8_t event)
+{
+    switch (event) {
+        case JOURNAL_EV_BOOT: return "boot";
+        case JOURNAL_EV_ALARM_ON: return "alarm_on";
+        case JOURNAL_EV_ALARM_OFF: return "alarm_off";
+        case JOURNAL_EV_SOURCE_ON: return "source_on";
+        case JOURNAL_EV_SOURCE_OFF: return "source_off";
+        case JOURNAL_EV_REMOTE_ON: return "remote_on";
+        case JOURNAL_EV_REMOTE_OFF: return "remote_off";
+        case JOURNAL_EV_RESET: return "reset";
+        case JOURNAL_EV_SILENCE: return "silence";
+        default: return "?";
+    }
+}
+
+const char *journal_actor_to_str(uint8_t actor)
+{
+    switch (actor) {
+        case JOURNAL_ACTOR_SYSTEM: return "system";
+        case JOURNAL_ACTOR_SENSOR: return "sensor";
+        case JOURNAL_ACTOR_BUTTON: return "button";
+        case JOURNAL_ACTOR_RF_REMOTE: return "rf";
+        case JOURNAL_ACTOR_WEB: return "web";
+        case JOURNAL_ACTOR_PEER: return "peer";
+        case JOURNAL_ACTOR_HUB: return "hub";
+        default: return "?";
+    }
+}
@@ -0,0 +1,112 @@
+// journal.h
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Nhật ký sự kiện báo cháy trong partition riêng (không qua NVS).
+ *
+ * Partition chia thành các segment 4 KB (một sector xóa). Mỗi segment gồm một header
+ * rồi các bản ghi 32 byte chỉ được ghi nối (append) vào ô còn trống (0xFF), mỗi bản
+ * ghi có CRC32 riêng. Segment đầy thì xóa segment cũ nhất kế tiếp (vòng tròn): luôn
+ * giữ lại các sự kiện mới nhất. Bản ghi hỏng do mất điện lúc ghi chỉ bị bỏ qua.
+ *
+ * journal_log() chỉ đẩy bản ghi vào queue (không chặn, không chạm flash); một task
+ * ưu tiên thấp ghi xuống flash. Không dùng trong ISR.
+ */
+
+#ifndef JOURNAL_PARTITION_LABEL
+#define JOURNAL_PARTITION_LABEL "journal"
+#endif
+
+#ifndef JOURNAL_QUEUE_LEN
+#define JOURNAL_QUEUE_LEN 16
+#endif
+
+#ifndef JOURNAL_TASK_PRIO
+#define JOURNAL_TASK_PRIO 2
+#endif
+
+typedef enum {
+    JOURNAL_EV_BOOT = 0,
+    JOURNAL_EV_ALARM_ON,        // Báo cháy toàn cục bật; value = bitmask nguồn
+    JOURNAL_EV_ALARM_OFF,
+    JOURNAL_EV_SOURCE_ON,       // Một nguồn cục bộ kích hoạt; value tùy nguồn
+    JOURNAL_EV_SOURCE_OFF,
+    JOURNAL_EV_REMOTE_ON,       // Thiết bị khác báo cháy (ESP-NOW)
+    JOURNAL_EV_REMOTE_OFF,
+    JOURNAL_EV_RESET,           // Xóa tất cả nguồn; value = bitmask nguồn trước khi xóa
+    JOURNAL_EV_SILENCE,         // Tắt còi; value = số giây, 0 = hủy (lệnh hoặc nguồn mới/hết cháy)
+    JOURNAL_EV_COUNT
+} journal_event_t;
+
+typedef enum {
+    JOURNAL_ACTOR_SYSTEM = 0,
+    JOURNAL_ACTOR_SENSOR,       // Cảm biến tự bật / hết dwell tự xóa
+    JOURNAL_ACTOR_BUTTON,       // Nút trên tủ
+    JOURNAL_ACTOR_RF_REMOTE,
+    JOURNAL_ACTOR_WEB,          // Lệnh qua MQTT
+    JOURNAL_ACTOR_PEER,         // Thiết bị khác qua ESP-NOW
+    JOURNAL_ACTOR_HUB,          // Lệnh MQTT hub chuyển xuống leaf qua ESP-NOW
+    JOURNAL_ACTOR_COUNT
+} journal_actor_t;
+
+typedef struct {
+    uint32_t seq;           // Số thứ tự toàn cục, tăng liên tục qua các lần khởi động
+    uint32_t uptime_ms;     // Thời điểm sự kiện (từ lúc boot)
+    int64_t unix_ms;        // Giờ thực nếu đã đồng bộ, 0 nếu chưa
+    int32_t value;
+    uint16_t boot;          // Số lần khởi động, phân biệt uptime giữa các lần boot
+    uint8_t event;          // journal_event_t
+    uint8_t source;         // Do ứng dụng định nghĩa (vd. chỉ số bit nguồn báo cháy)
+    uint8_t actor;          // journal_actor_t
+    uint8_t reserved[3];
+    uint32_t crc;           // CRC32 của 28 byte phía trước
+} journal_record_t;
+
+typedef struct {
+    uint32_t first_seq;     // Bản ghi cũ nhất còn trong flash
+    uint32_t next_seq;      // seq của bản ghi kế tiếp
+    uint16_t boot;
+    uint16_t segments;
+    uint32_t written;       // Số bản ghi đã ghi từ lúc boot
+    uint32_t dropped;       // Bị bỏ do queue đầy hoặc lỗi flash
+    uint32_t erases;        // Số segment đã xóa từ lúc boot
+    uint32_t crc_errors;    // Bản ghi hỏng gặp khi quét/đọc
+} journal_stats_t;
+
+/**
+ * @brief Visitor cho journal_read().
+ * @return false để dừng sớm.
+ */
+typedef bool (*journal_visit_cb_t)(const journal_record_t *rec, void *ctx);
+
+/**
+ * @brief Quét partition, khôi phục vị trí ghi và tạo task ghi. Ghi một bản ghi BOOT.
+ * @return ESP_ERR_NOT_FOUND nếu không có partition JOURNAL_PARTITION_LABEL.
+ */
+esp_err_t journal_init(void);
+
+/**
+ * @brief Ghi nhận một sự kiện (timestamp lấy tại lúc gọi). Không chặn.
+ * @return false nếu chưa init hoặc queue đầy (được đếm vào dropped).
+ */
+bool journal_log(journal_event_t event, uint8_t source, journal_actor_t actor, int32_t value);
+
+/**
+ * @brief Duyệt các bản ghi có seq >= @p from_seq theo thứ tự, tối đa @p max bản ghi.
+ * Segment bắt đầu được tìm bằng tìm kiếm nhị phân trên header; sau đó đọc tuần tự.
+ * @return Số bản ghi đã đưa cho @p cb.
+ */
+size_t journal_read(uint32_t from_seq, size_t max, journal_visit_cb_t cb, void *ctx);
+
+void journal_get_stats(journal_stats_t *out);
+
+const char *journal_event_to_str(uint8_t event);
+const char *journal_actor_to_str(uint8_t actor);
+
+#endif // JOURNAL_H
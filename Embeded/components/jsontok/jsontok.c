@@ -0,0 +1,201 @@
+// jsontok.c - bộ tách token JSON đệ quy xuống, độ sâu và số token giới hạn
+#include "jsontok.h"
+#include <string.h>
+
+typedef struct {
+    const char *js;
+    size_t len;
+    size_t pos;
+    jsontok_t *t;
+    int max;
+    int n;
+} jsontok_parser_t;
+
+static void skip_ws(jsontok_parser_t *p)
+{
+    while (p->pos < p->len) {
+        const char c = p->js[p->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        p->pos++;
+    }
+}
+
+static int alloc_tok(jsontok_parser_t *p, jsontok_type_t type, size_t start)
+{
+    if (p->n >= p->max) return JSONTOK_ERR_NOMEM;
+    jsontok_t *tok = &p->t[p->n];
+    tok->type = (uint8_t)type;
+    tok->flags = 0;
+    tok->start = (uint16_t)start;
+    tok->len = 0;
+    return p->n++;
+}
+
+static int parse_value(jsontok_parser_t *p, int depth);
+
+static int parse_string(jsontok_parser_t *p)
+{
+    const size_t start = ++p->pos;  // Bỏ dấu nháy mở
+    const int i = alloc_tok(p, JSONTOK_STRING, start);
+    if (i < 0) return i;
+    while (p->pos < p->len && p->js[p->pos] != '"') {
+        const unsigned char c = (unsigned char)p->js[p->pos];
+        if (c < 0x20) return JSONTOK_ERR_SYNTAX;
+        if (c == '\\') {
+            p->t[i].flags |= JSONTOK_F_ESCAPED;
+            p->pos++;       // Ký tự sau '\' không thể đóng chuỗi
+        }
+        p->pos++;
+    }
+    if (p->pos >= p->len) return JSONTOK_ERR_SYNTAX;
+    p->t[i].len = (uint16_t)(p->pos - start);
+    p->pos++;               // Dấu nháy đóng
+    p->t[i].end = (uint16_t)p->n;
+    return i;
+}
+
+// Số, true/false/null: chỉ kiểm tra ký tự hợp lệ, giá trị được đọc khi cần
+static int parse_primitive(jsontok_parser_t *p)
+{
+    const size_t start = p->pos;
+    // strchr cũng khớp '\0' (ký tự kết thúc của chính chuỗi mẫu): byte NUL trong message không phải primitive
+    while (p->pos < p->len && p->js[p->pos] != '\0' && strchr("0123456789+-.eEtrufalsn", p->js[p->pos]) != NULL) {
+        p->pos++;
+    }
+    const size_t len = p->pos - start;
+    const char *s = p->js + start;
+    jsontok_type_t type;
+    if ((len == 4 && memcmp(s, "true", 4) == 0) || (len == 5 && memcmp(s, "false", 5) == 0)) {
+        type = JSONTOK_BOOL;
+    } else if (len == 4 && memcmp(s, "null", 4) == 0) {
+        type = JSONTOK_NULL;
+    } else if (len > 0 && (s[0] == '-' || (s[0] >= '0' && s[0] <= '9'))) {
+        type = JSONTOK_NUMBER;
+    } else {
+        return JSONTOK_ERR_SYNTAX;
+    }
+    const int i = alloc_tok(p, type, start);
+    if (i < 0) return i;
+    p->t[i].len = (uint16_t)len;
+    p->t[i].end = (uint16_t)p->n;
+    return i;
+}
+
+static int parse_container(jsontok_parser_t *p, int depth)
+{
+    const bool is_object = p->js[p->pos] == '{';
+    const char close = is_object ? '}' : ']';
+    if (depth >= JSONTOK_MAX_DEPTH) return JSONTOK_ERR_DEPTH;
+    const int i = alloc_tok(p, is_object ? JSONTOK_OBJECT : JSONTOK_ARRAY, p->pos);
+    if (i < 0) return i;
+    p->pos++;
+    skip_ws(p);
+    if (p->pos < p->len && p->js[p->pos] == close) {
+        p->pos++;
+    } else {
+        while (1) {
+            if (is_object) {
+                skip_ws(p);
+                if (p->pos >= p->len || p->js[p->pos] != '"') return JSONTOK_ERR_SYNTAX;
+                const int key = parse_string(p);
+                if (key < 0) return key;
+                skip_ws(p);
+                if (p->pos >= p->len || p->js[p->pos++] != ':') return JSONTOK_ERR_SYNTAX;
+            }
+            const int v = parse_value(p, depth + 1);
+            if (v < 0) return v;
+            skip_ws(p);
+            if (p->pos >= p->len) return JSONTOK_ERR_SYNTAX;
+            const char c = p->js[p->pos++];
+            if (c == close) break;
+            if (c != ',') return JSONTOK_ERR_SYNTAX;
+        }
+    }
+    p->t[i].len = (uint16_t)(p->pos - p->t[i].start);
+    p->t[i].end = (uint16_t)p->n;
+    return i;
+}
+
+static int parse_value(jsontok_parser_t *p, int depth)
+{
+    skip_ws(p);
+    if (p->pos >= p->len) return JSONTOK_ERR_SYNTAX;
+    const char c = p->js[p->pos];
+    if (c == '{' || c == '[') return parse_container(p, depth);
+    if (c == '"') return parse_string(p);
+    return parse_primitive(p);
+}
+
+int jsontok_parse(const char *js, size_t len, jsontok_t *t, int max)
+{
+    if (len > UINT16_MAX) return JSONTOK_ERR_NOMEM;
+    jsontok_parser_t p = { .js = js, .len = len, .t = t, .max = max };
+    const int root = parse_value(&p, 0);
+    if (root < 0) return root;
+    skip_ws(&p);
+    return p.pos == len ? p.n : JSONTOK_ERR_SYNTAX;
+}
+
+bool jsontok_eq(const char *js, const jsontok_t *t, int i, const char *s)
+{
+    const size_t n = strlen(s);
+    return t[i].type == JSONTOK_STRING && t[i].len == n && memcmp(js + t[i].start, s, n) == 0;
+}
+
+int jsontok_obj_get(const char *js, const jsontok_t *t, int obj, const char *key)
+{
+    if (obj < 0 || t[obj].type != JSONTOK_OBJECT) return -1;
+    for (int k = obj + 1; k < t[obj].end; k = t[k + 1].end) {
+        if (jsontok_eq(js, t, k, key)) return k + 1;
+    }
+    return -1;
+}
+
+bool jsontok_fixed(const char *js, const jsontok_t *t, int i, int decimals, int32_t *out)
+{
+    if (i < 0 || t[i].type != JSONTOK_NUMBER) return false;
+    const char *s = js + t[i].start;
+    const char *e = s + t[i].len;
+    const bool neg = *s == '-';
+    if (neg) s++;
+    int64_t v = 0;
+    int frac = -1;              // Số chữ số sau dấu chấm đã lấy; -1: chưa gặp dấu chấm
+    bool digits = false;
+    for (; s < e; s++) {
+        if (*s == '.' && frac < 0) {
+            frac = 0;
+        } else if (*s >= '0' && *s <= '9') {
+            digits = true;
+            if (frac >= decimals) continue;     // Cắt phần lẻ thừa
+            v = v * 10 + (*s - '0');
+            if (frac >= 0) frac++;
+            if (v > INT32_MAX) return false;
+        } else {
+            return false;       // Số mũ không dùng trong lệnh
+        }
+    }
+    if (!digits) return false;
+    for (int k = frac < 0 ? 0 : frac; k < decimals; k++) {
+        v *= 10;
+        if (v > INT32_MAX) return false;
+    }
+    *out = (int32_t)(neg ? -v : v);
+    return true;
+}
+
+bool jsontok_bool(const char *js, const jsontok_t *t, int i, bool *out)
+{
+    if (i < 0 || t[i].type != JSONTOK_BOOL) return false;
+    *out = js[t[i].start] == 't';
+    return true;
+}
+
+bool jsontok_str(const char *js, const jsontok_t *t, int i, char *out, size_t out_size)
+{
+    if (i < 0 || t[i].type != JSONTOK_STRING || (t[i].flags & JSONTOK_F_ESCAPED) || t[i].len >= out_size) {
+        return false;
+    }
+    memcpy(out, js + t[i].start, t[i].len);
+    out[t[i].len] = '\0';
+    return true;
+}
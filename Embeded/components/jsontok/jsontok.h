@@ -0,0 +1,68 @@
+// jsontok.h
+#ifndef JSONTOK_H
+#define JSONTOK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Tách token JSON không cấp phát, không chép: mỗi token chỉ là vị trí/độ dài trong chuỗi gốc
+ * (không cần kết thúc NUL). Token xếp theo thứ tự tiền tự; con đầu tiên của object/array nằm
+ * ngay sau cha, token kế tiếp cùng cấp là t[i].end. Trong object, con xen kẽ khóa rồi giá trị.
+ * Đủ cho message lệnh nhỏ (vài chục token); không giải mã escape trong chuỗi.
+ */
+
+#ifndef JSONTOK_MAX_DEPTH
+#define JSONTOK_MAX_DEPTH       4
+#endif
+
+typedef enum {
+    JSONTOK_OBJECT = 0,
+    JSONTOK_ARRAY,
+    JSONTOK_STRING,             // start/len không gồm dấu nháy
+    JSONTOK_NUMBER,
+    JSONTOK_BOOL,
+    JSONTOK_NULL,
+} jsontok_type_t;
+
+#define JSONTOK_F_ESCAPED       0x01    // Chuỗi có '\': jsontok_str từ chối chép
+
+typedef struct {
+    uint8_t type;               // jsontok_type_t
+    uint8_t flags;
+    uint16_t start;
+    uint16_t len;
+    uint16_t end;               // Chỉ số token ngay sau cây con của token này
+} jsontok_t;
+
+#define JSONTOK_ERR_SYNTAX      (-1)
+#define JSONTOK_ERR_NOMEM       (-2)    // Hết token
+#define JSONTOK_ERR_DEPTH       (-3)
+
+/**
+ * @brief Tách @p len byte của @p js thành token; toàn bộ đầu vào phải là đúng một giá trị JSON.
+ * @return Số token (token 0 là giá trị gốc), hoặc JSONTOK_ERR_*.
+ */
+int jsontok_parse(const char *js, size_t len, jsontok_t *t, int max);
+
+/** @brief Chỉ số token giá trị của @p key trong object @p obj, -1 nếu không có. */
+int jsontok_obj_get(const char *js, const jsontok_t *t, int obj, const char *key);
+
+/** @brief Token chuỗi @p i có nội dung đúng bằng @p s. */
+bool jsontok_eq(const char *js, const jsontok_t *t, int i, const char *s);
+
+/** @brief Số nguyên hoặc thập phân, nhân 10^@p decimals rồi làm tròn về 0 ("57.5", 2 -> 5750). */
+bool jsontok_fixed(const char *js, const jsontok_t *t, int i, int decimals, int32_t *out);
+
+static inline bool jsontok_int(const char *js, const jsontok_t *t, int i, int32_t *out)
+{
+    return jsontok_fixed(js, t, i, 0, out);
+}
+
+bool jsontok_bool(const char *js, const jsontok_t *t, int i, bool *out);
+
+/** @brief Chép token chuỗi (không escape) vào @p out kèm NUL; false nếu sai kiểu hoặc không vừa. */
+bool jsontok_str(const char *js, const jsontok_t *t, int i, char *out, size_t out_size);
+
+#endif // JSONTOK_H
@@ -0,0 +1,74 @@
+// mq2_lut.h - SINH TỰ ĐỘNG bởi tools/gen_mq2_lut.py, không sửa tay
+// Chỉ include từ mq2_ppm.c, sau mq2_ppm.h (bảng đánh chỉ số theo mq2_gas_t)
+#ifndef MQ2_LUT_H
+#define MQ2_LUT_H
+
+#include <stdint.h>
+
+#define MQ2_LUT_PPM_MAX         10000
+#define MQ2_LUT_LOG2_MIN_Q8     (-1024)     // log2(Rs/R0) của ô đầu, Q8
+#define MQ2_LUT_STEP_SHIFT      4       // Q8 -> chỉ số ô: 1/16 octave mỗi ô
+#define MQ2_LUT_GAS_ENTRIES     129
+#define MQ2_LUT_LOG2_FRAC_BITS  6
+#define MQ2_LUT_TEMP_MIN_C      (-10)
+#define MQ2_LUT_TEMP_STEP_C     5
+#define MQ2_LUT_TEMP_ENTRIES    15
+
+// log2(1 + (i + 0.5)/64), Q8
+static const uint8_t MQ2_LUT_LOG2_FRAC[64] = {
+        3,     9,    14,    20,    25,    30,    36,    41,    46,    51,    56,    61,    66,    71,    75,    80,
+       85,    89,    94,    98,   103,   107,   111,   116,   120,   124,   128,   132,   136,   140,   144,   148,
+      152,   155,   159,   163,   167,   170,   174,   178,   181,   185,   188,   192,   195,   198,   202,   205,
+      208,   212,   215,   218,   221,   224,   228,   231,   234,   237,   240,   243,   246,   249,   252,   255,
+};
+
+// ppm theo log2(Rs/R0) = MQ2_LUT_LOG2_MIN_Q8/256 + i/16; thứ tự theo mq2_gas_t
+static const uint16_t MQ2_LUT_PPM[MQ2_GAS_COUNT][MQ2_LUT_GAS_ENTRIES] = {
+    [MQ2_GAS_LPG] = {
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,  9912,  9029,  8225,
+         7493,  6826,  6218,  5664,  5160,  4700,  4282,  3900,  3553,  3237,  2948,  2686,
+         2447,  2229,  2030,  1850,  1685,  1535,  1398,  1274,  1160,  1057,   963,   877,
+          799,   728,   663,   604,   550,   501,   457,   416,   379,   345,   314,   286,
+          261,   238,   216,   197,   180,   164,   149,   136,   124,   113,   103,    94,
+           85,    78,    71,    64,    59,    53,    49,    44,    40,    37,    34,    31,
+           28,    25,    23,    21,    19,    17,    16,    14,    13,    12,    11,    10,
+            9,     8,     8,     7,     6,     6,     5,     5,     4,     4,     4,     3,
+            3,     3,     2,     2,     2,     2,     2,     2,     1,
+    },
+    [MQ2_GAS_SMOKE] = {
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000,  9256,  8394,  7613,  6904,  6262,  5679,  5150,
+         4671,  4236,  3842,  3484,  3160,  2866,  2599,  2357,  2138,  1939,  1758,  1595,
+         1446,  1312,  1189,  1079,   978,   887,   805,   730,   662,   600,   544,   494,
+          448,   406,   368,   334,   303,   275,   249,   226,   205,   186,   169,   153,
+          139,   126,   114,   103,    94,    85,    77,    70,    63,    58,    52,    47,
+           43,    39,    35,    32,    29,    26,    24,    22,    20,    18,    16,    15,
+           13,    12,    11,    10,     9,     8,     7,     7,     6,
+    },
+    [MQ2_GAS_CO] = {
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,
+        10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000, 10000,  9908,
+         8722,  7678,  6758,  5949,  5237,  4610,  4058,  3572,  3145,  2768,  2437,  2145,
+         1888,  1662,  1463,  1288,  1134,   998,   879,   773,   681,   599,   528,   464,
+          409,   360,   317,   279,   246,   216,   190,   167,   147,   130,   114,   101,
+           89,    78,    69,    60,    53,    47,    41,    36,    32,    28,    25,    22,
+           19,    17,    15,    13,    12,    10,     9,     8,     7,
+    },
+};
+
+// Rs(T)/Rs(20 °C), Q12; T = MQ2_LUT_TEMP_MIN_C + i * MQ2_LUT_TEMP_STEP_C
+static const uint16_t MQ2_LUT_TEMP_Q12[MQ2_LUT_TEMP_ENTRIES] = {
+     5652,  5325,  4997,  4731,  4465,  4280,  4096,  3953,
+     3809,  3707,  3604,  3543,  3482,  3441,  3400,
+};
+
+#endif // MQ2_LUT_H
@@ -0,0 +1,77 @@
+// mq2_ppm.c - quy đổi Rs/R0 -> ppm bằng bảng tra, dùng chung cho backend ADC và sim
+#include "mq2_ppm.h"
+#include "mq2_lut.h"
+
+static int clamp_raw(int raw)
+{
+    if (raw < 1) return 1;
+    if (raw > MQ2_VC_RAW - 1) return MQ2_VC_RAW - 1;
+    return raw;
+}
+
+uint32_t mq2_ratio_q16(int raw, int baseline_raw)
+{
+    raw = clamp_raw(raw);
+    baseline_raw = clamp_raw(baseline_raw);
+    // Rs tỉ lệ (Vc - V)/V; RL và Vc tuyệt đối triệt tiêu khi chia cho R0
+    const uint64_t num = (uint64_t)(MQ2_VC_RAW - raw) * (uint64_t)baseline_raw * MQ2_CLEAN_AIR_RATIO_Q16;
+    const uint64_t den = (uint64_t)raw * (uint64_t)(MQ2_VC_RAW - baseline_raw);
+    const uint64_t ratio = num / den;
+    return ratio > UINT32_MAX ? UINT32_MAX : (uint32_t)ratio;
+}
+
+static uint32_t temp_factor_q12(int32_t temp_cdeg)
+{
+    const int32_t step_cdeg = MQ2_LUT_TEMP_STEP_C * 100;
+    int32_t pos = temp_cdeg - MQ2_LUT_TEMP_MIN_C * 100;
+    if (pos <= 0) return MQ2_LUT_TEMP_Q12[0];
+    const int32_t idx = pos / step_cdeg;
+    if (idx >= MQ2_LUT_TEMP_ENTRIES - 1) return MQ2_LUT_TEMP_Q12[MQ2_LUT_TEMP_ENTRIES - 1];
+    const int32_t a = MQ2_LUT_TEMP_Q12[idx];
+    const int32_t b = MQ2_LUT_TEMP_Q12[idx + 1];
+    return (uint32_t)(a + (b - a) * (pos - idx * step_cdeg) / step_cdeg);
+}
+
+uint32_t mq2_temp_compensate(uint32_t ratio_q16, int32_t temp_cdeg, int32_t cal_temp_cdeg)
+{
+    // Rs giảm khi nóng lên: chia cho hệ số lúc đo, nhân hệ số lúc hiệu chỉnh
+    const uint64_t r = (uint64_t)ratio_q16 * temp_factor_q12(cal_temp_cdeg) / temp_factor_q12(temp_cdeg);
+    return r > UINT32_MAX ? UINT32_MAX : (uint32_t)r;
+}
+
+// log2(x / 65536) ở Q8: bit cao nhất qua CLZ, phần lẻ qua bảng mantissa
+static int32_t log2_q16_to_q8(uint32_t x)
+{
+    const int msb = 31 - __builtin_clz(x);
+    const uint32_t frac = (msb >= MQ2_LUT_LOG2_FRAC_BITS)
+                              ? (x >> (msb - MQ2_LUT_LOG2_FRAC_BITS))
+                              : (x << (MQ2_LUT_LOG2_FRAC_BITS - msb));
+    return (msb - 16) * 256 + MQ2_LUT_LOG2_FRAC[frac & ((1u << MQ2_LUT_LOG2_FRAC_BITS) - 1)];
+}
+
+uint16_t mq2_ppm_from_ratio(mq2_gas_t gas, uint32_t ratio_q16)
+{
+    if ((unsigned)gas >= MQ2_GAS_COUNT) return 0;
+    const uint16_t *lut = MQ2_LUT_PPM[gas];
+    if (ratio_q16 == 0) return lut[0];
+
+    const int32_t pos = log2_q16_to_q8(ratio_q16) - MQ2_LUT_LOG2_MIN_Q8;
+    if (pos <= 0) return lut[0];
+    const int32_t idx = pos >> MQ2_LUT_STEP_SHIFT;
+    if (idx >= MQ2_LUT_GAS_ENTRIES - 1) return lut[MQ2_LUT_GAS_ENTRIES - 1];
+
+    const int32_t frac = pos & ((1 << MQ2_LUT_STEP_SHIFT) - 1);
+    const int32_t a = lut[idx];
+    const int32_t b = lut[idx + 1];
+    return (uint16_t)(a + (((b - a) * frac) >> MQ2_LUT_STEP_SHIFT));
+}
+
+const char *mq2_gas_name(mq2_gas_t gas)
+{
+    switch (gas) {
+        case MQ2_GAS_LPG: return "lpg";
+        case MQ2_GAS_SMOKE: return "smoke";
+        case MQ2_GAS_CO: return "co";
+        default: return "?";
+    }
+}
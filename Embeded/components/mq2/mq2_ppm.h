@@ -0,0 +1,55 @@
+// mq2_ppm.h
+#ifndef MQ2_PPM_H
+#define MQ2_PPM_H
+
+#include <stdint.h>
+
+/*
+ * Quy đổi điện áp ngõ AO của MQ-2 ra nồng độ (ppm) bằng số nguyên:
+ *   Rs/R0  = MQ2_CLEAN_AIR_RATIO * [(Vc - V)/V] / [(Vc - V0)/V0]   (V0: baseline khi hiệu chỉnh)
+ *   log2   = CLZ + bảng mantissa
+ *   ppm    = bảng theo log2(Rs/R0) của từng khí, nội suy tuyến tính giữa hai ô
+ * Bảng sinh sẵn trong mq2_lut.h (tools/gen_mq2_lut.py) từ đường cong datasheet;
+ * không dùng powf/logf lúc chạy. Không phụ thuộc IDF.
+ */
+
+// Giá trị ADC thô tương ứng điện áp cấp cho mạch cảm biến (Vc) đo tại chân ADC.
+// Mặc định: module cấp 5 V, AO qua cầu chia về 0..3.3 V nên Vc rơi đúng full-scale 12 bit.
+#ifndef MQ2_VC_RAW
+#define MQ2_VC_RAW 4095
+#endif
+
+// Rs/R0 trong không khí sạch theo datasheet (9.83), Q16
+#ifndef MQ2_CLEAN_AIR_RATIO_Q16
+#define MQ2_CLEAN_AIR_RATIO_Q16 644219u
+#endif
+
+// Nhiệt độ mặc định khi chưa có DS18B20 (điều kiện chuẩn của datasheet), 0.01 °C
+#define MQ2_TEMP_REF_CDEG 2000
+
+typedef enum {
+    MQ2_GAS_LPG = 0,
+    MQ2_GAS_SMOKE,
+    MQ2_GAS_CO,
+    MQ2_GAS_COUNT
+} mq2_gas_t;
+
+/**
+ * @brief Rs/R0 (Q16) từ giá trị ADC hiện tại và baseline lúc hiệu chỉnh.
+ */
+uint32_t mq2_ratio_q16(int raw, int baseline_raw);
+
+/**
+ * @brief Bù nhiệt: đưa Rs/R0 đo ở @p temp_cdeg về điều kiện lúc hiệu chỉnh (@p cal_temp_cdeg).
+ * Ngoài dải bảng (-10..60 °C) thì kẹp ở ô biên.
+ */
+uint32_t mq2_temp_compensate(uint32_t ratio_q16, int32_t temp_cdeg, int32_t cal_temp_cdeg);
+
+/**
+ * @brief Nồng độ của @p gas theo Rs/R0, kẹp trong 0..MQ2_LUT_PPM_MAX (mq2_lut.h).
+ */
+uint16_t mq2_ppm_from_ratio(mq2_gas_t gas, uint32_t ratio_q16);
+
+const char *mq2_gas_name(mq2_gas_t gas);
+
+#endif // MQ2_PPM_H
@@ -1,21 +1,66 @@
 // mq2_sensor.c
 #include "mq2_sensor.h"
+#include <stdbool.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_adc/adc_oneshot.h"
+#include "binlog.h"
 
-// ADC channel for ESP32-C3: ADC_CHANNEL_0 corresponds to GPIO0
-#define MQ2_CHANNEL ADC_CHANNEL_0
+#define MQ2_CHANNEL ((adc_channel_t)MQ2_ADC_CHANNEL)
 
 static const char *TAG = "MQ2_SENSOR";
 
 // Các biến nội bộ, được giấu đi khỏi app_main.c
 static adc_oneshot_unit_handle_t adc_handle = NULL;
 static int baseline = 0;
+static bool calibrated = false;
+static mq2_raw_reader_t raw_reader = NULL;
+static volatile int32_t ambient_cdeg = MQ2_TEMP_REF_CDEG;
+static int32_t calib_cdeg = MQ2_TEMP_REF_CDEG;
+
+void mq2_set_raw_reader(mq2_raw_reader_t reader)
+{
+    raw_reader = reader;
+}
+
+static esp_err_t mq2_read_raw(int *raw)
+{
+    if (raw_reader != NULL) {
+        *raw = raw_reader();
+        return (*raw < 0) ? ESP_ERR_INVALID_STATE : ESP_OK;
+    }
+    return adc_oneshot_read(adc_handle, MQ2_CHANNEL, raw);
+}
+
+// Trung bình 20 mẫu cách nhau 2 ms để lọc nhiễu ADC
+static esp_err_t mq2_read_avg(int *avg)
+{
+    const int avg_samples = 20;
+    long sum = 0;
+
+    for (int i = 0; i < avg_samples; ++i) {
+        int raw = 0;
+        esp_err_t err = mq2_read_raw(&raw);
+        if (err != ESP_OK) return err;
+        sum += raw;
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    *avg = sum / avg_samples;
+    return ESP_OK;
+}
+
+void mq2_set_ambient_temp(int32_t temp_cdeg)
+{
+    ambient_cdeg = temp_cdeg;
+}
 
 void mq2_init(void)
 {
+    if (raw_reader != NULL) {
+        ESP_LOGI(TAG, "MQ2 read through external ADC source");
+        return;
+    }
     adc_oneshot_unit_init_cfg_t init_cfg = {
         .unit_id = ADC_UNIT_1,
     };
@@ -40,28 +85,22 @@ void mq2_calibrate(void)
     const int samples = 100;
     for (int i = 0; i < samples; ++i) {
         int raw = 0;
-        ESP_ERROR_CHECK(adc_oneshot_read(adc_handle, MQ2_CHANNEL, &raw));
+        ESP_ERROR_CHECK(mq2_read_raw(&raw));
         sum += raw;
         vTaskDelay(pdMS_TO_TICKS(50));
     }
     baseline = sum / samples;
-    ESP_LOGI(TAG, "Calibration complete. Baseline=%d", baseline);
+    calib_cdeg = ambient_cdeg;
+    calibrated = true;
+    ESP_LOGI(TAG, "Calibration complete. Baseline=%d at %.1f C", baseline, calib_cdeg / 100.0f);
 
 }
 
 int mq2_read_value(void)
 {
-    const int avg_samples = 20;
     const int margin = 20; // Ngưỡng sai số để xác định có khí hay chưa
-    long sum = 0;
-
-    for (int i = 0; i < avg_samples; ++i) {
-        int raw = 0;
-        ESP_ERROR_CHECK(adc_oneshot_read(adc_handle, MQ2_CHANNEL, &raw));
-        sum += raw;
-        vTaskDelay(pdMS_TO_TICKS(2));
-    }
-    int rawValue = sum / avg_samples;
+    int rawValue = 0;
+    ESP_ERROR_CHECK(mq2_read_avg(&rawValue));
     int gasValue = 0;
 
     // Nếu vượt baseline + margin thì coi là có khí
@@ -72,7 +111,25 @@ int mq2_read_value(void)
     }
 
     // In log để debug chính xác sự thay đổi
-    ESP_LOGI(TAG, "Raw=%d, Baseline=%d, Diff=%d", rawValue, baseline, rawValue - baseline);
+    BLOGI(TAG, "Raw=%d, Baseline=%d, Diff=%d", rawValue, baseline, rawValue - baseline);
 
     return gasValue;
-}
\ No newline at end of file
+}
+
+esp_err_t mq2_read_ppm(mq2_reading_t *out)
+{
+    if (!calibrated) return ESP_ERR_INVALID_STATE;
+    int raw = 0;
+    esp_err_t err = mq2_read_avg(&raw);
+    if (err != ESP_OK) return err;
+
+    out->raw = raw;
+    out->ratio_q16 = mq2_temp_compensate(mq2_ratio_q16(raw, baseline), ambient_cdeg, calib_cdeg);
+    for (int g = 0; g < MQ2_GAS_COUNT; g++) {
+        out->ppm[g] = mq2_ppm_from_ratio((mq2_gas_t)g, out->ratio_q16);
+    }
+
+    BLOGI(TAG, "Raw=%d, Rs/R0=%.2f, LPG=%u, Smoke=%u, CO=%u ppm", raw, out->ratio_q16 / 65536.0f,
+          out->ppm[MQ2_GAS_LPG], out->ppm[MQ2_GAS_SMOKE], out->ppm[MQ2_GAS_CO]);
+    return ESP_OK;
+}
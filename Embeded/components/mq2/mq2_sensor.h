@@ -2,11 +2,42 @@
 #ifndef MQ2_SENSOR_H
 #define MQ2_SENSOR_H
 
+#include <stdint.h>
+#include "esp_err.h"
+#include "mq2_ppm.h"
+
+// Kênh ADC1 nối với ngõ AO của MQ2 (ADC_CHANNEL_0 = GPIO36 trên ESP32)
+#define MQ2_ADC_CHANNEL 0
+
+typedef struct {
+    int raw;                            // ADC trung bình của lần đọc
+    uint32_t ratio_q16;                 // Rs/R0 đã bù nhiệt, Q16
+    uint16_t ppm[MQ2_GAS_COUNT];        // Nồng độ ước lượng theo từng khí
+} mq2_reading_t;
+
+/**
+ * @brief Nguồn đọc giá trị ADC thô thay cho adc_oneshot.
+ * @return Giá trị 0..4095, âm nếu chưa có mẫu.
+ */
+typedef int (*mq2_raw_reader_t)(void);
+
+/**
+ * @brief Đọc MQ2 qua nguồn ngoài (vd. khi ADC1 đang chạy continuous cho cảm biến lửa
+ * thì adc_oneshot trên ADC1 bị từ chối). Gọi trước mq2_init().
+ */
+void mq2_set_raw_reader(mq2_raw_reader_t reader);
+
 /**
  * @brief Khởi tạo ADC cho cảm biến MQ2.
  */
 void mq2_init(void);
 
+/**
+ * @brief Cập nhật nhiệt độ môi trường (0.01 °C, từ DS18B20) để bù nhiệt cho Rs/R0.
+ * Giá trị lúc hiệu chỉnh được giữ làm mốc; chưa gọi thì coi như MQ2_TEMP_REF_CDEG.
+ */
+void mq2_set_ambient_temp(int32_t temp_cdeg);
+
 /**
  * @brief Hiệu chỉnh giá trị baseline cho cảm biến trong môi trường không khí sạch.
  * Hàm này sẽ block trong vài giây.
@@ -21,4 +52,10 @@ void mq2_calibrate(void);
  */
 int mq2_read_value(void);
 
+/**
+ * @brief Đọc MQ2 và quy đổi ra ppm (bảng tra, không dùng số thực).
+ * @return ESP_ERR_INVALID_STATE nếu chưa hiệu chỉnh hoặc nguồn ADC chưa có mẫu.
+ */
+esp_err_t mq2_read_ppm(mq2_reading_t *out);
+
 #endif // MQ2_SENSOR_H
\ No newline at end of file
@@ -0,0 +1,71 @@
+// mq2_sensor_linux.c - backend cho target linux: giá trị gas lấy từ kịch bản mô phỏng
+#include <stdbool.h>
+#include <stdlib.h>
+#include "mq2_sensor.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "binlog.h"
+#include "sim.h"
+
+static const char *TAG = "MQ2_SENSOR";
+
+// Giá trị sim_gas() là độ lệch ADC so với baseline mô phỏng này; quy đổi ppm dùng
+// đúng đường bảng tra như phần cứng
+#define MQ2_SIM_BASELINE_RAW 400
+
+static bool s_calibrated = false;
+static volatile int32_t s_ambient_cdeg = MQ2_TEMP_REF_CDEG;
+static int32_t s_calib_cdeg = MQ2_TEMP_REF_CDEG;
+
+// Giá trị đã lấy thẳng từ kịch bản, không có ADC để dùng chung
+void mq2_set_raw_reader(mq2_raw_reader_t reader)
+{
+    (void)reader;
+}
+
+void mq2_set_ambient_temp(int32_t temp_cdeg)
+{
+    s_ambient_cdeg = temp_cdeg;
+}
+
+void mq2_init(void)
+{
+    ESP_LOGI(TAG, "MQ2 simulated (scenario driven)");
+}
+
+void mq2_calibrate(void)
+{
+    // Giữ thời gian làm nóng để trình tự khởi động giống phần cứng; rút ngắn được khi soak test
+    int warmup_ms = atoi(sim_getenv("SIM_MQ2_WARMUP_MS", "30000"));
+    ESP_LOGW(TAG, "Simulated MQ-2 warm-up %d ms", warmup_ms);
+    if (warmup_ms > 0) {
+        vTaskDelay(pdMS_TO_TICKS(warmup_ms));
+    }
+    s_calib_cdeg = s_ambient_cdeg;
+    s_calibrated = true;
+    ESP_LOGI(TAG, "Calibration complete. Baseline=%d at %.1f C", MQ2_SIM_BASELINE_RAW, s_calib_cdeg / 100.0f);
+}
+
+int mq2_read_value(void)
+{
+    int gasValue = sim_gas();
+    BLOGI(TAG, "Raw=%d, Baseline=%d, Diff=%d", gasValue, 0, gasValue);
+    return gasValue;
+}
+
+esp_err_t mq2_read_ppm(mq2_reading_t *out)
+{
+    if (!s_calibrated) return ESP_ERR_INVALID_STATE;
+    const int raw = MQ2_SIM_BASELINE_RAW + sim_gas();
+
+    out->raw = raw;
+    out->ratio_q16 = mq2_temp_compensate(mq2_ratio_q16(raw, MQ2_SIM_BASELINE_RAW), s_ambient_cdeg, s_calib_cdeg);
+    for (int g = 0; g < MQ2_GAS_COUNT; g++) {
+        out->ppm[g] = mq2_ppm_from_ratio((mq2_gas_t)g, out->ratio_q16);
+    }
+
+    BLOGI(TAG, "Raw=%d, Rs/R0=%.2f, LPG=%u, Smoke=%u, CO=%u ppm", raw, out->ratio_q16 / 65536.0f,
+          out->ppm[MQ2_GAS_LPG], out->ppm[MQ2_GAS_SMOKE], out->ppm[MQ2_GAS_CO]);
+    return ESP_OK;
+}
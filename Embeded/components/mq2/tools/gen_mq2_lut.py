@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+# gen_mq2_lut.py - sinh mq2_lut.h: bảng tra cố định cho quy đổi Rs/R0 -> ppm và bù nhiệt MQ-2
+#
+# Chạy lại khi đổi đường cong hoặc độ phân giải:
+#     python3 tools/gen_mq2_lut.py > mq2_lut.h
+# Firmware chỉ đọc bảng (flash), không gọi powf/logf lúc chạy.
+
+import math
+
+# Đường cong Rs/R0 theo ppm (hình 1 datasheet Hanwei MQ-2, log-log gần thẳng):
+# hai điểm đầu/cuối dải đo 200..10000 ppm cho mỗi khí
+GASES = [
+    ("LPG",   (200, 1.60), (10000, 0.26)),
+    ("SMOKE", (200, 3.40), (10000, 0.60)),
+    ("CO",    (200, 5.10), (10000, 1.35)),
+]
+
+# Rs(T)/Rs(20 °C) ở 33 %RH (hình 2 datasheet), nội suy tuyến tính giữa các điểm đọc được
+TEMP_POINTS = [(-10, 1.38), (0, 1.22), (10, 1.09), (20, 1.00), (30, 0.93), (40, 0.88), (50, 0.85), (60, 0.83)]
+
+PPM_MAX = 10000
+LOG2_MIN = -4               # Rs/R0 = 1/16
+LOG2_MAX = 4                # Rs/R0 = 16
+LOG2_STEP_SHIFT = 4         # 1/16 octave mỗi ô
+LOG2_FRAC_BITS = 6          # Bảng mantissa 64 ô
+TEMP_MIN_C = -10
+TEMP_STEP_C = 5
+TEMP_MAX_C = 60
+
+
+def ppm_at(p0, p1, ratio):
+    (c0, r0), (c1, r1) = p0, p1
+    slope = (math.log10(r1) - math.log10(r0)) / (math.log10(c1) - math.log10(c0))
+    return 10 ** ((math.log10(ratio) - math.log10(r0)) / slope + math.log10(c0))
+
+
+def temp_factor(t):
+    for (t0, f0), (t1, f1) in zip(TEMP_POINTS, TEMP_POINTS[1:]):
+        if t0 <= t <= t1:
+            return f0 + (f1 - f0) * (t - t0) / (t1 - t0)
+    raise ValueError(t)
+
+
+def rows(values, per_line=12):
+    out = []
+    for i in range(0, len(values), per_line):
+        out.append("    " + ", ".join("%5d" % v for v in values[i:i + per_line]) + ",")
+    return "\n".join(out)
+
+
+def main():
+    n_gas = (LOG2_MAX - LOG2_MIN) * (1 << LOG2_STEP_SHIFT) + 1
+    # Giá trị giữa ô để sai số cắt mantissa chia đều hai phía
+    log2_frac = [round(math.log2(1 + (i + 0.5) / (1 << LOG2_FRAC_BITS)) * 256)
+                 for i in range(1 << LOG2_FRAC_BITS)]
+    n_temp = (TEMP_MAX_C - TEMP_MIN_C) // TEMP_STEP_C + 1
+    temp = [round(temp_factor(TEMP_MIN_C + i * TEMP_STEP_C) * 4096) for i in range(n_temp)]
+
+    print("// mq2_lut.h - SINH TỰ ĐỘNG bởi tools/gen_mq2_lut.py, không sửa tay")
+    print("// Chỉ include từ mq2_ppm.c, sau mq2_ppm.h (bảng đánh chỉ số theo mq2_gas_t)")
+    print("#ifndef MQ2_LUT_H")
+    print("#define MQ2_LUT_H")
+    print()
+    print("#include <stdint.h>")
+    print()
+    print("#define MQ2_LUT_PPM_MAX         %d" % PPM_MAX)
+    print("#define MQ2_LUT_LOG2_MIN_Q8     (%d)     // log2(Rs/R0) của ô đầu, Q8" % (LOG2_MIN * 256))
+    print("#define MQ2_LUT_STEP_SHIFT      %d       // Q8 -> chỉ số ô: 1/%d octave mỗi ô" % (8 - LOG2_STEP_SHIFT, 1 << LOG2_STEP_SHIFT))
+    print("#define MQ2_LUT_GAS_ENTRIES     %d" % n_gas)
+    print("#define MQ2_LUT_LOG2_FRAC_BITS  %d" % LOG2_FRAC_BITS)
+    print("#define MQ2_LUT_TEMP_MIN_C      (%d)" % TEMP_MIN_C)
+    print("#define MQ2_LUT_TEMP_STEP_C     %d" % TEMP_STEP_C)
+    print("#define MQ2_LUT_TEMP_ENTRIES    %d" % n_temp)
+    print()
+    print("// log2(1 + (i + 0.5)/%d), Q8" % (1 << LOG2_FRAC_BITS))
+    print("static const uint8_t MQ2_LUT_LOG2_FRAC[%d] = {" % len(log2_frac))
+    print(rows(log2_frac, 16))
+    print("};")
+    print()
+    print("// ppm theo log2(Rs/R0) = MQ2_LUT_LOG2_MIN_Q8/256 + i/%d; thứ tự theo mq2_gas_t" % (1 << LOG2_STEP_SHIFT))
+    print("static const uint16_t MQ2_LUT_PPM[MQ2_GAS_COUNT][MQ2_LUT_GAS_ENTRIES] = {")
+    for name, p0, p1 in GASES:
+        ppm = []
+        for i in range(n_gas):
+            ratio = 2 ** (LOG2_MIN + i / (1 << LOG2_STEP_SHIFT))
+            ppm.append(min(PPM_MAX, round(ppm_at(p0, p1, ratio))))
+        print("    [MQ2_GAS_%s] = {" % name)
+        print("    " + rows(ppm).replace("\n", "\n    "))
+        print("    },")
+    print("};")
+    print()
+    print("// Rs(T)/Rs(20 °C), Q12; T = MQ2_LUT_TEMP_MIN_C + i * MQ2_LUT_TEMP_STEP_C")
+    print("static const uint16_t MQ2_LUT_TEMP_Q12[MQ2_LUT_TEMP_ENTRIES] = {")
+    print(rows(temp, 8))
+    print("};")
+    print()
+    print("#endif // MQ2_LUT_H")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,275 @@
+// mqtt_tls.c - transport esp-tls cho esp-mqtt, dùng lại session ticket khi kết nối lại
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS    // Đọc hàm verify mà bundle chứng chỉ đã gắn để gọi tiếp
+#include "mqtt_tls.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_tls.h"
+#include "esp_crt_bundle.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "mbedtls/ssl.h"
+
+static const char *TAG = "MQTT_TLS";
+
+typedef struct {
+    const mqtt_tls_config_t *cfg;
+    esp_tls_t *tls;
+    mbedtls_x509_crt ca;                // cfg->ca_pem đã parse (khi có)
+    int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *);     // Hàm verify gốc của cấu hình
+    void *p_vrfy;
+    uint32_t certs_verified;            // Số chứng chỉ broker gửi trong lần bắt tay đang chạy
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    esp_tls_client_session_t *session;  // Ticket của lần bắt tay thành công gần nhất
+#if CONFIG_MBEDTLS_SSL_PROTO_TLS1_3
+    bool ticket_pending;                // Lấy ticket sau lần đọc dữ liệu ứng dụng đầu tiên
+#endif
+#endif
+} mqtt_tls_ctx_t;
+
+static mqtt_tls_stats_t s_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+// Transport đang bắt tay: crt_bundle_attach của esp-tls không có tham số ngữ cảnh.
+// Chỉ task MQTT gọi connect nên mỗi lúc có nhiều nhất một lần bắt tay
+static mqtt_tls_ctx_t *s_handshake_ctx;
+
+static void mqtt_tls_record(bool offered, bool resumed, bool ok, uint32_t took_ms)
+{
+    portENTER_CRITICAL(&s_stats_mux);
+    if (!ok) {
+        s_stats.failed++;
+    } else if (resumed) {
+        s_stats.resumed++;
+        s_stats.resumed_last_ms = took_ms;
+        if (took_ms > s_stats.resumed_max_ms) s_stats.resumed_max_ms = took_ms;
+    } else {
+        s_stats.full++;
+        if (offered) s_stats.rejected++;
+        s_stats.full_last_ms = took_ms;
+        if (took_ms > s_stats.full_max_ms) s_stats.full_max_ms = took_ms;
+    }
+    if (ok) s_stats.last_resumed = resumed;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
+
+static int mqtt_tls_sockfd(mqtt_tls_ctx_t *ctx)
+{
+    int fd = -1;
+    if (ctx->tls == NULL || esp_tls_get_conn_sockfd(ctx->tls, &fd) != ESP_OK) return -1;
+    return fd;
+}
+
+// Chỉ được gọi khi broker gửi chứng chỉ (bắt tay đầy đủ): phiên dùng lại bỏ qua bước này
+static int mqtt_tls_verify(void *arg, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+    mqtt_tls_ctx_t *ctx = (mqtt_tls_ctx_t *)arg;
+    ctx->certs_verified++;
+    return ctx->f_vrfy != NULL ? ctx->f_vrfy(ctx->p_vrfy, crt, depth, flags) : 0;
+}
+
+// Thay crt_bundle_attach: gắn CA (của cấu hình hoặc bundle) rồi bọc hàm verify để đếm chứng chỉ
+static esp_err_t mqtt_tls_attach(void *conf_arg)
+{
+    mbedtls_ssl_config *conf = (mbedtls_ssl_config *)conf_arg;
+    mqtt_tls_ctx_t *ctx = s_handshake_ctx;
+    if (ctx->cfg->ca_pem != NULL) {
+        mbedtls_ssl_conf_ca_chain(conf, &ctx->ca, NULL);
+    } else {
+        const esp_err_t err = esp_crt_bundle_attach(conf);
+        if (err != ESP_OK) return err;
+    }
+    ctx->f_vrfy = conf->MBEDTLS_PRIVATE(f_vrfy);
+    ctx->p_vrfy = conf->MBEDTLS_PRIVATE(p_vrfy);
+    mbedtls_ssl_conf_verify(conf, mqtt_tls_verify, ctx);
+    return ESP_OK;
+}
+
+static int mqtt_tls_close(esp_transport_handle_t t)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    int ret = 0;
+    if (ctx->tls != NULL) {
+        ret = esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = NULL;
+    }
+    return ret;
+}
+
+static int mqtt_tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    mqtt_tls_close(t);
+
+    // CA luôn gắn qua mqtt_tls_attach (esp-tls bỏ qua cacert_buf khi có crt_bundle_attach)
+    esp_tls_cfg_t tls_cfg = {
+        .timeout_ms = timeout_ms,
+        .common_name = ctx->cfg->common_name,
+        .crt_bundle_attach = mqtt_tls_attach,
+    };
+    bool offered = false;
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (ctx->cfg->session_tickets && ctx->session != NULL) {
+        tls_cfg.client_session = ctx->session;
+        offered = true;
+    }
+#endif
+
+    ctx->tls = esp_tls_init();
+    if (ctx->tls == NULL) return -1;
+
+    ctx->certs_verified = 0;
+    s_handshake_ctx = ctx;
+    const int64_t start_us = esp_timer_get_time();
+    const int ret = esp_tls_conn_new_sync(host, (int)strlen(host), port, &tls_cfg, ctx->tls);
+    const uint32_t took_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    s_handshake_ctx = NULL;
+    // Broker nhận ticket thì không gửi chứng chỉ: đó mới là phiên dùng lại, không phải "có đưa ticket"
+    const bool resumed = offered && ctx->certs_verified == 0;
+    mqtt_tls_record(offered, resumed, ret > 0, took_ms);
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // Ticket chỉ dùng một lần: bỏ ticket cũ dù thành công hay thất bại (broker có thể đã đổi khóa
+    // ticket). sdkconfig chỉ bật TLS 1.2: broker gửi NewSessionTicket trong bắt tay, trước
+    // ChangeCipherSpec/Finished, nên ticket mới đã có ngay khi bắt tay xong. TLS 1.3 gửi nó sau
+    // bắt tay; khi bật CONFIG_MBEDTLS_SSL_PROTO_TLS1_3 thì mqtt_tls_read lấy sau lần đọc đầu tiên
+    if (ctx->session != NULL) {
+        esp_tls_free_client_session(ctx->session);
+        ctx->session = NULL;
+    }
+#if CONFIG_MBEDTLS_SSL_PROTO_TLS1_3
+    ctx->ticket_pending = ret > 0 && ctx->cfg->session_tickets;
+#else
+    if (ret > 0 && ctx->cfg->session_tickets) ctx->session = esp_tls_get_client_session(ctx->tls);
+#endif
+#endif
+    if (ret <= 0) {
+        ESP_LOGW(TAG, "Handshake with %s:%d failed after %lu ms", host, port, (unsigned long)took_ms);
+        mqtt_tls_close(t);
+        return -1;
+    }
+    ESP_LOGI(TAG, "%s handshake with %s:%d in %lu ms%s", resumed ? "Resumed" : "Full",
+             host, port, (unsigned long)took_ms, offered && !resumed ? " (ticket rejected)" : "");
+    return 0;
+}
+
+// > 0: đọc được, 0: hết thời gian, < 0: lỗi socket
+static int mqtt_tls_poll(mqtt_tls_ctx_t *ctx, bool for_write, int timeout_ms)
+{
+    const int fd = mqtt_tls_sockfd(ctx);
+    if (fd < 0) return -1;
+    if (!for_write && esp_tls_get_bytes_avail(ctx->tls) > 0) return 1;    // mbedtls còn dữ liệu đã giải mã
+
+    fd_set set, errset;
+    FD_ZERO(&set);
+    FD_ZERO(&errset);
+    FD_SET(fd, &set);
+    FD_SET(fd, &errset);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    int ret = select(fd + 1, for_write ? NULL : &set, for_write ? &set : NULL, &errset,
+                     timeout_ms < 0 ? NULL : &tv);
+    if (ret > 0 && FD_ISSET(fd, &errset)) {
+        int sock_errno = 0;
+        socklen_t optlen = sizeof(sock_errno);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &sock_errno, &optlen);
+        ESP_LOGE(TAG, "Socket error %d", sock_errno);
+        ret = -1;
+    }
+    return ret;
+}
+
+static int mqtt_tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return mqtt_tls_poll(esp_transport_get_context_data(t), false, timeout_ms);
+}
+
+static int mqtt_tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return mqtt_tls_poll(esp_transport_get_context_data(t), true, timeout_ms);
+}
+
+static int mqtt_tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    const int poll = mqtt_tls_poll(ctx, false, timeout_ms);
+    if (poll <= 0) return poll;
+
+    const int ret = (int)esp_tls_conn_read(ctx->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_TIMEOUT) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret < 0) return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    if (ret == 0) return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;   // Socket báo đọc được nhưng đã đóng
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS && CONFIG_MBEDTLS_SSL_PROTO_TLS1_3
+    if (ctx->ticket_pending) {
+        // Mọi bản ghi trước dữ liệu ứng dụng đầu tiên (gồm NewSessionTicket) đã được mbedtls xử lý
+        ctx->ticket_pending = false;
+        ctx->session = esp_tls_get_client_session(ctx->tls);
+    }
+#endif
+    return ret;
+}
+
+static int mqtt_tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    const int poll = mqtt_tls_poll(ctx, true, timeout_ms);
+    if (poll <= 0) return poll;
+
+    const int ret = (int)esp_tls_conn_write(ctx->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_WRITE || ret == ESP_TLS_ERR_SSL_WANT_READ) return 0;
+    return ret < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : ret;
+}
+
+static int mqtt_tls_destroy(esp_transport_handle_t t)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    mqtt_tls_close(t);
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (ctx->session != NULL) esp_tls_free_client_session(ctx->session);
+#endif
+    mbedtls_x509_crt_free(&ctx->ca);
+    free(ctx);
+    return 0;
+}
+
+esp_transport_handle_t mqtt_tls_transport_create(const mqtt_tls_config_t *cfg)
+{
+    mqtt_tls_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    esp_transport_handle_t t = esp_transport_init();
+    if (ctx == NULL || t == NULL) {
+        free(ctx);
+        if (t != NULL) esp_transport_destroy(t);
+        return NULL;
+    }
+    ctx->cfg = cfg;
+    mbedtls_x509_crt_init(&ctx->ca);
+    if (cfg->ca_pem != NULL) {
+        const int err = mbedtls_x509_crt_parse(&ctx->ca, (const unsigned char *)cfg->ca_pem, strlen(cfg->ca_pem) + 1);
+        if (err != 0) {
+            ESP_LOGE(TAG, "Broker CA parse failed: -0x%04x", -err);
+            mbedtls_x509_crt_free(&ctx->ca);
+            free(ctx);
+            esp_transport_destroy(t);
+            return NULL;
+        }
+    }
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_func(t, mqtt_tls_connect, mqtt_tls_read, mqtt_tls_write, mqtt_tls_close,
+                           mqtt_tls_poll_read, mqtt_tls_poll_write, mqtt_tls_destroy);
+    esp_transport_set_default_port(t, 8883);
+#if !CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (cfg->session_tickets) {
+        ESP_LOGW(TAG, "CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS off, every reconnect does a full handshake");
+    }
+#endif
+    return t;
+}
+
+void mqtt_tls_get_stats(mqtt_tls_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_mux);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
@@ -0,0 +1,45 @@
+// mqtt_tls.h
+#ifndef MQTT_TLS_H
+#define MQTT_TLS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_transport.h"
+
+/*
+ * Transport TLS cho esp-mqtt (gắn qua esp_mqtt_client_config_t.network.transport).
+ *
+ * Transport SSL có sẵn của esp-mqtt bắt tay đầy đủ ở mọi lần kết nối lại. Transport này giữ
+ * session ticket của lần bắt tay thành công gần nhất và đưa lại cho broker ở lần sau: broker
+ * nhận ticket thì bỏ qua trao đổi khóa và gửi/kiểm tra chứng chỉ. Thời gian bắt tay chưa được đo
+ * trên thiết bị; mqtt_tls_get_stats ghi lại full/resumed để so sánh.
+ * Cần CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS; không có thì luôn bắt tay đầy đủ.
+ */
+
+typedef struct {
+    const char *ca_pem;         // CA của broker (PEM, kết thúc NUL); NULL: bundle chứng chỉ của ESP-IDF
+    const char *common_name;    // Tên trong chứng chỉ broker; NULL: dùng host của URI
+    bool session_tickets;
+} mqtt_tls_config_t;
+
+typedef struct {
+    uint32_t full;              // Số lần bắt tay đầy đủ (broker gửi chứng chỉ)
+    uint32_t resumed;           // Số lần broker thực sự dùng lại phiên từ ticket
+    uint32_t rejected;          // Trong số full: có đưa ticket nhưng broker không nhận
+    uint32_t failed;
+    uint32_t full_last_ms;
+    uint32_t full_max_ms;
+    uint32_t resumed_last_ms;
+    uint32_t resumed_max_ms;
+    bool last_resumed;          // Lần bắt tay thành công gần nhất là phiên dùng lại
+} mqtt_tls_stats_t;
+
+/**
+ * @brief Tạo transport; @p cfg và chuỗi nó trỏ tới phải sống suốt chương trình.
+ * @return NULL nếu hết bộ nhớ hoặc không đọc được ca_pem.
+ */
+esp_transport_handle_t mqtt_tls_transport_create(const mqtt_tls_config_t *cfg);
+
+void mqtt_tls_get_stats(mqtt_tls_stats_t *out);
+
+#endif // MQTT_TLS_H
@@ -32,18 +32,26 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <string.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "esp_timer.h" // for esp-idf v5
+#include "gpio_hub.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "driver/rmt_rx.h"
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+#endif
 
 #include "RCSwitch.h"
 
 static const char *TAG = "RF433";
 
-static const Protocol proto[] = {
+// DRAM: handleEdge()/receiveProtocol() đọc bảng này từ ngữ cảnh ISR, kể cả khi cache flash tắt
+static const Protocol DRAM_ATTR proto[] = {
   { 350, {  1, 31 }, {  1,  3 }, {  3,  1 }, false },    // protocol 1
   { 650, {  1, 10 }, {  1,  2 }, {  2,  1 }, false },    // protocol 2
   { 100, { 30, 71 }, {  4, 11 }, {  9,  6 }, false },    // protocol 3
@@ -74,6 +82,7 @@ void initSwich(RCSWITCH_t * RCSwitch) {
 	setRepeatTransmit(RCSwitch, 10);
 	setProtocol(RCSwitch, 1);
 	RCSwitch->nReceiverInterrupt = -1;
+	RCSwitch->rmt = NULL;
 	setReceiveTolerance(RCSwitch, 60);
 	RCSwitch->nReceivedValue = 0;
 }
@@ -381,29 +390,46 @@ esp_err_t enableReceive(RCSWITCH_t * RCSwitch, int interrupt) {
 	return (enableReceiveInternal(RCSwitch));
 }
 
-#define ESP_INTR_FLAG_DEFAULT 0
+#define RCSWITCH_HUB_RING_SIZE 256 // Một khung ~50 cạnh, đủ đệm vài khung + nhiễu của RXB6
+
+#if CONFIG_IDF_TARGET_LINUX
+#include "sim.h"
+
+// Target linux: kịch bản mô phỏng giao khung đã giải mã, bỏ qua giải mã độ rộng xung
+static void sim_rf_frame(unsigned long code, unsigned int bitlength, unsigned int protocol, void *ctx) {
+	RCSWITCH_t * RCSwitch = (RCSWITCH_t *)ctx;
+	RCSwitch->nReceivedBitlength = bitlength;
+	RCSwitch->nReceivedProtocol = protocol;
+	RCSwitch->nReceivedDelay = (protocol >= 1 && protocol <= numProto) ? proto[protocol-1].pulseLength : 0;
+	RCSwitch->nReceivedValue = code;
+}
+#endif
 
 
+// Consumer của GPIO hub (task bulk): timestamp đã được lấy trong ISR nên giải mã theo lô vẫn chính xác
+static void rcswitch_edge_cb(gpio_num_t pin, const gpio_hub_edge_t *edge, void *ctx) {
+	handleEdge((RCSWITCH_t *)ctx, edge->ts_us);
+}
+
 esp_err_t enableReceiveInternal(RCSWITCH_t * RCSwitch) {
-	uint64_t gpio_pin_sel = (1ULL<<RCSwitch->nReceiverInterrupt);
-	ESP_LOGI(TAG, "RCSwitch->nReceiverInterrupt=%d gpio_pin_sel=%llu", RCSwitch->nReceiverInterrupt, gpio_pin_sel);
+	ESP_LOGI(TAG, "RCSwitch->nReceiverInterrupt=%d", RCSwitch->nReceiverInterrupt);
 
-	// Configure the data input
-	gpio_config_t io_conf = {
+	// Configure the data input: hub dùng chung một ISR và ghi timestamp từng cạnh
+	gpio_hub_source_config_t src_cfg = {
+		.pin = RCSwitch->nReceiverInterrupt,
+		.name = "rf433",
 		.intr_type = GPIO_INTR_ANYEDGE,
-		.mode = GPIO_MODE_INPUT,
-		.pin_bit_mask = gpio_pin_sel,
-		.pull_up_en = GPIO_PULLUP_ENABLE,
-		.pull_down_en = GPIO_PULLDOWN_DISABLE
+		.pull_up = true,
+		.ring_size = RCSWITCH_HUB_RING_SIZE,
+		.bulk = true,			// Nhiễu RXB6 tạo hàng nghìn cạnh/s: giải mã theo lô ở ưu tiên thấp
+		.cb = rcswitch_edge_cb,
+		.ctx = RCSwitch,
 	};
-	gpio_config(&io_conf);
-
-	//install gpio isr service
-	esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
-	ESP_LOGI(TAG, "gpio_install_isr_service=%d", err);
-	//hook isr handler for specific gpio pin
-	err = gpio_isr_handler_add(RCSwitch->nReceiverInterrupt, handleInterrupt, RCSwitch);
-	ESP_LOGI(TAG, "gpio_isr_handler_add=%d", err);
+	esp_err_t err = gpio_hub_register(&src_cfg);
+	ESP_LOGI(TAG, "gpio_hub_register=%d", err);
+#if CONFIG_IDF_TARGET_LINUX
+	sim_set_rf_sink(sim_rf_frame, RCSwitch);
+#endif
 	return err;
 }
 
@@ -413,7 +439,10 @@ esp_err_t enableReceiveInternal(RCSWITCH_t * RCSwitch) {
 void disableReceive(RCSWITCH_t * RCSwitch) {
 	//detachInterrupt(this->nReceiverInterrupt);
 	//gpio_isr_handler_remove(GPIO_NUM_22);
-	gpio_isr_handler_remove(RCSwitch->nReceiverInterrupt); // nReceiverInterrupt is GPIO
+	gpio_hub_unregister(RCSwitch->nReceiverInterrupt); // nReceiverInterrupt is GPIO
+#if CONFIG_IDF_TARGET_LINUX
+	sim_set_rf_sink(NULL, NULL);
+#endif
 	RCSwitch->nReceiverInterrupt = -1;
 }
 
@@ -446,11 +475,11 @@ unsigned int* getReceivedRawdata(RCSWITCH_t * RCSwitch) {
 }
 
 /* helper function for the receiveProtocol method */
-static inline unsigned int diff(int A, int B) {
+static inline unsigned int IRAM_ATTR diff(int A, int B) {
 	return abs(A - B);
 }
 
-bool receiveProtocol(RCSWITCH_t * RCSwitch, const int p, unsigned int changeCount) {
+bool IRAM_ATTR receiveProtocol(RCSWITCH_t * RCSwitch, const int p, unsigned int changeCount) {
 	const Protocol pro = proto[p-1];
 
 	unsigned long code = 0;
@@ -505,15 +534,17 @@ bool receiveProtocol(RCSWITCH_t * RCSwitch, const int p, unsigned int changeCoun
 }
 
 
-void handleInterrupt(void* arg)
+void IRAM_ATTR handleInterrupt(void* arg)
 {
-	RCSWITCH_t *RCSwitch = (RCSWITCH_t *) arg;
+	handleEdge((RCSWITCH_t *) arg, (uint32_t)esp_timer_get_time());
+}
 
+void IRAM_ATTR handleEdge(RCSWITCH_t * RCSwitch, uint32_t time)
+{
 	static unsigned int changeCount = 0;
-	static unsigned long lastTime = 0;
+	static uint32_t lastTime = 0;
 	static unsigned int repeatCount = 0;
 
-	const long time = esp_timer_get_time();
 	const unsigned int duration = time - lastTime;
 
 	if (duration > RCSwitch->nSeparationLimit) {
@@ -547,3 +578,270 @@ void handleInterrupt(void* arg)
 	RCSwitch->timings[changeCount++] = duration;
 	lastTime = time;
 }
+
+
+/* ============================================================
+ * RMT-RX backend
+ * Phần cứng RMT đo độ rộng từng mức, lọc glitch và kết thúc một lần nhận khi
+ * tín hiệu đứng yên lâu hơn ngưỡng idle (chính là khoảng sync giữa 2 lần lặp).
+ * CPU chỉ nhận một ngắt cho mỗi khung; nhiễu liên tục của module siêu tái sinh
+ * chỉ làm đầy bộ đệm và bị loại ngay bằng kiểm tra độ dài.
+ * ============================================================ */
+#if !CONFIG_IDF_TARGET_LINUX
+
+#define RCSWITCH_RMT_RESOLUTION_HZ   1000000     // 1 tick = 1 us, cùng đơn vị với timings[]
+#define RCSWITCH_RMT_SYMBOLS         64          // Một khối bộ nhớ RMT trên ESP32; khung 32 bit = 34 symbol
+#define RCSWITCH_RMT_GLITCH_MAX_NS   3000        // Giới hạn bộ lọc của phần cứng (255 chu kỳ APB)
+#define RCSWITCH_RMT_WINDOW_MARGIN   25          // % dự phòng khi đặt ngưỡng idle giữa xung dài nhất và sync
+#define RCSWITCH_RMT_REPEAT_US       250000      // Hai khung giống nhau trong khoảng này mới được chấp nhận
+#define RCSWITCH_RMT_MIN_CHANGES     8           // Giống "changeCount > 7" của receiveProtocol
+
+typedef struct {
+	rmt_channel_handle_t channel;
+	QueueHandle_t done_queue;
+	rmt_receive_config_t rx_cfg;
+	uint32_t protocol_mask;
+	rmt_symbol_word_t buf[2][RCSWITCH_RMT_SYMBOLS];   // Ping-pong: nhận vào một nửa khi giải mã nửa kia
+	RCSWITCH_t scratch;                               // Giải mã vào bản nháp, chỉ công bố khi đã xác nhận
+	unsigned long last_code;
+	int64_t last_code_us;
+	rcswitch_rmt_stats_t stats;
+} rcswitch_rmt_t;
+
+typedef struct {
+	size_t num_symbols;
+	int buf_index;
+} rcswitch_rmt_done_t;
+
+// Giới hạn định thời của một giao thức (us): mức dài nhất trong khung, phần dài của sync, mức ngắn nhất
+static void protocolWindow(const Protocol *pro, uint32_t *max_level, uint32_t *sync_long, uint32_t *min_level) {
+	const uint8_t f[] = { pro->zero.high, pro->zero.low, pro->one.high, pro->one.low };
+	uint8_t fmax = (pro->syncFactor.high < pro->syncFactor.low) ? pro->syncFactor.high : pro->syncFactor.low;
+	uint8_t fmin = fmax;
+	for (int i = 0; i < 4; i++) {
+		if (f[i] > fmax) fmax = f[i];
+		if (f[i] < fmin) fmin = f[i];
+	}
+	const uint8_t fsync = (pro->syncFactor.high > pro->syncFactor.low) ? pro->syncFactor.high : pro->syncFactor.low;
+	*max_level = (uint32_t)pro->pulseLength * fmax;
+	*sync_long = (uint32_t)pro->pulseLength * fsync;
+	*min_level = (uint32_t)pro->pulseLength * fmin;
+}
+
+// Ghép ngưỡng của các giao thức được bật: idle phải dài hơn mọi mức trong khung và ngắn hơn mọi sync
+static esp_err_t computeRmtThresholds(uint32_t mask, uint32_t *glitch_ns, uint32_t *idle_us) {
+	uint32_t hi = 0, lo = UINT32_MAX, shortest = UINT32_MAX;
+	for (int p = 1; p <= numProto; p++) {
+		if (!(mask & RCSWITCH_PROTO_BIT(p))) continue;
+		uint32_t max_level, sync_long, min_level;
+		protocolWindow(&proto[p-1], &max_level, &sync_long, &min_level);
+		const uint32_t level_hi = max_level * (100 + RCSWITCH_RMT_WINDOW_MARGIN) / 100;
+		const uint32_t sync_lo = sync_long * (100 - RCSWITCH_RMT_WINDOW_MARGIN) / 100;
+		if (level_hi > hi) hi = level_hi;
+		if (sync_lo < lo) lo = sync_lo;
+		if (min_level < shortest) shortest = min_level;
+	}
+	if (shortest == UINT32_MAX || hi >= lo) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	*idle_us = (hi + lo) / 2;
+	// Glitch: nửa mức ngắn nhất (đã trừ dự phòng), nhưng phần cứng chỉ lọc được tới ~3 us
+	uint32_t glitch = shortest * (100 - RCSWITCH_RMT_WINDOW_MARGIN) / 100 * 1000 / 2;
+	*glitch_ns = (glitch > RCSWITCH_RMT_GLITCH_MAX_NS) ? RCSWITCH_RMT_GLITCH_MAX_NS : glitch;
+	return ESP_OK;
+}
+
+static bool IRAM_ATTR rmtRxDoneCallback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_ctx) {
+	rcswitch_rmt_t *ctx = (rcswitch_rmt_t *)user_ctx;
+	rcswitch_rmt_done_t done = {
+		.num_symbols = edata->num_symbols,
+		.buf_index = (edata->received_symbols == ctx->buf[0]) ? 0 : 1,
+	};
+	BaseType_t woken = pdFALSE;
+	xQueueSendFromISR(ctx->done_queue, &done, &woken);
+	return woken == pdTRUE;
+}
+
+/*
+ * Dựng lại timings[] như backend ngắt: timings[0] là sync, sau đó là độ rộng từng mức.
+ * RMT không đo mức idle cuối (chính là sync) nên timings[0] được suy ra từ độ rộng
+ * xung cơ sở ước lượng trên phần dữ liệu, rồi dùng lại receiveProtocol.
+ *
+ * Không có độ dài sync thật thì với dung sai 60% nhiều giao thức khớp cùng một khung
+ * (vd. giao thức 8 bị đọc thành giao thức 1), nên chọn giao thức có dạng bit khớp
+ * nhất trước; hoà thì lấy giao thức có pulseLength gần độ rộng xung ước lượng nhất.
+ */
+static uint32_t rmtFitError(const Protocol *pro, const unsigned int *t, unsigned int bits, uint32_t delay) {
+	uint32_t err = 0;
+	for (unsigned int b = 0; b < bits; b++, t += 2) {
+		const uint32_t e0 = abs((int)t[0] - (int)(delay * pro->zero.high)) + abs((int)t[1] - (int)(delay * pro->zero.low));
+		const uint32_t e1 = abs((int)t[0] - (int)(delay * pro->one.high)) + abs((int)t[1] - (int)(delay * pro->one.low));
+		err += (e0 < e1) ? e0 : e1;
+	}
+	return err;
+}
+
+#define RCSWITCH_RMT_FIT_TIE_PERMILLE 30
+
+static bool decodeRmtCapture(rcswitch_rmt_t *ctx, const rmt_symbol_word_t *sym, size_t n) {
+	RCSWITCH_t *rx = &ctx->scratch;
+	unsigned int changeCount = 1;
+	for (size_t i = 0; i < n && changeCount < RCSWITCH_MAX_CHANGES; i++) {
+		if (sym[i].duration0 == 0) break;
+		rx->timings[changeCount++] = sym[i].duration0;
+		if (sym[i].duration1 == 0 || changeCount >= RCSWITCH_MAX_CHANGES) break;
+		rx->timings[changeCount++] = sym[i].duration1;
+	}
+	if (changeCount < RCSWITCH_RMT_MIN_CHANGES) return false;
+
+	int best = 0;
+	uint32_t best_err = UINT32_MAX, best_delay = 0, best_dev = UINT32_MAX;
+	for (int p = 1; p <= numProto; p++) {
+		if (!(ctx->protocol_mask & RCSWITCH_PROTO_BIT(p))) continue;
+		const Protocol *pro = &proto[p-1];
+		const unsigned int first = pro->invertedSignal ? 2 : 1;
+		if (changeCount <= first + 2) continue;
+		const unsigned int bits = (changeCount - 1 - first) / 2;
+		uint32_t sum = 0;
+		for (unsigned int i = first; i < first + 2 * bits; i++) sum += rx->timings[i];
+		// Trung bình một cặp bit (0 và 1 có thể khác tổng số xung) -> độ rộng xung cơ sở
+		const uint32_t pair = pro->zero.high + pro->zero.low + pro->one.high + pro->one.low;
+		const uint32_t delay = 2 * sum / (bits * pair);
+		if (delay == 0) continue;
+		// Sai số chuẩn hoá theo tổng độ dài khung (phần nghìn)
+		const uint32_t err = (uint32_t)((uint64_t)rmtFitError(pro, &rx->timings[first], bits, delay) * 1000 / sum);
+		const uint32_t dev = abs((int)delay - (int)pro->pulseLength);
+		const bool tie = (err + RCSWITCH_RMT_FIT_TIE_PERMILLE > best_err) && (best_err + RCSWITCH_RMT_FIT_TIE_PERMILLE > err);
+		if ((tie && dev < best_dev) || (!tie && err < best_err)) {
+			best = p;
+			best_err = err;
+			best_delay = delay;
+			best_dev = dev;
+		}
+	}
+	if (best == 0) return false;
+
+	const Protocol *pro = &proto[best-1];
+	const uint32_t syncLen = (pro->syncFactor.high > pro->syncFactor.low) ? pro->syncFactor.high : pro->syncFactor.low;
+	rx->timings[0] = best_delay * syncLen;
+	return receiveProtocol(rx, best, changeCount);
+}
+
+static void rmtReceiveTask(void *arg) {
+	RCSWITCH_t *RCSwitch = (RCSWITCH_t *)arg;
+	rcswitch_rmt_t *ctx = (rcswitch_rmt_t *)RCSwitch->rmt;
+	rcswitch_rmt_done_t done;
+
+	while (1) {
+		if (xQueueReceive(ctx->done_queue, &done, portMAX_DELAY) != pdTRUE) continue;
+
+		// Nhận tiếp ngay vào bộ đệm còn lại để không bỏ lỡ lần lặp kế tiếp của khung
+		rmt_receive(ctx->channel, ctx->buf[done.buf_index ^ 1], sizeof(ctx->buf[0]), &ctx->rx_cfg);
+
+		ctx->stats.captures++;
+		if (done.num_symbols >= RCSWITCH_RMT_SYMBOLS) {
+			ctx->stats.truncated++;
+			ctx->stats.noise++;
+			continue;
+		}
+		if (!decodeRmtCapture(ctx, ctx->buf[done.buf_index], done.num_symbols)) {
+			ctx->stats.noise++;
+			continue;
+		}
+		ctx->stats.frames++;
+
+		// Tương đương repeatCount == 2 của backend ngắt: cùng mã xuất hiện lại trong thời gian ngắn
+		const int64_t now = esp_timer_get_time();
+		const unsigned long code = ctx->scratch.nReceivedValue;
+		if (code == ctx->last_code && now - ctx->last_code_us < RCSWITCH_RMT_REPEAT_US) {
+			RCSwitch->nReceivedBitlength = ctx->scratch.nReceivedBitlength;
+			RCSwitch->nReceivedDelay = ctx->scratch.nReceivedDelay;
+			RCSwitch->nReceivedProtocol = ctx->scratch.nReceivedProtocol;
+			RCSwitch->nReceivedValue = code;
+			ctx->stats.confirmed++;
+			ctx->last_code = 0;
+		} else {
+			ctx->last_code = code;
+		}
+		ctx->last_code_us = now;
+	}
+}
+
+esp_err_t enableReceiveRMT(RCSWITCH_t * RCSwitch, int pin, uint32_t protocolMask) {
+	if (RCSwitch->rmt != NULL) return ESP_ERR_INVALID_STATE;
+
+	uint32_t glitch_ns, idle_us;
+	if (computeRmtThresholds(protocolMask, &glitch_ns, &idle_us) != ESP_OK) {
+		ESP_LOGE(TAG, "Protocol mask 0x%03" PRIx32 " has no common idle threshold", protocolMask);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Bộ đệm symbol và ngữ cảnh được callback ISR đọc: phải ở RAM nội (CONFIG_RMT_RX_ISR_CACHE_SAFE)
+	rcswitch_rmt_t *ctx = heap_caps_calloc(1, sizeof(rcswitch_rmt_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if (ctx == NULL) return ESP_ERR_NO_MEM;
+	ctx->protocol_mask = protocolMask;
+	ctx->scratch.nReceiveTolerance = RCSwitch->nReceiveTolerance;
+	ctx->rx_cfg.signal_range_min_ns = glitch_ns;
+	ctx->rx_cfg.signal_range_max_ns = idle_us * 1000;
+	ctx->stats.glitch_ns = glitch_ns;
+	ctx->stats.idle_us = idle_us;
+	ctx->done_queue = xQueueCreate(2, sizeof(rcswitch_rmt_done_t));
+
+	rmt_rx_channel_config_t chan_cfg = {
+		.gpio_num = pin,
+		.clk_src = RMT_CLK_SRC_DEFAULT,
+		.resolution_hz = RCSWITCH_RMT_RESOLUTION_HZ,
+		.mem_block_symbols = RCSWITCH_RMT_SYMBOLS,
+	};
+	esp_err_t err = (ctx->done_queue != NULL) ? rmt_new_rx_channel(&chan_cfg, &ctx->channel) : ESP_ERR_NO_MEM;
+	if (err == ESP_OK) {
+		rmt_rx_event_callbacks_t cbs = { .on_recv_done = rmtRxDoneCallback };
+		err = rmt_rx_register_event_callbacks(ctx->channel, &cbs, ctx);
+	}
+	bool enabled = false;
+	if (err == ESP_OK) {
+		err = rmt_enable(ctx->channel);
+		enabled = (err == ESP_OK);
+	}
+	// Bắt đầu nhận trước khi tạo task: lỗi ở đây chưa để lại task nào trỏ vào ctx.
+	// Khung xong trước khi task chạy chỉ nằm chờ trong done_queue.
+	if (err == ESP_OK) err = rmt_receive(ctx->channel, ctx->buf[0], sizeof(ctx->buf[0]), &ctx->rx_cfg);
+	if (err == ESP_OK) {
+		RCSwitch->rmt = ctx;
+		if (xTaskCreate(rmtReceiveTask, "rf_rmt_task", 3072, RCSwitch, 6, NULL) != pdPASS) {
+			RCSwitch->rmt = NULL;
+			err = ESP_ERR_NO_MEM;
+		}
+	}
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "RMT RX init failed: %d", err);
+		if (enabled) rmt_disable(ctx->channel);     // Huỷ cả lần nhận đang chờ
+		if (ctx->channel) rmt_del_channel(ctx->channel);
+		if (ctx->done_queue) vQueueDelete(ctx->done_queue);
+		free(ctx);
+		return err;
+	}
+
+	RCSwitch->nReceiverInterrupt = pin;
+	ESP_LOGI(TAG, "RMT RX on GPIO %d: protocols 0x%03" PRIx32 ", glitch %" PRIu32 " ns, idle %" PRIu32 " us",
+			pin, protocolMask, glitch_ns, idle_us);
+	return ESP_OK;
+}
+
+esp_err_t getReceiveStatsRMT(RCSWITCH_t * RCSwitch, rcswitch_rmt_stats_t *stats) {
+	if (RCSwitch->rmt == NULL || stats == NULL) return ESP_ERR_INVALID_STATE;
+	*stats = ((rcswitch_rmt_t *)RCSwitch->rmt)->stats;
+	return ESP_OK;
+}
+
+#else
+
+esp_err_t enableReceiveRMT(RCSWITCH_t * RCSwitch, int pin, uint32_t protocolMask) {
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t getReceiveStatsRMT(RCSWITCH_t * RCSwitch, rcswitch_rmt_stats_t *stats) {
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
@@ -53,6 +53,24 @@
 // We can handle up to (unsigned long) => 32 bit * 2 H/L changes per bit + 2 for sync
 #define RCSWITCH_MAX_CHANGES 67
 
+// Bitmask giao thức cho backend RMT: bit (p-1) = giao thức p.
+// Mặc định: tất cả trừ giao thức 4 (khoảng sync 2.3 ms ngắn hơn xung dữ liệu dài
+// nhất của giao thức 8/9, không có ngưỡng idle chung) - giống backend GPIO vốn
+// cũng không nhận được giao thức 4 với nSeparationLimit = 4300 us.
+#define RCSWITCH_PROTO_BIT(p)           (1u << ((p) - 1))
+#define RCSWITCH_RMT_DEFAULT_PROTOCOLS  (0xFFFu & ~RCSWITCH_PROTO_BIT(4))
+
+// Thống kê backend RMT (đo tải CPU: số lần CPU phải xử lý so với số cạnh)
+typedef struct {
+	uint32_t captures;      // Số khung RMT hoàn tất (mỗi lần = một ngắt CPU)
+	uint32_t frames;        // Khung giải mã thành công
+	uint32_t confirmed;     // Khung được xác nhận (lặp lại 2 lần) và giao cho ứng dụng
+	uint32_t noise;         // Khung bị loại (độ dài / định thời không khớp giao thức nào)
+	uint32_t truncated;     // Khung đầy bộ đệm (nhiễu liên tục không có khoảng idle)
+	uint32_t glitch_ns;     // Ngưỡng lọc glitch đang dùng
+	uint32_t idle_us;       // Ngưỡng idle (kết thúc khung) đang dùng
+} rcswitch_rmt_stats_t;
+
 typedef struct {
 	unsigned long nReceivedValue;
 	unsigned int nReceivedBitlength;
@@ -70,6 +88,8 @@ typedef struct {
 	int nRepeatTransmit;
 
 	Protocol protocol;
+
+	void *rmt;              // Ngữ cảnh backend RMT (NULL khi dùng backend ngắt GPIO)
 } RCSWITCH_t;
 
 
@@ -103,7 +123,22 @@ typedef struct {
 	unsigned int getReceivedProtocol(RCSWITCH_t * RCSwitch);
 	unsigned int* getReceivedRawdata(RCSWITCH_t * RCSwitch);
 
+	/**
+	 * handleInterrupt()/handleEdge()/receiveProtocol() và bảng giao thức nằm trong IRAM/DRAM:
+	 * có thể gọi trực tiếp từ ISR đăng ký với ESP_INTR_FLAG_IRAM, kể cả khi đang ghi NVS.
+	 * RCSWITCH_t truyền vào cũng phải nằm trong RAM nội (biến tĩnh/toàn cục).
+	 */
 	void handleInterrupt(void* arg);
+	void handleEdge(RCSWITCH_t * RCSwitch, uint32_t time_us);
+
+	/**
+	 * Nhận qua RMT-RX: phần cứng đo độ rộng xung, lọc glitch và cắt khung theo
+	 * khoảng idle, CPU chỉ xử lý một lần cho mỗi khung thay vì mỗi cạnh.
+	 * Ngưỡng glitch/idle được tính từ bảng định thời của các giao thức trong protocolMask.
+	 * @return ESP_ERR_INVALID_ARG nếu các giao thức không có ngưỡng idle chung.
+	 */
+	esp_err_t enableReceiveRMT(RCSWITCH_t * RCSwitch, int pin, uint32_t protocolMask);
+	esp_err_t getReceiveStatsRMT(RCSWITCH_t * RCSwitch, rcswitch_rmt_stats_t *stats);
 
 	void setProtocol(RCSWITCH_t * RCSwitch, int nProtocol);
 	void setProtocolPulseLength(RCSWITCH_t * RCSwitch, int nProtocol, int nPulseLength);
@@ -0,0 +1,57 @@
+// seqlock.h
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Seqlock: một phía ghi (đã được tuần tự hóa bên ngoài), nhiều phía đọc không khóa.
+ *
+ * Bộ đếm lẻ trong lúc ghi, chẵn khi ổn định. Reader chép dữ liệu rồi kiểm tra bộ đếm
+ * không đổi; nếu đổi (ghi chen vào giữa) thì chép lại. Writer không bao giờ chờ reader.
+ *
+ * Writer phải không bị reader trên cùng core chen ngang giữa begin/end (vd. ghi trong
+ * portENTER_CRITICAL), nếu không reader ưu tiên cao hơn sẽ quay vòng mãi ở bộ đếm lẻ.
+ *
+ *   Ghi:  seqlock_write_begin(&sl); data = ...; seqlock_write_end(&sl);
+ *   Đọc:  do { s = seqlock_read_begin(&sl); copy = data; } while (seqlock_read_retry(&sl, s));
+ */
+
+typedef struct {
+    atomic_uint seq;
+} seqlock_t;
+
+#define SEQLOCK_INIT { 0 }
+
+static inline void seqlock_write_begin(seqlock_t *sl)
+{
+    const uint32_t s = atomic_load_explicit(&sl->seq, memory_order_relaxed);
+    atomic_store_explicit(&sl->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);      // Bộ đếm lẻ phải thấy được trước dữ liệu mới
+}
+
+static inline void seqlock_write_end(seqlock_t *sl)
+{
+    const uint32_t s = atomic_load_explicit(&sl->seq, memory_order_relaxed);
+    atomic_store_explicit(&sl->seq, s + 1, memory_order_release);
+}
+
+// Chờ tới khi không có ghi dở dang, trả về bộ đếm để so ở seqlock_read_retry
+static inline uint32_t seqlock_read_begin(const seqlock_t *sl)
+{
+    uint32_t s;
+    while ((s = atomic_load_explicit((atomic_uint *)&sl->seq, memory_order_acquire)) & 1u) {
+    }
+    return s;
+}
+
+// true: dữ liệu vừa chép có thể lẫn giữa hai lần ghi, phải chép lại
+static inline bool seqlock_read_retry(const seqlock_t *sl, uint32_t start)
+{
+    atomic_thread_fence(memory_order_acquire);      // Các lệnh đọc dữ liệu xong trước khi đọc lại bộ đếm
+    return atomic_load_explicit((atomic_uint *)&sl->seq, memory_order_relaxed) != start;
+}
+
+#endif // SEQLOCK_H
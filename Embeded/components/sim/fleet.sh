@@ -0,0 +1,59 @@
+#!/usr/bin/env bash
+# Chạy N gateway giả lập trên một máy (soak / latency / tải broker).
+# Gateway 2k và 2k+1 là một cặp "tủ" nghe ESP-NOW của nhau. Radio giả lập lọc theo MAC đích
+# như phần cứng: gateway i có MAC 02:00:00:00:HH:LL (i = 0xHHLL), SIM_PEER_MAC là MAC của tủ kia.
+# HUB=1: SIM_0 là hub (một kết nối broker, publish sensor/SIM_0/batch), SIM_1..N-1 là leaf
+# chỉ nối ESP-NOW tới hub (bảng leaf của hub: HUB_MAX_LEAVES = 24).
+# TOPO=line: gateway i chỉ nghe i-1 và i+1, cảnh báo từ SIM_0 phải qua N-1 bước relay
+# (cần build với -DESPNOW_FLOOD_TTL=<n>, mặc định 0 là tắt flood; quá n bước thì không tới);
+# xem "flood" trong diag.
+#
+#   ./fleet.sh [N] [scenario] [broker]
+#   ./fleet.sh 100 scenarios/kitchen_fire.txt mqtt://127.0.0.1:1883
+#   HUB=1 ./fleet.sh 21
+#   TOPO=line ./fleet.sh 5
+#
+# Log mỗi gateway ở $LOG_DIR/SIM_<i>.log; Ctrl+C dừng toàn bộ.
+set -euo pipefail
+
+N=${1:-2}
+SCENARIO=${2:-"$(dirname "$0")/scenarios/kitchen_fire.txt"}
+BROKER=${3:-mqtt://127.0.0.1:1883}
+ELF=${ELF:-"$(dirname "$0")/../../build_linux/ds18b20_read.elf"}
+LOG_DIR=${LOG_DIR:-/tmp/fleet}
+BASE_PORT=${BASE_PORT:-47000}
+HUB=${HUB:-0}
+TOPO=${TOPO:-pairs}
+
+mkdir -p "$LOG_DIR"
+trap 'kill $(jobs -p) 2>/dev/null' EXIT INT TERM
+
+sim_mac() { printf '02:00:00:00:%02x:%02x' $(( $1 >> 8 & 255 )) $(( $1 & 255 )); }
+
+LEAF_PORTS=$(seq -s, $(( BASE_PORT + 1 )) $(( BASE_PORT + N - 1 )))
+
+for ((i = 0; i < N; i++)); do
+    peers=$(( BASE_PORT + (i ^ 1) ))
+    role=direct
+    if [[ $TOPO == line ]]; then
+        peers=""
+        if (( i > 0 )); then peers=$(( BASE_PORT + i - 1 )); fi
+        if (( i + 1 < N )); then peers="${peers:+$peers,}$(( BASE_PORT + i + 1 ))"; fi
+    fi
+    if [[ $HUB == 1 ]]; then
+        if (( i == 0 )); then role=hub; peers=$LEAF_PORTS; else role=leaf; peers=$BASE_PORT; fi
+    fi
+    SIM_DEVICE_ID="SIM_$i" \
+    SIM_MAC=$(sim_mac "$i") \
+    SIM_PEER_MAC=$(sim_mac $(( i ^ 1 ))) \
+    SIM_NODE_ROLE=$role \
+    SIM_SCENARIO="$SCENARIO" \
+    SIM_MQTT_BROKER="$BROKER" \
+    SIM_ESPNOW_PORT=$(( BASE_PORT + i )) \
+    SIM_ESPNOW_PEERS=$peers \
+    SIM_MQ2_WARMUP_MS=${SIM_MQ2_WARMUP_MS:-30000} \
+        "$ELF" > "$LOG_DIR/SIM_$i.log" 2>&1 &
+done
+
+echo "Started $N simulated gateways, logs in $LOG_DIR"
+wait
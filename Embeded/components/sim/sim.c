@@ -0,0 +1,329 @@
+// sim.c
+#include "sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "SIM";
+
+#define SIM_DEFAULT_TEMP_C   25.0f
+#define SIM_LINE_MAX         128
+#define SIM_AO_MAX           8
+#define SIM_AO_NOISE         3      // Nhiễu nền ± đơn vị ADC
+
+// Giá trị cảm biến có thể đang "ramp": giá trị = from + (to - from) * t / dur
+typedef struct {
+    float from;
+    float to;
+    int64_t start_us;
+    int64_t dur_us;     // 0: giá trị cố định = to
+} sim_value_t;
+
+static sim_value_t s_temp = { SIM_DEFAULT_TEMP_C, SIM_DEFAULT_TEMP_C, 0, 0 };
+static sim_value_t s_gas = { 0, 0, 0, 0 };
+static portMUX_TYPE s_value_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static sim_rf_sink_t s_rf_sink = NULL;
+static void *s_rf_ctx = NULL;
+
+// Ngõ AO cảm biến lửa: DC + (sin | nhiễu lọc thông dải) hoặc phát lại file
+typedef struct {
+    bool on;
+    float dc;
+    float amp;
+    float hz;
+    float lp1, lp2, slow;       // Trạng thái bộ lọc của chế độ "ngọn lửa"
+    uint16_t *replay;
+    int replay_len;
+    int replay_pos;
+    unsigned int seed;
+} sim_ao_t;
+
+static sim_ao_t s_ao[SIM_AO_MAX];
+static portMUX_TYPE s_ao_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t s_mac[6];
+static bool s_mac_ready = false;
+
+static char *s_script = NULL;   // Nội dung file kịch bản, các dòng được tách tại chỗ
+
+const char *sim_getenv(const char *name, const char *def)
+{
+    const char *v = getenv(name);
+    return (v != NULL && v[0] != '\0') ? v : def;
+}
+
+// --- Giá trị cảm biến ---
+
+static float value_now(sim_value_t *v)
+{
+    portENTER_CRITICAL(&s_value_mux);
+    sim_value_t snap = *v;
+    portEXIT_CRITICAL(&s_value_mux);
+    if (snap.dur_us <= 0) return snap.to;
+    int64_t t = esp_timer_get_time() - snap.start_us;
+    if (t >= snap.dur_us) return snap.to;
+    if (t <= 0) return snap.from;
+    return snap.from + (snap.to - snap.from) * (float)t / (float)snap.dur_us;
+}
+
+static void value_set(sim_value_t *v, float from, float to, int64_t dur_us)
+{
+    portENTER_CRITICAL(&s_value_mux);
+    v->from = from;
+    v->to = to;
+    v->start_us = esp_timer_get_time();
+    v->dur_us = dur_us;
+    portEXIT_CRITICAL(&s_value_mux);
+}
+
+float sim_temp_c(void)
+{
+    return value_now(&s_temp);
+}
+
+int sim_gas(void)
+{
+    float g = value_now(&s_gas);
+    return g > 0 ? (int)(g + 0.5f) : 0;
+}
+
+// --- MAC giả lập: SIM_MAC hoặc băm FNV-1a của device id (locally administered) ---
+
+void sim_get_mac(uint8_t mac[6])
+{
+    if (!s_mac_ready) {
+        unsigned int b[6];
+        const char *env = sim_getenv("SIM_MAC", NULL);
+        if (env && sscanf(env, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) == 6) {
+            for (int i = 0; i < 6; i++) s_mac[i] = (uint8_t)b[i];
+        } else {
+            uint64_t h = 0xcbf29ce484222325ULL;
+            for (const char *p = sim_getenv("SIM_DEVICE_ID", "sim"); *p; p++) {
+                h = (h ^ (uint8_t)*p) * 0x100000001b3ULL;
+            }
+            for (int i = 0; i < 6; i++) s_mac[i] = (uint8_t)(h >> (8 * i));
+            s_mac[0] = (s_mac[0] & 0xFC) | 0x02;
+        }
+        s_mac_ready = true;
+    }
+    memcpy(mac, s_mac, 6);
+}
+
+static char *load_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = (size >= 0) ? malloc((size_t)size + 1) : NULL;
+    if (buf != NULL) {
+        size_t n = fread(buf, 1, (size_t)size, f);
+        buf[n] = '\0';
+    }
+    fclose(f);
+    return buf;
+}
+
+// --- Ngõ AO cảm biến lửa ---
+
+static float ao_rand(sim_ao_t *ao)
+{
+    return (float)rand_r(&ao->seed) / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+int sim_flame_ao(int sensor)
+{
+    if (sensor < 0 || sensor >= SIM_AO_MAX) return -1;
+    sim_ao_t *ao = &s_ao[sensor];
+    float v;
+
+    portENTER_CRITICAL(&s_ao_mux);
+    if (!ao->on) {
+        portEXIT_CRITICAL(&s_ao_mux);
+        return -1;
+    }
+    if (ao->replay != NULL) {
+        v = ao->replay[ao->replay_pos];
+        if (ao->replay_pos < ao->replay_len - 1) ao->replay_pos++;
+    } else if (ao->hz > 0) {
+        const float t = (float)(esp_timer_get_time() % 1000000000LL) / 1e6f;
+        v = ao->dc + ao->amp * sinf(2.0f * (float)M_PI * ao->hz * t);
+    } else {
+        // Nhiễu trắng qua 2 tầng thông thấp (~10 Hz) trừ thành phần trôi chậm: phổ tập trung 1..12 Hz
+        ao->lp1 += 0.5f * (ao_rand(ao) - ao->lp1);
+        ao->lp2 += 0.5f * (ao->lp1 - ao->lp2);
+        ao->slow += 0.03f * (ao->lp2 - ao->slow);
+        v = ao->dc + ao->amp * 4.0f * (ao->lp2 - ao->slow);
+    }
+    v += (float)(rand_r(&ao->seed) % (2 * SIM_AO_NOISE + 1) - SIM_AO_NOISE);
+    portEXIT_CRITICAL(&s_ao_mux);
+
+    if (v < 0) v = 0;
+    if (v > 4095) v = 4095;
+    return (int)v;
+}
+
+static void ao_set(int sensor, bool on, float dc, float amp, float hz, uint16_t *replay, int replay_len)
+{
+    sim_ao_t *ao = &s_ao[sensor];
+    portENTER_CRITICAL(&s_ao_mux);
+    uint16_t *old = ao->replay;
+    *ao = (sim_ao_t){ .on = on, .dc = dc, .amp = amp, .hz = hz,
+                      .replay = replay, .replay_len = replay_len, .seed = 1u + (unsigned)sensor };
+    portEXIT_CRITICAL(&s_ao_mux);
+    free(old);
+}
+
+// File mẫu thô: một số nguyên mỗi dòng (bỏ qua dòng không phải số)
+static int ao_load_replay(const char *path, uint16_t **out)
+{
+    char *text = load_file(path);
+    if (text == NULL) return -1;
+    int cap = 0, len = 0;
+    uint16_t *buf = NULL;
+    char *save = NULL;
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        int v;
+        if (sscanf(line, "%d", &v) != 1) continue;
+        if (len == cap) {
+            cap = cap ? cap * 2 : 1024;
+            uint16_t *grown = realloc(buf, (size_t)cap * sizeof(uint16_t));
+            if (grown == NULL) break;
+            buf = grown;
+        }
+        buf[len++] = (uint16_t)(v < 0 ? 0 : v > 4095 ? 4095 : v);
+    }
+    free(text);
+    *out = buf;
+    return len;
+}
+
+// --- RF ---
+
+void sim_set_rf_sink(sim_rf_sink_t sink, void *ctx)
+{
+    s_rf_ctx = ctx;
+    s_rf_sink = sink;
+}
+
+// --- Kịch bản ---
+
+static void run_line(char *line, int lineno)
+{
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+
+    char cmd[16], what[16], path[64];
+    float a = 0, b = 0;
+    long ms = 0;
+    int pin = 0, level = 0;
+    unsigned long code = 0;
+    unsigned int bits = 24, proto = 1;
+
+    if (sscanf(line, "%15s", cmd) != 1) return;
+
+    if (strcmp(cmd, "wait") == 0 && sscanf(line, "%*s %ld", &ms) == 1) {
+        vTaskDelay(pdMS_TO_TICKS(ms) > 0 ? pdMS_TO_TICKS(ms) : 1);
+    } else if (strcmp(cmd, "temp") == 0 && sscanf(line, "%*s %f", &a) == 1) {
+        value_set(&s_temp, a, a, 0);
+    } else if (strcmp(cmd, "gas") == 0 && sscanf(line, "%*s %f", &a) == 1) {
+        value_set(&s_gas, a, a, 0);
+    } else if (strcmp(cmd, "ramp") == 0 && sscanf(line, "%*s %15s %f %f %ld", what, &a, &b, &ms) == 4) {
+        sim_value_t *v = (strcmp(what, "temp") == 0) ? &s_temp : (strcmp(what, "gas") == 0) ? &s_gas : NULL;
+        if (v == NULL) {
+            ESP_LOGW(TAG, "line %d: unknown ramp target '%s'", lineno, what);
+            return;
+        }
+        value_set(v, a, b, (int64_t)ms * 1000);
+    } else if (strcmp(cmd, "gpio") == 0 && sscanf(line, "%*s %d %d", &pin, &level) == 2) {
+        sim_gpio_drive(pin, level);
+    } else if (strcmp(cmd, "rf") == 0 && sscanf(line, "%*s %lu %u %u", &code, &bits, &proto) >= 1) {
+        sim_rf_sink_t sink = s_rf_sink;
+        if (sink) {
+            sink(code, bits, proto, s_rf_ctx);
+        } else {
+            ESP_LOGW(TAG, "line %d: RF receiver not enabled, frame dropped", lineno);
+        }
+    } else if (strcmp(cmd, "ao") == 0 && sscanf(line, "%*s %d %15s", &pin, what) == 2) {
+        if (pin < 0 || pin >= SIM_AO_MAX) {
+            ESP_LOGW(TAG, "line %d: AO sensor index out of range", lineno);
+            return;
+        }
+        float hz = 0;
+        if (strcmp(what, "off") == 0) {
+            ao_set(pin, false, 0, 0, 0, NULL, 0);
+        } else if (sscanf(line, "%*s %*d %f %f %f", &a, &b, &hz) >= 1) {
+            ao_set(pin, true, a, b, hz, NULL, 0);
+        } else {
+            ESP_LOGW(TAG, "line %d: cannot parse '%s'", lineno, line);
+            return;
+        }
+    } else if (strcmp(cmd, "ao_replay") == 0 && sscanf(line, "%*s %d %63s", &pin, path) == 2) {
+        if (pin < 0 || pin >= SIM_AO_MAX) {
+            ESP_LOGW(TAG, "line %d: AO sensor index out of range", lineno);
+            return;
+        }
+        uint16_t *samples = NULL;
+        const int n = ao_load_replay(path, &samples);
+        if (n <= 0) {
+            free(samples);
+            ESP_LOGW(TAG, "line %d: cannot read samples from '%s'", lineno, path);
+            return;
+        }
+        ao_set(pin, true, 0, 0, 0, samples, n);
+    } else if (strcmp(cmd, "exit") == 0) {
+        int rc = 0;
+        sscanf(line, "%*s %d", &rc);
+        ESP_LOGI(TAG, "Scenario finished, exit(%d)", rc);
+        fflush(stdout);
+        exit(rc);
+    } else {
+        ESP_LOGW(TAG, "line %d: cannot parse '%s'", lineno, line);
+        return;
+    }
+    ESP_LOGI(TAG, "[%d] %s", lineno, line);
+}
+
+static void sim_scenario_task(void *arg)
+{
+    int lineno = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(s_script, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        char buf[SIM_LINE_MAX];
+        lineno++;
+        snprintf(buf, sizeof(buf), "%s", line);
+        run_line(buf, lineno);
+    }
+    ESP_LOGI(TAG, "Scenario reached end (%d lines), holding last values", lineno);
+    free(s_script);
+    s_script = NULL;
+    vTaskDelete(NULL);
+}
+
+void sim_init(void)
+{
+    uint8_t mac[6];
+    sim_get_mac(mac);
+    ESP_LOGI(TAG, "Simulated gateway '%s' MAC %02x:%02x:%02x:%02x:%02x:%02x",
+             sim_getenv("SIM_DEVICE_ID", "(default)"), mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    const char *path = sim_getenv("SIM_SCENARIO", NULL);
+    if (path == NULL) {
+        ESP_LOGW(TAG, "SIM_SCENARIO not set, sensors stay at defaults");
+        return;
+    }
+    s_script = load_file(path);
+    if (s_script == NULL) {
+        ESP_LOGE(TAG, "Cannot read scenario '%s'", path);
+        abort();
+    }
+    // Ưu tiên cao hơn các task cảm biến để sự kiện GPIO được phát đúng thời điểm
+    xTaskCreate(sim_scenario_task, "sim_scenario", 4096, NULL, 8, NULL);
+}
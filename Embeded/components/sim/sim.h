@@ -0,0 +1,81 @@
+// sim.h
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Môi trường mô phỏng cho bản build Linux (IDF target "linux").
+ *
+ * Thay phần cứng bằng kịch bản (scenario) đọc từ file: nhiệt độ, gas, mức GPIO
+ * (cảm biến lửa, nút nhấn) và mã RF. MQTT dùng socket thật của máy host nên
+ * firmware nói chuyện trực tiếp với broker cục bộ (vd. mosquitto).
+ *
+ * Biến môi trường:
+ *   SIM_SCENARIO      đường dẫn file kịch bản (không đặt: giá trị mặc định, không có sự kiện)
+ *   SIM_DEVICE_ID     ghi đè DEVICE_ID (mỗi gateway giả lập một ID riêng)
+ *   SIM_MQTT_BROKER   ghi đè URI broker, vd. mqtt://127.0.0.1:1883
+ *   SIM_MAC           MAC giả lập "aa:bb:cc:dd:ee:ff" (mặc định sinh từ SIM_DEVICE_ID)
+ *   SIM_ESPNOW_PORT   cổng UDP (127.0.0.1) mà "radio" ESP-NOW của tiến trình này lắng nghe
+ *   SIM_ESPNOW_PEERS  danh sách cổng cách nhau bởi dấu phẩy: các gateway "nghe thấy" mình; bên nhận
+ *                     chỉ giữ khung broadcast hoặc khung có MAC đích là MAC của nó, như radio thật
+ *   SIM_PEER_MAC      (main) MAC tủ kia cho khung ESP-NOW unicast kiểu cũ
+ *   SIM_NODE_ROLE     (main) direct | hub | leaf
+ *   SIM_MQ2_WARMUP_MS thời gian làm nóng MQ2 giả lập (mặc định 30000 như phần cứng)
+ *
+ * Cú pháp kịch bản (mỗi dòng một lệnh, '#' là chú thích, chạy tuần tự):
+ *   wait <ms>                         chờ
+ *   temp <°C> | gas <giá trị>         đặt giá trị cảm biến (gas: độ lệch ADC so với baseline MQ2)
+ *   ramp temp|gas <từ> <đến> <ms>     tăng/giảm tuyến tính (không chặn kịch bản)
+ *   gpio <pin> <0|1>                  lái mức chân input (gọi ISR nếu đã đăng ký)
+ *   rf <code> [bitlength] [protocol]  giả lập một khung RF 433MHz đã giải mã
+ *   ao <sensor> <dc> [amp] [hz]       ngõ AO cảm biến lửa (chỉ số trong mảng, đơn vị ADC 0..4095):
+ *                                     chỉ dc = nguồn sáng ổn định (nắng, đèn); hz > 0 = dao động sin;
+ *                                     amp không có hz = nhấp nháy ngẫu nhiên dải 1..12 Hz như ngọn lửa
+ *   ao <sensor> off                   ngắt ngõ AO (cảm biến chỉ còn digital)
+ *   ao_replay <sensor> <file>         phát lại file mẫu thô (một số mỗi dòng, 100 Hz), hết file giữ mẫu cuối
+ *   exit [code]                       kết thúc tiến trình
+ *   #! fire | #! clear                chú thích đánh dấu khoảng cháy thật cho fire_detect/tools/fire_replay
+ */
+
+/**
+ * @brief Đọc biến môi trường, nạp kịch bản và khởi chạy task kịch bản.
+ * Gọi một lần ở đầu app_main, trước khi khởi tạo cảm biến.
+ */
+void sim_init(void);
+
+/**
+ * @brief Trả về biến môi trường @p name, hoặc @p def nếu không đặt / rỗng.
+ */
+const char *sim_getenv(const char *name, const char *def);
+
+/** @brief Nhiệt độ hiện tại theo kịch bản (°C, mặc định 25.0). */
+float sim_temp_c(void);
+
+/** @brief Giá trị gas hiện tại theo kịch bản: độ lệch ADC trên baseline, backend mq2 quy đổi ra ppm. */
+int sim_gas(void);
+
+/** @brief MAC giả lập của tiến trình (dùng làm địa chỉ nguồn ESP-NOW). */
+void sim_get_mac(uint8_t mac[6]);
+
+/**
+ * @brief Callback nhận khung RF đã giải mã từ kịch bản (thay cho ISR 433MHz).
+ */
+typedef void (*sim_rf_sink_t)(unsigned long code, unsigned int bitlength, unsigned int protocol, void *ctx);
+
+void sim_set_rf_sink(sim_rf_sink_t sink, void *ctx);
+
+/**
+ * @brief Lái mức một chân input như thể tín hiệu ngoài thay đổi.
+ * Gọi ISR handler đã đăng ký nếu cạnh khớp với intr_type của chân.
+ */
+void sim_gpio_drive(int pin, int level);
+
+/**
+ * @brief Mẫu kế tiếp của ngõ AO cảm biến lửa @p sensor, gọi mỗi 10 ms.
+ * @return Giá trị ADC 0..4095, hoặc -1 nếu kịch bản chưa bật ngõ AO của cảm biến.
+ */
+int sim_flame_ao(int sensor);
+
+#endif // SIM_H
@@ -0,0 +1,185 @@
+// sim_espnow.c
+#include "esp_now.h"
+#include "sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const char *TAG = "SIM_ESPNOW";
+
+#define SIM_ESPNOW_DEFAULT_PORT 47000
+#define SIM_ESPNOW_MAX_LINKS    32      // Hub của fleet.sh nối tới mọi leaf
+#define SIM_ESPNOW_POLL_MS      10
+
+// Khung trên dây: MAC nguồn, MAC đích, độ dài, dữ liệu
+typedef struct __attribute__((packed)) {
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    uint8_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} sim_espnow_frame_t;
+
+#define SIM_ESPNOW_HDR_LEN (2 * ESP_NOW_ETH_ALEN + 1)
+
+static const uint8_t BROADCAST[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static int s_sock = -1;
+static esp_now_recv_cb_t s_recv_cb = NULL;
+static uint8_t s_local_mac[ESP_NOW_ETH_ALEN];
+static uint8_t s_peers[ESP_NOW_MAX_TOTAL_PEER_NUM][ESP_NOW_ETH_ALEN];
+static int s_peer_count = 0;
+static struct sockaddr_in s_links[SIM_ESPNOW_MAX_LINKS];
+static int s_link_count = 0;
+
+// Socket non-blocking + poll: syscall chặn trong task sẽ giữ cả scheduler của port POSIX
+static void sim_espnow_rx_task(void *arg)
+{
+    sim_espnow_frame_t frame;
+    while (1) {
+        ssize_t n;
+        while ((n = recv(s_sock, &frame, sizeof(frame), 0)) >= SIM_ESPNOW_HDR_LEN) {
+            if (frame.len > n - SIM_ESPNOW_HDR_LEN) continue;
+            if (memcmp(frame.src, s_local_mac, ESP_NOW_ETH_ALEN) == 0) continue;
+            // Link UDP là "vùng phủ sóng": mọi nút trong tầm đều nghe, radio chỉ nhận khung gửi cho mình
+            if (memcmp(frame.dst, s_local_mac, ESP_NOW_ETH_ALEN) != 0 &&
+                memcmp(frame.dst, BROADCAST, ESP_NOW_ETH_ALEN) != 0) {
+                continue;
+            }
+            esp_now_recv_cb_t cb = s_recv_cb;
+            if (cb != NULL) {
+                esp_now_recv_info_t info = { .src_addr = frame.src, .des_addr = frame.dst, .rx_ctrl = NULL };
+                cb(&info, frame.data, frame.len);
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(SIM_ESPNOW_POLL_MS));
+    }
+}
+
+static void parse_links(const char *list)
+{
+    char buf[SIM_ESPNOW_MAX_LINKS * 6 + 16];   // "47031," cho mỗi link
+    snprintf(buf, sizeof(buf), "%s", list);
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok && s_link_count < SIM_ESPNOW_MAX_LINKS;
+         tok = strtok_r(NULL, ",", &save)) {
+        int port = atoi(tok);
+        if (port <= 0 || port > 65535) continue;
+        struct sockaddr_in *addr = &s_links[s_link_count++];
+        memset(addr, 0, sizeof(*addr));
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons((uint16_t)port);
+        addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+}
+
+esp_err_t esp_now_init(void)
+{
+    if (s_sock >= 0) return ESP_OK;
+
+    const int port = atoi(sim_getenv("SIM_ESPNOW_PORT", "0"));
+    s_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s_sock < 0) {
+        ESP_LOGE(TAG, "socket() failed: %d", errno);
+        return ESP_ERR_ESPNOW_INTERNAL;
+    }
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)(port > 0 ? port : SIM_ESPNOW_DEFAULT_PORT)),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(s_sock, (struct sockaddr *)&local, sizeof(local)) != 0) {
+        ESP_LOGE(TAG, "bind(%d) failed: %d", ntohs(local.sin_port), errno);
+        close(s_sock);
+        s_sock = -1;
+        return ESP_ERR_ESPNOW_INTERNAL;
+    }
+    fcntl(s_sock, F_SETFL, fcntl(s_sock, F_GETFL, 0) | O_NONBLOCK);
+
+    sim_get_mac(s_local_mac);
+    parse_links(sim_getenv("SIM_ESPNOW_PEERS", ""));
+    xTaskCreate(sim_espnow_rx_task, "sim_espnow_rx", 4096, NULL, 6, NULL);
+
+    ESP_LOGI(TAG, "ESP-NOW over UDP: listen %d, %d link(s)", ntohs(local.sin_port), s_link_count);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void)
+{
+    // Task nhận vẫn chạy; chỉ dùng khi tắt tiến trình nên không dọn dẹp thêm
+    s_recv_cb = NULL;
+    s_peer_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    if (s_sock < 0) return ESP_ERR_ESPNOW_NOT_INIT;
+    s_recv_cb = cb;
+    return ESP_OK;
+}
+
+static int find_peer(const uint8_t *addr)
+{
+    for (int i = 0; i < s_peer_count; i++) {
+        if (memcmp(s_peers[i], addr, ESP_NOW_ETH_ALEN) == 0) return i;
+    }
+    return -1;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (s_sock < 0) return ESP_ERR_ESPNOW_NOT_INIT;
+    if (peer == NULL) return ESP_ERR_ESPNOW_ARG;
+    if (find_peer(peer->peer_addr) >= 0) return ESP_ERR_ESPNOW_EXIST;
+    if (s_peer_count >= ESP_NOW_MAX_TOTAL_PEER_NUM) return ESP_ERR_ESPNOW_FULL;
+    memcpy(s_peers[s_peer_count++], peer->peer_addr, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    int idx = find_peer(peer_addr);
+    if (idx < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+    memmove(s_peers[idx], s_peers[idx + 1], (size_t)(s_peer_count - idx - 1) * ESP_NOW_ETH_ALEN);
+    s_peer_count--;
+    return ESP_OK;
+}
+
+static void send_frame(const uint8_t *dst, const uint8_t *data, size_t len)
+{
+    sim_espnow_frame_t frame;
+    memcpy(frame.src, s_local_mac, ESP_NOW_ETH_ALEN);
+    memcpy(frame.dst, dst, ESP_NOW_ETH_ALEN);
+    frame.len = (uint8_t)len;
+    memcpy(frame.data, data, len);
+
+    for (int i = 0; i < s_link_count; i++) {
+        sendto(s_sock, &frame, SIM_ESPNOW_HDR_LEN + len, 0,
+               (const struct sockaddr *)&s_links[i], sizeof(s_links[i]));
+    }
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    if (s_sock < 0) return ESP_ERR_ESPNOW_NOT_INIT;
+    if (data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN) return ESP_ERR_ESPNOW_ARG;
+    if (peer_addr != NULL) {
+        if (find_peer(peer_addr) < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+        send_frame(peer_addr, data, len);
+        return ESP_OK;
+    }
+    // NULL: như ESP-NOW thật, gửi lần lượt tới từng peer trong danh sách
+    for (int i = 0; i < s_peer_count; i++) {
+        send_frame(s_peers[i], data, len);
+    }
+    return ESP_OK;
+}
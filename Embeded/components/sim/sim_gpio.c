@@ -0,0 +1,166 @@
+// sim_gpio.c
+#include "driver/gpio.h"
+#include "sim.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+static const char *TAG = "SIM_GPIO";
+
+typedef struct {
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    int level;
+    gpio_isr_t isr;
+    void *isr_arg;
+} sim_pin_t;
+
+static sim_pin_t s_pins[GPIO_NUM_MAX];
+static bool s_isr_service_installed = false;
+static portMUX_TYPE s_gpio_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline bool pin_valid(gpio_num_t gpio_num)
+{
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX;
+}
+
+esp_err_t gpio_config(const gpio_config_t *cfg)
+{
+    if (cfg == NULL) return ESP_ERR_INVALID_ARG;
+    for (int pin = 0; pin < GPIO_NUM_MAX; pin++) {
+        if (!(cfg->pin_bit_mask & (1ULL << pin))) continue;
+        portENTER_CRITICAL(&s_gpio_mux);
+        s_pins[pin].mode = cfg->mode;
+        s_pins[pin].intr_type = cfg->intr_type;
+        // Chân input để hở: mức theo điện trở kéo (giống phần cứng khi cảm biến không tác động)
+        if (!(cfg->mode & GPIO_MODE_OUTPUT)) {
+            s_pins[pin].level = cfg->pull_up_en ? 1 : 0;
+        }
+        portEXIT_CRITICAL(&s_gpio_mux);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    portENTER_CRITICAL(&s_gpio_mux);
+    s_pins[gpio_num].mode = GPIO_MODE_INPUT;
+    s_pins[gpio_num].intr_type = GPIO_INTR_DISABLE;
+    s_pins[gpio_num].level = 1;
+    portEXIT_CRITICAL(&s_gpio_mux);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    if (!pin_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_pins[gpio_num].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    if (!pin_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    if (!(s_pins[gpio_num].mode & GPIO_MODE_OUTPUT)) {
+        s_pins[gpio_num].level = (pull == GPIO_PULLUP_ONLY || pull == GPIO_PULLUP_PULLDOWN) ? 1 : 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (!pin_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_pins[gpio_num].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!pin_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    const int new_level = level ? 1 : 0;
+    bool changed = false;
+    portENTER_CRITICAL(&s_gpio_mux);
+    if (s_pins[gpio_num].level != new_level) {
+        s_pins[gpio_num].level = new_level;
+        changed = true;
+    }
+    portEXIT_CRITICAL(&s_gpio_mux);
+    // Chỉ log chân output thực sự (còi, LED, relay) - bỏ qua 1-Wire/RF TX đổi mức liên tục
+    if (changed && s_pins[gpio_num].mode == GPIO_MODE_OUTPUT) {
+        ESP_LOGI(TAG, "GPIO %d -> %d", gpio_num, new_level);
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) return 0;
+    return s_pins[gpio_num].level;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    if (s_isr_service_installed) return ESP_ERR_INVALID_STATE;
+    s_isr_service_installed = true;
+    return ESP_OK;
+}
+
+void gpio_uninstall_isr_service(void)
+{
+    s_isr_service_installed = false;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (!pin_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    if (!s_isr_service_installed) return ESP_ERR_INVALID_STATE;
+    portENTER_CRITICAL(&s_gpio_mux);
+    s_pins[gpio_num].isr = isr_handler;
+    s_pins[gpio_num].isr_arg = args;
+    portEXIT_CRITICAL(&s_gpio_mux);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    portENTER_CRITICAL(&s_gpio_mux);
+    s_pins[gpio_num].isr = NULL;
+    s_pins[gpio_num].isr_arg = NULL;
+    portEXIT_CRITICAL(&s_gpio_mux);
+    return ESP_OK;
+}
+
+void sim_gpio_drive(int pin, int level)
+{
+    if (!pin_valid(pin)) {
+        ESP_LOGW(TAG, "Invalid pin %d in scenario", pin);
+        return;
+    }
+    gpio_isr_t isr = NULL;
+    void *arg = NULL;
+    const int new_level = level ? 1 : 0;
+
+    portENTER_CRITICAL(&s_gpio_mux);
+    const int old_level = s_pins[pin].level;
+    s_pins[pin].level = new_level;
+    const gpio_int_type_t type = s_pins[pin].intr_type;
+    const bool rising = (old_level == 0 && new_level == 1);
+    const bool falling = (old_level == 1 && new_level == 0);
+    if ((type == GPIO_INTR_ANYEDGE && (rising || falling)) ||
+        (type == GPIO_INTR_POSEDGE && rising) ||
+        (type == GPIO_INTR_NEGEDGE && falling) ||
+        (type == GPIO_INTR_HIGH_LEVEL && new_level == 1) ||
+        (type == GPIO_INTR_LOW_LEVEL && new_level == 0)) {
+        isr = s_pins[pin].isr;
+        arg = s_pins[pin].isr_arg;
+    }
+    portEXIT_CRITICAL(&s_gpio_mux);
+
+    // Không có ngắt thật: handler chạy trong ngữ cảnh task kịch bản. Các handler
+    // của firmware chỉ dùng API *FromISR nên vẫn hợp lệ trên port POSIX.
+    if (isr != NULL && s_isr_service_installed) {
+        isr(arg);
+    }
+}
@@ -0,0 +1,80 @@
+// spsc_ring.c
+#include "spsc_ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t round_up_pow2(uint32_t v)
+{
+    uint32_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+esp_err_t spsc_ring_init(spsc_ring_t *ring, size_t elem_size, uint32_t capacity)
+{
+    if (ring == NULL || elem_size == 0 || elem_size > UINT16_MAX || capacity == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint32_t size = round_up_pow2(capacity);
+    uint8_t *buf = calloc(size, elem_size);
+    if (buf == NULL) return ESP_ERR_NO_MEM;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->buf = buf;
+    ring->mask = size - 1;
+    ring->elem_size = (uint16_t)elem_size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    return ESP_OK;
+}
+
+bool spsc_ring_push(spsc_ring_t *ring, const void *item)
+{
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->tail_cache > ring->mask) {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->tail_cache > ring->mask) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+    }
+    memcpy(ring->buf + (size_t)(head & ring->mask) * ring->elem_size, item, ring->elem_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+size_t spsc_ring_pop(spsc_ring_t *ring, void *out, size_t max_items)
+{
+    const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    // Bản sao head chỉ được làm mới khi không đủ cho cả lô
+    if (ring->head_cache - tail < max_items) {
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    const uint32_t avail = ring->head_cache - tail;
+    if (avail > ring->max_depth) ring->max_depth = avail;
+    const uint32_t n = avail < max_items ? avail : (uint32_t)max_items;
+    if (n == 0) return 0;
+
+    // Tối đa hai đoạn liên tục: đến cuối bộ đệm rồi vòng về đầu
+    const uint32_t start = tail & ring->mask;
+    const uint32_t first = (ring->mask + 1 - start) < n ? (ring->mask + 1 - start) : n;
+    memcpy(out, ring->buf + (size_t)start * ring->elem_size, (size_t)first * ring->elem_size);
+    if (n > first) {
+        memcpy((uint8_t *)out + (size_t)first * ring->elem_size, ring->buf,
+               (size_t)(n - first) * ring->elem_size);
+    }
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    return n;
+}
+
+void spsc_ring_get_stats(spsc_ring_t *ring, spsc_ring_stats_t *out)
+{
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    out->pushed = head;
+    out->dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    out->depth = head - tail;
+    out->max_depth = ring->max_depth;
+    out->capacity = ring->mask + 1;
+}
@@ -0,0 +1,80 @@
+// spsc_ring.h
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Ring một producer / một consumer, không khóa, phần tử kích thước cố định.
+ *
+ * Producer chỉ ghi head, consumer chỉ ghi tail; mỗi phía giữ bản sao chỉ số của
+ * phía kia và chỉ đọc lại khi bản sao cho thấy ring đầy/rỗng, nên đường push/pop
+ * thông thường không chạm vào dòng cache của phía bên kia. Chỉ số của hai phía nằm
+ * trên hai dòng cache riêng (false sharing trên target linux / CPU có cache dữ liệu;
+ * trên ESP32 DRAM không qua cache nhưng cách bố trí không tốn gì thêm).
+ *
+ * Ring đầy thì bỏ mẫu mới và đếm dropped: producer không bao giờ bị chặn.
+ */
+
+#ifndef SPSC_RING_CACHE_LINE
+#if CONFIG_IDF_TARGET_LINUX
+#define SPSC_RING_CACHE_LINE 64
+#else
+#define SPSC_RING_CACHE_LINE 32
+#endif
+#endif
+
+typedef struct {
+    // Phía producer
+    atomic_uint head __attribute__((aligned(SPSC_RING_CACHE_LINE)));
+    uint32_t tail_cache;            // tail thấy lần gần nhất
+    atomic_uint dropped;            // Số mẫu bị bỏ do ring đầy
+
+    // Phía consumer
+    atomic_uint tail __attribute__((aligned(SPSC_RING_CACHE_LINE)));
+    uint32_t head_cache;            // head thấy lần gần nhất
+    uint32_t max_depth;             // Độ sâu lớn nhất khi drain
+
+    // Chỉ đọc sau spsc_ring_init
+    uint8_t *buf __attribute__((aligned(SPSC_RING_CACHE_LINE)));
+    uint32_t mask;
+    uint16_t elem_size;
+} spsc_ring_t;
+
+typedef struct {
+    uint32_t pushed;        // Tổng số mẫu đã vào ring
+    uint32_t dropped;
+    uint32_t depth;         // Số mẫu đang chờ
+    uint32_t max_depth;
+    uint32_t capacity;
+} spsc_ring_stats_t;
+
+/**
+ * @brief Cấp phát bộ đệm cho @p capacity phần tử (làm tròn lên lũy thừa của 2).
+ * @return ESP_ERR_INVALID_ARG nếu kích thước bằng 0, ESP_ERR_NO_MEM nếu hết bộ nhớ.
+ */
+esp_err_t spsc_ring_init(spsc_ring_t *ring, size_t elem_size, uint32_t capacity);
+
+/**
+ * @brief Đẩy một phần tử (chỉ gọi từ producer). Không chặn.
+ * @return false nếu ring đầy (mẫu bị bỏ và được đếm).
+ */
+bool spsc_ring_push(spsc_ring_t *ring, const void *item);
+
+/**
+ * @brief Lấy tối đa @p max_items phần tử theo thứ tự vào @p out (chỉ gọi từ consumer).
+ * Cả lô được trả lại cho producer bằng một lần ghi tail.
+ * @return Số phần tử đã lấy.
+ */
+size_t spsc_ring_pop(spsc_ring_t *ring, void *out, size_t max_items);
+
+/**
+ * @brief Thống kê; gọi từ consumer để depth/max_depth nhất quán.
+ */
+void spsc_ring_get_stats(spsc_ring_t *ring, spsc_ring_stats_t *out);
+
+#endif // SPSC_RING_H
@@ -0,0 +1,79 @@
+// timesync.c - phần chung: độ lệch esp_timer -> UTC xuất bản qua seqlock
+#include "timesync.h"
+#include "timesync_backend.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "seqlock.h"
+
+static const char *TAG = "TIMESYNC";
+
+typedef struct {
+    int64_t offset_us;          // UTC - esp_timer
+    timesync_stats_t stats;
+} timesync_state_t;
+
+static timesync_state_t s_state;
+static seqlock_t s_seq = SEQLOCK_INIT;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;   // Reader ưu tiên cao không chen vào giữa lúc ghi
+
+static void timesync_read(timesync_state_t *out)
+{
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&s_seq);
+        *out = s_state;
+    } while (seqlock_read_retry(&s_seq, seq));
+}
+
+void timesync_apply(int64_t utc_us, int64_t mono_us)
+{
+    const int64_t offset_us = utc_us - mono_us;
+    int64_t step_ms;
+    uint32_t syncs;
+
+    portENTER_CRITICAL(&s_mux);
+    seqlock_write_begin(&s_seq);
+    step_ms = s_state.stats.syncs ? (offset_us - s_state.offset_us) / 1000 : 0;
+    s_state.offset_us = offset_us;
+    s_state.stats.syncs++;
+    s_state.stats.last_sync_mono_us = mono_us;
+    s_state.stats.last_step_ms = step_ms;
+    syncs = s_state.stats.syncs;
+    seqlock_write_end(&s_seq);
+    portEXIT_CRITICAL(&s_mux);
+
+    ESP_LOGI(TAG, "Clock synced (#%lu, step %lld ms)", (unsigned long)syncs, (long long)step_ms);
+}
+
+esp_err_t timesync_start(const char *server)
+{
+    return timesync_backend_start(server ? server : TIMESYNC_SERVER_DEFAULT);
+}
+
+bool timesync_is_synced(void)
+{
+    timesync_state_t st;
+    timesync_read(&st);
+    return st.stats.syncs > 0;
+}
+
+int64_t timesync_utc_ms(int64_t mono_us)
+{
+    timesync_state_t st;
+    timesync_read(&st);
+    if (st.stats.syncs == 0) return 0;
+    return (mono_us + st.offset_us) / 1000;
+}
+
+int64_t timesync_now_ms(void)
+{
+    return timesync_utc_ms(esp_timer_get_time());
+}
+
+void timesync_get_stats(timesync_stats_t *out)
+{
+    timesync_state_t st;
+    timesync_read(&st);
+    *out = st.stats;
+}
@@ -0,0 +1,47 @@
+// timesync.h
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Ánh xạ đồng hồ đơn điệu (esp_timer) sang UTC.
+ *
+ * Mỗi lần SNTP đồng bộ chỉ cập nhật độ lệch offset = UTC - esp_timer; mọi timestamp được
+ * tính bằng esp_timer + offset. Giữa hai lần đồng bộ thời gian không nhảy lùi, và mẫu đã
+ * lấy trước đó (lưu bằng esp_timer) vẫn đổi được sang UTC lúc publish.
+ * Đọc không khóa từ task bất kỳ (seqlock), không dùng trong ISR.
+ */
+
+#ifndef TIMESYNC_SERVER_DEFAULT
+#define TIMESYNC_SERVER_DEFAULT "pool.ntp.org"
+#endif
+
+typedef struct {
+    uint32_t syncs;             // Số lần đồng bộ thành công
+    int64_t last_sync_mono_us;  // esp_timer lúc đồng bộ gần nhất
+    int64_t last_step_ms;       // Độ lệch offset thay đổi ở lần đồng bộ gần nhất (trôi của thạch anh)
+} timesync_stats_t;
+
+/**
+ * @brief Bắt đầu đồng bộ với @p server (NULL: TIMESYNC_SERVER_DEFAULT). Gọi sau khi esp_netif
+ * đã khởi tạo; kết quả đến bất đồng bộ.
+ */
+esp_err_t timesync_start(const char *server);
+
+bool timesync_is_synced(void);
+
+/**
+ * @brief Đổi thời điểm esp_timer @p mono_us sang UTC (ms từ epoch).
+ * @return 0 nếu chưa đồng bộ lần nào.
+ */
+int64_t timesync_utc_ms(int64_t mono_us);
+
+/** @brief UTC hiện tại (ms), 0 nếu chưa đồng bộ. */
+int64_t timesync_now_ms(void);
+
+void timesync_get_stats(timesync_stats_t *out);
+
+#endif // TIMESYNC_H
@@ -0,0 +1,16 @@
+// timesync_backend.h - giao tiếp nội bộ giữa phần ánh xạ chung và nguồn thời gian (SNTP / host)
+#ifndef TIMESYNC_BACKEND_H
+#define TIMESYNC_BACKEND_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Khởi động nguồn thời gian. Mỗi lần có UTC mới, backend gọi timesync_apply()
+ * với cặp (UTC, esp_timer) lấy cùng thời điểm.
+ */
+esp_err_t timesync_backend_start(const char *server);
+
+void timesync_apply(int64_t utc_us, int64_t mono_us);
+
+#endif // TIMESYNC_BACKEND_H
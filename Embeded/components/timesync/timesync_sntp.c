@@ -0,0 +1,28 @@
+// timesync_sntp.c - nguồn thời gian ESP32: SNTP của esp_netif (đồng bộ lại theo CONFIG_LWIP_SNTP_UPDATE_DELAY)
+#include "timesync_backend.h"
+#include <sys/time.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+
+static const char *TAG = "TIMESYNC";
+
+// Gọi ngay sau khi SNTP đặt đồng hồ hệ thống: lấy esp_timer cùng lúc để ghép cặp
+static void timesync_sntp_cb(struct timeval *tv)
+{
+    const int64_t mono_us = esp_timer_get_time();
+    timesync_apply((int64_t)tv->tv_sec * 1000000 + tv->tv_usec, mono_us);
+}
+
+esp_err_t timesync_backend_start(const char *server)
+{
+    esp_sntp_config_t cfg = ESP_NETIF_SNTP_DEFAULT_CONFIG(server);
+    cfg.sync_cb = timesync_sntp_cb;
+    esp_err_t err = esp_netif_sntp_init(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "SNTP init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "SNTP started (%s)", server);
+    return ESP_OK;
+}
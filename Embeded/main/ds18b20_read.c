@@ -4,6 +4,8 @@
 #include <math.h>
 #include <time.h>
 #include <stdlib.h> // Cần cho asprintf
+#include <stdatomic.h>
+#include <stddef.h>
 
 /* FreeRTOS Libraries */
 #include "freertos/FreeRTOS.h"
@@ -18,23 +20,49 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_timer.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "rom/ets_sys.h"
+#endif
 
 /* ESP-IDF Driver Libraries */
 #include "driver/gpio.h"
 
 /* ESP-IDF Network Libraries */
-#include "esp_netif.h"
 #include "esp_event.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "sim.h"            // Bản build Linux: phần cứng giả lập, mạng của máy host
+#else
+#include "esp_netif.h"
 #include "esp_wifi.h"
+#endif
 #include "esp_now.h"
 #include "mqtt_client.h"
+#if CONFIG_MQTT_PROTOCOL_5
+#include "mqtt5_client.h"
+#endif
 
 /* Custom Component & Sensor Libraries (Giả định đã có) */
 #include "ds18b20.h"
 #include "mq2_sensor.h"
 #include "flame_sensor.h"
+#include "flame_flicker.h"
 #include "RCSwitch.h"
+#include "binlog.h"
+#include "fire_score.h"
+#include "rate_of_rise.h"
+#include "sample_sched.h"
+#include "alarm_hyst.h"
+#include "gpio_hub.h"
+#include "spsc_ring.h"
+#include "seqlock.h"
+#include "journal.h"
+#include "timesync.h"
+#include "hub.h"
+#include "flood.h"
+#include "jsontok.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "mqtt_tls.h"
+#endif
 
 
 // ============================
@@ -45,22 +73,137 @@
 #define DEVICE_ID           "TU_1_NHABEP"
 #define BUZZ_PIN            GPIO_NUM_15
 #define LED_PIN             GPIO_NUM_2
-#define SENSOR_POLL_INTERVAL_MS 2000
+#define SENSOR_POLL_INTERVAL_MS 2000    // Chu kỳ lấy mẫu mode NORMAL
+#define SENSOR_POLL_QUIET_MS    5000    // Yên tĩnh, xa ngưỡng
+#define SENSOR_POLL_ELEVATED_MS 1000    // Đang tiến gần ngưỡng
+#define SENSOR_POLL_CRITICAL_MS 0       // Liên tục (giới hạn bởi thời gian chuyển đổi ~750 ms của DS18B20)
+#define DIAG_PUBLISH_INTERVAL_MS 10000
+
+// --- Telemetry pipeline: mỗi nguồn cảm biến một ring SPSC, data_publish_task drain theo lô ---
+#define TELEMETRY_ENV_RING_SIZE     32      // > số mẫu nhiệt/gas giữa hai lần publish ở mode CRITICAL
+#define TELEMETRY_FLAME_RING_SIZE   32      // Sự kiện đổi trạng thái cảm biến lửa
+#define TELEMETRY_DRAIN_BATCH       8
+#define TELEMETRY_MAX_SILENCE_MS    5000    // Không có gì mới vẫn publish sau khoảng này (web báo offline sau 20 s)
+
+// --- Đường nhận mạng: callback ESP-NOW/MQTT chỉ chép vào queue, net_dispatch_task xử lý ---
+#define NET_EVT_QUEUE_LEN       16
+#define NET_CMD_MAX_LEN         (ESP_NOW_MAX_DATA_LEN - HUB_MSG_HDR_LEN)   // Vừa một khung downlink hub -> leaf; dài hơn bị từ chối
+#define CMD_ID_MAX_LEN          24      // Correlation id của lệnh JSON
+#define CMD_RECENT_IDS          4       // Số id gần nhất được nhớ để trả lại ACK khi web gửi lại
+#define CMD_BATCH_MAX           8       // Số lệnh tối đa trong một lô {"cmds":[...]}
+#define CMD_MAX_TOKENS          64      // Token JSON của một message lệnh (8 byte mỗi token, trên stack dispatcher)
+#define SILENCE_DEFAULT_S       60      // Lệnh SILENCE không ghi số giây
+#define SILENCE_MAX_S           600
+#define NET_DISPATCH_TASK_PRIO  5
+#define BULK_QUEUE_LEN          2       // LOG_DUMP/JOURNAL chờ bulk_task; đầy thì lệnh bị từ chối
+#define BULK_TASK_PRIO          2       // Dưới data_publish_task: dump không chen trước telemetry
 
 // --- Wi-Fi & MQTT ---
 #define WIFI_SSID           "OYE TRA SUA T2"
 #define WIFI_PASS           "39393939"
 #define MQTT_BROKER_URI     "mqtt://pbl3.click:1883"
+// Chế độ TLS: transport components/mqtt_tls dùng lại session ticket khi kết nối lại. CA của broker
+// đặt ở main/certs/mqtt_ca.pem (nhúng lúc build); không có file thì dùng bundle chứng chỉ của ESP-IDF
+#ifndef MQTT_USE_TLS
+#define MQTT_USE_TLS        0
+#endif
+#define MQTT_BROKER_URI_TLS "mqtts://pbl3.click:8883"
+#define SNTP_SERVER         "pool.ntp.org"      // Có thể trỏ tới NTP server trong mạng nội bộ khi thử nghiệm
+
+// --- Vai trò nút (chọn khi build; bản Linux ghi đè bằng SIM_NODE_ROLE=direct|hub|leaf) ---
+#define NODE_ROLE_DIRECT    0   // Mỗi tủ tự kết nối Wi-Fi + MQTT
+#define NODE_ROLE_HUB       1   // Kết nối broker cho mình và cho mọi leaf (components/hub)
+#define NODE_ROLE_LEAF      2   // Không Wi-Fi station/MQTT: trạng thái, cảnh báo, ACK đi qua hub bằng ESP-NOW
+#ifndef NODE_ROLE
+#define NODE_ROLE           NODE_ROLE_DIRECT
+#endif
+#define HUB_WIFI_CHANNEL    1   // Leaf không vào AP: phải cùng kênh với AP mà hub đang kết nối
+
+// --- Lan truyền cảnh báo nhiều bước qua ESP-NOW (components/flood) ---
+// 0 (mặc định): gửi espnow_payload_t thẳng tới s_peer_mac như firmware cũ. Firmware cũ hiểu byte
+// đầu khác 1 là "an toàn" nên khung flood (0xA4) sẽ tắt báo cháy của nó: chỉ đặt TTL > 0 (vd 4)
+// khi mọi tủ trong vùng phủ sóng đã nâng cấp. Các tủ phải cùng kênh Wi-Fi.
+#ifndef ESPNOW_FLOOD_TTL
+#define ESPNOW_FLOOD_TTL        0
+#endif
+#define ESPNOW_FLOOD_REFRESH_MS 30000   // Phát lại trạng thái hiện tại: bù khung mất và cho tủ mới bật
+
+// Mặc định lấy từ define; bản build Linux cho phép ghi đè qua biến môi trường (nhiều gateway giả lập)
+static const char *s_device_id = DEVICE_ID;
+static int s_node_role = NODE_ROLE;
+#if MQTT_USE_TLS
+#if CONFIG_IDF_TARGET_LINUX
+#error "MQTT_USE_TLS chỉ hỗ trợ ESP32 (components/mqtt_tls)"
+#endif
+static const char *s_broker_uri = MQTT_BROKER_URI_TLS;
+#if MQTT_TLS_CA_EMBEDDED
+extern const char mqtt_ca_pem_start[] asm("_binary_mqtt_ca_pem_start");
+#define MQTT_TLS_CA_PEM     mqtt_ca_pem_start
+#else
+#define MQTT_TLS_CA_PEM     NULL
+#endif
+#else
+static const char *s_broker_uri = MQTT_BROKER_URI;
+#endif
 
 // Tên topic được xây dựng dynamic
 #define MQTT_TOPIC_DATA_FMT     "sensor/%s/data"      
 #define MQTT_TOPIC_FIRE_FMT     "sensor/%s/alert"     
 #define MQTT_TOPIC_COMMAND_FMT  "sensor/%s/command"
+#define MQTT_TOPIC_LOG_FMT      "sensor/%s/log"
+#define MQTT_TOPIC_BOOT_FMT     "sensor/%s/boot"
+#define MQTT_TOPIC_DIAG_FMT     "sensor/%s/diag"
+#define MQTT_TOPIC_JOURNAL_FMT  "sensor/%s/journal"
+#define MQTT_TOPIC_ACK_FMT      "sensor/%s/ack"       // Phản hồi lệnh có correlation id
+#define MQTT_TOPIC_STATUS_FMT   "sensor/%s/status"    // Retained: birth {"online":true} / LWT {"online":false}
+#define MQTT_TOPIC_STATE_FMT    "sensor/%s/state"     // Retained: ảnh chụp trạng thái gần nhất cho dashboard
+#define MQTT_TOPIC_BATCH_FMT    "sensor/%s/batch"     // Hub: trạng thái gộp của mọi leaf, mỗi giây
+#define MQTT_TOPIC_CMD_FILTER   "sensor/+/command"    // Hub nhận lệnh của mình và của các leaf
+#define MQTT_KEEPALIVE_S        10      // Broker phát LWT sau ~1.5 x keepalive không nhận gói nào
+#define MQTT_RECONNECT_MIN_MS   250     // Lần thử lại đầu tiên sau khi mất kết nối
+#define MQTT_RECONNECT_MAX_MS   8000    // Trần backoff, cũng là chu kỳ tự kết nối lại của esp-mqtt
+#define STATE_SNAPSHOT_INTERVAL_MS 30000 // Ảnh chụp retained được làm mới ít nhất sau khoảng này
+#define MQTT_LOG_CHUNK_SIZE     1024    // Kích thước tối đa mỗi message khi dump binlog qua MQTT
+// Publish qua esp_mqtt_client_enqueue: task gọi không chờ mạng. Telemetry/bulk chỉ được chiếm
+// một phần outbox, phần còn lại luôn dành cho cảnh báo (QoS 1)
+#define MQTT_OUTBOX_LIMIT_BYTES     16384   // Giới hạn cứng của outbox esp-mqtt
+#define MQTT_TELEMETRY_OUTBOX_BYTES 4096    // data/diag/boot: quá mức này thì bỏ message
+#define MQTT_BULK_OUTBOX_BYTES      8192    // LOG_DUMP/JOURNAL: chờ outbox vơi, quá MQTT_BULK_WAIT_MS thì bỏ
+#define MQTT_BULK_WAIT_MS           2000
+#define MQTT_OUTBOX_POLL_MS         20
+#define MQTT_PENDING_ALERTS         8       // Topic cảnh báo giữ lại khi mất kết nối (tủ này + leaf của hub)
+#define MQTT_PENDING_ALERT_TOPIC_LEN 48
+#define MQTT_PENDING_ALERT_DATA_LEN 96
+// MQTT 5 (tùy chọn, bật CONFIG_MQTT_PROTOCOL_5 trong menuconfig; mặc định 3.1.1): topic alias cho
+// sensor/<id>/data, hạn sống (message expiry) theo lớp, phiên bản schema đi trong user property.
+// Build với -DMQTT_USE_V5=0 để so với 3.1.1 mà không đổi sdkconfig
+#ifndef MQTT_USE_V5
+#define MQTT_USE_V5                 CONFIG_MQTT_PROTOCOL_5
+#endif
+#define MQTT_SCHEMA_KEY             "schema"
+#define MQTT_SCHEMA_VERSION         "1"
+#define MQTT_SCHEMA_PROP_LEN        (5 + sizeof(MQTT_SCHEMA_KEY) - 1 + sizeof(MQTT_SCHEMA_VERSION) - 1)
+#define MQTT_ALIAS_DATA             1       // Topic alias của sensor/<id>/data
+#define MQTT_EXPIRY_TELEMETRY_S     10      // Telemetry cũ hơn thế không còn giá trị với dashboard
+#define MQTT_EXPIRY_BULK_S          60
+#define MQTT_EXPIRY_CONTROL_S       10      // Dashboard đã bỏ lệnh sau 3 lần x 3 s
+#define JOURNAL_QUERY_DEFAULT   64      // Số bản ghi trả về khi lệnh JOURNAL không ghi số lượng
+#define JOURNAL_QUERY_MAX       512     // Giới hạn một lần truy vấn (tránh giữ bulk_task quá lâu)
+#define JOURNAL_CHUNK_RECORDS   16      // Số bản ghi mỗi message trên sensor/<id>/journal
 
 // --- Sensor Thresholds ---
 #define FIRE_THRESHOLD_C        45.0f
-#define GAS_THRESHOLD_LIGHT     0       
-#define GAS_THRESHOLD_STRONG    80
+#define FIRE_PRE_ALARM_C        32.0f   // Nhiệt độ bắt đầu cộng điểm rủi ro
+// Ngưỡng khí theo ppm (MQ2 quy đổi qua bảng tra, mq2_ppm.h); điểm rủi ro dùng nồng độ khói
+#define GAS_THRESHOLD_LIGHT     200     // Khói (ppm) bắt đầu cộng điểm rủi ro: đầu dải đo datasheet
+#define GAS_THRESHOLD_STRONG    2000    // Khói (ppm) đủ điểm báo cháy (khi đứng một mình)
+#define GAS_SLOPE_FULL_PPM_MIN  1000    // Khói tăng (ppm/phút) được cộng đủ trọng số
+#define GAS_LPG_LEAK_PPM        2000    // LPG (ppm) coi là rò rỉ, ~10% LEL của propan
+
+// --- Rate-of-Rise (tốc độ tăng nhiệt) ---
+#define ROR_RATE_C_PER_MIN      8.3f    // Ngưỡng tăng nhiệt (°C/phút), tương đương đầu báo nhiệt gia tăng thương mại
+#define ROR_WINDOW_SAMPLES      32      // Số mẫu DS18B20 trong cửa sổ hồi quy (đủ 15 s ở mode CRITICAL)
+#define ROR_MIN_SPAN_MS         15000   // Cửa sổ phải dài ít nhất 15 s trước khi đánh giá
 
 // --- Flame Sensor Array ---
 static const gpio_num_t FLAME_SENSOR_PINS[] = {
@@ -69,16 +212,70 @@ static const gpio_num_t FLAME_SENSOR_PINS[] = {
 #define NUM_FLAME_SENSORS (sizeof(FLAME_SENSOR_PINS) / sizeof(FLAME_SENSOR_PINS[0]))
 #define FLAME_ALARM_THRESHOLD 2 // Số lượng cảm biến lửa tối thiểu để kích hoạt báo động
 
+// --- Flame Flicker (phân tích nhấp nháy trên ngõ AO, tùy chọn) ---
+// Đồng thuận tính theo "bằng chứng": cảm biến chỉ có digital đóng góp 100/cảm biến như trước.
+// Cảm biến có AO: nguồn sáng ổn định (nắng, đèn) chỉ đóng góp 50, nhấp nháy như lửa đóng góp
+// tới 200 -> một cảm biến thấy lửa thật là đủ báo, hai cảm biến bị nắng chiếu thì không.
+#ifndef FLAME_ANALOG_MODE
+#if CONFIG_IDF_TARGET_LINUX
+#define FLAME_ANALOG_MODE   1   // Kịch bản không có lệnh "ao" thì cảm biến vẫn hành xử như digital
+#else
+#define FLAME_ANALOG_MODE   0   // Cần nối ngõ AO của module vào các chân ADC1 trong FLAME_FLICKER_CHANNELS
+#endif
+#endif
+#define FLAME_EVIDENCE_DIGITAL      100     // Cảm biến không có kết quả AO
+#define FLAME_EVIDENCE_STEADY       50      // Có AO, tín hiệu không nhấp nháy (độ tin cậy 0)
+#define FLAME_EVIDENCE_FLICKER      200     // Có AO, độ tin cậy >= FLAME_FLICKER_CONF_FULL
+#define FLAME_FLICKER_CONF_FULL     80
+#define FLAME_FLICKER_STALE_MS      3000    // Kết quả AO cũ hơn mức này thì bỏ qua
+
+#if FLAME_ANALOG_MODE
+// Chỉ ADC1 dùng được: GPIO36 (CH0) cho MQ2, GPIO35 (CH7) cho bộ thu RF -> cảm biến 4 chỉ có digital
+static const flame_flicker_channel_t FLAME_FLICKER_CHANNELS[] = {
+    { .sensor_index = 0, .adc_channel = 3 },    // GPIO39
+    { .sensor_index = 1, .adc_channel = 6 },    // GPIO34
+    { .sensor_index = 2, .adc_channel = 4 },    // GPIO32
+    { .sensor_index = 3, .adc_channel = 5 },    // GPIO33
+};
+#endif
+
+// --- Hysteresis / Dwell cho từng nguồn báo cháy (chống bật/tắt liên tục quanh ngưỡng) ---
+// Bật: không trễ (an toàn tính mạng). Tắt: giá trị phải xuống dưới ngưỡng clear và giữ đủ dwell.
+#define TEMP_GAS_CLEAR_SCORE    700     // Điểm rủi ro phải giảm xuống mức này mới được xóa
+#define TEMP_GAS_MIN_OFF_MS     30000
+#define ROR_CLEAR_RATIO_PCT     50      // Xóa ROR khi tốc độ tăng < 50% ngưỡng
+#define ROR_MIN_OFF_MS          30000
+#define FLAME_CLEAR_COUNT       (FLAME_ALARM_THRESHOLD - 1)    // Tính theo FLAME_EVIDENCE_DIGITAL
+#define FLAME_MIN_OFF_MS        10000
+
 // --- RF Remote Control ---
 #define RF_RECEIVER_PIN     GPIO_NUM_35 
+#define RF_RECEIVER_USE_RMT 1           // 1: nhận bằng RMT-RX (một ngắt mỗi khung), 0: ngắt GPIO mỗi cạnh
 #define LEARN_BUTTON_PIN    GPIO_NUM_18 
 #define DELETE_BUTTON_PIN   GPIO_NUM_5  
 #define NVS_NAMESPACE       "storage"   
 #define MAX_RF_CODES        10          
 
+// --- Stress NVS + cạnh RF (chỉ để kiểm tra trên board, mặc định tắt) ---
+// Nối NVS_STRESS_INJECT_PIN với RF_RECEIVER_PIN (GPIO35 chỉ là input). Một timer phần cứng
+// IRAM-safe phát lại khung RF trong khi task khác liên tục nvs_set/nvs_commit (cache flash tắt).
+// Cần CONFIG_GPTIMER_ISR_CACHE_SAFE và CONFIG_GPTIMER_CTRL_FUNC_IN_IRAM.
+#ifndef NVS_STRESS_TEST
+#define NVS_STRESS_TEST     0
+#endif
+#define NVS_STRESS_INJECT_PIN   GPIO_NUM_4
+#define NVS_STRESS_CODE         0xA5A5AUL   // Mã 24 bit, protocol 1; không bao giờ được học
+#define NVS_STRESS_BITS         24
+#define NVS_STRESS_PULSE_US     350         // Độ rộng xung cơ sở của protocol 1
+#define NVS_STRESS_REPEATS      4           // Số lần lặp khung mỗi lần bấm, như remote thật
+#define NVS_STRESS_ROUNDS       200
+#define NVS_STRESS_SETTLE_MS    150         // Sau khung cuối: đủ cho rf_control_task (nhịp 50 ms) lấy mã
+
 // --- Manual Fire Control ---
 #define MANUAL_ALARM_PIN    GPIO_NUM_33 
 #define MANUAL_RESET_PIN    GPIO_NUM_25 
+#define BUTTON_DEBOUNCE_MS  20      // Đọc lại mức chân sau khoảng này để xác nhận nhấn
+#define BUTTON_LOCKOUT_MS   300     // Bỏ qua cạnh dội / nhấn lặp của cùng nút trong khoảng này
 
 
 // ============================
@@ -92,29 +289,62 @@ static const char *STATUS_TAG = "TRẠNG THÁI HỆ THỐNG";
 static char *MQTT_TOPIC_DATA = NULL;
 static char *MQTT_TOPIC_FIRE = NULL;
 static char *MQTT_TOPIC_COMMAND = NULL;
+static char *MQTT_TOPIC_LOG = NULL;
+static char *MQTT_TOPIC_BOOT = NULL;
+static char *MQTT_TOPIC_DIAG = NULL;
+static char *MQTT_TOPIC_JOURNAL = NULL;
+static char *MQTT_TOPIC_STATUS = NULL;
+static char *MQTT_TOPIC_ACK = NULL;
+static char *MQTT_TOPIC_STATE = NULL;
+static char *MQTT_TOPIC_BATCH = NULL;
+static char *s_mqtt_lwt_msg = NULL;     // Phải sống suốt vòng đời client
+static atomic_bool s_mqtt_state_resync; // Vừa kết nối lại: data_publish_task gửi lại ảnh chụp retained
 
 // --- Network & ESP-NOW ---
-// MAC Address của Tủ 2 (Peer) - Cần thay đổi nếu nạp cho Tủ 2
-static const uint8_t PEER_MAC[6] =  {0x78, 0x1C, 0x3C, 0x2B, 0xC5, 0x64};
+// MAC Address của Tủ 2 (Peer) - Cần thay đổi nếu nạp cho Tủ 2 (bản Linux: SIM_PEER_MAC)
+static uint8_t s_peer_mac[6] =  {0x78, 0x1C, 0x3C, 0x2B, 0xC5, 0x64};
 
 static uint8_t s_local_mac[6] =  {0xA0, 0xA3, 0xB3, 0xA9, 0xE9, 0x34};
+static const uint8_t BROADCAST_MAC[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};   // Khung hub <-> leaf, flood
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 static bool mqtt_connected = false;
 static uint8_t last_cmd_sent_espnow = 0xFF;
+static int64_t s_espnow_last_tx_us = 0;      // Lần gửi trạng thái gần nhất (mốc làm mới của flood)
+static bool s_peer_remote_fire = false;      // Trạng thái theo khung espnow_payload_t của peer
+static esp_timer_handle_t s_flood_timer = NULL;
 
 // --- System State Variables ---
-static bool alarm_on_state = false;   // Trạng thái báo cháy toàn cục (Có cháy = true)
 
 // --- Individual Local Alarm Source States ---
 static bool g_temp_gas_fire_state = false;
+static bool g_temp_ror_fire_state = false;
 static bool g_flame_consensus_fire_state = false;
 static bool g_rf_triggered_fire_state = false;
 static bool g_manual_triggered_fire_state = false;
 // [NEW] Biến kích hoạt từ Web
 static bool g_web_triggered_fire_state = false; 
+// SILENCE: còi tắt tới thời điểm này (ms esp_timer), 0 = không. Chỉ cho đợt báo cháy đang kêu:
+// update_and_propagate_alarm_state xóa khi có nguồn mới hoặc hết cháy
+static atomic_uint s_silence_until_ms;
 
 // --- Flame Sensor State Array ---
 static bool g_flame_sensor_states[NUM_FLAME_SENSORS];
+static volatile int g_flame_active_count = 0; // Đầu vào "flame count" cho bộ tính điểm rủi ro
+static volatile int g_flame_evidence = 0;     // Đầu vào của đồng thuận (xem FLAME_EVIDENCE_*)
+// Kết quả nhấp nháy từng cảm biến (ghi trong task lấy mẫu AO, đọc nguyên tử từng phần tử)
+static volatile uint8_t g_flame_flicker_conf[NUM_FLAME_SENSORS];
+static volatile uint32_t g_flame_flicker_ms[NUM_FLAME_SENSORS];     // 0: chưa có kết quả
+
+// --- Fire Risk Scoring (chỉ temp_gas_sensor_task ghi) ---
+static fire_score_t s_fire_score;
+static ror_detector_t s_temp_ror;
+static sample_sched_t s_sample_sched;
+
+// --- Hysteresis cho các nguồn báo cháy từ cảm biến (bảo vệ bởi s_alarm_src_mux) ---
+static alarm_hyst_t s_temp_gas_hyst;
+static alarm_hyst_t s_ror_hyst;
+static alarm_hyst_t s_flame_hyst;
+static portMUX_TYPE s_alarm_src_mux = portMUX_INITIALIZER_UNLOCKED;
 
 // --- RF Control Globals ---
 RCSWITCH_t rf_receiver;
@@ -122,26 +352,156 @@ unsigned long learned_rf_codes[MAX_RF_CODES] = {0};
 int num_learned_codes = 0;
 bool is_learning_mode = false;
 
+// --- Nút nhấn (qua GPIO hub): cạnh xuống được chuyển vào queue của task xử lý ---
+typedef struct {
+    gpio_num_t pin;
+    uint32_t ts_us;     // Timestamp cạnh lấy trong ISR
+} button_evt_t;
+
+static QueueHandle_t s_manual_button_queue = NULL; // Nút báo cháy / reset -> manual_control_task
+static QueueHandle_t s_rf_button_queue = NULL;     // Nút học / xóa mã RF -> rf_control_task
+
 // --- Data Structures ---
+// Nguồn báo cháy cục bộ trong system_state_t.sources
+#define ALARM_SRC_TEMP_GAS  (1u << 0)
+#define ALARM_SRC_ROR       (1u << 1)
+#define ALARM_SRC_FLAME     (1u << 2)
+#define ALARM_SRC_RF        (1u << 3)
+#define ALARM_SRC_MANUAL    (1u << 4)
+#define ALARM_SRC_WEB       (1u << 5)
+#define ALARM_SRC_COUNT     6
+#define JOURNAL_SRC_NONE    0xFF    // source của bản ghi journal không gắn với một nguồn
+
+// Tên nguồn theo chỉ số bit (trường source của bản ghi journal)
+static const char *const ALARM_SRC_NAMES[ALARM_SRC_COUNT] = { "temp_gas", "ror", "flame", "rf", "manual", "web" };
+
+// Trạng thái hệ thống nhìn từ ngoài (còi/đèn, MQTT, ESP-NOW). Một bản duy nhất, xuất bản
+// qua seqlock: ghi trong s_state_mux, đọc bằng state_read() từ task/core bất kỳ không khóa.
 typedef struct {
-    float temperature;
-    int gas_level;
-    bool combined_local_fire; // Tổng hợp các nguồn kích hoạt cục bộ
+    uint32_t generation;      // Tăng mỗi lần nội dung đổi: bên publish bỏ qua nếu không đổi
+    uint8_t sources;          // ALARM_SRC_* đang kích hoạt
+    bool local_fire;          // Tổng hợp các nguồn kích hoạt cục bộ (sources != 0)
     bool remote_fire;         // Cảnh báo cháy từ thiết bị khác gửi tới
-} sensor_state_t;
+    bool alarm_on;            // Trạng thái báo cháy toàn cục = local || remote
+    uint32_t flame_mask;      // bit i = cảm biến lửa i đang báo
+} system_state_t;
+
+// Một mẫu của temp_gas_sensor_task (producer duy nhất của s_env_ring)
+typedef struct {
+    uint32_t ts_ms;                 // esp_timer lúc lấy mẫu
+    int32_t temp_cdeg;
+    int32_t temp_rise_cdeg_min;     // Tốc độ tăng nhiệt (0.01 °C/phút)
+    uint16_t gas_ppm[MQ2_GAS_COUNT]; // 0 khi MQ2 đang hiệu chỉnh
+    int16_t risk_score;             // 0..FIRE_SCORE_MAX
+    uint8_t risk_level;             // fire_level_t
+    uint8_t sample_mode;            // sample_mode_t
+    uint32_t sample_period_ms;
+} env_sample_t;
+
+// Một lần cảm biến lửa đổi trạng thái (flame_sensor_task, producer duy nhất của s_flame_ring)
+typedef struct {
+    uint32_t ts_ms;
+    uint8_t sensor;
+    uint8_t detected;
+    uint8_t active_count;
+} flame_sample_t;
 
 typedef struct __attribute__((packed)) {
     uint8_t cmd; // 0 = Safe, 1 = Fire detected
+    int64_t ts_ms; // UTC (ms) lúc gửi, 0 nếu bên gửi chưa đồng bộ giờ
 } espnow_payload_t;
 
+#define ESPNOW_PAYLOAD_MIN_LEN  offsetof(espnow_payload_t, ts_ms)  // Khung của firmware cũ chỉ có cmd
+
+// Sự kiện nhận từ mạng, chép nguyên trong callback (task Wi-Fi / task MQTT) rồi xử lý ở net_dispatch_task
+typedef enum {
+    NET_EVT_ESPNOW = 0,
+    NET_EVT_MQTT_CMD,
+    NET_EVT_MQTT_CONNECTED,     // Birth/ảnh chụp/cảnh báo đang bật được gửi từ dispatcher, không từ task MQTT
+    NET_EVT_MQTT_RECONNECT,     // Hết thời gian backoff: thử kết nối lại broker
+    NET_EVT_HUB_FRAME,          // Khung ESP-NOW của chế độ hub (hub_state_frame_t / hub_msg_frame_t)
+    NET_EVT_HUB_DOWNLINK,       // Hub: lệnh MQTT cho một leaf, phát lại qua ESP-NOW
+    NET_EVT_FLOOD,              // Khung cảnh báo nhiều bước (flood_frame_t)
+    NET_EVT_FLOOD_RELAY,        // Hết jitter: phát lại các khung flood đã tới hạn
+    NET_EVT_SRC_COUNT
+} net_evt_type_t;
+
+typedef struct {
+    uint8_t type;               // net_evt_type_t
+    uint8_t len;                // Độ dài lệnh MQTT / khung hub trong data
+    uint8_t espnow_cmd;         // espnow_payload_t.cmd
+    uint8_t src_mac[6];
+    uint32_t rx_us;             // esp_timer lúc callback nhận (đo độ trễ tới khi xử lý xong)
+    int32_t link_ms;            // ESP-NOW: UTC lúc nhận - UTC lúc gửi, -1 nếu một bên chưa đồng bộ
+    int8_t rssi;                // Khung hub: RSSI lúc nhận (0 nếu không có)
+    char leaf_id[HUB_ID_LEN + 1];   // NET_EVT_HUB_DOWNLINK: leaf đích
+    char data[ESP_NOW_MAX_DATA_LEN];
+} net_event_t;
+
+// Lớp message MQTT (xem MQTT_CLASS_POLICY)
+typedef enum {
+    MQTT_CLASS_ALERT = 0,       // Cảnh báo cháy: QoS 1, không bị chính sách bỏ
+    MQTT_CLASS_TELEMETRY,       // Dữ liệu định kỳ: QoS 0, bỏ khi outbox dồn (bản sau thay thế)
+    MQTT_CLASS_BULK,            // Dump theo lệnh: QoS 0, chờ outbox vơi (chỉ gọi từ bulk_task)
+    MQTT_CLASS_RETAINED,        // Birth/ảnh chụp trạng thái: QoS 1, retained, ít và nhỏ
+    MQTT_CLASS_CONTROL,         // ACK lệnh: QoS 1, không bị bỏ (người vận hành đang chờ)
+    MQTT_CLASS_COUNT
+} mqtt_class_t;
+
+// Thống kê từng nguồn; mỗi phần tử chỉ do một task mạng ghi
+typedef struct {
+    uint32_t received;
+    uint32_t dropped;           // Queue đầy: sự kiện bị bỏ, task mạng không chờ
+    uint32_t cb_max_us;         // Thời gian dài nhất callback chiếm task mạng
+    uint64_t cb_total_us;
+} net_rx_stats_t;
+
 // --- Shared Resources ---
-static sensor_state_t sensor_data;
-static SemaphoreHandle_t data_mutex;
+// Queue sự kiện mạng -> net_dispatch_task
+static QueueHandle_t s_net_evt_queue = NULL;
+static net_rx_stats_t s_net_rx_stats[NET_EVT_SRC_COUNT];
+static const char *const NET_EVT_NAMES[NET_EVT_SRC_COUNT] = { "espnow", "mqtt", "mqtt_conn", "mqtt_retry", "hub_rx", "hub_cmd", "flood", "flood_relay" };
+static uint32_t s_net_queue_max_depth = 0;
+// Queue yêu cầu LOG_DUMP/JOURNAL -> bulk_task: publish BULK chờ outbox vơi, không được chặn dispatcher
+static QueueHandle_t s_bulk_queue = NULL;
+static uint32_t s_net_dispatch_max_us = 0;     // Nhận -> xử lý xong (gồm thời gian chờ trong queue)
+static int32_t s_espnow_link_last_ms = -1;     // Độ trễ gửi -> nhận ESP-NOW theo timestamp của hai thiết bị
+static int32_t s_espnow_link_max_ms = -1;
+
+// Ring cảm biến -> data_publish_task; s_env_latest chỉ data_publish_task đọc/ghi
+static spsc_ring_t s_env_ring;
+static spsc_ring_t s_flame_ring;
+static env_sample_t s_env_latest = {
+    .sample_mode = SAMPLE_MODE_NORMAL,
+    .sample_period_ms = SENSOR_POLL_INTERVAL_MS,
+};
+
+// MQ2 chỉ được đọc sau khi hiệu chỉnh xong (chạy nền, không chặn khởi động)
+static volatile bool g_gas_sensor_ready = false;
+
+// --- Boot Profiling ---
+#define BOOT_PROFILE_MAX_STAGES 16
+
+typedef struct {
+    const char *name;   // Chuỗi hằng
+    int64_t done_us;    // Thời điểm stage hoàn tất (esp_timer, tính từ lúc boot)
+} boot_stage_t;
+
+static boot_stage_t s_boot_stages[BOOT_PROFILE_MAX_STAGES];
+static int s_boot_stage_count = 0;
+static portMUX_TYPE s_boot_mux = portMUX_INITIALIZER_UNLOCKED;
 
 // ============================
 // --- FORWARD DECLARATIONS ---
 // ============================
-static void update_and_propagate_alarm_state(void);
+static void update_and_propagate_alarm_state(journal_actor_t actor);
+static bool mqtt_publish_class(mqtt_class_t cls, const char *topic, const char *data, int len);
+static void handle_mqtt_command(const char *data, int len, uint32_t rx_us, journal_actor_t actor);
+static int64_t sample_time_ms(uint32_t ts_ms);
+static void boot_profile_mark(const char *stage);
+static void boot_profile_publish(void);
+static void init_alarm_source_filters(void);
+static void evaluate_flame_consensus(void);
 void init_nvs();
 void init_rf_control_pins();
 void init_manual_control_pins();
@@ -151,6 +511,94 @@ void load_codes_from_nvs();
 void delete_all_codes_from_nvs();
 
 
+// ============================
+// --- SYSTEM STATE (SEQLOCK) ---
+// ============================
+static system_state_t s_state;
+static seqlock_t s_state_seq = SEQLOCK_INIT;
+static portMUX_TYPE s_state_mux = portMUX_INITIALIZER_UNLOCKED;    // Tuần tự hóa các writer
+static atomic_uint s_state_read_retries;    // Số lần reader phải chép lại vì ghi chen vào
+
+// Bản sao nhất quán của trạng thái hệ thống; không chặn writer
+static void state_read(system_state_t *out) {
+    uint32_t seq = seqlock_read_begin(&s_state_seq);
+    *out = s_state;
+    while (seqlock_read_retry(&s_state_seq, seq)) {
+        atomic_fetch_add_explicit(&s_state_read_retries, 1, memory_order_relaxed);
+        seq = seqlock_read_begin(&s_state_seq);
+        *out = s_state;
+    }
+}
+
+// Sửa trạng thái: state_update_begin() lấy bản làm việc và giữ s_state_mux (critical section),
+// state_update_end() xuất bản nếu có thay đổi. Giữa hai lời gọi không được log hay chặn.
+static void state_update_begin(system_state_t *work) {
+    portENTER_CRITICAL(&s_state_mux);
+    *work = s_state;
+}
+
+static bool state_update_end(system_state_t *work) {
+    const bool changed = work->sources != s_state.sources ||
+                         work->local_fire != s_state.local_fire ||
+                         work->remote_fire != s_state.remote_fire ||
+                         work->alarm_on != s_state.alarm_on ||
+                         work->flame_mask != s_state.flame_mask;
+    if (changed) {
+        work->generation = s_state.generation + 1;
+        seqlock_write_begin(&s_state_seq);
+        s_state = *work;
+        seqlock_write_end(&s_state_seq);
+    }
+    portEXIT_CRITICAL(&s_state_mux);
+    return changed;
+}
+
+
+// ============================
+// --- BOOT PROFILING ---
+// ============================
+
+// Ghi lại thời điểm hoàn tất một stage khởi động (gọi được từ nhiều task)
+static void boot_profile_mark(const char *stage) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_boot_mux);
+    if (s_boot_stage_count < BOOT_PROFILE_MAX_STAGES) {
+        s_boot_stages[s_boot_stage_count].name = stage;
+        s_boot_stages[s_boot_stage_count].done_us = now;
+        s_boot_stage_count++;
+    }
+    portEXIT_CRITICAL(&s_boot_mux);
+    BLOGI(TAG, "BOOT stage '%s' done at %d ms", stage, (int)(now / 1000));
+}
+
+// Publish bảng thời gian khởi động: {"id_thiet_bi":..,"stages":[{"n":"nvs","ms":12},..]}
+static void boot_profile_publish(void) {
+    if (!mqtt_connected || !MQTT_TOPIC_BOOT) return;
+
+    boot_stage_t stages[BOOT_PROFILE_MAX_STAGES];
+    int count;
+    portENTER_CRITICAL(&s_boot_mux);
+    count = s_boot_stage_count;
+    memcpy(stages, s_boot_stages, count * sizeof(boot_stage_t));
+    portEXIT_CRITICAL(&s_boot_mux);
+
+    char msg[512];
+    int offset = snprintf(msg, sizeof(msg), "{\"id_thiet_bi\":\"%s\",\"stages\":[", s_device_id);
+    for (int i = 0; i < count && offset < (int)sizeof(msg); i++) {
+        offset += snprintf(msg + offset, sizeof(msg) - offset, "%s{\"n\":\"%s\",\"ms\":%lu}",
+                           i ? "," : "", stages[i].name, (unsigned long)(stages[i].done_us / 1000));
+    }
+    if (offset < (int)sizeof(msg)) {
+        offset += snprintf(msg + offset, sizeof(msg) - offset, "]}");
+    }
+    if (offset >= (int)sizeof(msg)) {
+        ESP_LOGE(TAG, "Boot profile report truncated");
+        return;
+    }
+    mqtt_publish_class(MQTT_CLASS_TELEMETRY, MQTT_TOPIC_BOOT, msg, offset);
+}
+
+
 // ============================
 // --- PERIPHERAL INITIALIZATION ---
 // ============================
@@ -164,24 +612,44 @@ void init_nvs() {
     ESP_ERROR_CHECK(ret);
 }
 
+// Consumer GPIO hub cho nút nhấn (active-low): chỉ chuyển cạnh xuống sang queue, không chặn task dispatch
+static void button_edge_cb(gpio_num_t pin, const gpio_hub_edge_t *edge, void *ctx) {
+    if (edge->level != 0) return;
+    button_evt_t evt = { .pin = pin, .ts_us = edge->ts_us };
+    xQueueSend((QueueHandle_t)ctx, &evt, 0);
+}
+
+static void register_button(gpio_num_t pin, const char *name, QueueHandle_t queue) {
+    gpio_hub_source_config_t cfg = {
+        .pin = pin,
+        .name = name,
+        .intr_type = GPIO_INTR_NEGEDGE,
+        .pull_up = true,
+        .cb = button_edge_cb,
+        .ctx = queue,
+    };
+    ESP_ERROR_CHECK(gpio_hub_register(&cfg));
+}
+
+// Xác nhận một lần nhấn: bỏ qua nhấn lặp trong BUTTON_LOCKOUT_MS, đọc lại mức sau BUTTON_DEBOUNCE_MS
+static bool button_press_confirmed(const button_evt_t *evt, uint32_t *last_press_us) {
+    if (*last_press_us != 0 && evt->ts_us - *last_press_us < BUTTON_LOCKOUT_MS * 1000) return false;
+    vTaskDelay(pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS));
+    if (gpio_get_level(evt->pin) != 0) return false;
+    *last_press_us = evt->ts_us;
+    return true;
+}
+
 void init_rf_control_pins() {
-    gpio_config_t io_conf = {};
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = (1ULL << LEARN_BUTTON_PIN) | (1ULL << DELETE_BUTTON_PIN);
-    io_conf.pull_down_en = 0;
-    io_conf.pull_up_en = 1;
-    gpio_config(&io_conf);
+    s_rf_button_queue = xQueueCreate(4, sizeof(button_evt_t));
+    register_button(LEARN_BUTTON_PIN, "btn_learn", s_rf_button_queue);
+    register_button(DELETE_BUTTON_PIN, "btn_delete", s_rf_button_queue);
 }
 
 void init_manual_control_pins() {
-    gpio_config_t io_conf = {};
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = (1ULL << MANUAL_ALARM_PIN) | (1ULL << MANUAL_RESET_PIN);
-    io_conf.pull_down_en = 0;
-    io_conf.pull_up_en = 1;
-    gpio_config(&io_conf);
+    s_manual_button_queue = xQueueCreate(4, sizeof(button_evt_t));
+    register_button(MANUAL_ALARM_PIN, "btn_alarm", s_manual_button_queue);
+    register_button(MANUAL_RESET_PIN, "btn_reset", s_manual_button_queue);
 }
 
 
@@ -279,17 +747,339 @@ void flame_sensor_event_handler(int sensor_index, bool is_flame_detected)
         }
     }
 
-    bool new_consensus_state = (active_sensors >= FLAME_ALARM_THRESHOLD);
+    g_flame_active_count = active_sensors;
+
+    system_state_t st;
+    state_update_begin(&st);
+    if (is_flame_detected) {
+        st.flame_mask |= (1u << sensor_index);
+    } else {
+        st.flame_mask &= ~(1u << sensor_index);
+    }
+    state_update_end(&st);
+
+    const flame_sample_t sample = {
+        .ts_ms = (uint32_t)(esp_timer_get_time() / 1000),
+        .sensor = (uint8_t)sensor_index,
+        .detected = is_flame_detected,
+        .active_count = (uint8_t)active_sensors,
+    };
+    spsc_ring_push(&s_flame_ring, &sample);   // Đầy thì mất sự kiện này (được đếm), không chặn
+    evaluate_flame_consensus();
+}
+
+#if FLAME_ANALOG_MODE
+// Kết quả phân tích AO của một cảm biến (mỗi 0.64 s)
+static void flame_flicker_handler(int sensor_index, const flicker_result_t *result)
+{
+    if (sensor_index < 0 || sensor_index >= NUM_FLAME_SENSORS) return;
+    const uint8_t prev = g_flame_flicker_conf[sensor_index];
+    g_flame_flicker_conf[sensor_index] = result->confidence;
+    const uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    g_flame_flicker_ms[sensor_index] = now_ms ? now_ms : 1;
+    if ((prev >= 50) != (result->confidence >= 50)) {
+        BLOGI(TAG, "Flame %d flicker conf %u (band rms %u, %u%%)", sensor_index,
+              result->confidence, result->band_rms, result->band_pct);
+    }
+    // Chỉ cảm biến đang báo lửa mới đổi bằng chứng
+    if (g_flame_sensor_states[sensor_index]) {
+        evaluate_flame_consensus();
+    }
+}
+#endif
+
+// Bằng chứng của một cảm biến đang báo lửa: digital thuần hoặc theo độ tin cậy nhấp nháy
+static int flame_sensor_evidence(int i, uint32_t now_ms)
+{
+    if (!g_flame_sensor_states[i]) return 0;
+    const uint32_t seen_ms = g_flame_flicker_ms[i];
+    if (seen_ms == 0 || now_ms - seen_ms > FLAME_FLICKER_STALE_MS) {
+        return FLAME_EVIDENCE_DIGITAL;
+    }
+    const int conf = g_flame_flicker_conf[i] < FLAME_FLICKER_CONF_FULL ? g_flame_flicker_conf[i] : FLAME_FLICKER_CONF_FULL;
+    return FLAME_EVIDENCE_STEADY + (FLAME_EVIDENCE_FLICKER - FLAME_EVIDENCE_STEADY) * conf / FLAME_FLICKER_CONF_FULL;
+}
+
+// Đồng thuận cảm biến lửa qua hysteresis. Gọi khi có sự kiện lửa và định kỳ
+// (alarm_control_task) để việc xóa báo động sau dwell không phụ thuộc sự kiện mới.
+static void evaluate_flame_consensus(void)
+{
+    const int active_sensors = g_flame_active_count;
+    const uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    bool changed = false;
+    bool new_consensus_state;
+
+    int evidence = 0;
+    for (int i = 0; i < NUM_FLAME_SENSORS; i++) {
+        evidence += flame_sensor_evidence(i, now_ms);
+    }
+    g_flame_evidence = evidence;
 
+    portENTER_CRITICAL(&s_alarm_src_mux);
+    new_consensus_state = alarm_hyst_update(&s_flame_hyst, evidence, now_ms);
     if (new_consensus_state != g_flame_consensus_fire_state) {
         g_flame_consensus_fire_state = new_consensus_state;
-        if (g_flame_consensus_fire_state) {
-            ESP_LOGE(TAG, "FLAME ALARM: ON (Consensus from %d sensors)", active_sensors);
+        changed = true;
+    }
+    portEXIT_CRITICAL(&s_alarm_src_mux);
+
+    if (changed) {
+        if (new_consensus_state) {
+            ESP_LOGE(TAG, "FLAME ALARM: ON (Consensus from %d sensors, evidence %d)", active_sensors, evidence);
         } else {
             ESP_LOGI(TAG, "FLAME ALARM: OFF (Below threshold)");
         }
-        update_and_propagate_alarm_state();
+        update_and_propagate_alarm_state(JOURNAL_ACTOR_SENSOR);
+    }
+}
+
+static void init_alarm_source_filters(void)
+{
+    const alarm_hyst_config_t temp_gas_cfg = {
+        .set_threshold = FIRE_SCORE_MAX,
+        .clear_threshold = TEMP_GAS_CLEAR_SCORE,
+        .min_on_ms = 0,
+        .min_off_ms = TEMP_GAS_MIN_OFF_MS,
+    };
+    const int32_t ror_rate = (int32_t)(ROR_RATE_C_PER_MIN * 100);
+    const alarm_hyst_config_t ror_cfg = {
+        .set_threshold = ror_rate,
+        .clear_threshold = ror_rate * ROR_CLEAR_RATIO_PCT / 100,
+        .min_on_ms = 0,
+        .min_off_ms = ROR_MIN_OFF_MS,
+    };
+    const alarm_hyst_config_t flame_cfg = {
+        .set_threshold = FLAME_ALARM_THRESHOLD * FLAME_EVIDENCE_DIGITAL,
+        .clear_threshold = FLAME_CLEAR_COUNT * FLAME_EVIDENCE_DIGITAL,
+        .min_on_ms = 0,
+        .min_off_ms = FLAME_MIN_OFF_MS,
+    };
+    alarm_hyst_init(&s_temp_gas_hyst, &temp_gas_cfg);
+    alarm_hyst_init(&s_ror_hyst, &ror_cfg);
+    alarm_hyst_init(&s_flame_hyst, &flame_cfg);
+}
+
+
+// ============================
+// --- MQTT PUBLISH POLICY ---
+// ============================
+
+typedef struct {
+    const char *name;
+    uint8_t qos;
+    bool retain;
+    uint32_t outbox_budget;     // Outbox (byte) + message phải <= budget mới enqueue; 0: không áp dụng
+    uint32_t wait_ms;           // Thời gian chờ outbox vơi trước khi bỏ
+    uint32_t expiry_s;          // MQTT 5 message expiry; 0: không hết hạn (cảnh báo, retained)
+} mqtt_class_policy_t;
+
+static const mqtt_class_policy_t MQTT_CLASS_POLICY[MQTT_CLASS_COUNT] = {
+    [MQTT_CLASS_ALERT]     = { "alert",     1, false, 0,                           0,                 0 },
+    [MQTT_CLASS_TELEMETRY] = { "telemetry", 0, false, MQTT_TELEMETRY_OUTBOX_BYTES, 0,                 MQTT_EXPIRY_TELEMETRY_S },
+    [MQTT_CLASS_BULK]      = { "bulk",      0, false, MQTT_BULK_OUTBOX_BYTES,      MQTT_BULK_WAIT_MS, MQTT_EXPIRY_BULK_S },
+    [MQTT_CLASS_RETAINED]  = { "retained",  1, true,  0,                           0,                 0 },
+    [MQTT_CLASS_CONTROL]   = { "control",   1, false, 0,                           0,                 MQTT_EXPIRY_CONTROL_S },
+};
+
+typedef struct {
+    atomic_uint enqueued;
+    atomic_uint dropped;        // Bỏ do mất kết nối, vượt budget hoặc outbox đầy
+    atomic_uint wire_bytes;     // Tổng kích thước gói PUBLISH theo giao thức đang dùng (tính, không đo)
+    atomic_uint wire_bytes_311; // Cùng các message đó nếu gửi bằng MQTT 3.1.1
+} mqtt_class_stats_t;
+
+static mqtt_class_stats_t s_mqtt_class_stats[MQTT_CLASS_COUNT];
+static atomic_uint s_mqtt_outbox_max;
+
+// Cảnh báo phát ra khi chưa/mất kết nối broker: giữ bản mới nhất của mỗi topic (của tủ này và của
+// các leaf mà hub chuyển tiếp), gửi khi CONNECTED. Cảnh báo là trạng thái nên bản cũ hơn không cần
+typedef struct {
+    bool used;
+    uint8_t len;
+    char topic[MQTT_PENDING_ALERT_TOPIC_LEN];
+    char data[MQTT_PENDING_ALERT_DATA_LEN];
+} mqtt_pending_alert_t;
+
+static mqtt_pending_alert_t s_mqtt_pending_alerts[MQTT_PENDING_ALERTS];
+static portMUX_TYPE s_mqtt_pending_mux = portMUX_INITIALIZER_UNLOCKED;
+static atomic_uint s_mqtt_alerts_deferred;      // Số cảnh báo đã giữ lại để gửi khi kết nối
+
+#if MQTT_USE_V5
+static SemaphoreHandle_t s_mqtt_pub_lock = NULL;   // Property của esp-mqtt là trạng thái chung của client
+static mqtt5_user_property_handle_t s_mqtt_user_props = NULL;
+static atomic_uint s_mqtt_conn_gen;     // Tăng mỗi lần CONNECTED: alias chỉ sống trong một kết nối
+static unsigned s_mqtt_alias_gen = 0;   // Kết nối đã gửi gói topic + alias (giữ s_mqtt_pub_lock khi đọc/ghi)
+static unsigned s_mqtt_alias_off_gen = 0;   // Kết nối mà broker không nhận alias
+static atomic_uint s_mqtt_alias_short;  // Gói chỉ mang alias (topic rỗng)
+static atomic_uint s_mqtt_alias_full;   // Gói topic data mang topic đầy đủ (lập lại ánh xạ hoặc outbox chưa rỗng)
+#endif
+
+static uint32_t mqtt_varint_len(uint32_t n) {
+    return n < 128 ? 1 : n < 16384 ? 2 : n < 2097152 ? 3 : 4;
+}
+
+// Kích thước gói PUBLISH trên dây; @p props_len < 0: MQTT 3.1.1 (không có phần property)
+static uint32_t mqtt_publish_wire_len(uint32_t topic_len, uint32_t payload_len, int qos, int props_len) {
+    uint32_t rem = 2 + topic_len + (qos ? 2 : 0) + payload_len;
+    if (props_len >= 0) rem += mqtt_varint_len((uint32_t)props_len) + (uint32_t)props_len;
+    return 1 + mqtt_varint_len(rem) + rem;
+}
+
+#if MQTT_USE_V5
+/**
+ * Đặt property rồi đưa vào outbox; gọi khi giữ s_mqtt_pub_lock. Alias chỉ dùng cho lớp QoS 0
+ * (telemetry trên topic data): gói QoS > 0 có thể được gửi lại sau khi kết nối lại, nơi broker chưa
+ * có ánh xạ alias, nên luôn mang topic đầy đủ. Gói QoS 0 chỉ mang alias được enqueue khi outbox
+ * rỗng: gói topic + alias của kết nối này đã đi, và gói mới được gửi ngay.
+ */
+static int mqtt5_publish_locked(mqtt_class_t cls, const char *topic, const char *data, int len,
+                                uint32_t *wire_len) {
+    const mqtt_class_policy_t *pol = &MQTT_CLASS_POLICY[cls];
+    const unsigned gen = atomic_load(&s_mqtt_conn_gen);
+    esp_mqtt5_publish_property_config_t prop = {
+        .message_expiry_interval = pol->expiry_s,
+        .user_property = s_mqtt_user_props,
+    };
+    bool use_alias = (pol->qos == 0 && cls == MQTT_CLASS_TELEMETRY && topic == MQTT_TOPIC_DATA &&
+                      s_mqtt_alias_off_gen != gen);
+    if (use_alias) prop.topic_alias = MQTT_ALIAS_DATA;
+
+    if (esp_mqtt5_client_set_publish_property(mqtt_client, &prop) != ESP_OK && use_alias) {
+        // Topic Alias Maximum trong CONNACK nhỏ hơn alias: cả kết nối này gửi topic đầy đủ
+        s_mqtt_alias_off_gen = gen;
+        use_alias = false;
+        prop.topic_alias = 0;
+        esp_mqtt5_client_set_publish_property(mqtt_client, &prop);
+    }
+
+    const char *wire_topic = topic;
+    if (use_alias && s_mqtt_alias_gen == gen && esp_mqtt_client_get_outbox_size(mqtt_client) == 0) {
+        wire_topic = "";    // Broker đã có alias -> topic
+    }
+    const int msg_id = esp_mqtt_client_enqueue(mqtt_client, wire_topic, data, len, pol->qos, pol->retain, true);
+    if (msg_id >= 0 && use_alias) {
+        s_mqtt_alias_gen = gen;
+        atomic_fetch_add(wire_topic[0] ? &s_mqtt_alias_full : &s_mqtt_alias_short, 1);
+    }
+    const int props_len = (pol->expiry_s ? 5 : 0) + (use_alias ? 3 : 0) + (int)MQTT_SCHEMA_PROP_LEN;
+    *wire_len = mqtt_publish_wire_len((uint32_t)strlen(wire_topic), (uint32_t)len, pol->qos, props_len);
+    return msg_id;
+}
+#endif
+
+/**
+ * Leaf không có MQTT: cảnh báo và ACK lệnh đi qua hub (hub publish lên sensor/<id>/alert|ack).
+ * Telemetry thay bằng khung trạng thái gọn; các lớp còn lại không gửi được từ leaf.
+ */
+static bool leaf_uplink(mqtt_class_t cls, const char *data, int len) {
+    if (cls != MQTT_CLASS_ALERT && cls != MQTT_CLASS_CONTROL) return false;
+    if (len > ESP_NOW_MAX_DATA_LEN - HUB_MSG_HDR_LEN) return false;
+    uint8_t buf[ESP_NOW_MAX_DATA_LEN];
+    hub_msg_frame_t *frame = (hub_msg_frame_t *)buf;
+    frame->type = HUB_FRAME_UPLINK;
+    frame->kind = cls == MQTT_CLASS_ALERT ? HUB_UPLINK_ALERT : HUB_UPLINK_ACK;
+    hub_id_set(frame->id, s_device_id);
+    memcpy(frame->payload, data, len);
+    return esp_now_send(BROADCAST_MAC, buf, HUB_MSG_HDR_LEN + len) == ESP_OK;
+}
+
+// Giữ cảnh báo mới nhất của @p topic; false nếu không vừa hoặc hết chỗ (khi đó cảnh báo bị bỏ)
+static bool mqtt_alert_defer(const char *topic, const char *data, int len) {
+    if (strlen(topic) >= MQTT_PENDING_ALERT_TOPIC_LEN || len >= MQTT_PENDING_ALERT_DATA_LEN) return false;
+    bool stored = false;
+    portENTER_CRITICAL(&s_mqtt_pending_mux);
+    mqtt_pending_alert_t *slot = NULL;
+    for (int i = 0; i < MQTT_PENDING_ALERTS; i++) {
+        mqtt_pending_alert_t *p = &s_mqtt_pending_alerts[i];
+        if (p->used && strcmp(p->topic, topic) == 0) {
+            slot = p;
+            break;
+        }
+        if (!p->used && slot == NULL) slot = p;
+    }
+    if (slot != NULL) {
+        strcpy(slot->topic, topic);
+        memcpy(slot->data, data, len);
+        slot->len = (uint8_t)len;
+        slot->used = true;
+        stored = true;
+    }
+    portEXIT_CRITICAL(&s_mqtt_pending_mux);
+    if (stored) atomic_fetch_add(&s_mqtt_alerts_deferred, 1);
+    return stored;
+}
+
+// Cảnh báo mới của @p topic được gửi thẳng: bản đang giữ đã cũ, không được gửi sau nó
+static void mqtt_alert_discard(const char *topic) {
+    portENTER_CRITICAL(&s_mqtt_pending_mux);
+    for (int i = 0; i < MQTT_PENDING_ALERTS; i++) {
+        mqtt_pending_alert_t *p = &s_mqtt_pending_alerts[i];
+        if (p->used && strcmp(p->topic, topic) == 0) p->used = false;
+    }
+    portEXIT_CRITICAL(&s_mqtt_pending_mux);
+}
+
+/**
+ * Đưa message vào outbox của esp-mqtt theo chính sách của lớp @p cls; task MQTT gửi đi sau.
+ * Outbox gửi theo thứ tự vào, nên cảnh báo "chen hàng" bằng cách giới hạn phần telemetry/bulk
+ * được nằm trong outbox: cảnh báo chỉ phải đợi sau tối đa budget của các lớp đó.
+ */
+static bool mqtt_publish_class(mqtt_class_t cls, const char *topic, const char *data, int len) {
+    const mqtt_class_policy_t *pol = &MQTT_CLASS_POLICY[cls];
+    mqtt_class_stats_t *st = &s_mqtt_class_stats[cls];
+    if (len <= 0) len = (int)strlen(data);
+    if (s_node_role == NODE_ROLE_LEAF) {
+        if (!leaf_uplink(cls, data, len)) {
+            atomic_fetch_add(&st->dropped, 1);
+            return false;
+        }
+        atomic_fetch_add(&st->enqueued, 1);
+        return true;
+    }
+
+    if (!mqtt_connected || mqtt_client == NULL || topic == NULL) {
+        if (cls == MQTT_CLASS_ALERT && topic != NULL && mqtt_alert_defer(topic, data, len)) return true;
+        atomic_fetch_add(&st->dropped, 1);
+        return false;
+    }
+    if (cls == MQTT_CLASS_ALERT) mqtt_alert_discard(topic);
+    uint32_t waited_ms = 0;
+    while (pol->outbox_budget > 0 &&
+           esp_mqtt_client_get_outbox_size(mqtt_client) + len > (int)pol->outbox_budget) {
+        if (waited_ms >= pol->wait_ms || !mqtt_connected) {
+            atomic_fetch_add(&st->dropped, 1);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(MQTT_OUTBOX_POLL_MS));
+        waited_ms += MQTT_OUTBOX_POLL_MS;
+    }
+
+    const uint32_t wire_len_311 = mqtt_publish_wire_len((uint32_t)strlen(topic), (uint32_t)len, pol->qos, -1);
+    uint32_t wire_len = wire_len_311;
+    int msg_id;
+#if MQTT_USE_V5
+    xSemaphoreTake(s_mqtt_pub_lock, portMAX_DELAY);
+    msg_id = mqtt5_publish_locked(cls, topic, data, len, &wire_len);
+    xSemaphoreGive(s_mqtt_pub_lock);
+#else
+    // store = true: QoS 0 cũng đi qua outbox thay vì gửi ngay trong task gọi
+    msg_id = esp_mqtt_client_enqueue(mqtt_client, topic, data, len, pol->qos, pol->retain, true);
+#endif
+    if (msg_id < 0) {
+        atomic_fetch_add(&st->dropped, 1);
+        if (cls == MQTT_CLASS_ALERT) {
+            ESP_LOGE(TAG, "Alert not queued (outbox full)");
+        }
+        return false;
     }
+    atomic_fetch_add(&st->enqueued, 1);
+    atomic_fetch_add(&st->wire_bytes, wire_len);
+    atomic_fetch_add(&st->wire_bytes_311, wire_len_311);
+    const unsigned outbox = (unsigned)esp_mqtt_client_get_outbox_size(mqtt_client);
+    unsigned prev_max = atomic_load(&s_mqtt_outbox_max);
+    while (outbox > prev_max && !atomic_compare_exchange_weak(&s_mqtt_outbox_max, &prev_max, outbox)) {
+    }
+    return true;
 }
 
 
@@ -297,10 +1087,24 @@ void flame_sensor_event_handler(int sensor_index, bool is_flame_detected)
 // --- ALARM CONTROL LOGIC ---
 // ============================
 
+// Gửi trạng thái cục bộ: khung flood broadcast cho cả mạng, hoặc khung cũ tới s_peer_mac
+static esp_err_t espnow_send_state(uint8_t fire_flag) {
+    esp_err_t err;
+    if (ESPNOW_FLOOD_TTL > 0) {
+        flood_frame_t frame;
+        flood_originate(&frame, fire_flag, ESPNOW_FLOOD_TTL);
+        err = esp_now_send(BROADCAST_MAC, (const uint8_t *)&frame, sizeof(frame));
+    } else {
+        espnow_payload_t tx_payload = {.cmd = fire_flag, .ts_ms = timesync_now_ms()};
+        err = esp_now_send(s_peer_mac, (uint8_t*)&tx_payload, sizeof(tx_payload));
+    }
+    if (err == ESP_OK) s_espnow_last_tx_us = esp_timer_get_time();
+    return err;
+}
+
 static void send_fire_alert_espnow(uint8_t fire_flag) {
     if (fire_flag == last_cmd_sent_espnow) return;
-    espnow_payload_t tx_payload = {.cmd = fire_flag};
-    if (esp_now_send(PEER_MAC, (uint8_t*)&tx_payload, sizeof(tx_payload)) == ESP_OK) {
+    if (espnow_send_state(fire_flag) == ESP_OK) {
         ESP_LOGI(TAG, "Sent ESP-NOW message: {cmd: %d}", fire_flag);
         last_cmd_sent_espnow = fire_flag;
     } else {
@@ -308,54 +1112,104 @@ static void send_fire_alert_espnow(uint8_t fire_flag) {
     }
 }
 
+// Làm mới định kỳ (data_publish_task): tủ vừa bật hoặc vừa mất khung vẫn biết trạng thái của tủ này
+static void espnow_refresh_state(void) {
+    if (ESPNOW_FLOOD_TTL == 0 || last_cmd_sent_espnow > 1) return;
+    if (esp_timer_get_time() - s_espnow_last_tx_us < (int64_t)ESPNOW_FLOOD_REFRESH_MS * 1000) return;
+    espnow_send_state(last_cmd_sent_espnow);
+}
+
 // --- HÀM CẬP NHẬT TRẠNG THÁI (Quan trọng) ---
-static void update_and_propagate_alarm_state(void)
+// Giá trị ghi kèm sự kiện của một nguồn trong journal (đọc không khóa, chỉ để tra cứu)
+static int32_t alarm_source_journal_value(int src)
+{
+    switch (1u << src) {
+        case ALARM_SRC_TEMP_GAS: return s_fire_score.score;
+        case ALARM_SRC_ROR: return s_temp_ror.slope;        // 0.01 °C/phút
+        case ALARM_SRC_FLAME: return g_flame_evidence;
+        default: return 0;
+    }
+}
+
+// Ghi các thay đổi nguồn và trạng thái toàn cục vào journal (chỉ đẩy vào queue, không chạm flash)
+static void journal_alarm_transition(const system_state_t *prev, const system_state_t *st, journal_actor_t actor)
+{
+    const uint8_t changed = prev->sources ^ st->sources;
+    for (int src = 0; src < ALARM_SRC_COUNT; src++) {
+        if (!(changed & (1u << src))) continue;
+        const bool on = (st->sources & (1u << src)) != 0;
+        journal_log(on ? JOURNAL_EV_SOURCE_ON : JOURNAL_EV_SOURCE_OFF, (uint8_t)src, actor,
+                    alarm_source_journal_value(src));
+    }
+    if (st->alarm_on != prev->alarm_on) {
+        journal_log(st->alarm_on ? JOURNAL_EV_ALARM_ON : JOURNAL_EV_ALARM_OFF, JOURNAL_SRC_NONE, actor,
+                    st->sources | (st->remote_fire ? (1u << ALARM_SRC_COUNT) : 0));
+    }
+}
+
+// {"alert":bool,"ts":UTC ms lúc trạng thái đổi}; ts = 0 khi chưa đồng bộ giờ
+static void publish_alert(bool on, int64_t change_us)
 {
-    // Các cờ (Flag) để lưu hành động cần thực hiện sau khi thoát Mutex
+    char msg[64];
+    const int len = snprintf(msg, sizeof(msg), "{\"alert\":%s,\"ts\":%lld}", on ? "true" : "false",
+                             (long long)timesync_utc_ms(change_us));
+    mqtt_publish_class(MQTT_CLASS_ALERT, MQTT_TOPIC_FIRE, msg, len);
+}
+
+// @p actor: ai gây ra lần cập nhật này (ghi vào journal cùng các thay đổi)
+static void update_and_propagate_alarm_state(journal_actor_t actor)
+{
+    // Các cờ (Flag) để lưu hành động cần thực hiện sau khi ra khỏi vùng tới hạn
     bool should_publish_mqtt_on = false;
     bool should_publish_mqtt_off = false;
     bool should_send_espnow = false;
     int espnow_payload_val = 0;
 
     // --- BẮT ĐẦU VÙNG TỚI HẠN ---
-    if (xSemaphoreTake(data_mutex, portMAX_DELAY) == pdTRUE)
-    {
-        // B1: Tính toán trạng thái CỤC BỘ (Local)
-        // [UPDATE] Đã thêm g_web_triggered_fire_state vào đây
-        // Khi Web bật -> combined_local_fire = true -> Gửi ESP-NOW
-        bool new_combined_local_state = g_temp_gas_fire_state || 
-                                        g_flame_consensus_fire_state || 
-                                        g_rf_triggered_fire_state || 
-                                        g_manual_triggered_fire_state ||
-                                        g_web_triggered_fire_state;
-
-        // B2: Nếu Local thay đổi -> Đánh dấu gửi ESP-NOW
-        if (new_combined_local_state != sensor_data.combined_local_fire) {
-            sensor_data.combined_local_fire = new_combined_local_state;
-            should_send_espnow = true;
-            espnow_payload_val = sensor_data.combined_local_fire ? 1 : 0;
-        }
-
-        // B3: Tính toán trạng thái TOÀN CỤC (Global = Local OR Remote)
-        bool is_global_fire_active = sensor_data.combined_local_fire || sensor_data.remote_fire;
-        bool previous_alarm_state = alarm_on_state;
-
-        // B4: Nếu Global thay đổi -> Đánh dấu gửi MQTT và cập nhật alarm_on_state
-        if (is_global_fire_active && !previous_alarm_state) {
-            alarm_on_state = true;
-            should_publish_mqtt_on = true;
-            ESP_LOGW(TAG, "🔥 ALARM ACTIVATED! Global fire state is now ON.");
-        } else if (!is_global_fire_active && previous_alarm_state) {
-            alarm_on_state = false;
-            should_publish_mqtt_off = true;
-            ESP_LOGI(TAG, "✅ ALARM DEACTIVATED. Global fire state is now OFF.");
-        }
-        
-        xSemaphoreGive(data_mutex);
-    }
+    system_state_t st;
+    state_update_begin(&st);
+    const system_state_t prev = st;
+
+    // B1: Tính toán trạng thái CỤC BỘ (Local)
+    // Khi Web bật -> local_fire = true -> Gửi ESP-NOW
+    st.sources = (g_temp_gas_fire_state ? ALARM_SRC_TEMP_GAS : 0) |
+                 (g_temp_ror_fire_state ? ALARM_SRC_ROR : 0) |
+                 (g_flame_consensus_fire_state ? ALARM_SRC_FLAME : 0) |
+                 (g_rf_triggered_fire_state ? ALARM_SRC_RF : 0) |
+                 (g_manual_triggered_fire_state ? ALARM_SRC_MANUAL : 0) |
+                 (g_web_triggered_fire_state ? ALARM_SRC_WEB : 0);
+    st.local_fire = st.sources != 0;
+
+    // B2: Tính toán trạng thái TOÀN CỤC (Global = Local OR Remote)
+    st.alarm_on = st.local_fire || st.remote_fire;
+    state_update_end(&st);
     // --- KẾT THÚC VÙNG TỚI HẠN ---
+    const int64_t change_us = esp_timer_get_time();
+
+    journal_alarm_transition(&prev, &st, actor);
+
+    // Nguồn mới bật hoặc hết cháy: SILENCE cũ hết hiệu lực, còi kêu lại ngay
+    if (((st.sources & ~prev.sources) != 0 || (prev.alarm_on && !st.alarm_on)) &&
+        atomic_exchange(&s_silence_until_ms, 0) != 0) {
+        journal_log(JOURNAL_EV_SILENCE, JOURNAL_SRC_NONE, actor, 0);
+    }
+
+    // B3: Nếu Local thay đổi -> gửi ESP-NOW
+    if (st.local_fire != prev.local_fire) {
+        should_send_espnow = true;
+        espnow_payload_val = st.local_fire ? 1 : 0;
+    }
 
-    // --- THỰC HIỆN TÁC VỤ MẠNG (Không blocking Mutex) ---
+    // B4: Nếu Global thay đổi -> gửi MQTT
+    if (st.alarm_on && !prev.alarm_on) {
+        should_publish_mqtt_on = true;
+        ESP_LOGW(TAG, "🔥 ALARM ACTIVATED! Global fire state is now ON.");
+    } else if (!st.alarm_on && prev.alarm_on) {
+        should_publish_mqtt_off = true;
+        ESP_LOGI(TAG, "✅ ALARM DEACTIVATED. Global fire state is now OFF.");
+    }
+
+    // --- THỰC HIỆN TÁC VỤ MẠNG (ngoài vùng tới hạn) ---
 
     // 1. Gửi ESP-NOW
     if (should_send_espnow) {
@@ -363,12 +1217,8 @@ static void update_and_propagate_alarm_state(void)
     }
 
     // 2. Gửi MQTT
-    if ((should_publish_mqtt_on || should_publish_mqtt_off) && mqtt_connected) {
-        char *msg;
-        if (asprintf(&msg, "{\"alert\":%s}", should_publish_mqtt_on ? "true" : "false") > 0) {
-            esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_FIRE, msg, 0, 1, 0);
-            free(msg);
-        }
+    if (should_publish_mqtt_on || should_publish_mqtt_off) {
+        publish_alert(should_publish_mqtt_on, change_us);
     }
 }
 
@@ -376,27 +1226,291 @@ static void update_and_propagate_alarm_state(void)
 // --- ESP-NOW ---
 // ============================
 
+// Gọi trong callback của task mạng: không chờ queue, đo thời gian callback chiếm task
+static void net_event_post(const net_event_t *evt, int64_t start_us) {
+    net_rx_stats_t *st = &s_net_rx_stats[evt->type];
+    if (s_net_evt_queue != NULL && xQueueSend(s_net_evt_queue, evt, 0) == pdTRUE) {
+        st->received++;
+        const uint32_t depth = (uint32_t)uxQueueMessagesWaiting(s_net_evt_queue);
+        if (depth > s_net_queue_max_depth) s_net_queue_max_depth = depth;
+    } else {
+        st->dropped++;
+    }
+    const uint32_t took_us = (uint32_t)(esp_timer_get_time() - start_us);
+    st->cb_total_us += took_us;
+    if (took_us > st->cb_max_us) st->cb_max_us = took_us;
+}
+
+// Chạy trong task Wi-Fi: chỉ lọc và chép khung vào queue
 static void espnow_recv_cb(const esp_now_recv_info_t *info, const uint8_t *data, int len) {
+    const int64_t start_us = esp_timer_get_time();
     if (memcmp(info->src_addr, s_local_mac, 6) == 0) return;
-    if (len < sizeof(espnow_payload_t)) return;
+    if (len < (int)ESPNOW_PAYLOAD_MIN_LEN) return;
+
+    if (data[0] == FLOOD_FRAME_ALARM) {
+        if (ESPNOW_FLOOD_TTL == 0 || len < (int)sizeof(flood_frame_t)) return;
+        net_event_t evt = {
+            .type = NET_EVT_FLOOD,
+            .len = sizeof(flood_frame_t),
+            .rx_us = (uint32_t)start_us,
+        };
+        memcpy(evt.src_mac, info->src_addr, 6);
+        memcpy(evt.data, data, sizeof(flood_frame_t));
+        net_event_post(&evt, start_us);
+        return;
+    }
+    if (data[0] == HUB_FRAME_STATE || (data[0] >= HUB_FRAME_UPLINK && data[0] <= HUB_FRAME_DOWNLINK)) {
+        if (s_node_role == NODE_ROLE_DIRECT || len > (int)sizeof(((net_event_t *)0)->data)) return;
+        net_event_t evt = {
+            .type = NET_EVT_HUB_FRAME,
+            .len = (uint8_t)len,
+            .rx_us = (uint32_t)start_us,
+#if !CONFIG_IDF_TARGET_LINUX
+            .rssi = (int8_t)info->rx_ctrl->rssi,
+#endif
+        };
+        memcpy(evt.src_mac, info->src_addr, 6);
+        memcpy(evt.data, data, len);
+        net_event_post(&evt, start_us);
+        return;
+    }
+
+    espnow_payload_t rx = { 0 };
+    memcpy(&rx, data, len < (int)sizeof(rx) ? len : (int)sizeof(rx));
+    const int64_t now_ms = timesync_utc_ms(start_us);
+    net_event_t evt = {
+        .type = NET_EVT_ESPNOW,
+        .espnow_cmd = rx.cmd,
+        .rx_us = (uint32_t)start_us,
+        .link_ms = (rx.ts_ms > 0 && now_ms > 0) ? (int32_t)(now_ms - rx.ts_ms) : -1,
+    };
+    memcpy(evt.src_mac, info->src_addr, 6);
+    net_event_post(&evt, start_us);
+}
+
+// remote_fire = peer trực tiếp (khung cũ) HOẶC bất kỳ nút gốc nào trong mạng flood đang cháy
+static void apply_remote_fire(uint8_t cmd) {
+    const bool new_remote_fire_state = s_peer_remote_fire || flood_remote_active();
+    system_state_t st;
+    state_update_begin(&st);
+    const bool remote_changed = st.remote_fire != new_remote_fire_state;
+    st.remote_fire = new_remote_fire_state;
+    state_update_end(&st);
+    if (remote_changed) {
+        journal_log(new_remote_fire_state ? JOURNAL_EV_REMOTE_ON : JOURNAL_EV_REMOTE_OFF,
+                    JOURNAL_SRC_NONE, JOURNAL_ACTOR_PEER, cmd);
+    }
+    update_and_propagate_alarm_state(JOURNAL_ACTOR_PEER);
+}
 
-    const espnow_payload_t *rx_payload = (const espnow_payload_t*)data;
-    bool new_remote_fire_state = (rx_payload->cmd == 1);
-    ESP_LOGI(TAG, "ESP-NOW alert received from peer. Remote fire state: %s", new_remote_fire_state ? "ON" : "OFF");
+static void handle_espnow_alert(const net_event_t *evt) {
+    s_peer_remote_fire = (evt->espnow_cmd == 1);
+    ESP_LOGI(TAG, "ESP-NOW alert received from peer. Remote fire state: %s (link %ld ms)",
+             s_peer_remote_fire ? "ON" : "OFF", (long)evt->link_ms);
+    if (evt->link_ms >= 0) {
+        s_espnow_link_last_ms = evt->link_ms;
+        if (evt->link_ms > s_espnow_link_max_ms) s_espnow_link_max_ms = evt->link_ms;
+    }
+    apply_remote_fire(evt->espnow_cmd);
+}
+
+static void flood_timer_cb(void *arg) {
+    const int64_t start_us = esp_timer_get_time();
+    const net_event_t evt = {
+        .type = NET_EVT_FLOOD_RELAY,
+        .rx_us = (uint32_t)start_us,
+    };
+    net_event_post(&evt, start_us);
+}
+
+// Phát các khung đã hết jitter rồi hẹn timer cho khung kế tiếp (dispatcher)
+static void flood_relay_flush(void) {
+    flood_frame_t due[FLOOD_PENDING];
+    int64_t next_us = 0;
+    const int64_t now_us = esp_timer_get_time();
+    const int n = flood_relay_due(due, FLOOD_PENDING, now_us, &next_us);
+    for (int i = 0; i < n; i++) {
+        esp_now_send(BROADCAST_MAC, (const uint8_t *)&due[i], sizeof(due[i]));
+    }
+    if (next_us != 0 && s_flood_timer != NULL) {
+        esp_timer_stop(s_flood_timer);
+        esp_timer_start_once(s_flood_timer, next_us > now_us ? (uint64_t)(next_us - now_us) : 1);
+    }
+}
+
+// Khung flood: lần đầu thấy thì áp trạng thái của nút gốc; phát lại do flood_rx xếp lịch
+static void handle_flood_frame(const net_event_t *evt) {
+    flood_frame_t frame;
+    memcpy(&frame, evt->data, sizeof(frame));
+    // rx_us là 32 bit thấp của esp_timer lúc nhận: thời gian giữ ở relay gồm cả lúc nằm trong queue
+    const int64_t now_us = esp_timer_get_time();
+    const int64_t rx_us = now_us - (uint32_t)((uint32_t)now_us - evt->rx_us);
+    if (flood_rx(&frame, rx_us, now_us) != FLOOD_RX_NEW) return;
+    flood_relay_flush();    // Hẹn timer trước: jitter không bị cộng thêm thời gian ghi journal
+
+    ESP_LOGI(TAG, "Flood alert %02x%02x%02x seq %u: %s after %u hop(s)", frame.origin[3], frame.origin[4],
+             frame.origin[5], frame.seq, frame.cmd == 1 ? "ON" : "OFF", frame.hops + 1);
+    apply_remote_fire(frame.cmd);
+}
+
+// --- Chế độ hub ---
+static uint32_t s_hub_batches = 0;
+static uint32_t s_hub_batch_bytes = 0;
+static uint32_t s_hub_downlinks = 0;
+static uint32_t s_hub_downlink_unknown = 0;    // Lệnh cho id chưa từng gửi khung trạng thái
+static uint8_t s_leaf_seq = 0;
+
+static const char *const HUB_UPLINK_TOPIC_FMT[HUB_UPLINK_COUNT] = {
+    [HUB_UPLINK_ALERT] = MQTT_TOPIC_FIRE_FMT,
+    [HUB_UPLINK_ACK] = MQTT_TOPIC_ACK_FMT,
+};
+
+// Hub: khung trạng thái vào bảng leaf, cảnh báo/ACK của leaf được publish dưới topic của leaf.
+// Leaf: chỉ nhận lệnh gửi cho chính mình.
+static void handle_hub_frame(const net_event_t *evt) {
+    const uint8_t type = (uint8_t)evt->data[0];
+    if (s_node_role == NODE_ROLE_HUB) {
+        hub_note_rx(evt->len);
+        if (type == HUB_FRAME_STATE && evt->len >= sizeof(hub_state_frame_t)) {
+            hub_state_frame_t frame;
+            memcpy(&frame, evt->data, sizeof(frame));
+            hub_leaf_update(&frame, evt->rssi, esp_timer_get_time());
+        } else if (type == HUB_FRAME_UPLINK && evt->len >= HUB_MSG_HDR_LEN) {
+            const hub_msg_frame_t *frame = (const hub_msg_frame_t *)evt->data;
+            if (frame->kind >= HUB_UPLINK_COUNT) return;
+            char id[HUB_ID_LEN + 1];
+            char topic[64];
+            hub_id_get(frame->id, id);
+            snprintf(topic, sizeof(topic), HUB_UPLINK_TOPIC_FMT[frame->kind], id);
+            mqtt_publish_class(frame->kind == HUB_UPLINK_ALERT ? MQTT_CLASS_ALERT : MQTT_CLASS_CONTROL,
+                               topic, frame->payload, evt->len - HUB_MSG_HDR_LEN);
+        }
+    } else if (s_node_role == NODE_ROLE_LEAF && type == HUB_FRAME_DOWNLINK && evt->len > HUB_MSG_HDR_LEN) {
+        const hub_msg_frame_t *frame = (const hub_msg_frame_t *)evt->data;
+        if (hub_id_equals(frame->id, s_device_id)) {
+            handle_mqtt_command(frame->payload, evt->len - HUB_MSG_HDR_LEN, evt->rx_us, JOURNAL_ACTOR_HUB);
+        }
+    }
+}
+
+// Hub: lệnh trên sensor/<leaf>/command phát xuống leaf, leaf ACK lại qua HUB_FRAME_UPLINK
+static void hub_forward_command(const net_event_t *evt) {
+    if (!hub_leaf_known(evt->leaf_id)) {
+        s_hub_downlink_unknown++;
+        ESP_LOGW(TAG, "Command for unknown leaf '%s' dropped", evt->leaf_id);
+        return;
+    }
+    uint8_t buf[ESP_NOW_MAX_DATA_LEN];
+    hub_msg_frame_t *frame = (hub_msg_frame_t *)buf;
+    const int len = evt->len < ESP_NOW_MAX_DATA_LEN - HUB_MSG_HDR_LEN ? evt->len : ESP_NOW_MAX_DATA_LEN - HUB_MSG_HDR_LEN;
+    frame->type = HUB_FRAME_DOWNLINK;
+    frame->kind = 0;
+    hub_id_set(frame->id, evt->leaf_id);
+    memcpy(frame->payload, evt->data, len);
+    if (esp_now_send(BROADCAST_MAC, buf, HUB_MSG_HDR_LEN + len) == ESP_OK) {
+        s_hub_downlinks++;
+    }
+}
+
+// Leaf: một khung trạng thái mỗi lượt của data_publish_task (thay cho telemetry JSON)
+static void leaf_send_state(const system_state_t *st) {
+    hub_state_frame_t frame = {
+        .type = HUB_FRAME_STATE,
+        .seq = s_leaf_seq++,
+        .flags = (st->alarm_on ? HUB_FLAG_ALARM : 0) |
+                 ((st->sources & ALARM_SRC_WEB) ? HUB_FLAG_WEB : 0) |
+                 ((s_env_latest.gas_ppm[MQ2_GAS_SMOKE] > GAS_THRESHOLD_LIGHT ||
+                   s_env_latest.gas_ppm[MQ2_GAS_LPG] > GAS_LPG_LEAK_PPM) ? HUB_FLAG_GAS_HIGH : 0) |
+                 (timesync_is_synced() ? HUB_FLAG_SYNCED : 0),
+        .flame_mask = (uint8_t)st->flame_mask,
+        .risk_score = (uint16_t)s_env_latest.risk_score,
+        .risk_level = s_env_latest.risk_level,
+        .temp_cdeg = (int16_t)s_env_latest.temp_cdeg,
+        .temp_rise_cdeg_min = (int16_t)s_env_latest.temp_rise_cdeg_min,
+        .gas_ppm = { s_env_latest.gas_ppm[MQ2_GAS_LPG], s_env_latest.gas_ppm[MQ2_GAS_SMOKE],
+                     s_env_latest.gas_ppm[MQ2_GAS_CO] },
+        .ts_ms = sample_time_ms(s_env_latest.ts_ms),
+    };
+    hub_id_set(frame.id, s_device_id);
+    esp_now_send(BROADCAST_MAC, (const uint8_t *)&frame, sizeof(frame));
+}
 
-    if (xSemaphoreTake(data_mutex, portMAX_DELAY) == pdTRUE) {
-        sensor_data.remote_fire = new_remote_fire_state;
-        xSemaphoreGive(data_mutex);
+/**
+ * Hub: một message cho mọi leaf trên sensor/<hub>/batch. Dạng cột ("cot" là tên trường, mỗi
+ * phần tử của "tu" là một hàng) để 20+ leaf vẫn nằm trong budget outbox của lớp telemetry.
+ */
+static void hub_publish_batch(void) {
+    static hub_leaf_t leaves[HUB_MAX_LEAVES];        // Chỉ data_publish_task gọi
+    static char msg[HUB_MAX_LEAVES * 144 + 256];    // Hàng dài nhất ~140 byte; 24 leaf < 4 KB
+    const int64_t now_us = esp_timer_get_time();
+    const int n = hub_leaf_snapshot(leaves, HUB_MAX_LEAVES, now_us);
+    if (n == 0 || !mqtt_connected || MQTT_TOPIC_BATCH == NULL) return;
+
+    int len = snprintf(msg, sizeof(msg),
+                       "{\"hub\":\"%s\",\"ts\":%lld,\"cot\":[\"id_thiet_bi\",\"online\",\"nhiet_do\",\"lua\","
+                       "\"led_status\",\"khi_ga\",\"rui_ro\",\"muc_rui_ro\",\"toc_do_tang_nhiet\",\"lpg\",\"khoi\","
+                       "\"co\",\"lua_mask\",\"dong_bo\",\"ts\",\"rssi\",\"tuoi_ms\",\"mat_khung\"],\"tu\":[",
+                       s_device_id, (long long)timesync_now_ms());
+    for (int i = 0; i < n && len > 0 && len < (int)sizeof(msg); i++) {
+        const hub_leaf_t *l = &leaves[i];
+        const hub_state_frame_t *f = &l->state;
+        char id[HUB_ID_LEN + 1];
+        hub_id_get(f->id, id);
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        "%s[\"%s\",%d,%.2f,%d,%d,\"%s\",%u,\"%s\",%.1f,%u,%u,%u,%u,%d,%lld,%d,%lu,%lu]",
+                        i ? "," : "", id, l->online, f->temp_cdeg / 100.0f,
+                        (f->flags & HUB_FLAG_ALARM) != 0, (f->flags & HUB_FLAG_WEB) != 0,
+                        (f->flags & HUB_FLAG_GAS_HIGH) ? "cao" : "thap", f->risk_score,
+                        fire_level_to_str((fire_level_t)f->risk_level),
+                        f->temp_rise_cdeg_min / 100.0f,
+                        f->gas_ppm[0], f->gas_ppm[1], f->gas_ppm[2], f->flame_mask,
+                        (f->flags & HUB_FLAG_SYNCED) != 0, (long long)f->ts_ms, l->rssi,
+                        (unsigned long)((now_us - l->last_rx_us) / 1000), (unsigned long)l->lost);
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, "]}");
+    }
+    if (len <= 0 || len >= (int)sizeof(msg)) {
+        ESP_LOGE(TAG, "Hub batch truncated (%d leaves)", n);
+        return;
+    }
+    if (mqtt_publish_class(MQTT_CLASS_TELEMETRY, MQTT_TOPIC_BATCH, msg, len)) {
+        s_hub_batches++;
+        s_hub_batch_bytes += (uint32_t)len;
     }
-    update_and_propagate_alarm_state();
 }
 
 static esp_err_t espnow_init_and_setup(void) {
     ESP_ERROR_CHECK(esp_now_init());
     ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_recv_cb));
 
+#if CONFIG_IDF_TARGET_LINUX
+    sim_get_mac(s_local_mac);
+#else
+    esp_wifi_get_mac(WIFI_IF_STA, s_local_mac);
+#endif
+    // Jitter và seq đầu khác nhau giữa các tủ và giữa các lần khởi động
+    flood_init(s_local_mac, (uint32_t)esp_timer_get_time(), hub_espnow_airtime_us(sizeof(flood_frame_t)));
+    if (ESPNOW_FLOOD_TTL > 0) {
+        const esp_timer_create_args_t flood_timer_args = {
+            .callback = flood_timer_cb,
+            .name = "flood_relay",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&flood_timer_args, &s_flood_timer));
+    }
+
+    if (s_node_role != NODE_ROLE_DIRECT || ESPNOW_FLOOD_TTL > 0) {
+        esp_now_peer_info_t bcast = {0};
+        memcpy(bcast.peer_addr, BROADCAST_MAC, 6);
+        bcast.ifidx = ESP_IF_WIFI_STA;
+        if (esp_now_add_peer(&bcast) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to add ESP-NOW broadcast peer");
+            return ESP_FAIL;
+        }
+    }
+
     esp_now_peer_info_t peer = {0};
-    memcpy(peer.peer_addr, PEER_MAC, 6);
+    memcpy(peer.peer_addr, s_peer_mac, 6);
     peer.ifidx = ESP_IF_WIFI_STA;
     peer.encrypt = false;
     
@@ -411,62 +1525,799 @@ static esp_err_t espnow_init_and_setup(void) {
 // --- MQTT & WIFI ---
 // ============================
 
-// [UPDATE] Hàm xử lý lệnh MQTT đã thay đổi
+// --- Dump binlog qua MQTT: gom nhiều dòng vào một message để giảm số lần publish ---
+typedef struct {
+    char buf[MQTT_LOG_CHUNK_SIZE];
+    size_t len;
+} mqtt_log_chunk_t;
+
+static void mqtt_log_chunk_flush(mqtt_log_chunk_t *chunk) {
+    if (chunk->len > 0) {
+        mqtt_publish_class(MQTT_CLASS_BULK, MQTT_TOPIC_LOG, chunk->buf, chunk->len);
+    }
+    chunk->len = 0;
+}
+
+static void mqtt_log_sink(const char *line, size_t len, void *ctx) {
+    mqtt_log_chunk_t *chunk = (mqtt_log_chunk_t *)ctx;
+    if (chunk->len + len + 1 > sizeof(chunk->buf)) {
+        mqtt_log_chunk_flush(chunk);
+    }
+    if (len + 1 > sizeof(chunk->buf)) len = sizeof(chunk->buf) - 1;
+    memcpy(chunk->buf + chunk->len, line, len);
+    chunk->len += len;
+    chunk->buf[chunk->len++] = '\n';
+}
+
+static void dump_binlog_to_mqtt(void) {
+    static mqtt_log_chunk_t chunk; // Tránh cấp phát 1KB trên stack của bulk_task
+    chunk.len = 0;
+    size_t n = binlog_drain(mqtt_log_sink, &chunk, BINLOG_RING_SIZE);
+    mqtt_log_chunk_flush(&chunk);
+    ESP_LOGI(TAG, "Dumped %u binlog records to MQTT (lost so far: %lu)", (unsigned)n, (unsigned long)binlog_lost_count());
+}
+
+// --- Truy vấn journal qua MQTT: mỗi message chứa tối đa JOURNAL_CHUNK_RECORDS bản ghi ---
+// Bản ghi: [seq, boot, uptime_ms, unix_ms, "event", "source"|null, "actor", value]; "tiep" là seq
+// để truy vấn trang kế tiếp, message cuối có "xong":true.
+typedef struct {
+    char items[JOURNAL_CHUNK_RECORDS * 96];
+    int len;
+    int count;
+    uint32_t from_seq;
+    uint32_t next_seq;
+} journal_query_t;
+
+static void journal_query_flush(journal_query_t *q, bool done) {
+    static char msg[sizeof(((journal_query_t *)0)->items) + 128];
+    const int len = snprintf(msg, sizeof(msg),
+                             "{\"id_thiet_bi\":\"%s\",\"tu\":%lu,\"tiep\":%lu,\"xong\":%s,\"ban_ghi\":[%.*s]}",
+                             s_device_id, (unsigned long)q->from_seq, (unsigned long)q->next_seq,
+                             done ? "true" : "false", q->len, q->items);
+    if (len > 0 && len < (int)sizeof(msg)) {
+        mqtt_publish_class(MQTT_CLASS_BULK, MQTT_TOPIC_JOURNAL, msg, len);
+    }
+    q->from_seq = q->next_seq;
+    q->len = 0;
+    q->count = 0;
+}
+
+static bool journal_query_visit(const journal_record_t *rec, void *ctx) {
+    journal_query_t *q = (journal_query_t *)ctx;
+    char src[16];
+    if (rec->source < ALARM_SRC_COUNT) {
+        snprintf(src, sizeof(src), "\"%s\"", ALARM_SRC_NAMES[rec->source]);
+    } else {
+        strcpy(src, "null");
+    }
+    char item[96];
+    const int n = snprintf(item, sizeof(item), "%s[%lu,%u,%lu,%lld,\"%s\",%s,\"%s\",%ld]",
+                           q->len ? "," : "", (unsigned long)rec->seq, rec->boot,
+                           (unsigned long)rec->uptime_ms, (long long)rec->unix_ms,
+                           journal_event_to_str(rec->event), src,
+                           journal_actor_to_str(rec->actor), (long)rec->value);
+    if (n > 0 && n < (int)sizeof(item) && q->len + n < (int)sizeof(q->items)) {
+        memcpy(q->items + q->len, item, n);
+        q->len += n;
+        q->count++;
+    }
+    q->next_seq = rec->seq + 1;
+    if (q->count >= JOURNAL_CHUNK_RECORDS) {
+        journal_query_flush(q, false);
+    }
+    return true;
+}
+
+// Lệnh JOURNAL: không có from_seq thì trả về @p count bản ghi mới nhất
+static void journal_query_to_mqtt(bool has_from, unsigned long from, unsigned long count) {
+    static journal_query_t q;   // Tránh ~1.5KB trên stack của bulk_task
+    journal_stats_t stats;
+    journal_get_stats(&stats);
+
+    if (count > JOURNAL_QUERY_MAX) count = JOURNAL_QUERY_MAX;
+    if (!has_from) {
+        from = stats.next_seq > count ? stats.next_seq - count : 0;
+    }
+    if (from < stats.first_seq) from = stats.first_seq;
+
+    memset(&q, 0, sizeof(q));
+    q.from_seq = q.next_seq = (uint32_t)from;
+    const size_t n = journal_read((uint32_t)from, count, journal_query_visit, &q);
+    journal_query_flush(&q, true);
+    ESP_LOGI(TAG, "Journal query from %lu: %u records", from, (unsigned)n);
+}
+
+// Yêu cầu dump gửi cho bulk_task; lệnh chỉ xếp hàng, ACK không chờ dữ liệu gửi xong
+typedef struct {
+    bool journal;           // false: LOG_DUMP
+    bool has_from;
+    unsigned long from;
+    unsigned long count;
+} bulk_req_t;
+
+static bool bulk_request(const bulk_req_t *req) {
+    return s_bulk_queue != NULL && xQueueSend(s_bulk_queue, req, 0) == pdTRUE;
+}
+
+/**
+ * Phục vụ LOG_DUMP/JOURNAL ở ưu tiên thấp. Publish BULK có thể chờ outbox vơi tới MQTT_BULK_WAIT_MS
+ * mỗi message; chạy ở đây thì net_dispatch_task (lệnh, relay flood, cảnh báo của leaf) không phải đợi.
+ */
+static void bulk_task(void *pvParameters) {
+    bulk_req_t req;
+    while (1) {
+        if (xQueueReceive(s_bulk_queue, &req, portMAX_DELAY) != pdTRUE) continue;
+        if (req.journal) {
+            journal_query_to_mqtt(req.has_from, req.from, req.count);
+        } else {
+            dump_binlog_to_mqtt();
+        }
+    }
+}
+
+// --- Lệnh MQTT: bảng tra tên lệnh -> handler, ACK kèm correlation id trên sensor/<id>/ack ---
+typedef enum {
+    CMD_RES_APPLIED = 0,    // Trạng thái đã đổi
+    CMD_RES_UNCHANGED,      // Hợp lệ nhưng trạng thái đã đúng như yêu cầu
+    CMD_RES_DONE,           // Lệnh truy vấn/dump đã vào hàng của bulk_task
+    CMD_RES_SKIPPED,        // Không chạy vì lệnh khác trong cùng lô không hợp lệ
+    CMD_RES_REJECTED,       // Hợp lệ nhưng không áp được lúc này (SILENCE khi không cháy, hàng dump đầy)
+    CMD_RES_BAD_ARGS,
+    CMD_RES_UNKNOWN,
+} cmd_result_t;             // Thứ tự tăng dần theo mức lỗi: kết quả chung của lô là giá trị lớn nhất
+
+static const char *const CMD_RESULT_NAMES[] = { "applied", "unchanged", "done", "skipped", "rejected", "bad_args",
+                                                "unknown" };
+
+// Tham số của lệnh, trỏ thẳng vào buffer message (không chép)
+typedef struct {
+    const char *js;
+    const jsontok_t *tok;
+    int obj;                // Token object "args", -1 nếu không có
+    const char *text;       // Chuỗi trần sau tên lệnh hoặc "args" dạng chuỗi, "" nếu không có
+} cmd_args_t;
+
+// Tham số đã kiểm tra của một lệnh, check điền cho apply dùng
+typedef struct {
+    journal_actor_t actor;  // Lệnh đến từ đâu (MQTT trực tiếp hay hub chuyển xuống), ghi vào journal
+    union {
+        struct {
+            bool has_from;
+            unsigned long from;
+            unsigned long count;
+        } journal;
+        struct {
+            int32_t pre_cdeg;
+            int32_t alarm_cdeg;
+            int32_t gas_light;
+            int32_t gas_strong;
+        } thresholds;
+        int32_t silence_s;
+    };
+} cmd_params_t;
+
+// Hai bước để lô lệnh không áp dở dang: check của mọi lệnh chạy trước, chưa đổi trạng thái nào.
+// check trả về CMD_RES_SKIPPED nếu hợp lệ (giữ nguyên nếu lô bị từ chối), ngược lại là lỗi của lệnh.
+// @p sim là trạng thái mô phỏng: trạng thái trước lô, check của lệnh đổi trạng thái cập nhật nó,
+// nên ALARM_ON rồi SILENCE trong cùng lô được nhận. apply không thể thất bại.
+typedef cmd_result_t (*mqtt_cmd_check_t)(const cmd_args_t *a, cmd_params_t *p, system_state_t *sim);
+typedef cmd_result_t (*mqtt_cmd_apply_t)(const cmd_params_t *p);
+
+typedef struct {
+    const char *name;
+    mqtt_cmd_check_t check;     // NULL: không có tham số, không đổi trạng thái mà lệnh khác xét
+    mqtt_cmd_apply_t apply;
+} mqtt_cmd_entry_t;
+
+typedef struct {
+    const char *name;       // "" nếu message không có "cmd"
+    const mqtt_cmd_entry_t *cmd;    // NULL nếu lệnh lạ
+    cmd_args_t args;
+    cmd_params_t params;
+    cmd_result_t res;
+} cmd_call_t;
+
+typedef struct {
+    char id[CMD_ID_MAX_LEN + 1];
+    uint8_t n;
+    uint8_t result[CMD_BATCH_MAX];
+} cmd_recent_t;
+
+// Chỉ net_dispatch_task đọc/ghi
+static cmd_recent_t s_cmd_recent[CMD_RECENT_IDS];
+static int s_cmd_recent_next = 0;
+static uint32_t s_cmd_received = 0;
+static uint32_t s_cmd_dup = 0;
+static uint32_t s_cmd_malformed = 0;   // JSON hỏng: không đọc được id nên không có ACK
+static atomic_uint s_cmd_oversize;     // Dài hơn NET_CMD_MAX_LEN, bị bỏ ở callback MQTT
+
+// SET_THRESHOLDS: net_dispatch_task đặt cấu hình chờ, temp_gas_sensor_task áp trước mẫu kế tiếp.
+// Chỉ giữ trong RAM, khởi động lại thì về ngưỡng biên dịch
+static portMUX_TYPE s_score_cfg_mux = portMUX_INITIALIZER_UNLOCKED;
+static fire_score_config_t s_score_cfg_pending;
+static volatile bool s_score_cfg_dirty = false;
+
+static atomic_bool s_diag_requested;    // DIAG: data_publish_task publish ở lượt kế tiếp
+
 // Nhận lệnh ALARM_ON/LED_ON từ web -> Set biến g_web_triggered_fire_state -> Update logic
-static void handle_mqtt_command(const char* data, int len) {
-    char cmd[32];
-    if (len >= sizeof(cmd)) len = sizeof(cmd) - 1;
-    strncpy(cmd, data, len);
-    cmd[len] = '\0';
+static cmd_result_t cmd_set_web_alarm(bool on, journal_actor_t actor) {
+    if (g_web_triggered_fire_state == on) return CMD_RES_UNCHANGED;
+    g_web_triggered_fire_state = on;
+    if (on) {
+        ESP_LOGW(TAG, "COMMAND: WEB TRIGGERED ALARM (ON) -> Sending ESP-NOW to peers...");
+    } else {
+        ESP_LOGW(TAG, "COMMAND: WEB CLEARED ALARM (OFF)");
+    }
+    update_and_propagate_alarm_state(actor);
+    return CMD_RES_APPLIED;
+}
+
+// Số @p key trong args nhân 10^@p decimals, phải nằm trong [lo, hi]. Không có khóa thì giữ nguyên *out;
+// false nếu khóa có nhưng sai kiểu hoặc ngoài khoảng
+static bool cmd_arg_num(const cmd_args_t *a, const char *key, int decimals, int32_t lo, int32_t hi, int32_t *out) {
+    const int i = jsontok_obj_get(a->js, a->tok, a->obj, key);
+    if (i < 0) return true;
+    int32_t v;
+    if (!jsontok_fixed(a->js, a->tok, i, decimals, &v) || v < lo || v > hi) return false;
+    *out = v;
+    return true;
+}
+
+// ALARM_ON/OFF: như update_and_propagate_alarm_state, chỉ trên bản mô phỏng của lô
+static cmd_result_t cmd_web_alarm_check(system_state_t *sim, bool on) {
+    sim->sources = on ? (sim->sources | ALARM_SRC_WEB) : (sim->sources & ~ALARM_SRC_WEB);
+    sim->local_fire = sim->sources != 0;
+    sim->alarm_on = sim->local_fire || sim->remote_fire;
+    return CMD_RES_SKIPPED;
+}
+
+static cmd_result_t cmd_alarm_on_check(const cmd_args_t *a, cmd_params_t *p, system_state_t *sim) {
+    return cmd_web_alarm_check(sim, true);
+}
+
+static cmd_result_t cmd_alarm_off_check(const cmd_args_t *a, cmd_params_t *p, system_state_t *sim) {
+    return cmd_web_alarm_check(sim, false);
+}
+
+static cmd_result_t cmd_alarm_on(const cmd_params_t *p) { return cmd_set_web_alarm(true, p->actor); }
+static cmd_result_t cmd_alarm_off(const cmd_params_t *p) { return cmd_set_web_alarm(false, p->actor); }
+
+static cmd_result_t cmd_log_dump(const cmd_params_t *p) {
+    const bulk_req_t req = { .journal = false };
+    return bulk_request(&req) ? CMD_RES_DONE : CMD_RES_REJECTED;
+}
+
+// "JOURNAL [from_seq] [count]" hoặc args {"tu":from_seq,"so":count}
+static cmd_result_t cmd_journal_check(const cmd_args_t *a, cmd_params_t *p, system_state_t *sim) {
+    p->journal.from = 0;
+    p->journal.count = JOURNAL_QUERY_DEFAULT;
+    if (a->obj >= 0) {
+        int32_t f = -1, c = JOURNAL_QUERY_DEFAULT;
+        if (!cmd_arg_num(a, "tu", 0, 0, INT32_MAX, &f) || !cmd_arg_num(a, "so", 0, 1, JOURNAL_QUERY_MAX, &c)) {
+            return CMD_RES_BAD_ARGS;
+        }
+        p->journal.has_from = f >= 0;
+        p->journal.from = (unsigned long)(p->journal.has_from ? f : 0);
+        p->journal.count = (unsigned long)c;
+    } else {
+        p->journal.has_from = sscanf(a->text, "%lu %lu", &p->journal.from, &p->journal.count) >= 1;
+    }
+    return CMD_RES_SKIPPED;
+}
+
+static cmd_result_t cmd_journal(const cmd_params_t *p) {
+    const bulk_req_t req = {
+        .journal = true,
+        .has_from = p->journal.has_from,
+        .from = p->journal.from,
+        .count = p->journal.count,
+    };
+    return bulk_request(&req) ? CMD_RES_DONE : CMD_RES_REJECTED;
+}
+
+// Cấu hình chờ áp nếu có, không thì cấu hình đang chạy
+static fire_score_config_t score_cfg_current(void) {
+    portENTER_CRITICAL(&s_score_cfg_mux);
+    const fire_score_config_t cur = s_score_cfg_dirty ? s_score_cfg_pending : s_fire_score.cfg;
+    portEXIT_CRITICAL(&s_score_cfg_mux);
+    return cur;
+}
+
+// args {"bao_truoc":35,"nhiet_do":45.5,"khoi":200,"khoi_manh":2000} (°C, ppm khói), khóa nào thiếu thì giữ
+static cmd_result_t cmd_set_thresholds_check(const cmd_args_t *a, cmd_params_t *p, system_state_t *sim) {
+    if (a->obj < 0) return CMD_RES_BAD_ARGS;
+    const fire_score_config_t cur = score_cfg_current();
+    p->thresholds.pre_cdeg = cur.temp_pre_cdeg;
+    p->thresholds.alarm_cdeg = cur.temp_alarm_cdeg;
+    p->thresholds.gas_light = cur.gas_light;
+    p->thresholds.gas_strong = cur.gas_strong;
+    if (!cmd_arg_num(a, "bao_truoc", 2, 2000, 8000, &p->thresholds.pre_cdeg) ||
+        !cmd_arg_num(a, "nhiet_do", 2, 2000, 8000, &p->thresholds.alarm_cdeg) ||
+        !cmd_arg_num(a, "khoi", 0, 10, 10000, &p->thresholds.gas_light) ||
+        !cmd_arg_num(a, "khoi_manh", 0, 10, 10000, &p->thresholds.gas_strong) ||
+        p->thresholds.pre_cdeg >= p->thresholds.alarm_cdeg || p->thresholds.gas_light >= p->thresholds.gas_strong) {
+        return CMD_RES_BAD_ARGS;
+    }
+    return CMD_RES_SKIPPED;
+}
+
+static cmd_result_t cmd_set_thresholds(const cmd_params_t *p) {
+    const fire_score_config_t cur = score_cfg_current();
+    if (p->thresholds.pre_cdeg == cur.temp_pre_cdeg && p->thresholds.alarm_cdeg == cur.temp_alarm_cdeg &&
+        p->thresholds.gas_light == cur.gas_light && p->thresholds.gas_strong == cur.gas_strong) {
+        return CMD_RES_UNCHANGED;
+    }
+    fire_score_config_t cfg = cur;
+    cfg.temp_pre_cdeg = p->thresholds.pre_cdeg;
+    cfg.temp_alarm_cdeg = p->thresholds.alarm_cdeg;
+    cfg.gas_light = p->thresholds.gas_light;
+    cfg.gas_strong = p->thresholds.gas_strong;
+    portENTER_CRITICAL(&s_score_cfg_mux);
+    s_score_cfg_pending = cfg;
+    s_score_cfg_dirty = true;
+    portEXIT_CRITICAL(&s_score_cfg_mux);
+    BLOGW(TAG, "Thresholds: pre %ld alarm %ld cdeg, smoke %ld/%ld ppm", (long)cfg.temp_pre_cdeg,
+          (long)cfg.temp_alarm_cdeg, (long)cfg.gas_light, (long)cfg.gas_strong);
+    return CMD_RES_APPLIED;
+}
+
+// Như giữ nút LEARN: mã RF nhận được tiếp theo được lưu
+static cmd_result_t cmd_rf_learn(const cmd_params_t *p) {
+    if (is_learning_mode) return CMD_RES_UNCHANGED;
+    is_learning_mode = true;
+    ESP_LOGI(TAG, "RF learning mode enabled by command");
+    return CMD_RES_APPLIED;
+}
+
+// args {"giay":N}: tắt còi N giây (mặc định SILENCE_DEFAULT_S), đèn vẫn nháy; 0 hủy.
+// Chỉ nhận khi tủ này đang báo cháy (còi chỉ kêu khi cháy tại chỗ), xét sau các lệnh đứng trước trong lô
+static cmd_result_t cmd_silence_check(const cmd_args_t *a, cmd_params_t *p, system_state_t *sim) {
+    p->silence_s = SILENCE_DEFAULT_S;
+    if (!cmd_arg_num(a, "giay", 0, 0, SILENCE_MAX_S, &p->silence_s)) return CMD_RES_BAD_ARGS;
+    return (p->silence_s == 0 || sim->local_fire) ? CMD_RES_SKIPPED : CMD_RES_REJECTED;
+}
+
+static cmd_result_t cmd_silence(const cmd_params_t *p) {
+    if (p->silence_s == 0) {
+        if (atomic_exchange(&s_silence_until_ms, 0) == 0) return CMD_RES_UNCHANGED;
+        journal_log(JOURNAL_EV_SILENCE, JOURNAL_SRC_NONE, p->actor, 0);
+        return CMD_RES_APPLIED;
+    }
+    uint32_t until = (uint32_t)(esp_timer_get_time() / 1000) + (uint32_t)p->silence_s * 1000;
+    atomic_store(&s_silence_until_ms, until ? until : 1);
+    journal_log(JOURNAL_EV_SILENCE, JOURNAL_SRC_NONE, p->actor, p->silence_s);
+    BLOGW(TAG, "Buzzer silenced for %ld s", (long)p->silence_s);
+    return CMD_RES_APPLIED;
+}
+
+// Leaf không có MQTT: cờ được đặt nhưng không có gì để publish
+static cmd_result_t cmd_diag(const cmd_params_t *p) {
+    atomic_store(&s_diag_requested, true);
+    return CMD_RES_DONE;
+}
+
+// Thêm lệnh mới: check (nếu có tham số hoặc đổi trạng thái mô phỏng) + apply + một dòng ở đây, giữ thứ tự strcmp
+// (mqtt_cmd_lookup tìm nhị phân)
+static const mqtt_cmd_entry_t MQTT_COMMANDS[] = {
+    { "ALARM_OFF",      cmd_alarm_off_check,        cmd_alarm_off },
+    { "ALARM_ON",       cmd_alarm_on_check,         cmd_alarm_on },
+    { "DIAG",           NULL,                       cmd_diag },
+    { "JOURNAL",        cmd_journal_check,          cmd_journal },
+    { "LED_OFF",        cmd_alarm_off_check,        cmd_alarm_off },    // Tên cũ của dashboard
+    { "LED_ON",         cmd_alarm_on_check,         cmd_alarm_on },
+    { "LOG_DUMP",       NULL,                       cmd_log_dump },
+    { "RF_LEARN",       NULL,                       cmd_rf_learn },
+    { "SET_THRESHOLDS", cmd_set_thresholds_check,   cmd_set_thresholds },
+    { "SILENCE",        cmd_silence_check,          cmd_silence },
+};
+#define MQTT_COMMAND_COUNT  (sizeof(MQTT_COMMANDS) / sizeof(MQTT_COMMANDS[0]))
+
+// Bảng sai thứ tự thì tìm nhị phân trượt lệnh một cách âm thầm: dừng ngay khi khởi động
+static void mqtt_cmd_table_check(void) {
+    for (size_t i = 1; i < MQTT_COMMAND_COUNT; i++) {
+        if (strcmp(MQTT_COMMANDS[i - 1].name, MQTT_COMMANDS[i].name) >= 0) {
+            ESP_LOGE(TAG, "MQTT_COMMANDS not sorted at '%s'", MQTT_COMMANDS[i].name);
+            abort();
+        }
+    }
+}
+
+static const mqtt_cmd_entry_t *mqtt_cmd_lookup(const char *name) {
+    size_t lo = 0, hi = MQTT_COMMAND_COUNT;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        const int c = strcmp(MQTT_COMMANDS[mid].name, name);
+        if (c == 0) return &MQTT_COMMANDS[mid];
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// Kết thúc NUL token chuỗi tại chỗ (đè dấu nháy đóng); các hàm jsontok chỉ dùng start/len nên vẫn đúng
+static const char *cmd_json_cstr(char *buf, const jsontok_t *t, int i) {
+    if (i < 0 || t[i].type != JSONTOK_STRING) return NULL;
+    buf[t[i].start + t[i].len] = '\0';
+    return buf + t[i].start;
+}
 
-    bool state_changed = false;
+static void cmd_call_init(cmd_call_t *call, const char *buf, const jsontok_t *t) {
+    memset(call, 0, sizeof(*call));
+    call->name = "";
+    call->args = (cmd_args_t){ .js = buf, .tok = t, .obj = -1, .text = "" };
+    call->res = CMD_RES_SKIPPED;    // Giữ nguyên nếu lô bị từ chối vì lệnh khác
+}
+
+// Một object {"cmd":"...","args":...} -> @p call. Lệnh lạ: cmd = NULL; sai dạng: res = CMD_RES_BAD_ARGS
+static void cmd_parse_call(char *buf, const jsontok_t *t, int obj, cmd_call_t *call) {
+    cmd_call_init(call, buf, t);
+    if (t[obj].type != JSONTOK_OBJECT) {
+        call->res = CMD_RES_BAD_ARGS;
+        return;
+    }
+    const char *name = cmd_json_cstr(buf, t, jsontok_obj_get(buf, t, obj, "cmd"));
+    if (name != NULL) {
+        call->name = name;
+        call->cmd = mqtt_cmd_lookup(name);
+    }
+    const int args = jsontok_obj_get(buf, t, obj, "args");
+    if (args >= 0 && t[args].type == JSONTOK_OBJECT) {
+        call->args.obj = args;
+    } else if (args >= 0 && t[args].type == JSONTOK_STRING) {
+        call->args.text = cmd_json_cstr(buf, t, args);
+    } else if (args >= 0 && t[args].type != JSONTOK_NULL) {
+        call->res = CMD_RES_BAD_ARGS;
+    }
+}
+
+static void mqtt_command_ack(const char *id, const char *cmd, const uint8_t *res, int n, bool batch,
+                             bool dup, uint32_t rx_us) {
+    cmd_result_t worst = n > 0 ? CMD_RES_APPLIED : CMD_RES_BAD_ARGS;
+    for (int i = 0; i < n; i++) {
+        if (res[i] > worst) worst = (cmd_result_t)res[i];
+    }
+    system_state_t st;
+    state_read(&st);
+    char msg[320];
+    int len = snprintf(msg, sizeof(msg),
+                       "{\"id\":\"%s\",\"cmd\":\"%s\",\"ok\":%s,\"ket_qua\":\"%s\",\"lap_lai\":%s,"
+                       "\"led_status\":%s,\"xu_ly_us\":%lu",
+                       id, cmd, worst <= CMD_RES_DONE ? "true" : "false", CMD_RESULT_NAMES[worst],
+                       dup ? "true" : "false", (st.sources & ALARM_SRC_WEB) ? "true" : "false",
+                       (unsigned long)((uint32_t)esp_timer_get_time() - rx_us));
+    // Lô lệnh: kết quả từng lệnh theo thứ tự trong "cmds"
+    for (int i = 0; batch && i < n && len > 0 && len < (int)sizeof(msg); i++) {
+        len += snprintf(msg + len, sizeof(msg) - len, "%s\"%s\"", i ? "," : ",\"tung_lenh\":[",
+                        CMD_RESULT_NAMES[res[i]]);
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, batch && n > 0 ? "]}" : "}");
+    }
+    if (len <= 0 || len >= (int)sizeof(msg)) {
+        // Tên lệnh lạ quá dài: bỏ "cmd" và danh sách từng lệnh, phần còn lại (id <= CMD_ID_MAX_LEN)
+        // luôn vừa, để web vẫn nhận được kết quả thay vì chờ hết hạn
+        len = snprintf(msg, sizeof(msg),
+                       "{\"id\":\"%s\",\"ok\":%s,\"ket_qua\":\"%s\",\"lap_lai\":%s,\"cat_bot\":true}",
+                       id, worst <= CMD_RES_DONE ? "true" : "false", CMD_RESULT_NAMES[worst], dup ? "true" : "false");
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        mqtt_publish_class(MQTT_CLASS_CONTROL, MQTT_TOPIC_ACK, msg, len);
+    }
+}
 
-    if (strcmp(cmd, "LED_ON") == 0 || strcmp(cmd, "ALARM_ON") == 0) {
-        if (!g_web_triggered_fire_state) {
-            g_web_triggered_fire_state = true;
-            ESP_LOGW(TAG, "COMMAND: WEB TRIGGERED ALARM (ON) -> Sending ESP-NOW to peers...");
-            state_changed = true;
+/**
+ * Lệnh dạng JSON {"id":"...","cmd":"SILENCE","args":{"giay":60}} được ACK ngay sau khi xử lý; web gửi
+ * lại cùng id khi hết hạn chờ thì chỉ nhận lại ACK cũ, lệnh không chạy lần hai.
+ * Lô {"id":"...","cmds":[{"cmd":...,"args":...},...]} (tối đa CMD_BATCH_MAX) chạy theo thứ tự với một
+ * ACK chung. Mọi lệnh được check trước khi lệnh nào được apply: có lệnh lạ, sai tham số hoặc bị từ
+ * chối thì cả lô không chạy, không có lệnh nào áp dở dang. Check xét trạng thái sau các lệnh đứng
+ * trước trong lô ({"cmds":[ALARM_ON, SILENCE]} hợp lệ cả khi tủ chưa cháy).
+ * Chuỗi trần ("ALARM_ON", "JOURNAL 100 64") vẫn được nhận cho client cũ, không có ACK.
+ * Không cấp phát: message, token và danh sách lệnh đều nằm trên stack của net_dispatch_task.
+ */
+static void handle_mqtt_command(const char* data, int len, uint32_t rx_us, journal_actor_t actor) {
+    char buf[NET_CMD_MAX_LEN + 1];
+    if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+    memcpy(buf, data, len);
+    buf[len] = '\0';
+    s_cmd_received++;
+
+    jsontok_t tok[CMD_MAX_TOKENS];
+    cmd_call_t calls[CMD_BATCH_MAX];
+    int n_calls = 0;
+    bool batch = false;
+    char id[CMD_ID_MAX_LEN + 1] = "";
+    if (buf[0] == '{') {
+        const int n_tok = jsontok_parse(buf, len, tok, CMD_MAX_TOKENS);
+        if (n_tok < 0 || tok[0].type != JSONTOK_OBJECT) {
+            s_cmd_malformed++;
+            ESP_LOGW(TAG, "Malformed command JSON (%d)", n_tok);
+            return;
+        }
+        // id quá dài hoặc có escape: coi như không có id (không ACK), như client cũ
+        jsontok_str(buf, tok, jsontok_obj_get(buf, tok, 0, "id"), id, sizeof(id));
+        const int list = jsontok_obj_get(buf, tok, 0, "cmds");
+        if (list >= 0) {
+            // "cmds" không phải mảng, rỗng hoặc quá CMD_BATCH_MAX: cả lô bad_args, không lệnh nào chạy
+            batch = true;
+            bool fits = tok[list].type == JSONTOK_ARRAY;
+            for (int k = list + 1; fits && k < tok[list].end; k = tok[k].end) {
+                fits = n_calls < CMD_BATCH_MAX;
+                if (fits) cmd_parse_call(buf, tok, k, &calls[n_calls++]);
+            }
+            if (!fits) n_calls = 0;
+        } else {
+            cmd_parse_call(buf, tok, 0, &calls[n_calls++]);
+        }
+    } else {
+        cmd_call_t *call = &calls[n_calls++];
+        cmd_call_init(call, buf, tok);
+        char *space = strchr(buf, ' ');
+        if (space) {
+            *space = '\0';
+            call->args.text = space + 1;
+        }
+        call->name = buf;
+        call->cmd = mqtt_cmd_lookup(buf);
+    }
+    const char *ack_cmd = batch ? "BATCH" : calls[0].name;
+
+    if (id[0] != '\0') {
+        for (int i = 0; i < CMD_RECENT_IDS; i++) {
+            if (strcmp(s_cmd_recent[i].id, id) == 0) {
+                s_cmd_dup++;
+                mqtt_command_ack(id, ack_cmd, s_cmd_recent[i].result, s_cmd_recent[i].n, batch, true, rx_us);
+                return;
+            }
         }
-    } 
-    else if (strcmp(cmd, "LED_OFF") == 0 || strcmp(cmd, "ALARM_OFF") == 0) {
-        if (g_web_triggered_fire_state) {
-            g_web_triggered_fire_state = false;
-            ESP_LOGW(TAG, "COMMAND: WEB CLEARED ALARM (OFF)");
-            state_changed = true;
+    }
+
+    // Check cả lô trước khi apply lệnh nào, trên bản mô phỏng trạng thái
+    system_state_t sim;
+    state_read(&sim);
+    bool valid = true;
+    for (int i = 0; i < n_calls; i++) {
+        cmd_call_t *call = &calls[i];
+        call->params.actor = actor;
+        if (call->res == CMD_RES_BAD_ARGS) {
+            valid = false;
+        } else if (call->cmd == NULL) {
+            ESP_LOGW(TAG, "Unknown command '%s'", call->name);
+            call->res = CMD_RES_UNKNOWN;
+            valid = false;
+        } else if (call->cmd->check != NULL) {
+            call->res = call->cmd->check(&call->args, &call->params, &sim);
+            if (call->res != CMD_RES_SKIPPED) valid = false;
         }
     }
+    uint8_t results[CMD_BATCH_MAX];
+    for (int i = 0; i < n_calls; i++) {
+        if (valid) calls[i].res = calls[i].cmd->apply(&calls[i].params);
+        results[i] = (uint8_t)calls[i].res;
+    }
+
+    if (id[0] != '\0') {
+        cmd_recent_t *slot = &s_cmd_recent[s_cmd_recent_next];
+        s_cmd_recent_next = (s_cmd_recent_next + 1) % CMD_RECENT_IDS;
+        snprintf(slot->id, sizeof(slot->id), "%s", id);
+        slot->n = (uint8_t)n_calls;
+        memcpy(slot->result, results, n_calls);
+        mqtt_command_ack(id, ack_cmd, results, n_calls, batch, false, rx_us);
+    }
+}
+
+// --- Kết nối lại broker: backoff ngắn, tăng gấp đôi tới MQTT_RECONNECT_MAX_MS, có jitter ---
+static esp_timer_handle_t s_mqtt_retry_timer = NULL;
+static uint32_t s_mqtt_backoff_ms = MQTT_RECONNECT_MIN_MS;
+static uint32_t s_mqtt_reconnects = 0;
+static int64_t s_mqtt_connect_start_us = 0;     // MQTT_EVENT_BEFORE_CONNECT của lần thử hiện tại
+static bool s_mqtt_first_ack_pending = false;
+static uint32_t s_mqtt_connect_ms = 0;          // Bắt đầu kết nối -> CONNACK (gồm bắt tay TLS)
+static uint32_t s_mqtt_first_pub_ms = 0;        // Bắt đầu kết nối -> PUBACK của message QoS 1 đầu tiên
+#if MQTT_USE_TLS
+static uint32_t s_mqtt_first_pub_full_ms = 0;   // Như trên, tách theo loại bắt tay TLS
+static uint32_t s_mqtt_first_pub_resumed_ms = 0;
+#endif
+
+static void mqtt_retry_timer_cb(void *arg) {
+    const int64_t start_us = esp_timer_get_time();
+    const net_event_t evt = {
+        .type = NET_EVT_MQTT_RECONNECT,
+        .rx_us = (uint32_t)start_us,
+    };
+    net_event_post(&evt, start_us);
+}
+
+// Gọi khi mất kết nối hoặc một lần thử thất bại (task MQTT)
+static void mqtt_schedule_retry(void) {
+    if (s_mqtt_retry_timer == NULL) return;
+    // Jitter: chờ trong [backoff/2, backoff] để các tủ không cùng dội vào broker vừa khởi động lại
+    const uint32_t half = s_mqtt_backoff_ms / 2;
+    const uint32_t delay_ms = half + (uint32_t)(esp_timer_get_time() % (half + 1));
+    esp_timer_stop(s_mqtt_retry_timer);
+    esp_timer_start_once(s_mqtt_retry_timer, (uint64_t)delay_ms * 1000);
+    s_mqtt_backoff_ms = s_mqtt_backoff_ms * 2 > MQTT_RECONNECT_MAX_MS ? MQTT_RECONNECT_MAX_MS : s_mqtt_backoff_ms * 2;
+}
+
+// PUBACK đầu tiên sau khi kết nối: thời gian từ lúc bắt đầu kết nối tới khi broker nhận message (task MQTT)
+static void mqtt_note_first_ack(void) {
+    if (!s_mqtt_first_ack_pending) return;
+    s_mqtt_first_ack_pending = false;
+    s_mqtt_first_pub_ms = (uint32_t)((esp_timer_get_time() - s_mqtt_connect_start_us) / 1000);
+#if MQTT_USE_TLS
+    mqtt_tls_stats_t tls;
+    mqtt_tls_get_stats(&tls);
+    if (tls.last_resumed) {
+        s_mqtt_first_pub_resumed_ms = s_mqtt_first_pub_ms;
+    } else {
+        s_mqtt_first_pub_full_ms = s_mqtt_first_pub_ms;
+    }
+#endif
+}
+
+// Vừa kết nối broker. Chạy ở dispatcher: publish có thể chờ s_mqtt_pub_lock, còn task MQTT
+// đang giữ khóa API của esp-mqtt khi gọi event handler
+static void handle_mqtt_connected(void) {
+    // Birth (retained) ghi đè LWT {"online":false} mà broker giữ từ lần mất kết nối trước
+    char birth[128];
+    const int birth_len = snprintf(birth, sizeof(birth),
+                                   "{\"id_thiet_bi\":\"%s\",\"online\":true,\"uptime_s\":%lu}",
+                                   s_device_id, (unsigned long)(esp_timer_get_time() / 1000000));
+    mqtt_publish_class(MQTT_CLASS_RETAINED, MQTT_TOPIC_STATUS, birth, birth_len);
+    atomic_store(&s_mqtt_state_resync, true);
+    boot_profile_publish();
+
+    // Cảnh báo phát ra lúc mất kết nối: gửi bản mới nhất của từng topic, giữ nguyên ts lúc đổi trạng thái
+    mqtt_pending_alert_t pending[MQTT_PENDING_ALERTS];
+    portENTER_CRITICAL(&s_mqtt_pending_mux);
+    memcpy(pending, s_mqtt_pending_alerts, sizeof(pending));
+    for (int i = 0; i < MQTT_PENDING_ALERTS; i++) s_mqtt_pending_alerts[i].used = false;
+    portEXIT_CRITICAL(&s_mqtt_pending_mux);
+    bool own_sent = false;
+    for (int i = 0; i < MQTT_PENDING_ALERTS; i++) {
+        if (!pending[i].used) continue;
+        mqtt_publish_class(MQTT_CLASS_ALERT, pending[i].topic, pending[i].data, pending[i].len);
+        if (strcmp(pending[i].topic, MQTT_TOPIC_FIRE) == 0) own_sent = true;
+    }
+
+    // Báo cháy bật trước khi client MQTT được tạo (chưa có topic để giữ) -> gửi trạng thái hiện tại
+    system_state_t st;
+    state_read(&st);
+    if (st.alarm_on && !own_sent) {
+        publish_alert(true, esp_timer_get_time());
+    }
+}
 
-    if (state_changed) {
-        update_and_propagate_alarm_state();
+// Xử lý sự kiện mạng ngoài task Wi-Fi/MQTT: ở đây được phép chặn (ESP-NOW send, publish, flash)
+static void net_dispatch_task(void *pvParameters) {
+    mqtt_cmd_table_check();
+    net_event_t evt;
+    while (1) {
+        if (xQueueReceive(s_net_evt_queue, &evt, portMAX_DELAY) != pdTRUE) continue;
+        if (evt.type == NET_EVT_ESPNOW) {
+            handle_espnow_alert(&evt);
+        } else if (evt.type == NET_EVT_FLOOD) {
+            handle_flood_frame(&evt);
+        } else if (evt.type == NET_EVT_FLOOD_RELAY) {
+            flood_relay_flush();
+        } else if (evt.type == NET_EVT_MQTT_CONNECTED) {
+            handle_mqtt_connected();
+        } else if (evt.type == NET_EVT_HUB_FRAME) {
+            handle_hub_frame(&evt);
+        } else if (evt.type == NET_EVT_HUB_DOWNLINK) {
+            hub_forward_command(&evt);
+        } else if (evt.type == NET_EVT_MQTT_RECONNECT) {
+            // Chỉ có tác dụng khi client đang chờ kết nối lại; đã tự kết nối rồi thì bỏ qua
+            if (!mqtt_connected && esp_mqtt_client_reconnect(mqtt_client) == ESP_OK) s_mqtt_reconnects++;
+        } else {
+            handle_mqtt_command(evt.data, evt.len, evt.rx_us, JOURNAL_ACTOR_WEB);
+        }
+        const uint32_t latency_us = (uint32_t)esp_timer_get_time() - evt.rx_us;
+        if (latency_us > s_net_dispatch_max_us) s_net_dispatch_max_us = latency_us;
     }
 }
 
 
+// Hub: "sensor/<leaf>/command" -> leaf (không kết thúc NUL trong topic của esp-mqtt)
+static bool hub_command_leaf(const char *topic, int topic_len, char leaf[HUB_ID_LEN + 1]) {
+    static const char prefix[] = "sensor/";
+    static const char suffix[] = "/command";
+    const int pre = sizeof(prefix) - 1, suf = sizeof(suffix) - 1;
+    const int id_len = topic_len - pre - suf;
+    if (id_len <= 0 || id_len > HUB_ID_LEN || memcmp(topic, prefix, pre) != 0 ||
+        memcmp(topic + topic_len - suf, suffix, suf) != 0) {
+        return false;
+    }
+    memcpy(leaf, topic + pre, id_len);
+    leaf[id_len] = '\0';
+    return true;
+}
+
 static void mqtt_event_handler(void *args, esp_event_base_t base, int32_t event_id, void *event_data) {
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
-    if (event->event_id == MQTT_EVENT_CONNECTED) {
+    if (event->event_id == MQTT_EVENT_BEFORE_CONNECT) {
+        s_mqtt_connect_start_us = esp_timer_get_time();
+    } else if (event->event_id == MQTT_EVENT_CONNECTED) {
         mqtt_connected = true;
-        ESP_LOGI(TAG, "MQTT client connected. Subscribing to commands...");
-        if (MQTT_TOPIC_COMMAND) {
+        s_mqtt_connect_ms = (uint32_t)((esp_timer_get_time() - s_mqtt_connect_start_us) / 1000);
+        s_mqtt_first_ack_pending = true;
+        s_mqtt_backoff_ms = MQTT_RECONNECT_MIN_MS;
+        if (s_mqtt_retry_timer != NULL) esp_timer_stop(s_mqtt_retry_timer);
+        ESP_LOGI(TAG, "MQTT client connected in %lu ms. Subscribing to commands...",
+                 (unsigned long)s_mqtt_connect_ms);
+        // Hub: một subscription wildcard gồm cả topic lệnh của chính nó (đăng ký cả hai thì broker
+        // có thể giao trùng lệnh)
+        if (s_node_role == NODE_ROLE_HUB) {
+            esp_mqtt_client_subscribe(mqtt_client, MQTT_TOPIC_CMD_FILTER, 1);
+        } else if (MQTT_TOPIC_COMMAND) {
             esp_mqtt_client_subscribe(mqtt_client, MQTT_TOPIC_COMMAND, 1);
         }
+#if MQTT_USE_V5
+        atomic_fetch_add(&s_mqtt_conn_gen, 1);
+#endif
+        boot_profile_mark("mqtt_connected");
+        const int64_t start_us = esp_timer_get_time();
+        const net_event_t evt = {
+            .type = NET_EVT_MQTT_CONNECTED,
+            .rx_us = (uint32_t)start_us,
+        };
+        net_event_post(&evt, start_us);
+    } else if (event->event_id == MQTT_EVENT_PUBLISHED) {
+        mqtt_note_first_ack();
     } else if (event->event_id == MQTT_EVENT_DISCONNECTED) {
         mqtt_connected = false;
-        ESP_LOGW(TAG, "MQTT client disconnected.");
+        ESP_LOGW(TAG, "MQTT client disconnected, retry in <= %lu ms.", (unsigned long)s_mqtt_backoff_ms);
+        mqtt_schedule_retry();
     } else if (event->event_id == MQTT_EVENT_DATA) {
-        if (MQTT_TOPIC_COMMAND && event->topic_len == strlen(MQTT_TOPIC_COMMAND) && 
-            strncmp(event->topic, MQTT_TOPIC_COMMAND, event->topic_len) == 0) {
-            handle_mqtt_command(event->data, event->data_len);
+        const int64_t start_us = esp_timer_get_time();
+        net_event_t evt = {
+            .type = NET_EVT_MQTT_CMD,
+            .rx_us = (uint32_t)start_us,
+        };
+        const bool own = MQTT_TOPIC_COMMAND && event->topic_len == strlen(MQTT_TOPIC_COMMAND) && 
+            strncmp(event->topic, MQTT_TOPIC_COMMAND, event->topic_len) == 0;
+        if (!own) {
+            // Hub: lệnh trên sensor/<leaf>/command được chuyển xuống leaf qua ESP-NOW
+            if (s_node_role != NODE_ROLE_HUB ||
+                !hub_command_leaf(event->topic, event->topic_len, evt.leaf_id)) {
+                return;
+            }
+            evt.type = NET_EVT_HUB_DOWNLINK;
         }
+        // Cắt một lệnh JSON là đổi nghĩa của nó (hoặc làm hỏng cả lô): bỏ hẳn, kể cả message bị chia mảnh
+        if (event->total_data_len > NET_CMD_MAX_LEN) {
+            if (event->current_data_offset == 0) {
+                atomic_fetch_add(&s_cmd_oversize, 1);
+                ESP_LOGW(TAG, "Command of %d bytes dropped (max %d)", event->total_data_len, NET_CMD_MAX_LEN);
+            }
+            return;
+        }
+        memcpy(evt.data, event->data, event->data_len);
+        evt.len = (uint8_t)event->data_len;
+        net_event_post(&evt, start_us);
     }
 }
 
 static void mqtt_app_init(void) {
-    asprintf(&MQTT_TOPIC_DATA, MQTT_TOPIC_DATA_FMT, DEVICE_ID);
-    asprintf(&MQTT_TOPIC_FIRE, MQTT_TOPIC_FIRE_FMT, DEVICE_ID);
-    asprintf(&MQTT_TOPIC_COMMAND, MQTT_TOPIC_COMMAND_FMT, DEVICE_ID);
+    asprintf(&MQTT_TOPIC_DATA, MQTT_TOPIC_DATA_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_FIRE, MQTT_TOPIC_FIRE_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_COMMAND, MQTT_TOPIC_COMMAND_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_LOG, MQTT_TOPIC_LOG_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_BOOT, MQTT_TOPIC_BOOT_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_DIAG, MQTT_TOPIC_DIAG_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_JOURNAL, MQTT_TOPIC_JOURNAL_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_STATUS, MQTT_TOPIC_STATUS_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_ACK, MQTT_TOPIC_ACK_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_BATCH, MQTT_TOPIC_BATCH_FMT, s_device_id);
+    asprintf(&MQTT_TOPIC_STATE, MQTT_TOPIC_STATE_FMT, s_device_id);
+    asprintf(&s_mqtt_lwt_msg, "{\"id_thiet_bi\":\"%s\",\"online\":false}", s_device_id);
     
-    if (!MQTT_TOPIC_DATA || !MQTT_TOPIC_FIRE || !MQTT_TOPIC_COMMAND) {
+    if (!MQTT_TOPIC_DATA || !MQTT_TOPIC_FIRE || !MQTT_TOPIC_COMMAND || !MQTT_TOPIC_LOG ||
+        !MQTT_TOPIC_BOOT || !MQTT_TOPIC_DIAG || !MQTT_TOPIC_JOURNAL || !MQTT_TOPIC_STATUS ||
+        !MQTT_TOPIC_STATE || !MQTT_TOPIC_ACK || !s_mqtt_lwt_msg) {
         ESP_LOGE(TAG, "Failed to allocate memory for MQTT topics!");
         abort();
     }
@@ -474,16 +2325,73 @@ static void mqtt_app_init(void) {
     ESP_LOGI(TAG, "MQTT Data Topic: %s", MQTT_TOPIC_DATA);
     ESP_LOGI(TAG, "MQTT Command Topic: %s", MQTT_TOPIC_COMMAND);
     
-    const esp_mqtt_client_config_t mqtt_cfg = { .broker.address.uri = MQTT_BROKER_URI };
+#if MQTT_USE_TLS
+    static const mqtt_tls_config_t tls_cfg = {
+        .ca_pem = MQTT_TLS_CA_PEM,
+        .session_tickets = true,
+    };
+    esp_transport_handle_t tls_transport = mqtt_tls_transport_create(&tls_cfg);
+    if (tls_transport == NULL) {
+        ESP_LOGE(TAG, "Failed to create MQTT TLS transport!");
+        abort();
+    }
+#endif
+    const esp_timer_create_args_t retry_timer_args = {
+        .callback = mqtt_retry_timer_cb,
+        .name = "mqtt_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &s_mqtt_retry_timer));
+
+    const esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = s_broker_uri,
+        .session.keepalive = MQTT_KEEPALIVE_S,
+        .session.last_will = {
+            .topic = MQTT_TOPIC_STATUS,
+            .msg = s_mqtt_lwt_msg,
+            .qos = 1,
+            .retain = 1,
+        },
+        .outbox.limit = MQTT_OUTBOX_LIMIT_BYTES,
+        .network.reconnect_timeout_ms = MQTT_RECONNECT_MAX_MS,
+#if MQTT_USE_TLS
+        .network.transport = tls_transport,
+#endif
+#if MQTT_USE_V5
+        .session.protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
+    };
+#if MQTT_USE_V5
+    esp_mqtt5_user_property_item_t schema = { MQTT_SCHEMA_KEY, MQTT_SCHEMA_VERSION };
+    s_mqtt_pub_lock = xSemaphoreCreateMutex();
+    if (s_mqtt_pub_lock == NULL || esp_mqtt5_client_set_user_property(&s_mqtt_user_props, &schema, 1) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up MQTT 5 publish properties!");
+        abort();
+    }
+#endif
     mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
 }
 
+#if CONFIG_IDF_TARGET_LINUX
+// Bản build Linux: không có Wi-Fi, dùng mạng của máy host -> khởi động MQTT ngay
+static void wifi_init_sta(void) {
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_LOGI(TAG, "Host network. Starting MQTT client (%s).", s_broker_uri);
+    boot_profile_mark("wifi_got_ip");
+    esp_mqtt_client_start(mqtt_client);
+}
+
+// Leaf: ESP-NOW của sim chạy trên UDP, chỉ cần event loop
+static void leaf_radio_init(void) {
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+}
+#else
 static void wifi_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *data) {
     if (event_id == WIFI_EVENT_STA_START || event_id == WIFI_EVENT_STA_DISCONNECTED) {
         esp_wifi_connect();
     } else if (event_id == IP_EVENT_STA_GOT_IP) {
         ESP_LOGI(TAG, "Wi-Fi connected. Starting MQTT client.");
+        boot_profile_mark("wifi_got_ip");
         esp_mqtt_client_start(mqtt_client);
     }
 }
@@ -500,7 +2408,22 @@ static void wifi_init_sta(void) {
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg));
     ESP_ERROR_CHECK(esp_wifi_start());
+    if (s_node_role == NODE_ROLE_HUB) {
+        // Modem sleep bỏ lỡ khung broadcast của leaf giữa hai beacon
+        esp_wifi_set_ps(WIFI_PS_NONE);
+    }
+}
+
+// Leaf: chỉ bật radio cho ESP-NOW, không vào AP; kênh cố định phải trùng kênh AP của hub
+static void leaf_radio_init(void) {
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_channel(HUB_WIFI_CHANNEL, WIFI_SECOND_CHAN_NONE));
 }
+#endif
 
 // ============================
 // --- TASKS ---
@@ -508,53 +2431,311 @@ static void wifi_init_sta(void) {
 
 void temp_gas_sensor_task(void *pvParameters)
 {
+    fire_score_config_t score_cfg = FIRE_SCORE_CONFIG_DEFAULT();
+    score_cfg.temp_pre_cdeg = (int32_t)(FIRE_PRE_ALARM_C * 100);
+    score_cfg.temp_alarm_cdeg = (int32_t)(FIRE_THRESHOLD_C * 100);
+    score_cfg.gas_light = GAS_THRESHOLD_LIGHT;
+    score_cfg.gas_strong = GAS_THRESHOLD_STRONG;
+    score_cfg.gas_slope_full = GAS_SLOPE_FULL_PPM_MIN;
+    fire_score_init(&s_fire_score, &score_cfg);
+    fire_level_t last_level = FIRE_LEVEL_NORMAL;
+
+    ror_config_t ror_cfg = {
+        .rate_cdeg_per_min = (int32_t)(ROR_RATE_C_PER_MIN * 100),
+        .window = ROR_WINDOW_SAMPLES,
+        .min_span_ms = ROR_MIN_SPAN_MS,
+    };
+    ror_init(&s_temp_ror, &ror_cfg);
+
+    sample_sched_config_t sched_cfg = SAMPLE_SCHED_CONFIG_DEFAULT();
+    sched_cfg.period_ms[SAMPLE_MODE_QUIET] = SENSOR_POLL_QUIET_MS;
+    sched_cfg.period_ms[SAMPLE_MODE_NORMAL] = SENSOR_POLL_INTERVAL_MS;
+    sched_cfg.period_ms[SAMPLE_MODE_ELEVATED] = SENSOR_POLL_ELEVATED_MS;
+    sched_cfg.period_ms[SAMPLE_MODE_CRITICAL] = SENSOR_POLL_CRITICAL_MS;
+    // Tốc độ tăng nhiệt: NORMAL từ 1 °C/phút, ELEVATED/CRITICAL theo tỷ lệ ngưỡng ROR
+    sched_cfg.rise_normal = 100;
+    sched_cfg.rise_elevated = ror_cfg.rate_cdeg_per_min * 4 / 10;
+    sched_cfg.rise_critical = ror_cfg.rate_cdeg_per_min * 3 / 4;
+    sample_sched_init(&s_sample_sched, &sched_cfg);
+
     while (1)
     {
-        float temp1 = ds18b20_read_temp();
-        
-        if(temp1 > 10.0 && temp1 <80.0 ){
-            float temp = temp1;
-        int gas = mq2_read_value();
+        int64_t cycle_start_us = esp_timer_get_time();
+        float temp = ds18b20_read_temp();
         
-        bool current_temp_gas_state = (temp > FIRE_THRESHOLD_C) || (gas > GAS_THRESHOLD_LIGHT);
+        if (temp > 10.0 && temp < 80.0) {
+            // Trong lúc MQ2 đang hiệu chỉnh, chỉ dùng nhiệt độ
+            mq2_reading_t gas_reading = { 0 };
+            mq2_set_ambient_temp((int32_t)(temp * 100));
+            if (g_gas_sensor_ready && mq2_read_ppm(&gas_reading) != ESP_OK) {
+                memset(&gas_reading, 0, sizeof(gas_reading));
+            }
+            const int gas = gas_reading.ppm[MQ2_GAS_SMOKE];
+            uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+            // Ngưỡng mới từ lệnh SET_THRESHOLDS: chỉ đổi cấu hình, EWMA/slope đang có được giữ
+            if (s_score_cfg_dirty) {
+                portENTER_CRITICAL(&s_score_cfg_mux);
+                s_fire_score.cfg = s_score_cfg_pending;
+                s_score_cfg_dirty = false;
+                portEXIT_CRITICAL(&s_score_cfg_mux);
+            }
 
-        if (xSemaphoreTake(data_mutex, portMAX_DELAY) == pdTRUE) {
-            sensor_data.temperature = temp;
-            sensor_data.gas_level = gas;
-            xSemaphoreGive(data_mutex);
+            // Hợp nhất nhiệt độ + gas + lửa thành điểm rủi ro (O(1) mỗi mẫu)
+            fire_level_t level = fire_score_update(&s_fire_score, (int32_t)(temp * 100), gas,
+                                                   g_flame_active_count, now_ms);
+            if (level != last_level) {
+                BLOGW(TAG, "Fire risk %s -> %s (score %d)", fire_level_to_str(last_level),
+                      fire_level_to_str(level), s_fire_score.score);
+                last_level = level;
+            }
+            ror_update(&s_temp_ror, (int32_t)(temp * 100), now_ms);
+
+            // Nguồn báo cháy qua hysteresis + dwell: không bật/tắt theo từng mẫu quanh ngưỡng
+            bool current_temp_gas_state;
+            bool current_ror_state;
+            portENTER_CRITICAL(&s_alarm_src_mux);
+            current_temp_gas_state = alarm_hyst_update(&s_temp_gas_hyst, s_fire_score.score, now_ms);
+            current_ror_state = alarm_hyst_update(&s_ror_hyst, s_temp_ror.valid ? s_temp_ror.slope : 0, now_ms);
+            portEXIT_CRITICAL(&s_alarm_src_mux);
+
+            if (current_ror_state != g_temp_ror_fire_state) {
+                g_temp_ror_fire_state = current_ror_state;
+                ESP_LOGW(TAG, "Rate-of-rise state changed to: %s (%.1f C/min)",
+                         g_temp_ror_fire_state ? "DETECTED" : "CLEARED", s_temp_ror.slope / 100.0f);
+                update_and_propagate_alarm_state(JOURNAL_ACTOR_SENSOR);
+            }
+
+            if (current_temp_gas_state != g_temp_gas_fire_state) {
+                g_temp_gas_fire_state = current_temp_gas_state;
+                ESP_LOGW(TAG, "Temp/Gas sensor state changed to: %s", g_temp_gas_fire_state ? "DETECTED" : "CLEARED");
+                update_and_propagate_alarm_state(JOURNAL_ACTOR_SENSOR);
+            }
+
+            // Chọn chu kỳ lấy mẫu kế tiếp theo mức độ gần ngưỡng
+            sample_mode_t prev_mode = s_sample_sched.mode;
+            sample_mode_t mode = sample_sched_update(&s_sample_sched, s_fire_score.score,
+                                                     s_temp_ror.valid ? s_temp_ror.slope : 0,
+                                                     g_temp_gas_fire_state || g_temp_ror_fire_state);
+            if (mode != prev_mode) {
+                BLOGI(TAG, "Sampling mode %s -> %s (%d ms)", sample_mode_to_str(prev_mode),
+                      sample_mode_to_str(mode), (int)sample_sched_period_ms(&s_sample_sched));
+            }
+
+            // Gửi mẫu cho data_publish_task qua ring (không khóa); publish chậm thì mẫu mới bị bỏ
+            env_sample_t sample = {
+                .ts_ms = now_ms,
+                .temp_cdeg = (int32_t)(temp * 100),
+                .temp_rise_cdeg_min = s_temp_ror.slope,
+                .risk_score = s_fire_score.score,
+                .risk_level = (uint8_t)level,
+                .sample_mode = (uint8_t)mode,
+                .sample_period_ms = sample_sched_period_ms(&s_sample_sched),
+            };
+            memcpy(sample.gas_ppm, gas_reading.ppm, sizeof(sample.gas_ppm));
+            spsc_ring_push(&s_env_ring, &sample);
         }
 
-        if (current_temp_gas_state != g_temp_gas_fire_state) {
-            g_temp_gas_fire_state = current_temp_gas_state;
-            ESP_LOGW(TAG, "Temp/Gas sensor state changed to: %s", g_temp_gas_fire_state ? "DETECTED" : "CLEARED");
-            update_and_propagate_alarm_state();
+        // Chu kỳ tính từ đầu vòng lặp (đã gồm thời gian chuyển đổi DS18B20 và đọc MQ2)
+        int64_t elapsed_ms = (esp_timer_get_time() - cycle_start_us) / 1000;
+        int64_t remaining_ms = (int64_t)sample_sched_period_ms(&s_sample_sched) - elapsed_ms;
+        vTaskDelay(remaining_ms > 0 ? pdMS_TO_TICKS(remaining_ms) : 1);
+    }
+}
+
+// --- Hiệu chỉnh MQ2 chạy nền (làm nóng 30s) để không chặn đường báo cháy lúc khởi động ---
+void mq2_calibration_task(void *pvParameters)
+{
+    mq2_init();
+    ESP_LOGW(TAG, "--- Calibrating MQ2 Sensor... ---");
+    mq2_calibrate();
+    ESP_LOGI(TAG, "--- MQ2 Calibration complete.");
+    g_gas_sensor_ready = true;
+    boot_profile_mark("mq2_calibrated");
+    boot_profile_publish();
+    vTaskDelete(NULL);
+}
+
+// --- Khởi tạo mạng chạy nền: Wi-Fi/MQTT/ESP-NOW tham gia sau khi đường báo cháy cục bộ đã chạy ---
+void network_init_task(void *pvParameters)
+{
+    if (s_node_role == NODE_ROLE_LEAF) {
+        // Không MQTT/SNTP: dấu thời gian của leaf là đơn điệu (dong_bo = false trong batch của hub)
+        leaf_radio_init();
+        boot_profile_mark("wifi_start");
+    } else {
+        mqtt_app_init();
+        boot_profile_mark("mqtt_init");
+        wifi_init_sta();
+        boot_profile_mark("wifi_start");
+        if (timesync_start(SNTP_SERVER) != ESP_OK) {
+            ESP_LOGW(TAG, "SNTP unavailable, timestamps stay at 0");
         }
-        
-        vTaskDelay(pdMS_TO_TICKS(SENSOR_POLL_INTERVAL_MS));
     }
+    if (espnow_init_and_setup() == ESP_OK) {
+        boot_profile_mark("espnow");
+        // Trạng thái cục bộ có thể đã thay đổi trước khi ESP-NOW sẵn sàng -> đồng bộ lại với peer
+        system_state_t st;
+        state_read(&st);
+        send_fire_alert_espnow(st.local_fire ? 1 : 0);
+    }
+    vTaskDelete(NULL);
+}
+
+#if NVS_STRESS_TEST
+// ============================
+// --- NVS WRITE STRESS (NVS_STRESS_TEST) ---
+// ============================
+#if CONFIG_IDF_TARGET_LINUX
+#error "NVS_STRESS_TEST cần ESP32: cạnh được phát bằng timer phần cứng trong lúc ghi flash"
+#endif
+#if !CONFIG_GPTIMER_ISR_CACHE_SAFE || !CONFIG_GPTIMER_CTRL_FUNC_IN_IRAM
+#error "NVS_STRESS_TEST cần CONFIG_GPTIMER_ISR_CACHE_SAFE và CONFIG_GPTIMER_CTRL_FUNC_IN_IRAM"
+#endif
+#include "driver/gptimer.h"
+#include "hal/gpio_ll.h"
+
+#define NVS_STRESS_FRAME_PULSES (2 * NVS_STRESS_BITS + 2)     // Mỗi bit một cặp cao/thấp, cộng sync
+#define NVS_STRESS_PULSES       (NVS_STRESS_FRAME_PULSES * NVS_STRESS_REPEATS)
+
+// Độ dài từng mức (µs), chỉ số chẵn là mức cao. ISR timer đọc khi cache tắt: phải ở DRAM
+static DRAM_ATTR uint16_t s_stress_pulses[NVS_STRESS_PULSES];
+static DRAM_ATTR volatile int s_stress_pos;
+static atomic_bool s_stress_rf_seen;    // rf_control_task đã nhận NVS_STRESS_CODE
+
+static void nvs_stress_build_frames(void)
+{
+    int n = 0;
+    for (int r = 0; r < NVS_STRESS_REPEATS; r++) {
+        // Protocol 1: bit 1 = 3 cao + 1 thấp, bit 0 = 1 cao + 3 thấp, sync = 1 cao + 31 thấp ở cuối khung
+        for (int b = NVS_STRESS_BITS - 1; b >= 0; b--) {
+            const bool one = (NVS_STRESS_CODE >> b) & 1;
+            s_stress_pulses[n++] = (one ? 3 : 1) * NVS_STRESS_PULSE_US;
+            s_stress_pulses[n++] = (one ? 1 : 3) * NVS_STRESS_PULSE_US;
+        }
+        s_stress_pulses[n++] = 1 * NVS_STRESS_PULSE_US;
+        s_stress_pulses[n++] = 31 * NVS_STRESS_PULSE_US;
+    }
+}
+
+// Chạy cả khi cache flash tắt: chỉ đổi mức chân và đặt alarm kế tiếp
+static bool IRAM_ATTR nvs_stress_timer_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg)
+{
+    const int pos = ++s_stress_pos;
+    if (pos >= NVS_STRESS_PULSES) {
+        gpio_ll_set_level(&GPIO, NVS_STRESS_INJECT_PIN, 0);
+        return false;
+    }
+    gpio_ll_set_level(&GPIO, NVS_STRESS_INJECT_PIN, (pos & 1) ? 0 : 1);
+    const gptimer_alarm_config_t alarm = { .alarm_count = edata->alarm_value + s_stress_pulses[pos] };
+    gptimer_set_alarm_action(timer, &alarm);
+    return false;
+}
+
+static uint32_t nvs_stress_hub_overflows(void)
+{
+    gpio_hub_stats_t hub[GPIO_HUB_MAX_SOURCES];
+    const int n = gpio_hub_get_stats(hub, GPIO_HUB_MAX_SOURCES);
+    uint32_t total = 0;
+    for (int i = 0; i < n; i++) total += hub[i].overflows;
+    return total;
+}
+
+// Mỗi vòng: phát NVS_STRESS_REPEATS khung RF, suốt thời gian đó ghi + commit NVS liên tục.
+// Đạt khi mọi vòng đều được rf_control_task xác nhận mã và không ring nào của GPIO hub bị tràn.
+static void nvs_stress_task(void *pvParameters)
+{
+    nvs_stress_build_frames();
+    uint32_t frame_us = 0;
+    for (int i = 0; i < NVS_STRESS_PULSES; i++) frame_us += s_stress_pulses[i];
+
+    gpio_reset_pin(NVS_STRESS_INJECT_PIN);
+    gpio_set_direction(NVS_STRESS_INJECT_PIN, GPIO_MODE_OUTPUT);
+    gpio_set_level(NVS_STRESS_INJECT_PIN, 0);
+
+    gptimer_handle_t timer = NULL;
+    const gptimer_config_t timer_cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    const gptimer_event_callbacks_t cbs = { .on_alarm = nvs_stress_timer_cb };
+    nvs_handle_t nvs;
+    if (gptimer_new_timer(&timer_cfg, &timer) != ESP_OK ||
+        gptimer_register_event_callbacks(timer, &cbs, NULL) != ESP_OK ||
+        gptimer_enable(timer) != ESP_OK ||
+        nvs_open("nvs_stress", NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "NVS stress: setup failed");
+        abort();
+    }
+
+    const uint32_t ovf_start = nvs_stress_hub_overflows();
+    uint32_t missed = 0, writes = 0;
+    for (int round = 0; round < NVS_STRESS_ROUNDS; round++) {
+        atomic_store(&s_stress_rf_seen, false);
+        s_stress_pos = 0;
+        const gptimer_alarm_config_t first = { .alarm_count = s_stress_pulses[0] };
+        gptimer_set_raw_count(timer, 0);
+        gptimer_set_alarm_action(timer, &first);
+        gpio_set_level(NVS_STRESS_INJECT_PIN, 1);
+        gptimer_start(timer);
+
+        const int64_t end_us = esp_timer_get_time() + frame_us + NVS_STRESS_SETTLE_MS * 1000;
+        while (esp_timer_get_time() < end_us) {
+            ESP_ERROR_CHECK(nvs_set_u32(nvs, "n", writes));
+            ESP_ERROR_CHECK(nvs_commit(nvs));
+            writes++;
+        }
+        gptimer_stop(timer);
+        if (!atomic_load(&s_stress_rf_seen)) missed++;
+    }
+    const uint32_t overflows = nvs_stress_hub_overflows() - ovf_start;
+
+    nvs_erase_all(nvs);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+    gptimer_disable(timer);
+    gptimer_del_timer(timer);
+
+    if (missed == 0 && overflows == 0) {
+        ESP_LOGI(TAG, "NVS stress PASS: %d rounds, %lu commits, 0 missed codes, 0 hub overflows",
+                 NVS_STRESS_ROUNDS, (unsigned long)writes);
+    } else {
+        ESP_LOGE(TAG, "NVS stress FAIL: %d rounds, %lu commits, %lu missed codes, %lu hub overflows",
+                 NVS_STRESS_ROUNDS, (unsigned long)writes, (unsigned long)missed, (unsigned long)overflows);
     }
+    vTaskDelete(NULL);
 }
+#endif // NVS_STRESS_TEST
 
 void rf_control_task(void *pvParameters) {
     load_codes_from_nvs();
+    uint32_t last_learn_us = 0, last_delete_us = 0;
 
     while (1) {
-        if (gpio_get_level(LEARN_BUTTON_PIN) == 0) {
-            is_learning_mode = true;
-            vTaskDelay(pdMS_TO_TICKS(500)); // Debounce
-        }
-
-        if (gpio_get_level(DELETE_BUTTON_PIN) == 0) {
-            delete_all_codes_from_nvs();
-            if (g_rf_triggered_fire_state) { 
-                g_rf_triggered_fire_state = false;
-                update_and_propagate_alarm_state();
+        // Chờ sự kiện nút (đồng thời là nhịp 50 ms để kiểm tra mã RF)
+        button_evt_t evt;
+        if (xQueueReceive(s_rf_button_queue, &evt, pdMS_TO_TICKS(50)) == pdTRUE) {
+            if (evt.pin == LEARN_BUTTON_PIN && button_press_confirmed(&evt, &last_learn_us)) {
+                is_learning_mode = true;
+            } else if (evt.pin == DELETE_BUTTON_PIN && button_press_confirmed(&evt, &last_delete_us)) {
+                delete_all_codes_from_nvs();
+                if (g_rf_triggered_fire_state) { 
+                    g_rf_triggered_fire_state = false;
+                    update_and_propagate_alarm_state(JOURNAL_ACTOR_BUTTON);
+                }
             }
-            vTaskDelay(pdMS_TO_TICKS(500)); // Debounce
         }
 
         if (available(&rf_receiver)) {
             unsigned long received_code = getReceivedValue(&rf_receiver);
+#if NVS_STRESS_TEST
+            if (received_code == NVS_STRESS_CODE) {
+                atomic_store(&s_stress_rf_seen, true);
+                resetAvailable(&rf_receiver);
+                continue;
+            }
+#endif
             ESP_LOGI(TAG, "Received RF code: %lu", received_code);
 
             if (is_learning_mode) {
@@ -564,84 +2745,102 @@ void rf_control_task(void *pvParameters) {
                 if (is_code_already_learned(received_code)) {
                     ESP_LOGI(TAG, "Matching RF code found!");
                     g_rf_triggered_fire_state = true;
-                    update_and_propagate_alarm_state();
+                    update_and_propagate_alarm_state(JOURNAL_ACTOR_RF_REMOTE);
                 }
             }
             resetAvailable(&rf_receiver);
         }
-        vTaskDelay(pdMS_TO_TICKS(50));
     }
 }
 
+// Nút reset xóa tất cả các nguồn báo cháy, bao gồm cả Web
+static void manual_reset_all_sources(void)
+{
+    ESP_LOGW(TAG, "MANUAL RESET ACTIVATED! Clearing all local and remote alarm states.");
+
+    portENTER_CRITICAL(&s_alarm_src_mux);
+    alarm_hyst_reset(&s_temp_gas_hyst);
+    alarm_hyst_reset(&s_ror_hyst);
+    alarm_hyst_reset(&s_flame_hyst);
+    portEXIT_CRITICAL(&s_alarm_src_mux);
+    g_temp_gas_fire_state = false;
+    g_temp_ror_fire_state = false;
+    g_flame_consensus_fire_state = false;
+    g_rf_triggered_fire_state = false;
+    g_manual_triggered_fire_state = false;
+    g_web_triggered_fire_state = false; // Xóa trạng thái web
+
+    system_state_t st;
+    state_update_begin(&st);
+    const uint8_t prev_sources = st.sources | (st.remote_fire ? (1u << ALARM_SRC_COUNT) : 0);
+    st.remote_fire = false;
+    state_update_end(&st);
+    s_peer_remote_fire = false;
+    flood_clear_remote();
+    journal_log(JOURNAL_EV_RESET, JOURNAL_SRC_NONE, JOURNAL_ACTOR_BUTTON, prev_sources);
+
+    update_and_propagate_alarm_state(JOURNAL_ACTOR_BUTTON);
+}
+
+// Xử lý nút báo cháy / reset theo sự kiện từ GPIO hub (không còn polling 100 ms)
 void manual_control_task(void *pvParameters)
 {
+    uint32_t last_alarm_us = 0, last_reset_us = 0;
+
     while (1)
     {
+        button_evt_t evt;
+        if (xQueueReceive(s_manual_button_queue, &evt, portMAX_DELAY) != pdTRUE) continue;
+
         // --- Check for manual alarm trigger ---
-        if (gpio_get_level(MANUAL_ALARM_PIN) == 0) {
-            vTaskDelay(pdMS_TO_TICKS(20)); // Debounce delay
-            if (gpio_get_level(MANUAL_ALARM_PIN) == 0) { 
-                if (!g_manual_triggered_fire_state) {
-                    ESP_LOGW(TAG, "MANUAL ALARM TRIGGERED!");
-                    g_manual_triggered_fire_state = true;
-                    update_and_propagate_alarm_state();
-                }
-                while(gpio_get_level(MANUAL_ALARM_PIN) == 0) { 
-                    vTaskDelay(pdMS_TO_TICKS(50));
-                }
+        if (evt.pin == MANUAL_ALARM_PIN && button_press_confirmed(&evt, &last_alarm_us)) {
+            if (!g_manual_triggered_fire_state) {
+                ESP_LOGW(TAG, "MANUAL ALARM TRIGGERED!");
+                g_manual_triggered_fire_state = true;
+                update_and_propagate_alarm_state(JOURNAL_ACTOR_BUTTON);
             }
         }
 
         // --- Check for manual reset ---
-        if (gpio_get_level(MANUAL_RESET_PIN) == 0) {
-            vTaskDelay(pdMS_TO_TICKS(20)); // Debounce delay
-            if (gpio_get_level(MANUAL_RESET_PIN) == 0) {
-                ESP_LOGW(TAG, "MANUAL RESET ACTIVATED! Clearing all local and remote alarm states.");
-                
-                // [UPDATE] Nút reset sẽ xóa tất cả các nguồn, bao gồm cả Web
-                g_temp_gas_fire_state = false;
-                g_flame_consensus_fire_state = false;
-                g_rf_triggered_fire_state = false;
-                g_manual_triggered_fire_state = false;
-                g_web_triggered_fire_state = false; // Xóa trạng thái web
-
-                if (xSemaphoreTake(data_mutex, portMAX_DELAY) == pdTRUE) {
-                    sensor_data.remote_fire = false;
-                    xSemaphoreGive(data_mutex);
-                }
-
-                update_and_propagate_alarm_state(); 
-                
-                while(gpio_get_level(MANUAL_RESET_PIN) == 0) { 
-                    vTaskDelay(pdMS_TO_TICKS(50));
-                }
-            }
+        if (evt.pin == MANUAL_RESET_PIN && button_press_confirmed(&evt, &last_reset_us)) {
+            manual_reset_all_sources();
         }
-        vTaskDelay(pdMS_TO_TICKS(100));
     }
 }
 
+// Lệnh SILENCE còn hiệu lực; hết hạn thì xóa để esp_timer quay vòng 32 bit không bật lại
+static bool alarm_silenced(void)
+{
+    uint32_t until = atomic_load(&s_silence_until_ms);
+    if (until == 0) return false;
+    if ((int32_t)(until - (uint32_t)(esp_timer_get_time() / 1000)) > 0) return true;
+    atomic_compare_exchange_strong(&s_silence_until_ms, &until, 0);
+    return false;
+}
+
 // --- TASK ĐIỀU KHIỂN CÒI/ĐÈN ---
 void alarm_control_task(void *pvParameters)
 {
+    bool led_on = false;
     while (1) {
-        bool is_local_fire = false;  // Cháy tại tủ này (bao gồm cả Web trigger)
-        bool is_remote_fire = false; // Cháy từ tủ khác (ESP-NOW)
+        // 0. Đánh giá lại đồng thuận lửa để hết dwell thì tự xóa
+        evaluate_flame_consensus();
 
-        // 1. Lấy dữ liệu chi tiết từ Mutex
-        if (xSemaphoreTake(data_mutex, portMAX_DELAY) == pdTRUE) {
-            is_local_fire = sensor_data.combined_local_fire; 
-            is_remote_fire = sensor_data.remote_fire;        
-            xSemaphoreGive(data_mutex);
-        }
+        // 1. Lấy bản sao trạng thái (không khóa)
+        system_state_t st;
+        state_read(&st);
+        const bool is_local_fire = st.local_fire;   // Cháy tại tủ này (bao gồm cả Web trigger)
+        const bool is_remote_fire = st.remote_fire; // Cháy từ tủ khác (ESP-NOW)
 
         // 3. XỬ LÝ LOGIC ƯU TIÊN
 
         // --- TRƯỜNG HỢP 1: CHÁY TẠI CHỖ (Cảm biến hoặc WEB kích hoạt) ---
         // Hành động: CÒI KÊU + ĐÈN NHÁY NHANH
         if (is_local_fire) {
-            gpio_set_level(LED_PIN, 1);
-            gpio_set_level(BUZZ_PIN, 1); // Bật còi
+            led_on = !led_on;               // Nháy 2 Hz, kể cả khi còi bị SILENCE
+            gpio_set_level(LED_PIN, led_on);
+            gpio_set_level(BUZZ_PIN, alarm_silenced() ? 0 : 1); // Bật còi, trừ khi web đã gửi SILENCE
+            vTaskDelay(pdMS_TO_TICKS(250)); // Nhường CPU cho task ưu tiên thấp (publish) khi đang cháy
         } 
         
         // --- TRƯỜNG HỢP 2: NHẬN ESP-NOW TỪ TỦ KHÁC (Cảnh báo) ---
@@ -666,58 +2865,406 @@ void alarm_control_task(void *pvParameters)
     }
 }
 
+// --- Diagnostics: sensor/<id>/diag (chu kỳ DIAG_PUBLISH_INTERVAL_MS) ---
+static void publish_diagnostics(void) {
+    if (!mqtt_connected || !MQTT_TOPIC_DIAG) return;
+
+    const sample_mode_t mode = (sample_mode_t)s_env_latest.sample_mode;
+    const uint32_t period_ms = s_env_latest.sample_period_ms;
+
+    uint32_t suppressed_temp_gas, suppressed_ror, suppressed_flame;
+    portENTER_CRITICAL(&s_alarm_src_mux);
+    suppressed_temp_gas = alarm_hyst_suppressed(&s_temp_gas_hyst);
+    suppressed_ror = alarm_hyst_suppressed(&s_ror_hyst);
+    suppressed_flame = alarm_hyst_suppressed(&s_flame_hyst);
+    portEXIT_CRITICAL(&s_alarm_src_mux);
+
+    gpio_hub_stats_t hub[GPIO_HUB_MAX_SOURCES];
+    const int hub_count = gpio_hub_get_stats(hub, GPIO_HUB_MAX_SOURCES);
+
+    static char msg[4000];     // Chỉ data_publish_task gọi: không chiếm stack của task
+    int len = snprintf(msg, sizeof(msg),
+                       "{\"id_thiet_bi\":\"%s\",\"uptime_s\":%lu,\"free_heap\":%lu,"
+                       "\"sample_mode\":\"%s\",\"sample_period_ms\":%lu,\"sample_mode_changes\":%lu,"
+                       "\"binlog_lost\":%lu,"
+                       "\"suppressed\":{\"temp_gas\":%lu,\"ror\":%lu,\"flame\":%lu},"
+                       "\"gpio_hub\":[",
+                       s_device_id,
+                       (unsigned long)(esp_timer_get_time() / 1000000),
+                       (unsigned long)esp_get_free_heap_size(),
+                       sample_mode_to_str(mode),
+                       (unsigned long)period_ms,
+                       (unsigned long)s_sample_sched.mode_changes,
+                       (unsigned long)binlog_lost_count(),
+                       (unsigned long)suppressed_temp_gas,
+                       (unsigned long)suppressed_ror,
+                       (unsigned long)suppressed_flame);
+    // Thống kê từng nguồn GPIO hub: tổng cạnh, tốc độ (cạnh/s), số cạnh bị bỏ và độ sâu ring lớn nhất
+    for (int i = 0; i < hub_count && len > 0 && len < (int)sizeof(msg); i++) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        "%s{\"n\":\"%s\",\"edges\":%lu,\"rate\":%lu,\"ovf\":%lu,\"depth\":%u}",
+                        i ? "," : "", hub[i].name, (unsigned long)hub[i].edges,
+                        (unsigned long)hub[i].rate_hz, (unsigned long)hub[i].overflows,
+                        (unsigned)hub[i].max_depth);
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, "]");
+    }
+    // Độ tin cậy nhấp nháy từng cảm biến lửa (-1: không có ngõ AO / kết quả đã cũ)
+    const uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    for (int i = 0; i < NUM_FLAME_SENSORS && len > 0 && len < (int)sizeof(msg); i++) {
+        const uint32_t seen_ms = g_flame_flicker_ms[i];
+        const bool fresh = seen_ms != 0 && now_ms - seen_ms <= FLAME_FLICKER_STALE_MS;
+        len += snprintf(msg + len, sizeof(msg) - len, "%s%d", i ? "," : ",\"flicker\":[",
+                        fresh ? (int)g_flame_flicker_conf[i] : -1);
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, "],\"flame_evidence\":%d", g_flame_evidence);
+    }
+    // Backend RMT: số khung (= số lần CPU xử lý) so với "rf433" của GPIO hub (= số ngắt mỗi cạnh)
+    rcswitch_rmt_stats_t rf;
+    if (getReceiveStatsRMT(&rf_receiver, &rf) == ESP_OK && len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"rf\":{\"captures\":%lu,\"frames\":%lu,\"confirmed\":%lu,"
+                        "\"noise\":%lu,\"truncated\":%lu,\"idle_us\":%lu}",
+                        (unsigned long)rf.captures, (unsigned long)rf.frames,
+                        (unsigned long)rf.confirmed, (unsigned long)rf.noise,
+                        (unsigned long)rf.truncated, (unsigned long)rf.idle_us);
+    }
+    // Pipeline telemetry: bản trạng thái (seqlock) và số mẫu mất ở từng ring
+    system_state_t st;
+    state_read(&st);
+    spsc_ring_stats_t env_ring, flame_ring;
+    spsc_ring_get_stats(&s_env_ring, &env_ring);
+    spsc_ring_get_stats(&s_flame_ring, &flame_ring);
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"pipeline\":{\"state_gen\":%lu,\"state_retries\":%lu,"
+                        "\"env\":{\"pushed\":%lu,\"dropped\":%lu,\"max_depth\":%lu},"
+                        "\"flame\":{\"pushed\":%lu,\"dropped\":%lu,\"max_depth\":%lu}}",
+                        (unsigned long)st.generation,
+                        (unsigned long)atomic_load(&s_state_read_retries),
+                        (unsigned long)env_ring.pushed, (unsigned long)env_ring.dropped,
+                        (unsigned long)env_ring.max_depth,
+                        (unsigned long)flame_ring.pushed, (unsigned long)flame_ring.dropped,
+                        (unsigned long)flame_ring.max_depth);
+    }
+    // Đường nhận mạng: thời gian callback chiếm task Wi-Fi/MQTT và độ trễ tới dispatcher
+    for (int i = 0; i < NET_EVT_SRC_COUNT && len > 0 && len < (int)sizeof(msg); i++) {
+        const net_rx_stats_t *rx = &s_net_rx_stats[i];
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        "%s\"%s\":{\"n\":%lu,\"drop\":%lu,\"cb_max_us\":%lu,\"cb_avg_us\":%lu}",
+                        i ? "," : ",\"net_rx\":{", NET_EVT_NAMES[i],
+                        (unsigned long)rx->received, (unsigned long)rx->dropped,
+                        (unsigned long)rx->cb_max_us,
+                        (unsigned long)(rx->received + rx->dropped ?
+                                        rx->cb_total_us / (rx->received + rx->dropped) : 0));
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, ",\"queue_max\":%lu,\"dispatch_max_us\":%lu}",
+                        (unsigned long)s_net_queue_max_depth, (unsigned long)s_net_dispatch_max_us);
+    }
+    // Outbox MQTT: độ sâu hiện tại/lớn nhất (byte), số cảnh báo giữ lại khi mất kết nối, số message
+    // đã enqueue/bị bỏ và số byte theo lớp. bytes/bytes_311 tính từ cách mã hóa gói PUBLISH (giao thức
+    // đang dùng / cùng message đó bằng 3.1.1), không phải số đo trên dây
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, ",\"mqtt\":{\"outbox\":%d,\"outbox_max\":%u,\"alert_deferred\":%u",
+                        mqtt_client ? esp_mqtt_client_get_outbox_size(mqtt_client) : 0,
+                        atomic_load(&s_mqtt_outbox_max), atomic_load(&s_mqtt_alerts_deferred));
+    }
+#if MQTT_USE_V5
+    // Topic data: số gói chỉ mang alias / mang topic đầy đủ
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, ",\"alias\":{\"short\":%u,\"full\":%u}",
+                        atomic_load(&s_mqtt_alias_short), atomic_load(&s_mqtt_alias_full));
+    }
+#endif
+    for (int i = 0; i < MQTT_CLASS_COUNT && len > 0 && len < (int)sizeof(msg); i++) {
+        len += snprintf(msg + len, sizeof(msg) - len, ",\"%s\":{\"q\":%u,\"drop\":%u,\"bytes\":%u,\"bytes_311\":%u}%s",
+                        MQTT_CLASS_POLICY[i].name, atomic_load(&s_mqtt_class_stats[i].enqueued),
+                        atomic_load(&s_mqtt_class_stats[i].dropped),
+                        atomic_load(&s_mqtt_class_stats[i].wire_bytes),
+                        atomic_load(&s_mqtt_class_stats[i].wire_bytes_311),
+                        i == MQTT_CLASS_COUNT - 1 ? "}" : "");
+    }
+    // Liên kết broker: thời gian kết nối, tới PUBACK đầu tiên, backoff hiện tại; TLS: full/resumed
+    // (resumed: broker thực sự dùng lại phiên; rejected: có đưa ticket nhưng bị bắt tay đầy đủ)
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"link\":{\"reconnects\":%lu,\"backoff_ms\":%lu,\"connect_ms\":%lu,\"first_pub_ms\":%lu",
+                        (unsigned long)s_mqtt_reconnects, (unsigned long)s_mqtt_backoff_ms,
+                        (unsigned long)s_mqtt_connect_ms, (unsigned long)s_mqtt_first_pub_ms);
+    }
+#if MQTT_USE_TLS
+    mqtt_tls_stats_t tls;
+    mqtt_tls_get_stats(&tls);
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"tls\":{\"full\":%lu,\"resumed\":%lu,\"rejected\":%lu,\"failed\":%lu,"
+                        "\"full_ms\":%lu,\"full_max_ms\":%lu,\"resumed_ms\":%lu,\"resumed_max_ms\":%lu,"
+                        "\"first_pub_full_ms\":%lu,\"first_pub_resumed_ms\":%lu}",
+                        (unsigned long)tls.full, (unsigned long)tls.resumed, (unsigned long)tls.rejected,
+                        (unsigned long)tls.failed,
+                        (unsigned long)tls.full_last_ms, (unsigned long)tls.full_max_ms,
+                        (unsigned long)tls.resumed_last_ms, (unsigned long)tls.resumed_max_ms,
+                        (unsigned long)s_mqtt_first_pub_full_ms, (unsigned long)s_mqtt_first_pub_resumed_ms);
+    }
+#endif
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, "}");
+    }
+    // Đồng hồ: số lần SNTP đồng bộ, bước chỉnh gần nhất và độ trễ ESP-NOW theo timestamp hai đầu
+    timesync_stats_t ts;
+    timesync_get_stats(&ts);
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"time\":{\"syncs\":%lu,\"last_step_ms\":%lld,\"since_sync_s\":%lld,"
+                        "\"espnow_link_ms\":%ld,\"espnow_link_max_ms\":%ld}",
+                        (unsigned long)ts.syncs, (long long)ts.last_step_ms,
+                        ts.syncs ? (long long)((esp_timer_get_time() - ts.last_sync_mono_us) / 1000000) : -1LL,
+                        (long)s_espnow_link_last_ms, (long)s_espnow_link_max_ms);
+    }
+    // Hub: số leaf, khung ESP-NOW đã nhận/mất, thời gian phát sóng ước tính và số message gộp
+    if (s_node_role == NODE_ROLE_HUB && len > 0 && len < (int)sizeof(msg)) {
+        hub_stats_t hs;
+        hub_get_stats(&hs, esp_timer_get_time());
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"hub\":{\"leaves\":%lu,\"online\":%lu,\"table_full\":%lu,\"frames\":%lu,"
+                        "\"lost\":%lu,\"bytes\":%lu,\"airtime_ms\":%lu,\"batches\":%lu,\"batch_bytes\":%lu,"
+                        "\"downlinks\":%lu,\"downlink_unknown\":%lu}",
+                        (unsigned long)hs.leaves, (unsigned long)hs.online, (unsigned long)hs.table_full, (unsigned long)hs.frames,
+                        (unsigned long)hs.lost, (unsigned long)hs.bytes,
+                        (unsigned long)(hs.airtime_us / 1000), (unsigned long)s_hub_batches,
+                        (unsigned long)s_hub_batch_bytes, (unsigned long)s_hub_downlinks,
+                        (unsigned long)s_hub_downlink_unknown);
+    }
+    // Flood: khung gốc/mới/trùng/cũ, số lần phát lại và bị nén; trễ (us) theo số bước [n, last, max, giữ ở relay]
+    if (ESPNOW_FLOOD_TTL > 0 && len > 0 && len < (int)sizeof(msg)) {
+        flood_stats_t fs;
+        flood_get_stats(&fs);
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"flood\":{\"orig\":%lu,\"new\":%lu,\"dup\":%lu,\"stale\":%lu,\"relayed\":%lu,"
+                        "\"suppressed\":%lu,\"pending_full\":%lu,\"origins_full\":%lu,\"hop_us\":[",
+                        (unsigned long)fs.originated, (unsigned long)fs.rx_new, (unsigned long)fs.rx_dup,
+                        (unsigned long)fs.rx_stale, (unsigned long)fs.relayed, (unsigned long)fs.suppressed,
+                        (unsigned long)fs.pending_full, (unsigned long)fs.origins_full);
+        for (int i = 0; i < FLOOD_MAX_HOPS && len > 0 && len < (int)sizeof(msg); i++) {
+            const flood_hop_stats_t *h = &fs.hop[i];
+            len += snprintf(msg + len, sizeof(msg) - len, "%s[%lu,%lu,%lu,%lu]", i ? "," : "",
+                            (unsigned long)h->n, (unsigned long)h->last_us, (unsigned long)h->max_us,
+                            (unsigned long)h->hold_us);
+        }
+        if (len > 0 && len < (int)sizeof(msg)) {
+            len += snprintf(msg + len, sizeof(msg) - len, "]}");
+        }
+    }
+    journal_stats_t jr;
+    journal_get_stats(&jr);
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"journal\":{\"first\":%lu,\"next\":%lu,\"boot\":%u,\"written\":%lu,"
+                        "\"dropped\":%lu,\"erases\":%lu,\"crc_errors\":%lu}",
+                        (unsigned long)jr.first_seq, (unsigned long)jr.next_seq, jr.boot,
+                        (unsigned long)jr.written, (unsigned long)jr.dropped,
+                        (unsigned long)jr.erases, (unsigned long)jr.crc_errors);
+    }
+    // Lệnh MQTT và ngưỡng đang dùng (SET_THRESHOLDS chỉ sống tới lần khởi động lại)
+    portENTER_CRITICAL(&s_score_cfg_mux);
+    const fire_score_config_t score_cfg = s_fire_score.cfg;
+    portEXIT_CRITICAL(&s_score_cfg_mux);
+    const uint32_t silence_until = atomic_load(&s_silence_until_ms);
+    const int32_t silence_ms = silence_until ? (int32_t)(silence_until - (uint32_t)(esp_timer_get_time() / 1000)) : 0;
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len,
+                        ",\"cmd\":{\"n\":%lu,\"dup\":%lu,\"malformed\":%lu,\"oversize\":%u,\"silence_s\":%ld,"
+                        "\"thresholds\":[%ld,%ld,%ld,%ld]}",
+                        (unsigned long)s_cmd_received, (unsigned long)s_cmd_dup, (unsigned long)s_cmd_malformed,
+                        atomic_load(&s_cmd_oversize), (long)(silence_ms > 0 ? silence_ms / 1000 : 0),
+                        (long)score_cfg.temp_pre_cdeg, (long)score_cfg.temp_alarm_cdeg,
+                        (long)score_cfg.gas_light, (long)score_cfg.gas_strong);
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        len += snprintf(msg + len, sizeof(msg) - len, "}");
+    }
+    if (len > 0 && len < (int)sizeof(msg)) {
+        mqtt_publish_class(MQTT_CLASS_TELEMETRY, MQTT_TOPIC_DIAG, msg, len);
+    }
+}
+
+// Nối một phần tử vào mảng JSON đang xây trong @p buf; hết chỗ thì bỏ phần tử (mảng vẫn hợp lệ)
+static void json_array_append(char *buf, size_t size, int *len, const char *item)
+{
+    const int item_len = (int)strlen(item);
+    if (*len + item_len + 3 > (int)size) return;   // Chừa chỗ cho ',', ']' và NUL
+    if (*len > 1) buf[(*len)++] = ',';
+    memcpy(buf + *len, item, item_len + 1);
+    *len += item_len;
+}
+
+// Drain ring nhiệt/gas theo lô: mọi mẫu từ lần publish trước vào "mau" [ts_ms, 0.01 °C, ppm khói],
+// mẫu cuối thành s_env_latest. Trả về số mẫu đã lấy.
+// ts_ms của mẫu là esp_timer (ms) cắt 32 bit: khôi phục theo thời điểm hiện tại rồi đổi sang UTC.
+// Chưa đồng bộ giờ thì trả về ms từ lúc boot (kèm "dong_bo":false trong tin nhắn).
+static int64_t sample_time_ms(uint32_t ts_ms)
+{
+    const int64_t now_ms = esp_timer_get_time() / 1000;
+    const int64_t mono_ms = now_ms - (uint32_t)((uint32_t)now_ms - ts_ms);
+    return timesync_is_synced() ? timesync_utc_ms(mono_ms * 1000) : mono_ms;
+}
+
+static int telemetry_drain_env(char *buf, size_t size)
+{
+    env_sample_t batch[TELEMETRY_DRAIN_BATCH];
+    int len = snprintf(buf, size, "[");
+    int count = 0;
+    size_t n;
+    while ((n = spsc_ring_pop(&s_env_ring, batch, TELEMETRY_DRAIN_BATCH)) > 0) {
+        count += (int)n;
+        for (size_t i = 0; i < n; i++) {
+            char item[48];
+            snprintf(item, sizeof(item), "[%lld,%ld,%u]", (long long)sample_time_ms(batch[i].ts_ms),
+                     (long)batch[i].temp_cdeg, batch[i].gas_ppm[MQ2_GAS_SMOKE]);
+            json_array_append(buf, size, &len, item);
+        }
+        s_env_latest = batch[n - 1];
+    }
+    snprintf(buf + len, size - len, "]");
+    return count;
+}
+
+// Sự kiện cảm biến lửa từ lần publish trước: [ts_ms, cảm biến, 1 = có lửa]
+static int telemetry_drain_flame(char *buf, size_t size)
+{
+    flame_sample_t batch[TELEMETRY_DRAIN_BATCH];
+    int len = snprintf(buf, size, "[");
+    int count = 0;
+    size_t n;
+    while ((n = spsc_ring_pop(&s_flame_ring, batch, TELEMETRY_DRAIN_BATCH)) > 0) {
+        count += (int)n;
+        for (size_t i = 0; i < n; i++) {
+            char item[32];
+            snprintf(item, sizeof(item), "[%lld,%u,%u]", (long long)sample_time_ms(batch[i].ts_ms),
+                     batch[i].sensor, batch[i].detected);
+            json_array_append(buf, size, &len, item);
+        }
+    }
+    snprintf(buf + len, size - len, "]");
+    return count;
+}
+
 void data_publish_task(void *pv) {
     char *msg = NULL; 
+    int64_t last_diag_us = 0;
+    int64_t last_publish_us = 0;
+    uint32_t last_generation = UINT32_MAX;
+    uint32_t last_state_generation = UINT32_MAX;
+    int64_t last_state_us = 0;
+    static char fields[384];
+    static char env_json[TELEMETRY_ENV_RING_SIZE * 32 + 2];
+    static char flame_json[TELEMETRY_FLAME_RING_SIZE * 28 + 2];
     
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(1000)); 
 
-        float current_temp = 0.0f;
-        int current_gas = 0;
-        bool is_global_alert_active = false;
-        bool is_gas_high = false;
+        // Consumer duy nhất của các ring: drain trước để diag và tin nhắn dùng mẫu mới nhất
+        const int env_count = telemetry_drain_env(env_json, sizeof(env_json));
+        const int flame_count = telemetry_drain_flame(flame_json, sizeof(flame_json));
 
-        if (xSemaphoreTake(data_mutex, portMAX_DELAY) == pdTRUE) {
-            current_temp = sensor_data.temperature;
-            current_gas = sensor_data.gas_level;
-            is_global_alert_active = alarm_on_state;
-            xSemaphoreGive(data_mutex);
+        espnow_refresh_state();
+
+        system_state_t st;
+        state_read(&st);
+        // Leaf: không có MQTT, hub gộp trạng thái của mọi leaf thành một message
+        if (s_node_role == NODE_ROLE_LEAF) {
+            leaf_send_state(&st);
+            continue;
+        }
+        if (s_node_role == NODE_ROLE_HUB) {
+            hub_publish_batch();
         }
-        
-        is_gas_high = (current_gas > GAS_THRESHOLD_LIGHT);
 
-        // --- Build consolidated status log ---
-        char flame_status_str[50];
-        int offset = snprintf(flame_status_str, sizeof(flame_status_str), "Flame:[");
-        for (int i = 0; i < NUM_FLAME_SENSORS; i++) {
-            offset += snprintf(flame_status_str + offset, sizeof(flame_status_str) - offset, " %d", g_flame_sensor_states[i] ? 1 : 0);
+        if (atomic_exchange(&s_diag_requested, false) ||
+            esp_timer_get_time() - last_diag_us >= (int64_t)DIAG_PUBLISH_INTERVAL_MS * 1000) {
+            publish_diagnostics();
+            last_diag_us = esp_timer_get_time();
         }
-        snprintf(flame_status_str + offset, sizeof(flame_status_str) - offset, " ]");
 
-        ESP_LOGI(STATUS_TAG, "Temp: %.1f | Gas: %d | %s | WebTrigger: %d | ==> ALARM: %s",
+        // Không có mẫu mới và trạng thái cùng generation: bỏ lượt này, trừ khi đã im quá lâu
+        const int64_t now_us = esp_timer_get_time();
+        if (env_count == 0 && flame_count == 0 && st.generation == last_generation &&
+            now_us - last_publish_us < (int64_t)TELEMETRY_MAX_SILENCE_MS * 1000) {
+            continue;
+        }
+        last_generation = st.generation;
+        last_publish_us = now_us;
+
+        const float current_temp = s_env_latest.temp_cdeg / 100.0f;
+        const uint16_t *current_gas = s_env_latest.gas_ppm;
+        const int risk_score = s_env_latest.risk_score;
+        const fire_level_t risk_level = (fire_level_t)s_env_latest.risk_level;
+        const int32_t temp_rise = s_env_latest.temp_rise_cdeg_min;
+        const bool is_global_alert_active = st.alarm_on;
+        const bool is_web_triggered = (st.sources & ALARM_SRC_WEB) != 0;
+        const bool is_gas_high = (current_gas[MQ2_GAS_SMOKE] > GAS_THRESHOLD_LIGHT) ||
+                      (current_gas[MQ2_GAS_LPG] > GAS_LPG_LEAK_PPM);
+
+        // --- Build consolidated status log (binlog: chỉ định dạng khi drain) ---
+        // Trạng thái cảm biến lửa gói thành bitmask, bit i = cảm biến i
+        const uint32_t flame_mask = st.flame_mask;
+
+        BLOGI(STATUS_TAG, "Temp: %.1f | Smoke: %u ppm | Flame: 0x%02x | WebTrigger: %d | ==> ALARM: %s",
              current_temp,
-             current_gas,
-             flame_status_str,
-             g_web_triggered_fire_state, // In ra log để debug
+             current_gas[MQ2_GAS_SMOKE],
+             flame_mask,
+             is_web_triggered, // In ra log để debug
              is_global_alert_active ? "YES" : "NO");
 
         // --- Publish detailed data to MQTT ---
         if (mqtt_connected && MQTT_TOPIC_DATA) {
            // Lưu ý: led_status giờ đây phản ánh trạng thái kích hoạt từ web (hoặc báo cháy)
-           int len = asprintf(&msg,
-                     "{\"id_thiet_bi\":\"%s\",\"nhiet_do\":%.2f,\"khi_ga\":\"%s\",\"lua\":%s,\"led_status\":%s}",
-                     DEVICE_ID,
+           // Phần chung của data (kèm mẫu) và ảnh chụp retained sensor/<id>/state
+           const int fields_len = snprintf(fields, sizeof(fields),
+                     "\"id_thiet_bi\":\"%s\",\"nhiet_do\":%.2f,\"khi_ga\":\"%s\",\"lua\":%s,\"led_status\":%s,"
+                     "\"rui_ro\":%d,\"muc_rui_ro\":\"%s\",\"toc_do_tang_nhiet\":%.1f,"
+                     "\"khi_ga_ppm\":{\"lpg\":%u,\"khoi\":%u,\"co\":%u},"
+                     "\"dong_bo\":%s,\"ts\":%lld",
+                     s_device_id,
                      current_temp,
                      is_gas_high ? "cao" : "thap",
                      is_global_alert_active ? "true" : "false",
-                     g_web_triggered_fire_state ? "true" : "false" // Gửi trạng thái web trigger lên
+                     is_web_triggered ? "true" : "false", // Gửi trạng thái web trigger lên
+                     risk_score,
+                     fire_level_to_str(risk_level),
+                     temp_rise / 100.0f,
+                     current_gas[MQ2_GAS_LPG],
+                     current_gas[MQ2_GAS_SMOKE],
+                     current_gas[MQ2_GAS_CO],
+                     timesync_is_synced() ? "true" : "false",
+                     (long long)sample_time_ms(s_env_latest.ts_ms)
                      );
-            
+            if (fields_len <= 0 || fields_len >= (int)sizeof(fields)) continue;
+
+            int len = asprintf(&msg, "{%s,\"ts_gui\":%lld,\"mau\":%s,\"su_kien_lua\":%s}", fields,
+                               (long long)timesync_now_ms(), env_json, flame_json);
             if (len > 0) {
-                esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_DATA, msg, 0, 1, 0);
+                mqtt_publish_class(MQTT_CLASS_TELEMETRY, MQTT_TOPIC_DATA, msg, len);
                 free(msg); 
                 msg = NULL;
             }
+
+            // Ảnh chụp retained: khi trạng thái báo cháy đổi, sau khi kết nối lại, hoặc định kỳ
+            if (st.generation != last_state_generation || atomic_exchange(&s_mqtt_state_resync, false) ||
+                now_us - last_state_us >= (int64_t)STATE_SNAPSHOT_INTERVAL_MS * 1000) {
+                len = asprintf(&msg, "{%s,\"uptime_s\":%lu}", fields, (unsigned long)(now_us / 1000000));
+                if (len > 0) {
+                    if (mqtt_publish_class(MQTT_CLASS_RETAINED, MQTT_TOPIC_STATE, msg, len)) {
+                        last_state_generation = st.generation;
+                        last_state_us = now_us;
+                    }
+                    free(msg);
+                    msg = NULL;
+                }
+            }
         }
     }
 }
@@ -728,41 +3275,106 @@ void data_publish_task(void *pv) {
 // ============================
 void app_main(void) {
     // --- Initialize Core System Services ---
-    init_nvs();
-    data_mutex = xSemaphoreCreateMutex();
-    
-    // --- Initialize Peripherals ---
+#if CONFIG_IDF_TARGET_LINUX
+    s_device_id = sim_getenv("SIM_DEVICE_ID", DEVICE_ID);
+    s_broker_uri = sim_getenv("SIM_MQTT_BROKER", MQTT_BROKER_URI);
+    const char *role = sim_getenv("SIM_NODE_ROLE", "");
+    if (strcmp(role, "hub") == 0) {
+        s_node_role = NODE_ROLE_HUB;
+    } else if (strcmp(role, "leaf") == 0) {
+        s_node_role = NODE_ROLE_LEAF;
+    } else if (strcmp(role, "direct") == 0) {
+        s_node_role = NODE_ROLE_DIRECT;
+    }
+    // Radio giả lập lọc theo MAC đích: khung unicast cũ phải nhắm đúng MAC của tủ kia
+    unsigned int peer[6];
+    if (sscanf(sim_getenv("SIM_PEER_MAC", ""), "%x:%x:%x:%x:%x:%x",
+               &peer[0], &peer[1], &peer[2], &peer[3], &peer[4], &peer[5]) == 6) {
+        for (int i = 0; i < 6; i++) s_peer_mac[i] = (uint8_t)peer[i];
+    }
+    sim_init();
+#endif
+    binlog_init(true);
+    boot_profile_mark("app_main");
+    // Journal chỉ phục vụ tra cứu sau sự cố: thiếu partition thì hệ thống vẫn chạy
+    if (journal_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Alarm journal unavailable, events are not persisted");
+    }
+    ESP_ERROR_CHECK(spsc_ring_init(&s_env_ring, sizeof(env_sample_t), TELEMETRY_ENV_RING_SIZE));
+    ESP_ERROR_CHECK(spsc_ring_init(&s_flame_ring, sizeof(flame_sample_t), TELEMETRY_FLAME_RING_SIZE));
+
+    // ---- STAGE 1: Đường báo cháy cục bộ (lửa, nút tay, còi/đèn) phải sống trước tiên ----
+    init_alarm_source_filters();
     gpio_reset_pin(BUZZ_PIN);
     gpio_set_direction(BUZZ_PIN, GPIO_MODE_OUTPUT);
     gpio_set_level(BUZZ_PIN, 0); 
     gpio_reset_pin(LED_PIN);
     gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
     gpio_set_level(LED_PIN, 0); 
-
-    init_rf_control_pins();
+    ESP_ERROR_CHECK(gpio_hub_init()); // Một ISR chung cho lửa, RF và nút nhấn
     init_manual_control_pins();
+    boot_profile_mark("gpio");
 
-    // --- Initialize Network and Protocols ---
-    wifi_init_sta();
-    mqtt_app_init(); 
-    espnow_init_and_setup();
-    
-    // --- Initialize Sensors ---
-    initSwich(&rf_receiver);
-    enableReceive(&rf_receiver, RF_RECEIVER_PIN);
-    mq2_init();
-    ESP_LOGW(TAG, "--- Calibrating MQ2 Sensor... ---");
-    mq2_calibrate(); 
-    ESP_LOGI(TAG, "--- MQ2 Calibration complete.");
-    
     memset(g_flame_sensor_states, false, sizeof(g_flame_sensor_states));
     flame_sensor_init(FLAME_SENSOR_PINS, NUM_FLAME_SENSORS, &flame_sensor_event_handler);
+#if FLAME_ANALOG_MODE
+    flame_flicker_config_t flicker_cfg = {
+        .channels = FLAME_FLICKER_CHANNELS,
+        .num_channels = sizeof(FLAME_FLICKER_CHANNELS) / sizeof(FLAME_FLICKER_CHANNELS[0]),
+        .aux_adc_channel = MQ2_ADC_CHANNEL,     // ADC1 bị continuous chiếm: MQ2 đọc qua cùng luồng mẫu
+        .flicker = FLICKER_CONFIG_DEFAULT(),
+        .callback = flame_flicker_handler,
+    };
+    if (flame_flicker_start(&flicker_cfg) == ESP_OK) {
+#if !CONFIG_IDF_TARGET_LINUX
+        mq2_set_raw_reader(flame_flicker_read_aux);
+#endif
+    } else {
+        ESP_LOGW(TAG, "Flame flicker analysis unavailable, digital consensus only");
+    }
+#endif
+    boot_profile_mark("flame");
 
-    // --- Create Application Tasks ---
-    xTaskCreate(temp_gas_sensor_task, "temp_gas_task", 4096, NULL, 5, NULL);
-    xTaskCreate(rf_control_task, "rf_control_task", 4096, NULL, 6, NULL);
-    xTaskCreate(manual_control_task, "manual_control_task", 4096, NULL, 7, NULL); 
     xTaskCreate(alarm_control_task, "alarm_control_task", 4096, NULL, 4, NULL);
+    xTaskCreate(manual_control_task, "manual_control_task", 4096, NULL, 7, NULL); 
+    boot_profile_mark("local_alarm_live");
+
+    // ---- STAGE 2: NVS (cần cho Wi-Fi và mã RF) + điều khiển RF ----
+    init_nvs();
+    boot_profile_mark("nvs");
+
+    init_rf_control_pins();
+    initSwich(&rf_receiver);
+#if RF_RECEIVER_USE_RMT && !CONFIG_IDF_TARGET_LINUX
+    if (enableReceiveRMT(&rf_receiver, RF_RECEIVER_PIN, RCSWITCH_RMT_DEFAULT_PROTOCOLS) != ESP_OK) {
+        ESP_LOGW(TAG, "RMT receiver unavailable, falling back to GPIO edge interrupts");
+        enableReceive(&rf_receiver, RF_RECEIVER_PIN);
+    }
+#else
+    enableReceive(&rf_receiver, RF_RECEIVER_PIN);
+#endif
+    xTaskCreate(rf_control_task, "rf_control_task", 4096, NULL, 6, NULL);
+#if NVS_STRESS_TEST
+    xTaskCreate(nvs_stress_task, "nvs_stress", 4096, NULL, 3, NULL);
+#endif
+    boot_profile_mark("rf");
+
+    // ---- STAGE 3: Cảm biến chậm và mạng tham gia bất đồng bộ ----
+    xTaskCreate(temp_gas_sensor_task, "temp_gas_task", 4096, NULL, 5, NULL);
+    xTaskCreate(mq2_calibration_task, "mq2_calib_task", 3072, NULL, 2, NULL);
+    s_net_evt_queue = xQueueCreate(NET_EVT_QUEUE_LEN, sizeof(net_event_t));
+    if (s_net_evt_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create network event queue!");
+        abort();
+    }
+    s_bulk_queue = xQueueCreate(BULK_QUEUE_LEN, sizeof(bulk_req_t));
+    if (s_bulk_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create bulk request queue!");
+        abort();
+    }
+    xTaskCreate(bulk_task, "bulk_task", 3072, NULL, BULK_TASK_PRIO, NULL);
+    xTaskCreate(net_dispatch_task, "net_dispatch_task", 5120, NULL, NET_DISPATCH_TASK_PRIO, NULL);   // Lệnh MQTT: token JSON + lô lệnh trên stack
+    xTaskCreate(network_init_task, "net_init_task", 4096, NULL, 5, NULL);
     xTaskCreate(data_publish_task, "data_publish_task", 4096, NULL, 3, NULL);
     
     ESP_LOGI(TAG, "System initialization complete. Web trigger mode active.");
@@ -3,8 +3,10 @@ const MQTT_BROKER_URL = 'wss://pbl3.click/mqtt';
 const MQTT_BASE_TOPIC = 'sensor/#';
 const TEMPERATURE_ALERT_THRESHOLD = 40;
 const MAX_CHART_DATA_POINTS = 10; 
-const SENSOR_TIMEOUT_MS = 20000; // 60s để đánh dấu OFFLINE
+const SENSOR_TIMEOUT_MS = 20000; // Dự phòng cho firmware cũ chưa có LWT (sensor/<id>/status)
 const CHART_UPDATE_INTERVAL = 1000; // Giới hạn cập nhật chart 1 giây/lần
+const COMMAND_ACK_TIMEOUT_MS = 3000; // Không có ACK trên sensor/<id>/ack sau khoảng này thì gửi lại
+const COMMAND_MAX_ATTEMPTS = 3;
 
 /* ======================= CẤU HÌNH CẢNH BÁO (Tối ưu) ======================= */
 const ALERT_CONDITIONS = [
@@ -52,6 +54,9 @@ let customCabinetInfo = {};
 
 let cabinetAlertState = {}; // MỚI: Theo dõi trạng thái đã thừa nhận của từng tủ
 
+const pendingCommands = new Map(); // correlation id -> { cabinetId, cmd, payload, sentAt, attempts, timer }
+let commandSeq = 0;
+
 /* ======================= DOM ELEMENTS ======================= */
 const mainSelection = document.getElementById('main-selection');
 const detailsView = document.getElementById('details-view');
@@ -183,47 +188,96 @@ client.on('message', (topic, message) => {
     try {
         lastSystemMessage = Date.now();
         updateConnectionStatus('connected', 'Hệ thống trực tuyến');
+        // data: telemetry realtime; state: ảnh chụp retained (có ngay khi mở trang);
+        // status: birth/LWT retained; batch: trạng thái gộp các leaf của một hub.
+        // diag/boot/log... không vẽ lên giao diện
+        const kind = topic.substring(topic.lastIndexOf('/') + 1);
+        if (kind !== 'data' && kind !== 'state' && kind !== 'status' && kind !== 'ack' && kind !== 'batch') return;
         let data; try { data = JSON.parse(message.toString()); } catch (e) { return; }
-        const id = data.id_thiet_bi;
+        if (kind === 'ack') { handleCommandAck(data); return; }
+        if (kind === 'batch') { handleHubBatch(data); return; }
+        handleCabinetMessage(kind, data);
+    } catch (e) {}
+});
 
-        ensureCabinetElementExists(id);
-        
-        if (!cabinetDataStore[id]) { 
-            cabinetDataStore[id] = { lastData: null, chartLabels: [], chartData: [], lastSeen: Date.now(), isOnline: true };
-            updateCabinetOnlineStatus(id, true);
-        } else {
-            // Xử lý kết nối lại sau khi offline
-            if (!cabinetDataStore[id].isOnline) {
-                cabinetDataStore[id].isOnline = true;
-                updateCabinetOnlineStatus(id, true);
-                showToast(`${id} kết nối lại`, "success");
-            }
-        }
-        
-        const store = cabinetDataStore[id];
-        store.lastData = data;
+// Cột 0/1 trong batch của hub -> boolean như telemetry của tủ kết nối trực tiếp
+const BATCH_BOOL_COLUMNS = ['online', 'lua', 'led_status', 'dong_bo'];
+
+// sensor/<hub>/batch: "cot" là tên trường, mỗi hàng của "tu" là một leaf
+function handleHubBatch(batch) {
+    if (!Array.isArray(batch.cot) || !Array.isArray(batch.tu)) return;
+    batch.tu.forEach(row => {
+        const data = {};
+        batch.cot.forEach((col, i) => { data[col] = row[i]; });
+        BATCH_BOOL_COLUMNS.forEach(col => { data[col] = data[col] === 1; });
+        data.khi_ga_ppm = { lpg: data.lpg, khoi: data.khoi, co: data.co };
+        // Leaf im quá HUB_LEAF_TIMEOUT_MS: hub báo offline thay cho LWT mà leaf không có
+        handleCabinetMessage(data.online ? 'data' : 'status', data);
+    });
+}
+
+function handleCabinetMessage(kind, data) {
+    const id = data.id_thiet_bi;
+    if (!id) return;
+
+    ensureCabinetElementExists(id);
+    if (!cabinetDataStore[id]) {
+        cabinetDataStore[id] = { lastData: null, chartLabels: [], chartData: [], lastSeen: 0, isOnline: false };
+        updateCabinetOnlineStatus(id, false);
+    }
+    const store = cabinetDataStore[id];
+
+    if (kind === 'status') {
+        handlePresence(id, store, data.online === true);
+        return;
+    }
+    // Ảnh chụp retained có thể đã cũ: chỉ data realtime (hoặc birth) mới chứng minh tủ đang sống
+    if (kind === 'data') markCabinetOnline(id, store);
+
+    store.lastData = data;
+    if (kind === 'data') {
         store.lastSeen = Date.now();
-        
-        // Cập nhật dữ liệu biểu đồ
-        store.chartLabels.push(new Date().toLocaleTimeString('vi-VN', {hour:'2-digit', minute:'2-digit', second:'2-digit'}));
-        store.chartData.push(data.nhiet_do);
-        if (store.chartLabels.length > MAX_CHART_DATA_POINTS) { store.chartLabels.shift(); store.chartData.shift(); }
+        pushChartPoint(store, data);
+        updateLatency(id, data);
+    }
 
-        saveToLocalStorage();
-        updateCabinetBadge(id, data);
-        checkAlertLogic(id, data); 
-
-        // Cập nhật giao diện chi tiết (bao gồm cả trạng thái LED)
-        if (currentCabinet.id === id) {
-            updateSensorUI(data); 
-            if (isRealtimeChart && (Date.now() - lastChartUpdateTimestamp > CHART_UPDATE_INTERVAL)) {
-                updateChartWithStoredData(store, 'none');
-                lastChartUpdateTimestamp = Date.now();
-            }
-            if (store.isOnline && document.querySelector('.sensors-group')) document.querySelector('.sensors-group').style.opacity = '1';
+    saveToLocalStorage();
+    updateCabinetBadge(id, data);
+    if (store.isOnline) checkAlertLogic(id, data); 
+
+    // Cập nhật giao diện chi tiết (bao gồm cả trạng thái LED)
+    if (currentCabinet.id === id) {
+        updateSensorUI(data); 
+        if (kind === 'data' && isRealtimeChart && (Date.now() - lastChartUpdateTimestamp > CHART_UPDATE_INTERVAL)) {
+            updateChartWithStoredData(store, 'none');
+            lastChartUpdateTimestamp = Date.now();
         }
-    } catch (e) {}
-});
+        if (store.isOnline && document.querySelector('.sensors-group')) document.querySelector('.sensors-group').style.opacity = '1';
+    }
+}
+
+// Birth/LWT trên sensor/<id>/status: broker báo mất kết nối ngay sau keepalive, không chờ SENSOR_TIMEOUT_MS
+function handlePresence(id, store, online) {
+    store.presence = online ? 'online' : 'offline';
+    if (online) {
+        store.lastSeen = Date.now();
+        markCabinetOnline(id, store);
+        saveToLocalStorage();
+    } else if (store.isOnline || store.lastSeen === 0) {
+        markCabinetOffline(id, store);
+    } else {
+        updateCabinetOnlineStatus(id, false);
+    }
+}
+
+function markCabinetOnline(id, store) {
+    if (store.isOnline) return;
+    const wasSeen = store.lastSeen !== 0;
+    store.isOnline = true;
+    updateCabinetOnlineStatus(id, true);
+    if (store.lastData) { updateCabinetBadge(id, store.lastData); checkAlertLogic(id, store.lastData); }
+    if (wasSeen) showToast(`${id} kết nối lại`, "success");
+}
 
 /* ======================= UI & LOGIC ======================= */
 function checkAlertLogic(id, data) {
@@ -288,45 +342,46 @@ function checkAlertLogic(id, data) {
 function checkSensorHealth() {
      const now = Date.now();
      for (const [id, store] of Object.entries(cabinetDataStore)) {
-         
          // Điều kiện: Tủ đang ONLINE VÀ đã quá thời gian chờ (SENSOR_TIMEOUT_MS)
          if (store.isOnline && now - store.lastSeen > SENSOR_TIMEOUT_MS) {
-             
-             store.isOnline = false;
-             
-             // --- BẮT ĐẦU LOGIC RESET TRẠNG THÁI CẢNH BÁO ---
-             if (store.lastData) {
-                 // Đặt các trạng thái cảnh báo về mức an toàn
-                 store.lastData.nhiet_do = 25; 
-                 store.lastData.lua = false;
-                 store.lastData.khi_ga = 'thap'; 
-                 store.lastData.rf_status = false; // Reset trạng thái RF
-                 
-                 // Kích hoạt cập nhật UI để xóa cảnh báo trên trang chính
-                 updateCabinetBadge(id, store.lastData);
-                 
-                 // Nếu đây là tủ đang được xem
-                 if (currentCabinet.id === id) {
-                     updateSensorUI(store.lastData); // Cập nhật UI chi tiết
-                     dismissAlert(); // Đảm bảo modal cảnh báo tắt và nhạc dừng
-                 }
-             }
-             // --- KẾT THÚC LOGIC RESET TRẠNG THÁI CẢNH BÁO ---
- 
-             // Cập nhật trạng thái hiển thị MẤT TÍN HIỆU
-             updateCabinetOnlineStatus(id, false);
-             if (currentCabinet.id === id) { 
-                 if(document.querySelector('.sensors-group')) 
-                     document.querySelector('.sensors-group').style.opacity = '0.5'; 
-             }
-             showToast(`Mất tín hiệu từ ${id}`, "error");
-             
-             // Lưu trạng thái đã reset vào Local Storage
-             saveToLocalStorage(); 
+             markCabinetOffline(id, store);
          }
      }
  }
 
+function markCabinetOffline(id, store) {
+     const wasOnline = store.isOnline;
+     store.isOnline = false;
+     
+     // --- BẮT ĐẦU LOGIC RESET TRẠNG THÁI CẢNH BÁO ---
+     if (store.lastData) {
+         // Đặt các trạng thái cảnh báo về mức an toàn
+         store.lastData.nhiet_do = 25; 
+         store.lastData.lua = false;
+         store.lastData.khi_ga = 'thap'; 
+         delete store.lastData.khi_ga_ppm; // Nồng độ cũ không còn đúng sau reset
+         store.lastData.rf_status = false; // Reset trạng thái RF
+         
+         // Nếu đây là tủ đang được xem
+         if (currentCabinet.id === id) {
+             updateSensorUI(store.lastData); // Cập nhật UI chi tiết
+             dismissAlert(); // Đảm bảo modal cảnh báo tắt và nhạc dừng
+         }
+     }
+     // --- KẾT THÚC LOGIC RESET TRẠNG THÁI CẢNH BÁO ---
+
+     // Cập nhật trạng thái hiển thị MẤT TÍN HIỆU
+     updateCabinetOnlineStatus(id, false);
+     if (currentCabinet.id === id) { 
+         if(document.querySelector('.sensors-group')) 
+             document.querySelector('.sensors-group').style.opacity = '0.5'; 
+     }
+     if (wasOnline) showToast(`Mất tín hiệu từ ${id}`, "error");
+     
+     // Lưu trạng thái đã reset vào Local Storage
+     saveToLocalStorage(); 
+ }
+
 function ensureCabinetElementExists(id) {
     if (renderedCabinets.has(id)) return;
     
@@ -367,6 +422,8 @@ function ensureCabinetElementExists(id) {
 function showDetails(name, loc, id) {
      currentCabinet = { id, name, location: loc };
      document.getElementById('details-title').innerText = name;
+     const rttEl = document.getElementById('command-rtt');
+     if (rttEl) rttEl.textContent = '';
      
      const subtitleEl = document.getElementById('details-subtitle');
      if (subtitleEl) {
@@ -468,8 +525,10 @@ function updateSensorUI(data) {
  
      // Khí Gas
      const isGasAlert = khi_ga && khi_ga.toLowerCase() === 'cao';
-     // Sử dụng 'thap' hoặc giá trị số nếu có để hiển thị (tùy thuộc vào cấu trúc dữ liệu của bạn)
-     updateBox(gasCard, isGasAlert, khi_ga || '--', 'Ổn', 'Rò rỉ');
+     // Firmware mới gửi kèm nồng độ (ppm); thiết bị cũ chỉ có 'cao'/'thap'
+     const gasPpm = data.khi_ga_ppm;
+     const gasText = gasPpm ? `${gasPpm.khoi} ppm khói · ${gasPpm.lpg} ppm LPG` : (khi_ga || '--');
+     updateBox(gasCard, isGasAlert, gasText, 'Ổn', 'Rò rỉ');
      if (isGasAlert) activeAlerts.push("KHÍ GAS");
  
      // Cảnh báo RF
@@ -609,17 +668,85 @@ function saveCabinetInfo() {
 }
 
 /**
- * Gửi lệnh điều khiển qua MQTT.
- * **Bỏ logic cập nhật UI** tại đây để đồng bộ hoàn toàn qua tin nhắn phản hồi của thiết bị.
+ * Gửi lệnh điều khiển qua MQTT dạng {"id","cmd"}; thiết bị trả ACK cùng id trên sensor/<id>/ack.
+ * Hết COMMAND_ACK_TIMEOUT_MS chưa có ACK thì gửi lại cùng id (thiết bị không chạy lại lệnh đã nhận).
  */
-function sendCommand(c) { 
+function sendCommand(c, args) { 
     if(!currentCabinet.id) return showToast("Vui lòng chọn tủ", "error");
     
-    // Gửi lệnh qua MQTT (thiết bị nhận lệnh)
-    client.publish(`sensor/${currentCabinet.id}/command`, c); 
-    
-    const isLedOn = (c === 'LED_ON');
-    showToast(`Đã gửi lệnh: ${isLedOn ? 'Bật' : 'Tắt'} đèn cho ${currentCabinet.id}. Đang chờ thiết bị phản hồi...`, "info");
+    const id = `${Date.now().toString(36)}-${(commandSeq++).toString(36)}`;
+    const payload = { id, cmd: c };
+    if (args) payload.args = args;
+    const entry = { cabinetId: currentCabinet.id, cmd: c, payload: JSON.stringify(payload), sentAt: 0, attempts: 0, timer: null };
+    pendingCommands.set(id, entry);
+    publishPendingCommand(id, entry);
+    updateCommandRtt(entry.cabinetId, 'Đang chờ thiết bị...');
+}
+
+function publishPendingCommand(id, entry) {
+    entry.attempts++;
+    entry.sentAt = performance.now();
+    client.publish(`sensor/${entry.cabinetId}/command`, entry.payload, { qos: 1 });
+    entry.timer = setTimeout(() => {
+        if (!pendingCommands.has(id)) return;
+        if (entry.attempts < COMMAND_MAX_ATTEMPTS) {
+            showToast(`${entry.cabinetId} chưa phản hồi lệnh ${entry.cmd}, gửi lại (${entry.attempts + 1}/${COMMAND_MAX_ATTEMPTS})`, "info");
+            publishPendingCommand(id, entry);
+        } else {
+            pendingCommands.delete(id);
+            updateCommandRtt(entry.cabinetId, 'Không có phản hồi');
+            showToast(`Lệnh ${entry.cmd} tới ${entry.cabinetId} không được xác nhận`, "error");
+        }
+    }, COMMAND_ACK_TIMEOUT_MS);
+}
+
+function handleCommandAck(ack) {
+    const entry = pendingCommands.get(ack.id);
+    if (!entry) return; // ACK của tab khác hoặc ACK trùng sau khi đã nhận
+    clearTimeout(entry.timer);
+    pendingCommands.delete(ack.id);
+
+    // RTT tính từ lần gửi cuối cùng (ACK trả lời lần gửi đó hoặc lần trước, thiết bị không phân biệt)
+    const rtt = Math.round(performance.now() - entry.sentAt);
+    const retryNote = entry.attempts > 1 ? ` sau ${entry.attempts} lần gửi` : '';
+    updateCommandRtt(entry.cabinetId, ack.ok ? `Phản hồi ${rtt} ms${retryNote}` : `Lỗi: ${ack.ket_qua}`);
+    if (!ack.ok) return showToast(`${entry.cabinetId} từ chối lệnh ${entry.cmd}: ${ack.ket_qua}`, "error");
+
+    // Cập nhật trạng thái LED ngay, không chờ telemetry kế tiếp
+    const store = cabinetDataStore[entry.cabinetId];
+    if (store && store.lastData) store.lastData.led_status = ack.led_status;
+    if (currentCabinet.id === entry.cabinetId && ledStatusDisplay) {
+        ledStatusDisplay.textContent = ack.led_status ? 'Đang Bật' : 'Đang Tắt';
+        ledStatusDisplay.className = `status-badge ${ack.led_status ? 'on' : 'off'}`;
+    }
+    showToast(`${entry.cabinetId} đã thực hiện ${entry.cmd} (${rtt} ms)`, "success");
+}
+
+// Tủ đã đồng bộ SNTP gửi "ts" (UTC ms lúc lấy mẫu): dùng làm trục thời gian và chèn đúng thứ tự
+// khi tin nhắn đến lệch nhau; chưa đồng bộ thì lấy giờ nhận như trước
+function pushChartPoint(store, data) {
+    const ts = (data.dong_bo && data.ts) ? data.ts : Date.now();
+    if (!store.chartTimes || store.chartTimes.length !== store.chartLabels.length) {
+        store.chartTimes = store.chartLabels.map(() => 0);
+    }
+    let i = store.chartTimes.length;
+    while (i > 0 && store.chartTimes[i - 1] > ts) i--;
+    store.chartTimes.splice(i, 0, ts);
+    store.chartLabels.splice(i, 0, new Date(ts).toLocaleTimeString('vi-VN', {hour:'2-digit', minute:'2-digit', second:'2-digit'}));
+    store.chartData.splice(i, 0, data.nhiet_do);
+    if (store.chartLabels.length > MAX_CHART_DATA_POINTS) { store.chartTimes.shift(); store.chartLabels.shift(); store.chartData.shift(); }
+}
+
+// Độ trễ đầu-cuối = giờ nhận - giờ lấy mẫu mới nhất (cần cả tủ lẫn máy duyệt web đồng bộ giờ)
+function updateLatency(cabinetId, data) {
+    const el = document.getElementById('e2e-latency');
+    if (!el || currentCabinet.id !== cabinetId) return;
+    el.textContent = (data.dong_bo && data.ts) ? `Độ trễ cảm biến → web: ${Date.now() - data.ts} ms` : '';
+}
+
+function updateCommandRtt(cabinetId, text) {
+    const el = document.getElementById('command-rtt');
+    if (el && currentCabinet.id === cabinetId) el.textContent = text;
 }
 
 /* ======================= CHART & UTIL ======================= */
@@ -714,6 +841,7 @@ function loadFromLocalStorage() {
             // Xóa dữ liệu biểu đồ quá 1 giờ để tiết kiệm bộ nhớ
             if (now - cabinetDataStore[id].lastSeen > 3600000) { 
                 cabinetDataStore[id].chartLabels=[]; 
+                cabinetDataStore[id].chartTimes=[]; 
                 cabinetDataStore[id].chartData=[]; 
             }
             
@@ -730,6 +858,7 @@ function loadFromLocalStorage() {
                 cabinetDataStore[id].lastData.nhiet_do = 25; 
                 cabinetDataStore[id].lastData.lua = false;
                 cabinetDataStore[id].lastData.khi_ga = 'thap';
+                delete cabinetDataStore[id].lastData.khi_ga_ppm;
                 
                 // Đảm bảo không còn trạng thái cảnh báo
                 // Tuy nhiên, nếu thiết bị vật lý gửi dữ liệu cảnh báo ngay lập tức, cảnh báo sẽ xuất hiện lại.